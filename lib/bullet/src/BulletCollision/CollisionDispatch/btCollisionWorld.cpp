@@ -441,9 +441,10 @@ void	btCollisionWorld::rayTestSingle(const btTransform& rayFromTrans,const btTra
 				{
 					RayResultCallback* m_userCallback;
 					int m_i;
+					const btCollisionShape* m_childShape;
 					
-					LocalInfoAdder2 (int i, RayResultCallback *user)
-						: m_userCallback(user), m_i(i)
+					LocalInfoAdder2 (int i, RayResultCallback *user, const btCollisionShape* childShape)
+						: m_userCallback(user), m_i(i), m_childShape(childShape)
 					{ 
 						m_closestHitFraction = m_userCallback->m_closestHitFraction;
 					}
@@ -459,6 +460,8 @@ void	btCollisionWorld::rayTestSingle(const btTransform& rayFromTrans,const btTra
 						shapeInfo.m_triangleIndex = m_i;
 						if (r.m_localShapeInfo == NULL)
 							r.m_localShapeInfo = &shapeInfo;
+						if (r.m_childShape == NULL)
+							r.m_childShape = m_childShape;
 
 						const btScalar result = m_userCallback->addSingleResult(r, b);
 						m_closestHitFraction = m_userCallback->m_closestHitFraction;
@@ -497,11 +500,11 @@ void	btCollisionWorld::rayTestSingle(const btTransform& rayFromTrans,const btTra
 						const btTransform& childTrans = m_compoundShape->getChildTransform(i);
 						btTransform childWorldTrans = m_colObjWorldTransform * childTrans;
 						
-						// replace collision shape so that callback can determine the triangle
-						btCollisionShape* saveCollisionShape = m_collisionObject->getCollisionShape();
-						m_collisionObject->internalSetTemporaryCollisionShape((btCollisionShape*)childCollisionShape);
-
-						LocalInfoAdder2 my_cb(i, &m_resultCallback);
+						// STK: the collision shape is not temporarily replaced with
+						// the child shape, so that several threads can cast rays
+						// against the same compound object. The child shape is
+						// reported in LocalRayResult::m_childShape instead.
+						LocalInfoAdder2 my_cb(i, &m_resultCallback, childCollisionShape);
 
 						rayTestSingle(
 							m_rayFromTrans,
@@ -510,9 +513,6 @@ void	btCollisionWorld::rayTestSingle(const btTransform& rayFromTrans,const btTra
 							childCollisionShape,
 							childWorldTrans,
 							my_cb);
-						
-						// restore
-						m_collisionObject->internalSetTemporaryCollisionShape(saveCollisionShape);
 					}
 					
 					void Process(const btDbvtNode* leaf)
@@ -180,7 +180,8 @@ public:
 		:m_collisionObject(collisionObject),
 		m_localShapeInfo(localShapeInfo),
 		m_hitNormalLocal(hitNormalLocal),
-		m_hitFraction(hitFraction)
+		m_hitFraction(hitFraction),
+		m_childShape(0)
 		{
 		}
 
@@ -188,6 +189,10 @@ public:
 		LocalShapeInfo*			m_localShapeInfo;
 		btVector3				m_hitNormalLocal;
 		btScalar				m_hitFraction;
+		// STK: the child shape that was hit if m_collisionObject has a
+		// compound shape (whose shape is not temporarily replaced by the
+		// child shape during the ray test), NULL otherwise.
+		const btCollisionShape*	m_childShape;
 
 	};
 
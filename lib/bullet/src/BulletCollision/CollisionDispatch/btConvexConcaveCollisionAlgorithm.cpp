@@ -108,10 +108,13 @@ void btConvexTriangleCallback::processTriangle(btVector3* triangle,int partId, i
 		btTriangleShape tm(triangle[0],triangle[1],triangle[2]);	
 		tm.setMargin(m_collisionMarginTriangle);
 		
-		btCollisionShape* tmpShape = ob->getCollisionShape();
-		ob->internalSetTemporaryCollisionShape( &tm );
+		// STK: the triangle is set as shape of the copy of the mesh object
+		// (see setTimeStepAndCounters) instead of temporarily changing the
+		// shape of the mesh object itself, so that several pairs with the
+		// same mesh (e.g. the track) can be processed in parallel.
+		m_triObCopy.internalSetTemporaryCollisionShape( &tm );
 
-		btCollisionAlgorithm* colAlgo = ci.m_dispatcher1->findAlgorithm(m_convexBody,m_triBody,m_manifoldPtr);
+		btCollisionAlgorithm* colAlgo = ci.m_dispatcher1->findAlgorithm(m_convexBody,&m_triObCopy,m_manifoldPtr);
 
 		if (m_resultOut->getBody0Internal() == m_triBody)
 		{
@@ -122,10 +125,9 @@ void btConvexTriangleCallback::processTriangle(btVector3* triangle,int partId, i
 			m_resultOut->setShapeIdentifiersB(partId,triangleIndex);
 		}
 	
-		colAlgo->processCollision(m_convexBody,m_triBody,*m_dispatchInfoPtr,m_resultOut);
+		colAlgo->processCollision(m_convexBody,&m_triObCopy,*m_dispatchInfoPtr,m_resultOut);
 		colAlgo->~btCollisionAlgorithm();
 		ci.m_dispatcher1->freeCollisionAlgorithm(colAlgo);
-		ob->internalSetTemporaryCollisionShape( tmpShape);
 	}
 
 
@@ -139,6 +141,10 @@ void	btConvexTriangleCallback::setTimeStepAndCounters(btScalar collisionMarginTr
 	m_collisionMarginTriangle = collisionMarginTriangle;
 	m_resultOut = resultOut;
 
+	// STK: copy the mesh object once per call (and not per triangle), it
+	// is only read while its triangles are processed.
+	m_triObCopy = *m_triBody;
+
 	//recalc aabbs
 	btTransform convexInTriangleSpace;
 	convexInTriangleSpace = m_triBody->getWorldTransform().inverse() * m_convexBody->getWorldTransform();
@@ -24,6 +24,7 @@ subject to the following restrictions:
 class btDispatcher;
 #include "BulletCollision/BroadphaseCollision/btBroadphaseProxy.h"
 #include "btCollisionCreateFunc.h"
+#include "btCollisionObject.h"
 
 ///For each triangle in the concave mesh that overlaps with the AABB of a convex (m_convexProxy), processTriangle is called.
 class btConvexTriangleCallback : public btTriangleCallback
@@ -39,6 +40,10 @@ class btConvexTriangleCallback : public btTriangleCallback
 	btDispatcher*	m_dispatcher;
 	const btDispatcherInfo* m_dispatchInfoPtr;
 	btScalar m_collisionMarginTriangle;
+
+	// STK: copy of the triangle mesh object whose shape is replaced by the
+	// triangle being tested, see setTimeStepAndCounters.
+	btCollisionObject m_triObCopy;
 	
 public:
 int	m_triangleCount;
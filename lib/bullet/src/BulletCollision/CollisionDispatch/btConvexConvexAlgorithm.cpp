@@ -350,7 +350,11 @@ void btConvexConvexAlgorithm ::processCollision (btCollisionObject* body0,btColl
 	
 	btGjkPairDetector::ClosestPointInput input;
 
-	btGjkPairDetector	gjkPairDetector(min0,min1,m_simplexSolver,m_pdSolver);
+	// STK: use a local simplex solver instead of the one shared by all
+	// algorithms created by the same create function (the solver is reset
+	// for each query anyway), so that pairs can be processed in parallel.
+	btVoronoiSimplexSolver simplexSolver;
+	btGjkPairDetector	gjkPairDetector(min0,min1,&simplexSolver,m_pdSolver);
 	//TODO: if (dispatchInfo.m_useContinuous)
 	gjkPairDetector.setMinkowskiA(min0);
 	gjkPairDetector.setMinkowskiB(min1);
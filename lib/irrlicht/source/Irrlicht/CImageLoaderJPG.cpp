@@ -16,9 +16,6 @@ namespace irr
 namespace video
 {
 
-// Static members
-io::path CImageLoaderJPG::Filename;
-
 //! constructor
 CImageLoaderJPG::CImageLoaderJPG()
 {
@@ -54,6 +51,10 @@ bool CImageLoaderJPG::isALoadableFileExtension(const io::path& filename) const
 
         // for longjmp, to return to caller on a fatal error
         jmp_buf setjmp_buffer;
+
+        // name of the file for error messages (stored here instead of
+        // in a static variable, so images can be loaded in several threads)
+        const io::path *filename;
     };
 
 void CImageLoaderJPG::init_source (j_decompress_ptr cinfo)
@@ -110,8 +111,10 @@ void CImageLoaderJPG::output_message(j_common_ptr cinfo)
 	// display the error message.
 	c8 temp1[JMSG_LENGTH_MAX];
 	(*cinfo->err->format_message)(cinfo, temp1);
+	// cinfo->err really points to a irr_error_mgr struct
+	irr_jpeg_error_mgr *myerr = (irr_jpeg_error_mgr*) cinfo->err;
 	core::stringc errMsg("JPEG FATAL ERROR in ");
-	errMsg += core::stringc(Filename);
+	errMsg += core::stringc(*myerr->filename);
 	os::Printer::log(errMsg.c_str(),temp1, ELL_ERROR);
 }
 #endif // _IRR_COMPILE_WITH_LIBJPEG_
@@ -145,8 +148,6 @@ IImage* CImageLoaderJPG::loadImage(io::IReadFile* file) const
 	if (!file)
 		return 0;
 
-	Filename = file->getFileName();
-
 	u8 **rowPtr=0;
 	u8* input = new u8[file->getSize()];
 	file->read(input, file->getSize());
@@ -161,6 +162,7 @@ IImage* CImageLoaderJPG::loadImage(io::IReadFile* file) const
 	//address which we place into the link field in cinfo.
 
 	cinfo.err = jpeg_std_error(&jerr.pub);
+	jerr.filename = &file->getFileName();
 	cinfo.err->error_exit = error_exit;
 	cinfo.err->output_message = output_message;
 
@@ -92,19 +92,24 @@ SFXManager::SFXManager()
     // Should be the default, but just in case:
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 
-    m_thread_id.setAtomic(new pthread_t());
+    m_thread_id.setAtomic(0);
     // The thread is created even if there atm sfx are disabled
-    // (since the user might enable it later).
-    int error = pthread_create(m_thread_id.getData(), &attr,
-                               &SFXManager::mainLoop, this);
-    if (error)
-    {
-        m_thread_id.lock();
-        delete m_thread_id.getData();
-        m_thread_id.unlock();
-        m_thread_id.setAtomic(0);
-        Log::error("SFXManager", "Could not create thread, error=%d.",
-                   errno);
+    // (since the user might enable it later). A dedicated server never
+    // plays any sfx, so no thread is needed there.
+    if (!UserConfigParams::m_dedicated_server)
+    {
+        m_thread_id.setAtomic(new pthread_t());
+        int error = pthread_create(m_thread_id.getData(), &attr,
+                                   &SFXManager::mainLoop, this);
+        if (error)
+        {
+            m_thread_id.lock();
+            delete m_thread_id.getData();
+            m_thread_id.unlock();
+            m_thread_id.setAtomic(0);
+            Log::error("SFXManager", "Could not create thread, error=%d.",
+                       errno);
+        }
     }
     pthread_attr_destroy(&attr);
 
@@ -121,8 +126,11 @@ SFXManager::SFXManager()
 SFXManager::~SFXManager()
 {
     m_thread_id.lock();
-    pthread_join(*m_thread_id.getData(), NULL);
-    delete m_thread_id.getData();
+    if (m_thread_id.getData())
+    {
+        pthread_join(*m_thread_id.getData(), NULL);
+        delete m_thread_id.getData();
+    }
     m_thread_id.unlock();
     pthread_cond_destroy(&m_cond_request);
 
@@ -234,6 +242,15 @@ void SFXManager::queue(SFXCommands command, MusicInformation *mi, float f)
  */
 void SFXManager::queueCommand(SFXCommand *command)
 {
+    // Without a thread (dedicated server) the commands are not executed,
+    // but sfx must still be freed.
+    if (!m_thread_id.getAtomic())
+    {
+        if (command->m_command == SFX_DELETE)
+            deleteSFX(command->m_sfx);
+        delete command;
+        return;
+    }
     m_sfx_commands.lock();
     if(World::getWorld() && 
         m_sfx_commands.getData().size() > 20*race_manager->getNumberOfKarts()+20 &&
@@ -149,6 +149,7 @@ void STKConfig::load(const std::string &filename)
     CHECK_NEG(m_replay_delta_angle,        "replay delta-angle"         );
     CHECK_NEG(m_replay_delta_pos2,         "replay delta-position"      );
     CHECK_NEG(m_replay_dt,                 "replay delta-t"             );
+    CHECK_NEG(m_replay_keyframe_interval,  "replay keyframe-interval"   );
     CHECK_NEG(m_smooth_angle_limit,        "physics smooth-angle-limit" );
 
     // Square distance to make distance checks cheaper (no sqrt)
@@ -187,6 +188,7 @@ void STKConfig::init_defaults()
     m_replay_delta_angle         = -100;
     m_replay_delta_pos2          = -100;
     m_replay_dt                  = -100;
+    m_replay_keyframe_interval   = -100;
     m_title_music                = NULL;
     m_enable_networking          = true;
     m_smooth_normals             = false;
@@ -374,6 +376,7 @@ void STKConfig::getAllData(const XMLNode * root)
         replay_node->get("delta-pos",   &m_replay_delta_pos2 );
         replay_node->get("delta-t",     &m_replay_dt         );
         replay_node->get("max-time",    &m_replay_max_time   );
+        replay_node->get("keyframe-interval", &m_replay_keyframe_interval);
 
     }
 
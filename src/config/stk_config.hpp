@@ -149,6 +149,10 @@ public:
     /** Minimum time between consecutive saved tranform events.  */
     float m_replay_dt;
 
+    /** Time between two keyframes in a replay file, which determines how
+     *  much needs to be decoded when seeking. */
+    float m_replay_keyframe_interval;
+
     /** Maximum difference between interpolated and actual position. If the
      *  difference is larger than this, a new event is generated. */
     float m_replay_delta_pos2;
@@ -546,6 +546,10 @@ namespace UserConfigParams
     /** True if hardware skinning should be enabled */
     PARAM_PREFIX bool m_hw_skinning_enabled  PARAM_DEFAULT( false );
 
+    /** True if the history of each race should be written to history.bin
+     *  while racing, instead of only keeping the last seconds in memory. */
+    PARAM_PREFIX bool m_record_history    PARAM_DEFAULT( false );
+
     // not saved to file
 
     // ---- Networking
@@ -554,6 +558,82 @@ namespace UserConfigParams
             PARAM_DEFAULT(  IntUserConfigParam(16, "server_max_players",
                                        "Maximum number of players on the server.") );
 
+    PARAM_PREFIX IntUserConfigParam         m_server_tick_rate
+            PARAM_DEFAULT(  IntUserConfigParam(60, "server_tick_rate",
+                                       "Number of simulation steps per second in "
+                                       "network games (must be the same on the "
+                                       "server and the clients).") );
+
+    PARAM_PREFIX IntUserConfigParam         m_server_port
+            PARAM_DEFAULT(  IntUserConfigParam(7321, "server_port",
+                                       "Port on which the server listens.") );
+
+    PARAM_PREFIX IntUserConfigParam         m_server_lobbies
+            PARAM_DEFAULT(  IntUserConfigParam(1, "server_lobbies",
+                                       "Number of races a dedicated server hosts at "
+                                       "the same time, each in its own process.") );
+
+    PARAM_PREFIX IntUserConfigParam         m_server_auto_start
+            PARAM_DEFAULT(  IntUserConfigParam(0, "server_auto_start",
+                                       "Number of players at which the server "
+                                       "starts the kart selection by itself, 0 "
+                                       "to start it from the console (which is "
+                                       "not possible with several lobbies).") );
+
+    PARAM_PREFIX IntUserConfigParam         m_server_selection_time
+            PARAM_DEFAULT(  IntUserConfigParam(30, "server_selection_time",
+                                       "Seconds the players have to select a "
+                                       "kart when the server starts the "
+                                       "selection by itself.") );
+
+    PARAM_PREFIX IntUserConfigParam         m_job_threads
+            PARAM_DEFAULT(  IntUserConfigParam(-1, "job_threads",
+                                       "Number of worker threads of the job "
+                                       "system, which is used by physics, "
+                                       "culling and loading, -1 to use one "
+                                       "less than the number of processors.") );
+
+    PARAM_PREFIX IntUserConfigParam         m_physics_threads
+            PARAM_DEFAULT(  IntUserConfigParam(0, "physics_threads",
+                                       "Number of threads used for collision "
+                                       "detection and kart raycasts, 0 to do "
+                                       "all physics in the main thread.") );
+
+    PARAM_PREFIX BoolUserConfigParam        m_cache_physics
+            PARAM_DEFAULT(  BoolUserConfigParam(true, "cache_physics",
+                                       "Store the collision meshes of tracks "
+                                       "on disk to speed up loading.") );
+
+    PARAM_PREFIX BoolUserConfigParam        m_threaded_loading
+            PARAM_DEFAULT(  BoolUserConfigParam(true, "threaded_loading",
+                                       "Read and decode files with the job "
+                                       "system while loading, false to "
+                                       "load everything in the main thread.") );
+
+    PARAM_PREFIX IntUserConfigParam         m_culling_threads
+            PARAM_DEFAULT(  IntUserConfigParam(-1, "culling_threads",
+                                       "Number of threads used for culling "
+                                       "and filling the instance buffers, "
+                                       "-1 to use the number of processors.") );
+
+    PARAM_PREFIX IntUserConfigParam         m_ai_threads
+            PARAM_DEFAULT(  IntUserConfigParam(-1, "ai_threads",
+                                       "Number of threads used to compute the "
+                                       "decisions of the AI karts, -1 to use "
+                                       "all threads of the job system.") );
+
+    PARAM_PREFIX BoolUserConfigParam        m_ai_lookahead_table
+            PARAM_DEFAULT(  BoolUserConfigParam(false, "ai_lookahead_table",
+                                       "Use a table computed when loading a "
+                                       "track to shorten the look-ahead "
+                                       "search of the AI. This approximates "
+                                       "the search, so it changes the "
+                                       "steering of the AI.") );
+
+    /** True if this is a dedicated server without graphics and GUI. Not
+     *  saved to the config file. */
+    PARAM_PREFIX bool m_dedicated_server PARAM_DEFAULT( false );
+
     PARAM_PREFIX StringListUserConfigParam         m_stun_servers
             PARAM_DEFAULT(  StringListUserConfigParam("Stun_servers", "The stun servers"
                             " that will be used to know the public address.",
@@ -583,6 +663,35 @@ namespace UserConfigParams
                             "stun.voxgratia.org",
                             "stun.xten.com") );
 
+    PARAM_PREFIX IntUserConfigParam         m_kart_update_frequency
+            PARAM_DEFAULT(  IntUserConfigParam(10, "kart_update_frequency",
+                                       "Number of kart state updates per second sent by the server.") );
+
+    PARAM_PREFIX BoolUserConfigParam        m_network_rollback
+            PARAM_DEFAULT(  BoolUserConfigParam(true, "network_rollback",
+                                       "Predict the local kart on clients and "
+                                       "correct it with the state of the "
+                                       "server, false to let the server use "
+                                       "the kart positions sent by clients.") );
+
+    PARAM_PREFIX BoolUserConfigParam        m_network_batching
+            PARAM_DEFAULT(  BoolUserConfigParam(true, "network_batching",
+                                       "Combine all messages to a peer in one "
+                                       "tick into one packet.") );
+
+    PARAM_PREFIX BoolUserConfigParam        m_network_interest_management
+            PARAM_DEFAULT(  BoolUserConfigParam(true, "network_interest_management",
+                                       "Send the states of karts that are far "
+                                       "away from a client's kart less often "
+                                       "to this client.") );
+
+    PARAM_PREFIX IntUserConfigParam         m_network_client_bandwidth
+            PARAM_DEFAULT(  IntUserConfigParam(0, "network_client_bandwidth",
+                                       "Maximum bytes per second of kart "
+                                       "states sent to each client with "
+                                       "interest management, 0 for no "
+                                       "limit.") );
+
     PARAM_PREFIX StringUserConfigParam m_packets_log_filename
             PARAM_DEFAULT( StringUserConfigParam("packets_log.txt", "packets_log_filename",
                                                  "Where to log received and sent packets.") );
@@ -42,6 +42,7 @@ MaterialManager::MaterialManager()
 
     m_default_material = NULL;
     m_materials.reserve(256);
+    pthread_mutex_init(&m_texture_cache_mutex, NULL);
     // We can't call init/loadMaterial here, since the global variable
     // material_manager has not yet been initialised, and
     // material_manager is used in the Material constructor.
@@ -59,41 +60,103 @@ MaterialManager::~MaterialManager()
         delete m_materials[i];
     }
     m_materials.clear();
+    m_index_by_name.clear();
+    m_index_by_path.clear();
+    m_texture_cache.clear();
+    pthread_mutex_destroy(&m_texture_cache_mutex);
 }   // ~MaterialManager
 
 //-----------------------------------------------------------------------------
+/** Clears the cache of getMaterialFor, e.g. because a material was added
+ *  or removed.
+ */
+void MaterialManager::clearTextureCache()
+{
+    pthread_mutex_lock(&m_texture_cache_mutex);
+    m_texture_cache.clear();
+    pthread_mutex_unlock(&m_texture_cache_mutex);
+}   // clearTextureCache
+
+//-----------------------------------------------------------------------------
+/** Adds a material to the list of all materials and to the indices.
+ *  \param m The material to add.
+ */
+void MaterialManager::addMaterial(Material *m)
+{
+    const int index = (int)m_materials.size();
+    m_materials.push_back(m);
+    m_index_by_name[m->getTexFname()].push_back(index);
+    m_index_by_path[m->getTexFullPath()].push_back(index);
+    // The new material might hide a material found earlier
+    clearTextureCache();
+}   // addMaterial
 
+//-----------------------------------------------------------------------------
+/** Returns the index of the last material with the given texture name, or
+ *  -1 if no such material exists.
+ *  \param name Name of the texture (without path).
+ */
+int MaterialManager::findMaterial(const std::string &name) const
+{
+    std::unordered_map<std::string, std::vector<int> >::const_iterator i =
+        m_index_by_name.find(name);
+    if(i==m_index_by_name.end()) return -1;
+    return i->second.back();
+}   // findMaterial
+
+//-----------------------------------------------------------------------------
+/** Returns the index of the last material with the given full texture path,
+ *  or -1 if no such material exists.
+ *  \param path Full path of the texture.
+ */
+int MaterialManager::findMaterialByPath(const std::string &path) const
+{
+    std::unordered_map<std::string, std::vector<int> >::const_iterator i =
+        m_index_by_path.find(path);
+    if(i==m_index_by_path.end()) return -1;
+    return i->second.back();
+}   // findMaterialByPath
+
+//-----------------------------------------------------------------------------
+/** Returns the material for a texture. The result is cached per texture,
+ *  since this is called for each mesh buffer while loading a track. This
+ *  can be called by several threads, but the materials must not be
+ *  changed at the same time.
+ *  \param t The texture.
+ *  \param mb The mesh buffer (unused).
+ */
 Material* MaterialManager::getMaterialFor(video::ITexture* t,
                                           scene::IMeshBuffer *mb)
 {
     if (t == NULL)
         return m_default_material;
 
-    core::stringc img_path = core::stringc(t->getName());
-    const std::string image = StringUtils::getBasename(img_path.c_str());
-    if (!img_path.empty() && (img_path.findFirst('/') != -1 || img_path.findFirst('\\') != -1))
+    const io::path &name = t->getName().getPath();
+    pthread_mutex_lock(&m_texture_cache_mutex);
+    std::unordered_map<video::ITexture*, TextureMaterial>::iterator cached =
+        m_texture_cache.find(t);
+    if (cached != m_texture_cache.end() && cached->second.m_name == name)
     {
-        // Search backward so that temporary (track) textures are found first
-        for (int i = (int)m_materials.size() - 1; i >= 0; i--)
-        {
-            if (m_materials[i]->getTexFullPath() == img_path.c_str())
-            {
-                return m_materials[i];
-            }
-        }
+        Material *material = cached->second.m_material;
+        pthread_mutex_unlock(&m_texture_cache_mutex);
+        return material ? material : m_default_material;
     }
+    pthread_mutex_unlock(&m_texture_cache_mutex);
+
+    core::stringc img_path = core::stringc(name);
+    int index;
+    if (!img_path.empty() && (img_path.findFirst('/') != -1 || img_path.findFirst('\\') != -1))
+        index = findMaterialByPath(img_path.c_str());
     else
-    {
-        for (int i = (int)m_materials.size() - 1; i >= 0; i--)
-        {
-            if (m_materials[i]->getTexFname() == image)
-            {
-                return m_materials[i];
-            }
-        }   // for i
-    }
-    return m_default_material;
-}
+        index = findMaterial(StringUtils::getBasename(img_path.c_str()));
+
+    pthread_mutex_lock(&m_texture_cache_mutex);
+    TextureMaterial &tm = m_texture_cache[t];
+    tm.m_name     = name;
+    tm.m_material = index>=0 ? m_materials[index] : NULL;
+    pthread_mutex_unlock(&m_texture_cache_mutex);
+    return index>=0 ? m_materials[index] : m_default_material;
+}   // getMaterialFor
 
 //-----------------------------------------------------------------------------
 /** Searches for the material in the given texture, and calls a function
@@ -164,15 +227,9 @@ void MaterialManager::adjustForFog(video::ITexture* t,
                                    bool use_fog) const
 {
     const std::string image = StringUtils::getBasename(core::stringc(t->getName()).c_str());
-    // Search backward so that temporary (track) textures are found first
-    for(int i = (int)m_materials.size()-1; i>=0; i-- )
-    {
-        if (m_materials[i]->getTexFname()==image)
-        {
-            m_materials[i]->adjustForFog(parent, &(mb->getMaterial()), use_fog);
-            return;
-        }
-    }   // for i
+    const int index = findMaterial(image);
+    if (index>=0)
+        m_materials[index]->adjustForFog(parent, &(mb->getMaterial()), use_fog);
 }   // adjustForFog
 
 //-----------------------------------------------------------------------------
@@ -198,7 +255,7 @@ void MaterialManager::setAllUntexturedMaterialFlags(scene::IMeshBuffer *mb)
 //-----------------------------------------------------------------------------
 int MaterialManager::addEntity(Material *m)
 {
-    m_materials.push_back(m);
+    addMaterial(m);
     return (int)m_materials.size()-1;
 }
 
@@ -269,7 +326,7 @@ bool MaterialManager::pushTempMaterial(const XMLNode *root,
         }
         try
         {
-            m_materials.push_back(new Material(node, deprecated));
+            addMaterial(new Material(node, deprecated));
         }
         catch(std::exception& e)
         {
@@ -286,9 +343,20 @@ void MaterialManager::popTempMaterial()
 {
     for(int i=(int)m_materials.size()-1; i>=this->m_shared_material_index; i--)
     {
+        // Materials are always removed from the end, so the index of this
+        // material is the last one in its index lists.
+        std::vector<int> &by_name = m_index_by_name[m_materials[i]->getTexFname()];
+        by_name.pop_back();
+        if(by_name.empty())
+            m_index_by_name.erase(m_materials[i]->getTexFname());
+        std::vector<int> &by_path = m_index_by_path[m_materials[i]->getTexFullPath()];
+        by_path.pop_back();
+        if(by_path.empty())
+            m_index_by_path.erase(m_materials[i]->getTexFullPath());
         delete m_materials[i];
         m_materials.pop_back();
     }   // for i6
+    clearTextureCache();
 }   // popTempMaterial
 
 //-----------------------------------------------------------------------------
@@ -329,15 +397,12 @@ Material *MaterialManager::getMaterial(const std::string& fname,
     else
         basename = fname;
         
-    // Search backward so that temporary (track) textures are found first
-    for(int i = (int)m_materials.size()-1; i>=0; i-- )
-    {
-        if(m_materials[i]->getTexFname()==basename) return m_materials[i];
-    }
+    const int index = findMaterial(basename);
+    if(index>=0) return m_materials[index];
 
     // Add the new material
     Material* m = new Material(fname, is_full_path, complain_if_not_found);
-    m_materials.push_back(m);
+    addMaterial(m);
     if(make_permanent)
     {
         assert(m_shared_material_index==(int)m_materials.size()-1);
@@ -359,11 +424,5 @@ void MaterialManager::makeMaterialsPermanent()
 bool MaterialManager::hasMaterial(const std::string& fname)
 {
     std::string basename=StringUtils::getBasename(fname);
-
-    // Search backward so that temporary (track) textures are found first
-    for(int i = (int)m_materials.size()-1; i>=0; i-- )
-    {
-        if(m_materials[i]->getTexFname()==basename) return true;
-    }
-    return false;
-}
+    return findMaterial(basename)>=0;
+}   // hasMaterial
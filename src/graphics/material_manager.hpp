@@ -29,7 +29,11 @@ namespace irr
 }
 using namespace irr;
 
+#include <path.h>
+
+#include <pthread.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class Material;
@@ -48,8 +52,37 @@ private:
 
     std::vector<Material*> m_materials;
 
+    /** For each texture name the indices of all materials with this name
+     *  in m_materials, in increasing order. The last index is the material
+     *  a backwards search in m_materials would find, i.e. temporary (track)
+     *  materials are found before shared materials. */
+    std::unordered_map<std::string, std::vector<int> > m_index_by_name;
+
+    /** Same as m_index_by_name, but indexed by the full path of the
+     *  texture. */
+    std::unordered_map<std::string, std::vector<int> > m_index_by_path;
+
+    /** Caches the result of getMaterialFor for a texture. The name of the
+     *  texture is stored to detect if a texture was freed and another
+     *  texture was allocated at the same address. The cache is protected
+     *  by m_texture_cache_mutex, since getMaterialFor can be called by the
+     *  jobs of the threaded loading. */
+    struct TextureMaterial
+    {
+        io::path  m_name;
+        /** The material, or NULL if the default material is used. */
+        Material *m_material;
+    };
+    std::unordered_map<video::ITexture*, TextureMaterial> m_texture_cache;
+    pthread_mutex_t m_texture_cache_mutex;
+
     Material* m_default_material;
 
+    void      addMaterial(Material *m);
+    int       findMaterial(const std::string &name) const;
+    int       findMaterialByPath(const std::string &path) const;
+    void      clearTextureCache();
+
 public:
               MaterialManager();
              ~MaterialManager();
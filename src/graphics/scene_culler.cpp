@@ -0,0 +1,603 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "graphics/scene_culler.hpp"
+
+#include "config/hardware_stats.hpp"
+#include "utils/job_system.hpp"
+#include "utils/log.hpp"
+#include "utils/profiler.hpp"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__AVX__)
+#  include <immintrin.h>
+#  define CULLER_USE_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || \
+      (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define CULLER_USE_SSE
+#endif
+
+/** Below this number of nodes all tests are done in the calling thread,
+ *  since starting the threads would take longer than the tests. */
+static const int MIN_NODES_PER_THREAD = 64;
+
+// ----------------------------------------------------------------------------
+/** Uses the SIMD kernel if SSE or AVX is available. Otherwise testing each
+ *  node separately is faster, since it can stop after the first plane that
+ *  culls the node.
+ */
+SceneCuller::SceneCuller()
+{
+#if defined(CULLER_USE_AVX) || defined(CULLER_USE_SSE)
+    m_kernel = KERNEL_SIMD;
+#else
+    m_kernel = KERNEL_AOS;
+#endif
+}   // SceneCuller
+
+// ----------------------------------------------------------------------------
+/** Returns the name of the instruction set used by KERNEL_SIMD. */
+const char *SceneCuller::getSIMDName()
+{
+#if defined(CULLER_USE_AVX)
+    return "AVX";
+#elif defined(CULLER_USE_SSE)
+    return "SSE";
+#else
+    return "scalar";
+#endif
+}   // getSIMDName
+
+// ----------------------------------------------------------------------------
+/** Returns the bit mask of the cameras a node is tested against. */
+static unsigned char getTestMask(SceneCuller::NodeType type,
+                                 bool automatic_culling)
+{
+    if (type == SceneCuller::NODE_INHERIT || !automatic_culling)
+        return 0;
+    if (type == SceneCuller::NODE_TEST_MAIN)
+        return 1 << SceneCuller::CAM_MAIN;
+    return (1 << SceneCuller::CAM_COUNT) - 1;
+}   // getTestMask
+
+// ----------------------------------------------------------------------------
+/** Sets the frustum of a camera.
+ *  \param camera The camera.
+ *  \param frustum Its view frustum.
+ */
+void SceneCuller::setFrustum(Camera camera, const scene::SViewFrustum &frustum)
+{
+    for (unsigned i = 0; i < scene::SViewFrustum::VF_PLANE_COUNT; i++)
+        m_planes[camera][i] = frustum.planes[i];
+}   // setFrustum
+
+// ----------------------------------------------------------------------------
+/** Adds a node.
+ *  \param box The bounding box of the node in node coordinates.
+ *  \param transform The absolute transformation of the node.
+ *  \param automatic_culling If false the node is never culled itself
+ *         (but it can still be culled because its parent is culled).
+ *  \param type How the node is tested.
+ *  \param parent Index of the parent node, or -1.
+ *  \return The index of the node.
+ */
+int SceneCuller::addNode(const core::aabbox3df &box,
+                         const core::matrix4 &transform,
+                         bool automatic_culling, NodeType type, int parent)
+{
+    assert(parent < (int)m_nodes.size());
+    m_nodes.push_back(Node());
+    Node &node = m_nodes.back();
+    node.m_box               = box;
+    node.m_transform         = transform;
+    node.m_parent            = parent;
+    node.m_type              = type;
+    node.m_automatic_culling = automatic_culling;
+
+    const int index = (int)m_nodes.size() - 1;
+    const int lane  = index % BLOCK_SIZE;
+    if (lane == 0)
+    {
+        m_blocks.push_back(Block());
+        memset(&m_blocks.back(), 0, sizeof(Block));
+    }
+    Block &b = m_blocks.back();
+    // Same computations as in aabbox3df::getEdges
+    const core::vector3df middle = box.getCenter();
+    const core::vector3df diag   = middle - box.MaxEdge;
+    b.m_middle[0][lane] = middle.X;
+    b.m_middle[1][lane] = middle.Y;
+    b.m_middle[2][lane] = middle.Z;
+    b.m_diag[0][lane]   = diag.X;
+    b.m_diag[1][lane]   = diag.Y;
+    b.m_diag[2][lane]   = diag.Z;
+    for (int row = 0; row < 4; row++)
+    {
+        for (int column = 0; column < 3; column++)
+            b.m_transform[row*3 + column][lane] = transform[row*4 + column];
+    }
+    b.m_test[lane] = getTestMask(type, automatic_culling);
+    return index;
+}   // addNode
+
+// ----------------------------------------------------------------------------
+/** Returns true if all edges of a box are in front of one of the planes
+ *  of a frustum, i.e. the box is not visible.
+ *  \param planes The planes of the frustum.
+ *  \param edges The edges of the box.
+ */
+bool SceneCuller::isBoxCulled(const core::plane3df *planes,
+                              const core::vector3df edges[8])
+{
+    for (int i = 0; i < scene::SViewFrustum::VF_PLANE_COUNT; i++)
+    {
+        bool all_in_front = true;
+        for (unsigned j = 0; j < 8; j++)
+        {
+            if (planes[i].classifyPointRelation(edges[j]) !=
+                core::ISREL3D_FRONT)
+            {
+                all_in_front = false;
+                break;
+            }
+        }
+        if (all_in_front)
+            return true;
+    }
+    return false;
+}   // isBoxCulled
+
+// ----------------------------------------------------------------------------
+/** Does the frustum tests of a single node (ignoring its parent).
+ *  \return Bit mask of the cameras the node is culled for.
+ */
+unsigned char SceneCuller::testNode(const Node &node) const
+{
+    if (node.m_type == NODE_INHERIT || !node.m_automatic_culling)
+        return 0;
+
+    core::vector3df edges[8];
+    node.m_box.getEdges(edges);
+    for (unsigned i = 0; i < 8; i++)
+        node.m_transform.transformVect(edges[i]);
+
+    const int num_cameras = node.m_type == NODE_TEST_MAIN ? 1 : CAM_COUNT;
+    unsigned char culled = 0;
+    for (int camera = 0; camera < num_cameras; camera++)
+    {
+        if (isBoxCulled(m_planes[camera], edges))
+            culled |= 1 << camera;
+    }
+    return culled;
+}   // testNode
+
+// ----------------------------------------------------------------------------
+/** Computes the transformed edges of the boxes of a block, with the same
+ *  operations as aabbox3df::getEdges and matrix4::transformVect, so that
+ *  all kernels give identical results.
+ *  \param block Index of the block.
+ *  \param edges Receives the edges, [edge][axis][node].
+ */
+void SceneCuller::getBlockEdges(int block,
+                                float edges[8][3][BLOCK_SIZE]) const
+{
+    const Block &b = m_blocks[block];
+    for (unsigned j = 0; j < 8; j++)
+    {
+        for (int lane = 0; lane < BLOCK_SIZE; lane++)
+        {
+            const float x = (j & 4) ? b.m_middle[0][lane] - b.m_diag[0][lane]
+                                    : b.m_middle[0][lane] + b.m_diag[0][lane];
+            const float y = (j & 1) ? b.m_middle[1][lane] - b.m_diag[1][lane]
+                                    : b.m_middle[1][lane] + b.m_diag[1][lane];
+            const float z = (j & 2) ? b.m_middle[2][lane] - b.m_diag[2][lane]
+                                    : b.m_middle[2][lane] + b.m_diag[2][lane];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                edges[j][axis][lane] = x * b.m_transform[axis    ][lane]
+                                     + y * b.m_transform[axis + 3][lane]
+                                     + z * b.m_transform[axis + 6][lane]
+                                     +     b.m_transform[axis + 9][lane];
+            }
+        }
+    }
+}   // getBlockEdges
+
+// ----------------------------------------------------------------------------
+/** Does the frustum tests of the nodes of a block without SIMD instructions
+ *  (the inner loops over the nodes can still be vectorised by the compiler).
+ *  The tests for a camera stop as soon as all nodes are culled.
+ *  \param block Index of the block.
+ */
+void SceneCuller::testBlockScalar(int block)
+{
+    const Block &b = m_blocks[block];
+    // For each camera a bit mask of the nodes that are tested against it
+    int lanes_tested[CAM_COUNT] = { 0 };
+    unsigned char needed = 0;
+    for (int lane = 0; lane < BLOCK_SIZE; lane++)
+    {
+        needed |= b.m_test[lane];
+        for (int camera = 0; camera < CAM_COUNT; camera++)
+        {
+            if (b.m_test[lane] & (1 << camera))
+                lanes_tested[camera] |= 1 << lane;
+        }
+    }
+
+    unsigned char culled[BLOCK_SIZE] = { 0 };
+    if (needed)
+    {
+        float edges[8][3][BLOCK_SIZE];
+        getBlockEdges(block, edges);
+        for (int camera = 0; camera < CAM_COUNT; camera++)
+        {
+            if (lanes_tested[camera] == 0)
+                continue;
+            // Bit mask of the nodes that are in front of one of the planes
+            int lanes_culled = 0;
+            for (int i = 0; i < scene::SViewFrustum::VF_PLANE_COUNT &&
+                 (lanes_culled & lanes_tested[camera]) != lanes_tested[camera];
+                 i++)
+            {
+                const core::plane3df &plane = m_planes[camera][i];
+                int all_in_front[BLOCK_SIZE];
+                for (int lane = 0; lane < BLOCK_SIZE; lane++)
+                    all_in_front[lane] = 1;
+                for (unsigned j = 0; j < 8; j++)
+                {
+                    for (int lane = 0; lane < BLOCK_SIZE; lane++)
+                    {
+                        const float d = plane.Normal.X * edges[j][0][lane]
+                                      + plane.Normal.Y * edges[j][1][lane]
+                                      + plane.Normal.Z * edges[j][2][lane]
+                                      + plane.D;
+                        all_in_front[lane] &= d > core::ROUNDING_ERROR_f32;
+                    }
+                }
+                for (int lane = 0; lane < BLOCK_SIZE; lane++)
+                    lanes_culled |= all_in_front[lane] << lane;
+            }
+            for (int lane = 0; lane < BLOCK_SIZE; lane++)
+            {
+                if (lanes_culled & (1 << lane))
+                    culled[lane] |= 1 << camera;
+            }
+        }
+    }
+
+    const int first = block * BLOCK_SIZE;
+    const int count = (int)m_nodes.size() - first;
+    for (int lane = 0; lane < count && lane < BLOCK_SIZE; lane++)
+        m_culled[first + lane] = culled[lane] & b.m_test[lane];
+}   // testBlockScalar
+
+// ----------------------------------------------------------------------------
+/** Does the frustum tests of the nodes of a block with AVX (one register
+ *  for all nodes of the block) or SSE (two registers), in the same way as
+ *  testBlockScalar(). Falls back to testBlockScalar() if neither
+ *  instruction set is available.
+ *  \param block Index of the block.
+ */
+void SceneCuller::testBlockSIMD(int block)
+{
+#if defined(CULLER_USE_AVX) || defined(CULLER_USE_SSE)
+    const Block &b = m_blocks[block];
+    // For each camera a bit mask of the nodes that are tested against it
+    int lanes_tested[CAM_COUNT] = { 0 };
+    unsigned char needed = 0;
+    for (int lane = 0; lane < BLOCK_SIZE; lane++)
+    {
+        needed |= b.m_test[lane];
+        for (int camera = 0; camera < CAM_COUNT; camera++)
+        {
+            if (b.m_test[lane] & (1 << camera))
+                lanes_tested[camera] |= 1 << lane;
+        }
+    }
+
+    unsigned char culled[BLOCK_SIZE] = { 0 };
+    if (needed)
+    {
+#ifdef CULLER_USE_AVX
+        typedef __m256 Vec;
+#       define VEC_LOAD(p)     _mm256_loadu_ps(p)
+#       define VEC_STORE(p, v) _mm256_storeu_ps(p, v)
+#       define VEC_SET(f)      _mm256_set1_ps(f)
+#       define VEC_ADD(a, b)   _mm256_add_ps(a, b)
+#       define VEC_SUB(a, b)   _mm256_sub_ps(a, b)
+#       define VEC_MUL(a, b)   _mm256_mul_ps(a, b)
+#       define VEC_AND(a, b)   _mm256_and_ps(a, b)
+#       define VEC_GT(a, b)    _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#       define VEC_TRUE        _mm256_castsi256_ps(_mm256_set1_epi32(-1))
+#       define VEC_MASK(v)     _mm256_movemask_ps(v)
+        const int width = 8;
+#else
+        typedef __m128 Vec;
+#       define VEC_LOAD(p)     _mm_loadu_ps(p)
+#       define VEC_STORE(p, v) _mm_storeu_ps(p, v)
+#       define VEC_SET(f)      _mm_set1_ps(f)
+#       define VEC_ADD(a, b)   _mm_add_ps(a, b)
+#       define VEC_SUB(a, b)   _mm_sub_ps(a, b)
+#       define VEC_MUL(a, b)   _mm_mul_ps(a, b)
+#       define VEC_AND(a, b)   _mm_and_ps(a, b)
+#       define VEC_GT(a, b)    _mm_cmpgt_ps(a, b)
+#       define VEC_TRUE        _mm_castsi128_ps(_mm_set1_epi32(-1))
+#       define VEC_MASK(v)     _mm_movemask_ps(v)
+        const int width = 4;
+#endif
+        // Transform the edges, same operations as in getBlockEdges()
+        float edges[8][3][BLOCK_SIZE];
+        for (int k = 0; k < BLOCK_SIZE; k += width)
+        {
+            Vec plus[3], minus[3], m[12];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const Vec middle = VEC_LOAD(b.m_middle[axis] + k);
+                const Vec diag   = VEC_LOAD(b.m_diag[axis] + k);
+                plus[axis]  = VEC_ADD(middle, diag);
+                minus[axis] = VEC_SUB(middle, diag);
+            }
+            for (int i = 0; i < 12; i++)
+                m[i] = VEC_LOAD(b.m_transform[i] + k);
+            for (unsigned j = 0; j < 8; j++)
+            {
+                const Vec x = (j & 4) ? minus[0] : plus[0];
+                const Vec y = (j & 1) ? minus[1] : plus[1];
+                const Vec z = (j & 2) ? minus[2] : plus[2];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    const Vec v = VEC_ADD(VEC_ADD(VEC_ADD(
+                        VEC_MUL(x, m[axis]), VEC_MUL(y, m[axis + 3])),
+                        VEC_MUL(z, m[axis + 6])), m[axis + 9]);
+                    VEC_STORE(edges[j][axis] + k, v);
+                }
+            }
+        }
+
+        const Vec eps = VEC_SET(core::ROUNDING_ERROR_f32);
+        for (int camera = 0; camera < CAM_COUNT; camera++)
+        {
+            if (lanes_tested[camera] == 0)
+                continue;
+            // Bit mask of the nodes that are in front of one of the planes
+            int lanes_culled = 0;
+            for (int i = 0; i < scene::SViewFrustum::VF_PLANE_COUNT &&
+                 (lanes_culled & lanes_tested[camera]) != lanes_tested[camera];
+                 i++)
+            {
+                const core::plane3df &plane = m_planes[camera][i];
+                const Vec nx = VEC_SET(plane.Normal.X);
+                const Vec ny = VEC_SET(plane.Normal.Y);
+                const Vec nz = VEC_SET(plane.Normal.Z);
+                const Vec d  = VEC_SET(plane.D);
+                for (int k = 0; k < BLOCK_SIZE; k += width)
+                {
+                    Vec in_front = VEC_TRUE;
+                    for (unsigned j = 0; j < 8; j++)
+                    {
+                        const Vec dist = VEC_ADD(VEC_ADD(VEC_ADD(
+                            VEC_MUL(nx, VEC_LOAD(edges[j][0] + k)),
+                            VEC_MUL(ny, VEC_LOAD(edges[j][1] + k))),
+                            VEC_MUL(nz, VEC_LOAD(edges[j][2] + k))), d);
+                        in_front = VEC_AND(in_front, VEC_GT(dist, eps));
+                    }
+                    lanes_culled |= VEC_MASK(in_front) << k;
+                }
+            }
+            for (int lane = 0; lane < BLOCK_SIZE; lane++)
+            {
+                if (lanes_culled & (1 << lane))
+                    culled[lane] |= 1 << camera;
+            }
+        }
+#undef VEC_LOAD
+#undef VEC_STORE
+#undef VEC_SET
+#undef VEC_ADD
+#undef VEC_SUB
+#undef VEC_MUL
+#undef VEC_AND
+#undef VEC_GT
+#undef VEC_TRUE
+#undef VEC_MASK
+    }
+
+    const int first = block * BLOCK_SIZE;
+    const int count = (int)m_nodes.size() - first;
+    for (int lane = 0; lane < count && lane < BLOCK_SIZE; lane++)
+        m_culled[first + lane] = culled[lane] & b.m_test[lane];
+#else
+    testBlockScalar(block);
+#endif
+}   // testBlockSIMD
+
+// ----------------------------------------------------------------------------
+/** Tests the nodes in [begin, end) with the per node kernel. */
+void SceneCuller::testNodes(int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+        m_culled[i] = testNode(m_nodes[i]);
+}   // testNodes
+
+// ----------------------------------------------------------------------------
+/** Tests the blocks in [begin, end) with the selected block kernel. */
+void SceneCuller::testBlocks(int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        if (m_kernel == KERNEL_SIMD)
+            testBlockSIMD(i);
+        else
+            testBlockScalar(i);
+    }
+}   // testBlocks
+
+// ----------------------------------------------------------------------------
+/** Tests all nodes. The frustum tests are independent for each node (or
+ *  block of nodes) and are split into jobs of the job system, then the
+ *  results of the parents are combined in order in the calling thread.
+ *  \param num_threads Maximum number of threads to use.
+ */
+void SceneCuller::cull(int num_threads)
+{
+    const int num_nodes = (int)m_nodes.size();
+    m_culled.resize(num_nodes);
+    if (num_threads > num_nodes / MIN_NODES_PER_THREAD)
+        num_threads = num_nodes / MIN_NODES_PER_THREAD;
+    if (num_threads < 1)
+        num_threads = 1;
+
+    if (m_kernel == KERNEL_AOS)
+        JobSystem::parallelFor(0, num_nodes, this, &SceneCuller::testNodes,
+                               num_threads);
+    else
+        JobSystem::parallelFor(0, (int)m_blocks.size(), this,
+                               &SceneCuller::testBlocks, num_threads);
+
+    for (int i = 0; i < num_nodes; i++)
+    {
+        const Node &node = m_nodes[i];
+        if (node.m_parent >= 0 && node.m_type != NODE_TEST_MAIN)
+            m_culled[i] |= m_culled[node.m_parent];
+    }
+}   // cull
+
+// ----------------------------------------------------------------------------
+/** Tests the culling with a synthetic scene, checks that all kernels give
+ *  the same results, and compares the time used by each kernel with one
+ *  thread, and by the SIMD kernel with one thread per processor.
+ */
+void SceneCuller::unitTesting()
+{
+    SceneCuller culler;
+    core::matrix4 projection, view;
+    projection.buildProjectionMatrixPerspectiveFovLH(1.0f, 4.0f/3.0f,
+                                                     1.0f, 200.0f);
+    view.buildCameraLookAtMatrixLH(core::vector3df(0, 10, -100),
+                                   core::vector3df(0, 0, 0),
+                                   core::vector3df(0, 1, 0));
+    scene::SViewFrustum frustum(projection*view);
+    for (int camera = 0; camera < CAM_COUNT; camera++)
+        culler.setFrustum((Camera)camera, frustum);
+    // Use a different frustum for the last shadow cascade, looking back
+    view.buildCameraLookAtMatrixLH(core::vector3df(0, 10, -100),
+                                   core::vector3df(0, 10, -200),
+                                   core::vector3df(0, 1, 0));
+    culler.setFrustum((Camera)(CAM_COUNT-1),
+                      scene::SViewFrustum(projection*view));
+
+    const core::aabbox3df unit_box(-1, -1, -1, 1, 1, 1);
+    core::matrix4 at_origin, behind;
+    behind.setTranslation(core::vector3df(0, 0, -300));
+
+    // Indices of the test nodes (in the order in which they are added)
+    enum { VISIBLE, INVISIBLE, CHILD, NO_AUTO, INHERIT, PARTICLES };
+    culler.addNode(unit_box, at_origin, true,  NODE_TEST_ALL,  -1);
+    culler.addNode(unit_box, behind,    true,  NODE_TEST_ALL,  -1);
+    culler.addNode(unit_box, at_origin, true,  NODE_TEST_ALL,  INVISIBLE);
+    culler.addNode(unit_box, behind,    false, NODE_TEST_ALL,  -1);
+    culler.addNode(unit_box, at_origin, true,  NODE_INHERIT,   INVISIBLE);
+    culler.addNode(unit_box, at_origin, true,  NODE_TEST_MAIN, INVISIBLE);
+    for (int kernel = KERNEL_AOS; kernel <= KERNEL_SIMD; kernel++)
+    {
+        culler.setKernel((Kernel)kernel);
+        culler.cull(1);
+        assert(!culler.isCulled(VISIBLE,   CAM_MAIN));
+        assert( culler.isCulled(VISIBLE,   CAM_COUNT-1));
+        assert( culler.isCulled(INVISIBLE, CAM_MAIN));
+        assert( culler.isCulled(CHILD,     CAM_MAIN));
+        assert(!culler.isCulled(NO_AUTO,   CAM_MAIN));
+        assert( culler.isCulled(INHERIT,   CAM_RSM));
+        assert(!culler.isCulled(PARTICLES, CAM_MAIN));
+    }
+
+    // Synthetic scene: groups of objects with a parent node each, spread
+    // around the cameras, with a deterministic pseudo random generator.
+    culler.reset();
+    unsigned int seed = 12345;
+    const int num_groups = 2000, objects_per_group = 10;
+    for (int group = 0; group < num_groups; group++)
+    {
+        seed = seed*1103515245 + 12345;
+        core::matrix4 transform;
+        transform.setTranslation(core::vector3df(
+            float((seed >> 4) % 400) - 200.0f, 0,
+            float((seed >> 16) % 400) - 200.0f));
+        core::aabbox3df box(-10, -1, -10, 10, 5, 10);
+        int parent = culler.addNode(box, transform, true, NODE_INHERIT, -1);
+        for (int i = 0; i < objects_per_group; i++)
+        {
+            seed = seed*1103515245 + 12345;
+            core::matrix4 t = transform;
+            t.setTranslation(transform.getTranslation() +
+                core::vector3df(float(seed % 20) - 10.0f, 0,
+                                float((seed >> 8) % 20) - 10.0f));
+            t.setRotationDegrees(core::vector3df(0, float(seed % 360), 0));
+            culler.addNode(core::aabbox3df(-1, 0, -2, 1, 2, 2), t,
+                           (seed & 15) != 0, NODE_TEST_ALL, parent);
+        }
+    }
+
+    // Reference results, computed directly
+    std::vector<unsigned char> reference(culler.getNumNodes());
+    for (unsigned int i = 0; i < culler.getNumNodes(); i++)
+    {
+        const Node &node = culler.m_nodes[i];
+        reference[i] = node.m_parent >= 0 ? reference[node.m_parent] : 0;
+        if (node.m_type == NODE_INHERIT || !node.m_automatic_culling)
+            continue;
+        core::vector3df edges[8];
+        node.m_box.getEdges(edges);
+        for (unsigned j = 0; j < 8; j++)
+            node.m_transform.transformVect(edges[j]);
+        for (int camera = 0; camera < CAM_COUNT; camera++)
+            if (isBoxCulled(culler.m_planes[camera], edges))
+                reference[i] |= 1 << camera;
+    }
+
+    // One run per kernel with one thread, then the SIMD kernel with
+    // one thread per processor
+    const int num_threads = HardwareStats::getNumProcessors();
+    const int iterations = 50;
+    const int num_runs = KERNEL_SIMD + 2;
+    double time[num_runs];
+    for (int run = 0; run < num_runs; run++)
+    {
+        const int threads = run <= KERNEL_SIMD ? 1 : num_threads;
+        culler.setKernel((Kernel)core::min_(run, (int)KERNEL_SIMD));
+        double start = getTimeMilliseconds();
+        for (int i = 0; i < iterations; i++)
+            culler.cull(threads);
+        time[run] = (getTimeMilliseconds() - start) / iterations;
+        for (unsigned int i = 0; i < culler.getNumNodes(); i++)
+            assert(culler.m_culled[i] == reference[i]);
+    }
+    int num_culled = 0;
+    for (unsigned int i = 0; i < culler.getNumNodes(); i++)
+        if (culler.isCulled(i, CAM_MAIN)) num_culled++;
+    Log::info("SceneCuller", "%d nodes (%d culled for the main camera), "
+              "1 thread: per node %.3f ms, blocks %.3f ms, %s blocks %.3f ms "
+              "(%.1fx). %s blocks with %d threads: %.3f ms.",
+              culler.getNumNodes(), num_culled, time[KERNEL_AOS],
+              time[KERNEL_SCALAR], getSIMDName(), time[KERNEL_SIMD],
+              time[KERNEL_AOS] / core::max_(time[KERNEL_SIMD], 0.001),
+              getSIMDName(), num_threads, time[KERNEL_SIMD + 1]);
+}   // unitTesting
@@ -0,0 +1,157 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SCENE_CULLER_HPP
+#define HEADER_SCENE_CULLER_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <aabbox3d.h>
+#include <matrix4.h>
+#include <plane3d.h>
+#include <SViewFrustum.h>
+
+#include <vector>
+
+using namespace irr;
+
+/**
+ * \brief Tests the nodes of a scene against the frustums of all cameras.
+ * The scene is first flattened into a list of nodes (in the order in which
+ * they are drawn, each node refering to its parent), then the frustum tests
+ * for all nodes are done, optionally with the job system. The result does
+ * not depend on the number of threads. This class only uses irrlicht's
+ * math classes, it does not need a scene manager or an OpenGL context.
+ * The transformed bounding boxes are stored as structure of arrays in
+ * blocks of BLOCK_SIZE nodes, so that SSE or AVX (if enabled when
+ * compiling) can test several boxes against a plane at once. The result
+ * is identical to testing each box with plane3df::classifyPointRelation.
+ * \ingroup graphics
+ */
+class SceneCuller : public NoCopy
+{
+public:
+    /** The cameras a node is tested against: the main camera, the camera
+     *  of the reflective shadow map and the four shadow cascades. */
+    enum Camera { CAM_MAIN = 0, CAM_RSM = 1, CAM_SHADOW = 2, CAM_COUNT = 6 };
+
+    /** How a node is tested. */
+    enum NodeType
+    {
+        /** The node is not tested, it is culled if its parent is culled
+         *  (e.g. nodes that are not meshes). */
+        NODE_INHERIT,
+        /** The node is tested against all cameras, and it is also culled
+         *  for each camera its parent is culled for (meshes). */
+        NODE_TEST_ALL,
+        /** The node is only tested against the main camera, independent
+         *  of its parent (particles and billboards). */
+        NODE_TEST_MAIN
+    };
+
+    /** The implementation of the frustum tests. */
+    enum Kernel
+    {
+        /** Each box is tested separately using irrlicht's vectors. */
+        KERNEL_AOS,
+        /** The boxes are tested in blocks without SIMD instructions. */
+        KERNEL_SCALAR,
+        /** The boxes are tested in blocks with SSE or AVX if available,
+         *  otherwise this is the same as KERNEL_SCALAR. */
+        KERNEL_SIMD
+    };
+
+    /** Number of nodes tested together. */
+    static const int BLOCK_SIZE = 8;
+
+private:
+    struct Node
+    {
+        core::aabbox3df m_box;
+        core::matrix4   m_transform;
+        /** Index of the parent node, or -1 if the node has no parent. */
+        int             m_parent;
+        NodeType        m_type;
+        bool            m_automatic_culling;
+    };   // Node
+
+    /** All nodes, parents always before their children. */
+    std::vector<Node> m_nodes;
+
+    /** The bounding boxes and transformations of BLOCK_SIZE nodes, stored
+     *  as structure of arrays (one float per node for each value). */
+    struct Block
+    {
+        /** Center of each box, and center minus maximum edge. */
+        float m_middle[3][BLOCK_SIZE];
+        float m_diag[3][BLOCK_SIZE];
+        /** The matrix elements used by matrix4::transformVect, i.e. the
+         *  first three columns of the four rows (row*3+column). */
+        float m_transform[12][BLOCK_SIZE];
+        /** Bit mask of the cameras each node is tested against. */
+        unsigned char m_test[BLOCK_SIZE];
+    };   // Block
+
+    /** For each node a bit mask of the cameras it is culled for. */
+    std::vector<unsigned char> m_culled;
+
+    /** The boxes of all nodes, used by the block kernels. */
+    std::vector<Block> m_blocks;
+
+    /** The planes of the frustum of each camera. */
+    core::plane3df m_planes[CAM_COUNT][scene::SViewFrustum::VF_PLANE_COUNT];
+
+    /** The kernel to use. */
+    Kernel m_kernel;
+
+    unsigned char testNode(const Node &node) const;
+    void getBlockEdges(int block, float edges[8][3][BLOCK_SIZE]) const;
+    void testBlockScalar(int block);
+    void testBlockSIMD(int block);
+    void testNodes(int begin, int end);
+    void testBlocks(int begin, int end);
+
+public:
+         SceneCuller();
+    static const char *getSIMDName();
+    // ------------------------------------------------------------------------
+    /** Selects the implementation of the frustum tests. */
+    void setKernel(Kernel kernel) { m_kernel = kernel; }
+    // ------------------------------------------------------------------------
+    /** Removes all nodes, the frustums are kept. */
+    void reset() { m_nodes.clear(); m_culled.clear(); m_blocks.clear(); }
+    void setFrustum(Camera camera, const scene::SViewFrustum &frustum);
+    int  addNode(const core::aabbox3df &box, const core::matrix4 &transform,
+                 bool automatic_culling, NodeType type, int parent);
+    void cull(int num_threads);
+    static bool isBoxCulled(const core::plane3df *planes,
+                            const core::vector3df edges[8]);
+    static void unitTesting();
+    // ------------------------------------------------------------------------
+    /** Returns the number of nodes. */
+    unsigned int getNumNodes() const { return (unsigned int)m_nodes.size(); }
+    // ------------------------------------------------------------------------
+    /** Returns if a node is culled for a camera. Only valid after cull().
+     *  \param node Index of the node as returned by addNode().
+     *  \param camera The camera (CAM_SHADOW+i for shadow cascade i). */
+    bool isCulled(int node, int camera) const
+    {
+        return (m_culled[node] & (1 << camera)) != 0;
+    }   // isCulled
+};   // SceneCuller
+
+#endif
@@ -20,13 +20,17 @@
 #include "graphics/stkmesh.hpp"
 #include "graphics/irr_driver.hpp"
 #include "graphics/central_settings.hpp"
+#include "graphics/scene_culler.hpp"
 #include "stkanimatedmesh.hpp"
 #include "stkmeshscenenode.hpp"
 #include "utils/ptr_vector.hpp"
 #include <ICameraSceneNode.h>
 #include <SViewFrustum.h>
 #include "callbacks.hpp"
+#include "config/hardware_stats.hpp"
+#include "config/user_config.hpp"
 #include "utils/cpp2011.hpp"
+#include "utils/job_system.hpp"
 #include "modes/world.hpp"
 #include "tracks/track.hpp"
 #include "lod_node.hpp"
@@ -128,7 +132,7 @@ void InstanceFiller<GlowInstanceData>::add(GLMesh *mesh, scene::ISceneNode *node
 
 template<typename T>
 static void
-FillInstances_impl(std::vector<std::pair<GLMesh *, scene::ISceneNode *> > InstanceList, T * InstanceBuffer, DrawElementsIndirectCommand *CommandBuffer,
+FillInstances_impl(const std::vector<std::pair<GLMesh *, scene::ISceneNode *> > &InstanceList, T * InstanceBuffer, DrawElementsIndirectCommand *CommandBuffer,
     size_t &InstanceBufferOffset, size_t &CommandBufferOffset, size_t &PolyCount)
 {
     // Should never be empty
@@ -137,7 +141,7 @@ FillInstances_impl(std::vector<std::pair<GLMesh *, scene::ISceneNode *> > Instan
 
     for (unsigned i = 0; i < InstanceList.size(); i++)
     {
-        auto &Tp = InstanceList[i];
+        const auto &Tp = InstanceList[i];
         scene::ISceneNode *node = Tp.second;
         InstanceFiller<T>::add(mesh, node, InstanceBuffer[InstanceBufferOffset++]);
         assert(InstanceBufferOffset * sizeof(T) < 10000 * sizeof(InstanceDataDualTex));
@@ -153,35 +157,95 @@ FillInstances_impl(std::vector<std::pair<GLMesh *, scene::ISceneNode *> > Instan
     PolyCount += (InstanceBufferOffset - InitialOffset) * mesh->IndexCount / 3;
 }
 
+static int getCullingThreads()
+{
+    int n = UserConfigParams::m_culling_threads;
+    if (n < 0)
+        n = HardwareStats::getNumProcessors();
+    return n < 1 ? 1 : n;
+}
+
+/** Fills the instances and commands of a range of mesh lists, used with
+ *  JobSystem::parallelFor. */
+template<typename T>
+struct FillInstancesRange
+{
+    const std::vector<const std::vector<std::pair<GLMesh *, scene::ISceneNode*> > *> *Lists;
+    const std::vector<size_t> *Offsets;
+    std::vector<size_t> *PolyCounts;
+    T *InstanceBuffer;
+    DrawElementsIndirectCommand *CommandBuffer;
+    size_t FirstCommand;
+
+    void operator()(int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            size_t InstanceOffset = (*Offsets)[i], CommandOffset = FirstCommand + i;
+            FillInstances_impl<T>(*(*Lists)[i], InstanceBuffer, CommandBuffer, InstanceOffset, CommandOffset, (*PolyCounts)[i]);
+        }
+    }
+};
+
 template<typename T>
 static
 void FillInstances(const std::unordered_map<scene::IMeshBuffer *, std::vector<std::pair<GLMesh *, scene::ISceneNode*> > > &GatheredGLMesh, std::vector<GLMesh *> &InstancedList,
     T *InstanceBuffer, DrawElementsIndirectCommand *CommandBuffer, size_t &InstanceBufferOffset, size_t &CommandBufferOffset, size_t &Polycount)
 {
+    // First assign the instance and command buffer ranges in the order of
+    // the map, then fill the ranges in parallel. The buffers are therefore
+    // identical to filling them serially.
+    std::vector<const std::vector<std::pair<GLMesh *, scene::ISceneNode*> > *> Lists;
+    std::vector<size_t> Offsets;
+    Lists.reserve(GatheredGLMesh.size());
+    Offsets.reserve(GatheredGLMesh.size());
     auto It = GatheredGLMesh.begin(), E = GatheredGLMesh.end();
     for (; It != E; ++It)
     {
-        FillInstances_impl<T>(It->second, InstanceBuffer, CommandBuffer, InstanceBufferOffset, CommandBufferOffset, Polycount);
+        Lists.push_back(&It->second);
+        Offsets.push_back(InstanceBufferOffset);
+        InstanceBufferOffset += It->second.size();
         if (!CVS->isAZDOEnabled())
             InstancedList.push_back(It->second.front().first);
     }
+    const size_t FirstCommand = CommandBufferOffset;
+    CommandBufferOffset += Lists.size();
+
+    // This is called from the parallel sections of PrepareDrawCalls, the
+    // jobs are shared with the workers and the other sections.
+    const int Count = (int)Lists.size();
+    const int NumThreads = getCullingThreads();
+    std::vector<size_t> PolyCounts(Count, 0);
+    FillInstancesRange<T> Range;
+    Range.Lists = &Lists;
+    Range.Offsets = &Offsets;
+    Range.PolyCounts = &PolyCounts;
+    Range.InstanceBuffer = InstanceBuffer;
+    Range.CommandBuffer = CommandBuffer;
+    Range.FirstCommand = FirstCommand;
+    JobSystem::parallelFor(0, Count, &Range, Count > 16 ? NumThreads : 1);
+    for (int i = 0; i < Count; i++)
+        Polycount += PolyCounts[i];
 }
 
 static std::unordered_map <scene::IMeshBuffer *, std::vector<std::pair<GLMesh *, scene::ISceneNode*> > > MeshForSolidPass[Material::SHADERTYPE_COUNT], MeshForShadowPass[Material::SHADERTYPE_COUNT][4], MeshForRSM[Material::SHADERTYPE_COUNT];
 static std::unordered_map <scene::IMeshBuffer *, std::vector<std::pair<GLMesh *, scene::ISceneNode*> > > MeshForGlowPass;
 static std::vector <STKMeshCommon *> DeferredUpdate;
 
-static core::vector3df windDir;
+/** The kind of a node in the flattened scene. */
+enum CullNodeKind { CULL_NODE_OTHER, CULL_NODE_MESH, CULL_NODE_PARTICLES, CULL_NODE_BILLBOARD };
 
-// From irrlicht code
-static
-bool isBoxInFrontOfPlane(const core::plane3df &plane, const core::vector3df edges[8])
+/** The visible nodes of the scene in drawing order, with the same index as
+ *  in the culler. */
+struct CullNode
 {
-    for (u32 j = 0; j<8; ++j)
-        if (plane.classifyPointRelation(edges[j]) != core::ISREL3D_FRONT)
-            return false;
-    return true;
-}
+    scene::ISceneNode *m_node;
+    CullNodeKind       m_kind;
+};
+static std::vector<CullNode> CullNodes;
+static SceneCuller Culler;
+
+static core::vector3df windDir;
 
 std::vector<float> BoundingBoxes;
 
@@ -195,37 +259,11 @@ static void addEdge(const core::vector3df &P0, const core::vector3df &P1)
     BoundingBoxes.push_back(P1.Z);
 }
 
-static
-bool isCulledPrecise(const scene::ICameraSceneNode *cam, const scene::ISceneNode *node)
-{
-    if (!node->getAutomaticCulling())
-        return false;
-
-    const core::matrix4 &trans = node->getAbsoluteTransformation();
-    const scene::SViewFrustum &frust = *cam->getViewFrustum();
-
-    core::vector3df edges[8];
-    node->getBoundingBox().getEdges(edges);
-    for (unsigned i = 0; i < 8; i++)
-        trans.transformVect(edges[i]);
-
-    for (s32 i = 0; i < scene::SViewFrustum::VF_PLANE_COUNT; ++i)
-        if (isBoxInFrontOfPlane(frust.planes[i], edges))
-            return true;
-    return false;
-}
-
 static void
 handleSTKCommon(scene::ISceneNode *Node, std::vector<scene::ISceneNode *> *ImmediateDraw,
-    const scene::ICameraSceneNode *cam, scene::ICameraSceneNode *shadowcam[4], const scene::ICameraSceneNode *rsmcam,
-    bool &culledforcam, bool culledforshadowcam[4], bool &culledforrsm, bool drawRSM)
+    bool culledforcam, const bool culledforshadowcam[4], bool culledforrsm, bool drawRSM)
 {
     STKMeshCommon *node = dynamic_cast<STKMeshCommon*>(Node);
-    if (!node)
-        return;
-    node->updateNoGL();
-    DeferredUpdate.push_back(node);
-
 
     const core::matrix4 &trans = Node->getAbsoluteTransformation();
 
@@ -267,11 +305,6 @@ handleSTKCommon(scene::ISceneNode *Node, std::vector<scene::ISceneNode *> *Immed
         return;
     }
 
-    culledforcam = culledforcam || isCulledPrecise(cam, Node);
-    culledforrsm = culledforrsm || isCulledPrecise(rsmcam, Node);
-    for (unsigned i = 0; i < 4; i++)
-        culledforshadowcam[i] = culledforshadowcam[i] || isCulledPrecise(shadowcam[i], Node);
-
     // Transparent
 
     if (World::getWorld() && World::getWorld()->isFogEnabled())
@@ -501,10 +534,14 @@ handleSTKCommon(scene::ISceneNode *Node, std::vector<scene::ISceneNode *> *Immed
     }
 }
 
+/** Flattens the scene into CullNodes and the culler. Nodes that are not
+ *  visible (and their children) are skipped. This also updates the nodes,
+ *  so it must be done in the main thread.
+ *  \param List The nodes to add.
+ *  \param parent Index of the parent of these nodes, or -1.
+ */
 static void
-parseSceneManager(core::list<scene::ISceneNode*> &List, std::vector<scene::ISceneNode *> *ImmediateDraw,
-    const scene::ICameraSceneNode* cam, scene::ICameraSceneNode *shadow_cam[4], const scene::ICameraSceneNode *rsmcam,
-    bool culledforcam, bool culledforshadowcam[4], bool culledforrsm, bool drawRSM)
+parseSceneManager(core::list<scene::ISceneNode*> &List, int parent)
 {
     core::list<scene::ISceneNode*>::Iterator I = List.begin(), E = List.end();
     for (; I != E; ++I)
@@ -515,27 +552,36 @@ parseSceneManager(core::list<scene::ISceneNode*> &List, std::vector<scene::IScen
         if (!(*I)->isVisible())
             continue;
 
-        if (ParticleSystemProxy *node = dynamic_cast<ParticleSystemProxy *>(*I))
+        CullNode cull_node;
+        cull_node.m_node = *I;
+        const bool automatic_culling = (*I)->getAutomaticCulling() != scene::EAC_OFF;
+        if (dynamic_cast<ParticleSystemProxy *>(*I) || dynamic_cast<STKBillboard *>(*I))
         {
-            if (!isCulledPrecise(cam, *I))
-                ParticlesList::getInstance()->push_back(node);
+            // Particles and billboards only depend on the main camera,
+            // and their children are not drawn.
+            cull_node.m_kind = dynamic_cast<STKBillboard *>(*I) ? CULL_NODE_BILLBOARD : CULL_NODE_PARTICLES;
+            Culler.addNode((*I)->getBoundingBox(), (*I)->getAbsoluteTransformation(),
+                automatic_culling, SceneCuller::NODE_TEST_MAIN, parent);
+            CullNodes.push_back(cull_node);
             continue;
         }
 
-        if (STKBillboard *node = dynamic_cast<STKBillboard *>(*I))
+        SceneCuller::NodeType type = SceneCuller::NODE_INHERIT;
+        cull_node.m_kind = CULL_NODE_OTHER;
+        if (STKMeshCommon *node = dynamic_cast<STKMeshCommon*>(*I))
         {
-            if (!isCulledPrecise(cam, *I))
-                BillBoardList::getInstance()->push_back(node);
-            continue;
+            // This can change the bounding box, so it must be done first
+            node->updateNoGL();
+            DeferredUpdate.push_back(node);
+            cull_node.m_kind = CULL_NODE_MESH;
+            if (!node->isImmediateDraw())
+                type = SceneCuller::NODE_TEST_ALL;
         }
+        int index = Culler.addNode((*I)->getBoundingBox(), (*I)->getAbsoluteTransformation(),
+            automatic_culling, type, parent);
+        CullNodes.push_back(cull_node);
 
-        bool newculledforcam = culledforcam;
-        bool newculledforrsm = culledforrsm;
-        bool newculledforshadowcam[4] = { culledforshadowcam[0], culledforshadowcam[1], culledforshadowcam[2], culledforshadowcam[3] };
-
-        handleSTKCommon(*I, ImmediateDraw, cam, shadow_cam, rsmcam, newculledforcam, newculledforshadowcam, newculledforrsm, drawRSM);
-
-        parseSceneManager(const_cast<core::list<scene::ISceneNode*>& >((*I)->getChildren()), ImmediateDraw, cam, shadow_cam, rsmcam, newculledforcam, newculledforshadowcam, newculledforrsm, drawRSM);
+        parseSceneManager(const_cast<core::list<scene::ISceneNode*>& >((*I)->getChildren()), index);
     }
 }
 
@@ -599,9 +645,44 @@ PROFILER_PUSH_CPU_MARKER("- culling", 0xFF, 0xFF, 0x0);
     for (scene::ISceneNode *child : List)
         FixBoundingBoxes(child);
 
-    bool cam = false, rsmcam = false;
-    bool shadowcam[4] = { false, false, false, false };
-    parseSceneManager(List, ImmediateDrawList::getInstance(), camnode, m_shadow_camnodes, m_suncam, cam, shadowcam, rsmcam, !m_rsm_map_available);
+    Culler.reset();
+    CullNodes.clear();
+    Culler.setFrustum(SceneCuller::CAM_MAIN, *camnode->getViewFrustum());
+    Culler.setFrustum(SceneCuller::CAM_RSM, *m_suncam->getViewFrustum());
+    for (unsigned i = 0; i < 4; i++)
+        Culler.setFrustum((SceneCuller::Camera)(SceneCuller::CAM_SHADOW + i), *m_shadow_camnodes[i]->getViewFrustum());
+    parseSceneManager(List, -1);
+    Culler.cull(getCullingThreads());
+
+    // Now fill the lists in the order of the scene
+    const bool drawRSM = !m_rsm_map_available;
+    for (unsigned i = 0; i < CullNodes.size(); i++)
+    {
+        scene::ISceneNode *node = CullNodes[i].m_node;
+        switch (CullNodes[i].m_kind)
+        {
+        case CULL_NODE_PARTICLES:
+            if (!Culler.isCulled(i, SceneCuller::CAM_MAIN))
+                ParticlesList::getInstance()->push_back(dynamic_cast<ParticleSystemProxy *>(node));
+            break;
+        case CULL_NODE_BILLBOARD:
+            if (!Culler.isCulled(i, SceneCuller::CAM_MAIN))
+                BillBoardList::getInstance()->push_back(dynamic_cast<STKBillboard *>(node));
+            break;
+        case CULL_NODE_MESH:
+        {
+            bool shadowcam[4];
+            for (unsigned j = 0; j < 4; j++)
+                shadowcam[j] = Culler.isCulled(i, SceneCuller::CAM_SHADOW + j);
+            handleSTKCommon(node, ImmediateDrawList::getInstance(),
+                Culler.isCulled(i, SceneCuller::CAM_MAIN), shadowcam,
+                Culler.isCulled(i, SceneCuller::CAM_RSM), drawRSM);
+            break;
+        }
+        case CULL_NODE_OTHER:
+            break;
+        }
+    }
 PROFILER_POP_CPU_MARKER();
 
     // Add a 1 s timeout
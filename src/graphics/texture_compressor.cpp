@@ -0,0 +1,661 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "graphics/texture_compressor.hpp"
+
+#include "config/user_config.hpp"
+#include "graphics/gl_headers.hpp"
+#include "graphics/irr_driver.hpp"
+#include "io/asset_loader.hpp"
+#include "io/file_manager.hpp"
+#include "utils/job_system.hpp"
+#include "utils/log.hpp"
+#include "utils/profiler.hpp"
+#include "utils/string_utils.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <fstream>
+#include <set>
+
+// ----------------------------------------------------------------------------
+/** Converts an 8 bit sRGB value to linear. */
+static float srgbToLinear(unsigned char c)
+{
+    const float f = c / 255.0f;
+    return f <= 0.04045f ? f / 12.92f : powf((f + 0.055f) / 1.055f, 2.4f);
+}   // srgbToLinear
+
+// ----------------------------------------------------------------------------
+/** Lookup table from 8 bit sRGB to linear, filled at startup (so that it
+ *  can be used by all threads). */
+static struct SrgbTable
+{
+    float m_linear[256];
+    SrgbTable()
+    {
+        for (int i = 0; i < 256; i++)
+            m_linear[i] = srgbToLinear((unsigned char)i);
+    }
+} srgb_table;
+
+// ----------------------------------------------------------------------------
+/** Converts a linear value to 8 bit sRGB (with rounding). */
+static unsigned char linearToSrgb(float f)
+{
+    f = f <= 0.0031308f ? f * 12.92f : 1.055f * powf(f, 1.0f / 2.4f) - 0.055f;
+    const int c = (int)(f * 255.0f + 0.5f);
+    return (unsigned char)(c < 0 ? 0 : c > 255 ? 255 : c);
+}   // linearToSrgb
+
+// ----------------------------------------------------------------------------
+/** Computes the next mipmap level of a BGRA image with a 2x2 box filter.
+ *  Colors of sRGB images are averaged in linear space, alpha is always
+ *  linear.
+ *  \param src The image.
+ *  \param w, h Size of the image.
+ *  \param srgb True if the colors are sRGB.
+ *  \param dest Receives the next level, of size max(w/2,1) x max(h/2,1).
+ */
+void TextureCompressor::downsample(const unsigned char *src, unsigned int w,
+                                   unsigned int h, bool srgb,
+                                   unsigned char *dest)
+{
+    const float *to_linear = srgb_table.m_linear;
+    const unsigned int nw = w > 1 ? w / 2 : 1, nh = h > 1 ? h / 2 : 1;
+    for (unsigned int y = 0; y < nh; y++)
+    {
+        const unsigned int y0 = 2 * y, y1 = core::min_(2 * y + 1, h - 1);
+        for (unsigned int x = 0; x < nw; x++)
+        {
+            const unsigned int x0 = 2 * x, x1 = core::min_(2 * x + 1, w - 1);
+            const unsigned char *p[4] = { src + 4 * (y0 * w + x0),
+                                          src + 4 * (y0 * w + x1),
+                                          src + 4 * (y1 * w + x0),
+                                          src + 4 * (y1 * w + x1) };
+            unsigned char *out = dest + 4 * (y * nw + x);
+            for (int c = 0; c < 3; c++)
+            {
+                if (srgb)
+                {
+                    out[c] = linearToSrgb(0.25f * (to_linear[p[0][c]] +
+                                                   to_linear[p[1][c]] +
+                                                   to_linear[p[2][c]] +
+                                                   to_linear[p[3][c]]));
+                }
+                else
+                {
+                    out[c] = (unsigned char)((p[0][c] + p[1][c] + p[2][c] +
+                                              p[3][c] + 2) / 4);
+                }
+            }
+            out[3] = (unsigned char)((p[0][3] + p[1][3] + p[2][3] +
+                                      p[3][3] + 2) / 4);
+        }
+    }
+}   // downsample
+
+// ----------------------------------------------------------------------------
+/** Converts a BGRA color to RGB565. */
+static unsigned int toRGB565(const int *bgr)
+{
+    return ((bgr[2] >> 3) << 11) | ((bgr[1] >> 2) << 5) | (bgr[0] >> 3);
+}   // toRGB565
+
+// ----------------------------------------------------------------------------
+/** Converts an RGB565 color back to 8 bits per channel (BGR order). */
+static void fromRGB565(unsigned int c, int *bgr)
+{
+    const int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    bgr[0] = (b << 3) | (b >> 2);
+    bgr[1] = (g << 2) | (g >> 4);
+    bgr[2] = (r << 3) | (r >> 2);
+}   // fromRGB565
+
+// ----------------------------------------------------------------------------
+/** Compresses a block of 4x4 pixels with DXT5. The color end points are the
+ *  corners of the (slightly inset) bounding box of the colors, with the
+ *  red and blue ranges flipped if they are anti-correlated with green, the
+ *  alpha end points are the minimum and maximum alpha. Each pixel then uses
+ *  the nearest palette entry.
+ *  \param bgra The 16 pixels, row by row, 4 bytes each.
+ *  \param block Receives the 16 bytes of the compressed block.
+ */
+void TextureCompressor::compressBlockDXT5(const unsigned char *bgra,
+                                          unsigned char *block)
+{
+    // Alpha block: two end points and 16 3-bit indices
+    int a_min = 255, a_max = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        a_min = core::min_(a_min, (int)bgra[4 * i + 3]);
+        a_max = core::max_(a_max, (int)bgra[4 * i + 3]);
+    }
+    block[0] = (unsigned char)a_max;
+    block[1] = (unsigned char)a_min;
+    unsigned long long alpha_bits = 0;
+    if (a_max > a_min)
+    {
+        int palette[8];
+        palette[0] = a_max;
+        palette[1] = a_min;
+        for (int k = 2; k < 8; k++)
+            palette[k] = ((8 - k) * a_max + (k - 1) * a_min) / 7;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, best_error = 256;
+            for (int k = 0; k < 8; k++)
+            {
+                const int error = abs(palette[k] - bgra[4 * i + 3]);
+                if (error < best_error)
+                {
+                    best = k;
+                    best_error = error;
+                }
+            }
+            alpha_bits |= (unsigned long long)best << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; i++)
+        block[2 + i] = (unsigned char)(alpha_bits >> (8 * i));
+
+    // Color block: bounding box of the colors, with each of blue and red
+    // flipped if it decreases when green increases
+    int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            lo[c] = core::min_(lo[c], (int)bgra[4 * i + c]);
+            hi[c] = core::max_(hi[c], (int)bgra[4 * i + c]);
+            mean[c] += bgra[4 * i + c];
+        }
+    }
+    int cov[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+    {
+        const int g = 16 * bgra[4 * i + 1] - mean[1];
+        cov[0] += (16 * bgra[4 * i    ] - mean[0]) * g;
+        cov[2] += (16 * bgra[4 * i + 2] - mean[2]) * g;
+    }
+    int end0[3], end1[3];
+    for (int c = 0; c < 3; c++)
+    {
+        const int inset = (hi[c] - lo[c]) >> 4;
+        end0[c] = hi[c] - inset;
+        end1[c] = lo[c] + inset;
+        if (cov[c] < 0)
+            std::swap(end0[c], end1[c]);
+    }
+
+    unsigned int c0 = toRGB565(end0), c1 = toRGB565(end1);
+    // c0 > c1 selects the mode with four colors
+    if (c0 < c1)
+        std::swap(c0, c1);
+    unsigned int color_bits = 0;
+    if (c0 != c1)
+    {
+        int palette[4][3];
+        fromRGB565(c0, palette[0]);
+        fromRGB565(c1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, best_error = 1 << 30;
+            for (int k = 0; k < 4; k++)
+            {
+                int error = 0;
+                for (int c = 0; c < 3; c++)
+                {
+                    const int d = palette[k][c] - bgra[4 * i + c];
+                    error += d * d;
+                }
+                if (error < best_error)
+                {
+                    best = k;
+                    best_error = error;
+                }
+            }
+            color_bits |= best << (2 * i);
+        }
+    }
+    block[ 8] = (unsigned char)(c0 & 0xff);
+    block[ 9] = (unsigned char)(c0 >> 8);
+    block[10] = (unsigned char)(c1 & 0xff);
+    block[11] = (unsigned char)(c1 >> 8);
+    for (int i = 0; i < 4; i++)
+        block[12 + i] = (unsigned char)(color_bits >> (8 * i));
+}   // compressBlockDXT5
+
+// ----------------------------------------------------------------------------
+/** Compresses a BGRA image with DXT5. Blocks at the right and bottom border
+ *  of images whose size is not a multiple of 4 repeat the last column/row.
+ *  \param bgra The image.
+ *  \param w, h Size of the image.
+ *  \param out Receives the compressed data (16 bytes per 4x4 block).
+ */
+void TextureCompressor::compressDXT5(const unsigned char *bgra,
+                                     unsigned int w, unsigned int h,
+                                     std::vector<unsigned char> *out)
+{
+    const unsigned int bw = (w + 3) / 4, bh = (h + 3) / 4;
+    out->resize(bw * bh * 16);
+    for (unsigned int by = 0; by < bh; by++)
+    {
+        for (unsigned int bx = 0; bx < bw; bx++)
+        {
+            unsigned char pixels[64];
+            for (unsigned int y = 0; y < 4; y++)
+            {
+                const unsigned int sy = core::min_(4 * by + y, h - 1);
+                for (unsigned int x = 0; x < 4; x++)
+                {
+                    const unsigned int sx = core::min_(4 * bx + x, w - 1);
+                    memcpy(pixels + 4 * (4 * y + x),
+                           bgra + 4 * (sy * w + sx), 4);
+                }
+            }
+            compressBlockDXT5(pixels, &(*out)[16 * (by * bw + bx)]);
+        }
+    }
+}   // compressDXT5
+
+// ----------------------------------------------------------------------------
+/** Returns the size of the texture that irrlicht creates for an image (see
+ *  COpenGLTexture::getImageValues()): the image is limited to the maximum
+ *  size of the driver, rounded up to a power of two if the driver does not
+ *  support other sizes, and limited to the maximum texture size set by the
+ *  game (see IrrDriver::setMaxTextureSize()). The texture cache must have
+ *  this size, since compressTexture() compresses the texture and not the
+ *  image.
+ *  \param image_size Size of the image.
+ */
+static core::dimension2du getTextureSize(const core::dimension2du &image_size)
+{
+    video::IVideoDriver *driver = irr_driver->getVideoDriver();
+    const u32 max_driver_size = driver->getMaxTextureSize().Width;
+    core::dimension2du size = image_size;
+    const f32 ratio = (f32)size.Width / (f32)size.Height;
+    if (size.Width > max_driver_size && ratio >= 1.0f)
+    {
+        size.Width  = max_driver_size;
+        size.Height = (u32)(max_driver_size / ratio);
+    }
+    else if (size.Height > max_driver_size)
+    {
+        size.Height = max_driver_size;
+        size.Width  = (u32)(max_driver_size * ratio);
+    }
+    size = size.getOptimalSize(!driver->queryFeature(video::EVDF_TEXTURE_NPOT));
+    const core::dimension2du max_size = driver->getDriverAttributes()
+                                 .getAttributeAsDimension2d("MAX_TEXTURE_SIZE");
+    if (max_size.Width > 0 && size.Width > max_size.Width)
+        size.Width = max_size.Width;
+    if (max_size.Height > 0 && size.Height > max_size.Height)
+        size.Height = max_size.Height;
+    return size;
+}   // getTextureSize
+
+// ----------------------------------------------------------------------------
+/** Decodes an image, and writes it compressed with all mipmap levels in the
+ *  format of saveCompressedTexture(). The image is scaled to the size the
+ *  texture will have in the game. Can be called from any thread.
+ *  \param filename The image file.
+ *  \param cached_file The file to write.
+ *  \param srgb If the texture is used as sRGB texture.
+ *  \return True if the file was written.
+ */
+bool TextureCompressor::compressFile(const std::string &filename,
+                                     const std::string &cached_file,
+                                     bool srgb)
+{
+    io::IReadFile *file = AssetLoader::readFile(filename);
+    if (!file)
+        return false;
+    video::IVideoDriver *driver = irr_driver->getVideoDriver();
+    video::IImage *image = driver->createImageFromFile(file);
+    file->drop();
+    if (!image)
+        return false;
+
+    // Textures are created by irrlicht with 8 bit BGRA, and scaled the
+    // same way as here
+    const core::dimension2du size = getTextureSize(image->getDimension());
+    std::vector<unsigned char> level(size.Width * size.Height * 4);
+    video::IImage *converted =
+        driver->createImageFromData(video::ECF_A8R8G8B8, size, &level[0],
+                                    /*own foreign memory*/true,
+                                    /*delete memory*/false);
+    if (size == image->getDimension())
+        image->copyTo(converted);
+    else
+        image->copyToScaling(converted);
+    converted->drop();
+    image->drop();
+
+    std::ofstream ofs(cached_file.c_str(), std::ios::out | std::ios::binary);
+    if (!ofs.is_open())
+        return false;
+    int internal_format = srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+                               : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    ofs.write((char*)&internal_format, sizeof(int));
+
+    std::vector<unsigned char> compressed, next;
+    unsigned int w = size.Width, h = size.Height;
+    while (true)
+    {
+        compressDXT5(&level[0], w, h, &compressed);
+        int header[3] = { (int)w, (int)h, (int)compressed.size() };
+        ofs.write((char*)header, sizeof(header));
+        ofs.write((char*)&compressed[0], compressed.size());
+        if (w == 1 && h == 1)
+            break;
+        next.resize(core::max_(w / 2, 1u) * core::max_(h / 2, 1u) * 4);
+        downsample(&level[0], w, h, srgb, &next[0]);
+        level.swap(next);
+        w = core::max_(w / 2, 1u);
+        h = core::max_(h / 2, 1u);
+    }
+    ofs.close();
+    if (ofs.fail())
+    {
+        remove(cached_file.c_str());
+        return false;
+    }
+    return true;
+}   // compressFile
+
+// ----------------------------------------------------------------------------
+/** Adds all image files in a directory and its subdirectories.
+ *  \param dir The directory (without '/' at the end).
+ *  \param srgb If the textures are used as sRGB textures.
+ *  \param files The found files are added here.
+ *  \param srgb_files The srgb flag is added here for each file.
+ */
+void TextureCompressor::findTextures(const std::string &dir, bool srgb,
+                                     std::vector<std::string> *files,
+                                     std::vector<bool> *srgb_files)
+{
+    std::set<std::string> entries;
+    file_manager->listFiles(entries, dir);
+    for (std::set<std::string>::const_iterator i = entries.begin();
+         i != entries.end(); i++)
+    {
+        if (*i == "." || *i == "..")
+            continue;
+        const std::string path = dir + "/" + *i;
+        if (file_manager->isDirectory(path))
+        {
+            findTextures(path, srgb, files, srgb_files);
+            continue;
+        }
+        const std::string ext =
+            StringUtils::toLowerCase(StringUtils::getExtension(*i));
+        if (ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "bmp")
+        {
+            files->push_back(path);
+            srgb_files->push_back(srgb);
+        }
+    }
+}   // findTextures
+
+// ----------------------------------------------------------------------------
+/** Compresses the files in a range of indices, used with
+ *  JobSystem::parallelFor. */
+struct CompressRange
+{
+    const std::vector<std::string> *m_sources, *m_targets;
+    const std::vector<bool>        *m_srgb;
+    /** One char per file, a vector<bool> can't be written by several
+     *  threads at once. */
+    std::vector<char>              *m_ok;
+    void operator()(int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            (*m_ok)[i] = TextureCompressor::compressFile((*m_sources)[i],
+                                                         (*m_targets)[i],
+                                                         (*m_srgb)[i]);
+        }
+    }
+};   // CompressRange
+
+// ----------------------------------------------------------------------------
+/** Compresses all textures of the game and of the installed addons that
+ *  are not yet in the texture cache (or changed since they were cached).
+ *  GUI, skin and font textures are compressed as linear textures, all
+ *  other textures as sRGB textures. If the game uses a texture with the
+ *  other format it recompresses it, see loadCompressedTexture().
+ *  The files are compressed by the job system.
+ *  \param num_threads Number of threads to use (the job system is
+ *         recreated with num_threads-1 workers), or 0 to use the job system
+ *         as configured.
+ */
+void TextureCompressor::compressAllTextures(int num_threads)
+{
+    if (num_threads > 0)
+    {
+        // Don't change the saved config
+        const int job_threads = UserConfigParams::m_job_threads;
+        UserConfigParams::m_job_threads = num_threads - 1;
+        JobSystem::destroy();
+        JobSystem::create();
+        UserConfigParams::m_job_threads = job_threads;
+    }
+    num_threads = JobSystem::get() ? JobSystem::get()->getNumWorkers() + 1
+                                   : 1;
+    const double start = getTimeMilliseconds();
+
+    std::vector<std::string> files;
+    std::vector<bool> srgb;
+    const FileManager::AssetType linear_dirs[] =
+        { FileManager::GUI, FileManager::SKIN, FileManager::FONT };
+    std::vector<std::string> roots;
+    for (unsigned int i = 0; i < sizeof(linear_dirs)/sizeof(linear_dirs[0]);
+         i++)
+    {
+        std::string dir = file_manager->getAsset(linear_dirs[i], "");
+        roots.push_back(dir);
+        findTextures(dir.substr(0, dir.size() - 1), false, &files, &srgb);
+    }
+    // All other textures in the data directory (which contains the
+    // textures directory) and in the addons directory
+    std::string data_dir = file_manager->getAsset(FileManager::TEXTURE, "");
+    data_dir = StringUtils::getPath(data_dir.substr(0, data_dir.size() - 1));
+    std::vector<std::string> all;
+    std::vector<bool> all_srgb;
+    findTextures(data_dir, true, &all, &all_srgb);
+    std::string addons_dir = file_manager->getAddonsDir();
+    if (StringUtils::hasSuffix(addons_dir, "/"))
+        addons_dir = addons_dir.substr(0, addons_dir.size() - 1);
+    findTextures(addons_dir, true, &all, &all_srgb);
+    for (unsigned int i = 0; i < all.size(); i++)
+    {
+        bool is_linear = false;
+        for (unsigned int j = 0; j < roots.size(); j++)
+        {
+            if (all[i].compare(0, roots[j].size(), roots[j]) == 0)
+                is_linear = true;
+        }
+        if (!is_linear)
+        {
+            files.push_back(all[i]);
+            srgb.push_back(true);
+        }
+    }
+
+    // Find the cache files in the main thread, since this creates the
+    // directories. Different textures can have the same cache file, only
+    // the first one is compressed (the same happens in the game).
+    std::vector<std::string> sources, targets;
+    std::vector<bool> target_srgb;
+    std::set<std::string> used;
+    int up_to_date = 0;
+    for (unsigned int i = 0; i < files.size(); i++)
+    {
+        const std::string cached =
+            file_manager->getTextureCacheLocation(files[i]) + ".gltz";
+        if (!used.insert(cached).second)
+            continue;
+        if (file_manager->fileExists(cached) &&
+            !file_manager->fileIsNewer(files[i], cached))
+        {
+            up_to_date++;
+            continue;
+        }
+        sources.push_back(files[i]);
+        targets.push_back(cached);
+        target_srgb.push_back(srgb[i]);
+    }
+    Log::info("TextureCompressor", "Compressing %d textures with %d threads "
+              "(%d are up to date).", (int)sources.size(), num_threads,
+              up_to_date);
+
+    const int count = (int)sources.size();
+    std::vector<char> ok(count);
+    CompressRange range;
+    range.m_sources = &sources;
+    range.m_targets = &targets;
+    range.m_srgb    = &target_srgb;
+    range.m_ok      = &ok;
+    JobSystem::parallelFor(0, count, &range);
+    int failed = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (!ok[i])
+        {
+            Log::warn("TextureCompressor", "Could not compress '%s'.",
+                      sources[i].c_str());
+            failed++;
+        }
+    }
+    Log::info("TextureCompressor", "Compressed %d textures in %.1f s, "
+              "%d failed.", count - failed,
+              (getTimeMilliseconds() - start) / 1000.0, failed);
+}   // compressAllTextures
+
+// ----------------------------------------------------------------------------
+/** Decodes a DXT5 block, used to test the compression. */
+static void decodeBlockDXT5(const unsigned char *block, unsigned char *bgra)
+{
+    const int a0 = block[0], a1 = block[1];
+    int alpha[8] = { a0, a1 };
+    for (int k = 2; k < 8; k++)
+    {
+        alpha[k] = a0 > a1 ? ((8 - k) * a0 + (k - 1) * a1) / 7
+                 : k < 6   ? ((6 - k) * a0 + (k - 1) * a1) / 5
+                 : k == 6  ? 0 : 255;
+    }
+    unsigned long long alpha_bits = 0;
+    for (int i = 0; i < 6; i++)
+        alpha_bits |= (unsigned long long)block[2 + i] << (8 * i);
+    int palette[4][3];
+    fromRGB565(block[8] | (block[9] << 8), palette[0]);
+    fromRGB565(block[10] | (block[11] << 8), palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    const unsigned int color_bits = block[12] | (block[13] << 8) |
+                                    (block[14] << 16) | (block[15] << 24);
+    for (int i = 0; i < 16; i++)
+    {
+        const int k = (color_bits >> (2 * i)) & 3;
+        for (int c = 0; c < 3; c++)
+            bgra[4 * i + c] = (unsigned char)palette[k][c];
+        bgra[4 * i + 3] = (unsigned char)alpha[(alpha_bits >> (3 * i)) & 7];
+    }
+}   // decodeBlockDXT5
+
+// ----------------------------------------------------------------------------
+/** Compresses synthetic images and checks the decoded result, the mipmap
+ *  computation, and prints the compression speed.
+ */
+void TextureCompressor::unitTesting()
+{
+    // A uniform block must be exact (apart from RGB565 rounding)
+    unsigned char pixels[64], decoded[64], block[16];
+    for (int i = 0; i < 16; i++)
+    {
+        pixels[4 * i] = 0x20; pixels[4 * i + 1] = 0x80;
+        pixels[4 * i + 2] = 0xff; pixels[4 * i + 3] = 0x7f;
+    }
+    compressBlockDXT5(pixels, block);
+    decodeBlockDXT5(block, decoded);
+    for (int i = 0; i < 64; i++)
+        assert(abs(decoded[i] - pixels[i]) <= 4);
+
+    // A gradient image: the error must be small
+    const unsigned int w = 256, h = 128;
+    std::vector<unsigned char> image(w * h * 4);
+    for (unsigned int y = 0; y < h; y++)
+    {
+        for (unsigned int x = 0; x < w; x++)
+        {
+            unsigned char *p = &image[4 * (y * w + x)];
+            p[0] = (unsigned char)x;
+            p[1] = (unsigned char)(2 * y);
+            p[2] = (unsigned char)(255 - x);
+            p[3] = (unsigned char)((x + y) / 2);
+        }
+    }
+    std::vector<unsigned char> compressed;
+    const double start = getTimeMilliseconds();
+    const int iterations = 20;
+    for (int i = 0; i < iterations; i++)
+        compressDXT5(&image[0], w, h, &compressed);
+    const double time = (getTimeMilliseconds() - start) / iterations;
+    assert(compressed.size() == (w / 4) * (h / 4) * 16);
+    int max_error = 0;
+    for (unsigned int b = 0; b < compressed.size() / 16; b++)
+    {
+        decodeBlockDXT5(&compressed[16 * b], decoded);
+        const unsigned int bx = b % (w / 4), by = b / (w / 4);
+        for (int i = 0; i < 16; i++)
+        {
+            const unsigned char *p =
+                &image[4 * ((4 * by + i / 4) * w + 4 * bx + i % 4)];
+            for (int c = 0; c < 4; c++)
+                max_error = core::max_(max_error,
+                                       abs(decoded[4 * i + c] - p[c]));
+        }
+    }
+    assert(max_error <= 12);
+
+    // The mipmap of a uniform image is the same color, also in sRGB
+    std::vector<unsigned char> uniform(8 * 2 * 4, 0x80), mip(4 * 1 * 4);
+    downsample(&uniform[0], 8, 2, true, &mip[0]);
+    for (unsigned int i = 0; i < mip.size(); i++)
+        assert(mip[i] == 0x80);
+    // Averaging black and white gives 50% grey in linear space
+    std::vector<unsigned char> checker(2 * 2 * 4, 0);
+    memset(&checker[0], 0xff, 8);
+    downsample(&checker[0], 2, 2, true, &mip[0]);
+    assert(mip[0] == 188 && mip[3] == 0x80);
+    downsample(&checker[0], 2, 2, false, &mip[0]);
+    assert(mip[0] == 0x80);
+
+    Log::info("TextureCompressor", "DXT5 compression of a %dx%d image: "
+              "%.2f ms, maximum error %d.", w, h, time, max_error);
+}   // unitTesting
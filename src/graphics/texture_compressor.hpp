@@ -0,0 +1,56 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_TEXTURE_COMPRESSOR_HPP
+#define HEADER_TEXTURE_COMPRESSOR_HPP
+
+#include <string>
+#include <vector>
+
+/**
+ * \brief Creates the compressed texture cache ahead of time.
+ * Normally a texture is compressed by the driver the first time it is used
+ * (see compressTexture()), and the result is saved in the texture cache.
+ * This class does the same on the CPU for all textures of the game and the
+ * installed addons, with several threads: it decodes each image, scales it
+ * to the size of the texture in the game, computes all mipmap levels,
+ * compresses them with DXT5 and writes them in the format read by
+ * loadCompressedTexture(). The game then only needs to load the cached
+ * files.
+ * \ingroup graphics
+ */
+class TextureCompressor
+{
+private:
+    static void downsample(const unsigned char *src, unsigned int w,
+                           unsigned int h, bool srgb, unsigned char *dest);
+    static void compressBlockDXT5(const unsigned char *rgba,
+                                  unsigned char *block);
+    static void findTextures(const std::string &dir, bool srgb,
+                             std::vector<std::string> *files,
+                             std::vector<bool> *srgb_files);
+
+public:
+    static void compressDXT5(const unsigned char *bgra, unsigned int w,
+                             unsigned int h, std::vector<unsigned char> *out);
+    static bool compressFile(const std::string &filename,
+                             const std::string &cached_file, bool srgb);
+    static void compressAllTextures(int num_threads);
+    static void unitTesting();
+};   // TextureCompressor
+
+#endif
@@ -17,6 +17,7 @@
 
 #include "central_settings.hpp"
 #include "texturemanager.hpp"
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include "../../lib/irrlicht/source/Irrlicht/COpenGLTexture.h"
@@ -51,15 +52,42 @@ void compressTexture(irr::video::ITexture *tex, bool srgb, bool premul_alpha)
 
     glBindTexture(GL_TEXTURE_2D, getTextureGLuint(tex));
 
+    unsigned internalFormat, Format;
+    if (tex->hasAlpha())
+        Format = GL_BGRA;
+    else
+        Format = GL_BGR;
+
+    if (!CVS->isTextureCompressionEnabled())
+    {
+        if (srgb)
+            internalFormat = (tex->hasAlpha()) ? GL_SRGB_ALPHA : GL_SRGB;
+        else
+            internalFormat = (tex->hasAlpha()) ? GL_RGBA : GL_RGB;
+    }
+    else
+    {
+        if (srgb)
+            internalFormat = (tex->hasAlpha()) ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        else
+            internalFormat = (tex->hasAlpha()) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+
     std::string cached_file;
     if (CVS->isTextureCompressionEnabled())
     {
-        // Try to retrieve the compressed texture in cache
+        // Try to retrieve the compressed texture in cache. The cache can be
+        // created ahead of time (see TextureCompressor), so the format and
+        // the size (which depends on the maximum texture size) must be
+        // checked, and textures with premultiplied alpha use another file.
         std::string tex_name = irr_driver->getTextureName(tex);
         if (!tex_name.empty()) {
-            cached_file = file_manager->getTextureCacheLocation(tex_name) + ".gltz";
-            if (!file_manager->fileIsNewer(tex_name, cached_file)) {
-                if (loadCompressedTexture(cached_file))
+            cached_file = file_manager->getTextureCacheLocation(tex_name)
+                        + (premul_alpha ? ".premul.gltz" : ".gltz");
+            if (file_manager->fileExists(cached_file) &&
+                !file_manager->fileIsNewer(tex_name, cached_file)) {
+                if (loadCompressedTexture(cached_file, internalFormat,
+                                          tex->getSize()))
                     return;
             }
         }
@@ -69,11 +97,6 @@ void compressTexture(irr::video::ITexture *tex, bool srgb, bool premul_alpha)
     unsigned char *data = new unsigned char[w * h * 4];
     memcpy(data, tex->lock(), w * h * 4);
     tex->unlock();
-    unsigned internalFormat, Format;
-    if (tex->hasAlpha())
-        Format = GL_BGRA;
-    else
-        Format = GL_BGR;
 
     if (premul_alpha)
     {
@@ -88,20 +111,6 @@ void compressTexture(irr::video::ITexture *tex, bool srgb, bool premul_alpha)
         }
     }
 
-    if (!CVS->isTextureCompressionEnabled())
-    {
-        if (srgb)
-            internalFormat = (tex->hasAlpha()) ? GL_SRGB_ALPHA : GL_SRGB;
-        else
-            internalFormat = (tex->hasAlpha()) ? GL_RGBA : GL_RGB;
-    }
-    else
-    {
-        if (srgb)
-            internalFormat = (tex->hasAlpha()) ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
-        else
-            internalFormat = (tex->hasAlpha()) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
-    }
     glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, Format, GL_UNSIGNED_BYTE, (GLvoid *)data);
     glGenerateMipmap(GL_TEXTURE_2D);
     delete[] data;
@@ -117,10 +126,19 @@ void compressTexture(irr::video::ITexture *tex, bool srgb, bool premul_alpha)
 /** Try to load a compressed texture from the given file name.
 *   Data in the specified file need to have a specific format. See the
 *   saveCompressedTexture() function for a description of the format.
+*   If the file contains all mipmap levels they are loaded, otherwise the
+*   mipmaps are generated.
+*   \param compressed_tex File name of the compressed texture.
+*   \param expected_format The internal format the texture must have, or 0
+*          to accept any format.
+*   \param expected_size The size level 0 of the texture must have, or 0x0
+*          to accept any size.
 *   \return true if the loading succeeded, false otherwise.
 *   \see saveCompressedTexture
 */
-bool loadCompressedTexture(const std::string& compressed_tex)
+bool loadCompressedTexture(const std::string& compressed_tex,
+                           unsigned expected_format,
+                           const irr::core::dimension2du &expected_size)
 {
     std::ifstream ifs(compressed_tex.c_str(), std::ios::in | std::ios::binary);
     if (!ifs.is_open())
@@ -136,20 +154,52 @@ bool loadCompressedTexture(const std::string& compressed_tex)
 
     if (ifs.fail() || size == -1)
         return false;
+    if (expected_format != 0 && internal_format != (int)expected_format)
+        return false;
+    if (expected_size.Width != 0 &&
+        (w != (int)expected_size.Width || h != (int)expected_size.Height))
+        return false;
 
     char *data = new char[size];
     ifs.read(data, size);
-    if (!ifs.fail())
+    if (ifs.fail())
     {
-        glCompressedTexImage2D(GL_TEXTURE_2D, 0, internal_format,
-            w, h, 0, size, (GLvoid*)data);
-        glGenerateMipmap(GL_TEXTURE_2D);
         delete[] data;
-        ifs.close();
-        return true;
+        return false;
     }
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, internal_format,
+        w, h, 0, size, (GLvoid*)data);
     delete[] data;
-    return false;
+
+    // Load the other mipmap levels, as long as the file contains them
+    int level = 1;
+    while (w > 1 || h > 1)
+    {
+        int level_w, level_h, level_size;
+        ifs.read((char*)&level_w, sizeof(int));
+        ifs.read((char*)&level_h, sizeof(int));
+        ifs.read((char*)&level_size, sizeof(int));
+        if (ifs.fail() || level_w != std::max(w / 2, 1) ||
+            level_h != std::max(h / 2, 1) || level_size <= 0)
+            break;
+        data = new char[level_size];
+        ifs.read(data, level_size);
+        if (!ifs.fail())
+        {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, internal_format,
+                level_w, level_h, 0, level_size, (GLvoid*)data);
+        }
+        delete[] data;
+        if (ifs.fail())
+            break;
+        w = level_w;
+        h = level_h;
+        level++;
+    }
+    if (w > 1 || h > 1)
+        glGenerateMipmap(GL_TEXTURE_2D);
+    ifs.close();
+    return true;
 }
 
 //-----------------------------------------------------------------------------
@@ -159,33 +209,43 @@ bool loadCompressedTexture(const std::string& compressed_tex)
 *   \note The following format is used to save the compressed texture:<br>
 *         <internal-format><width><height><size><data> <br>
 *         The first four elements are integers and the last one is stored
-*         on \c size bytes.
+*         on \c size bytes. The following mipmap levels (if compressed) are
+*         appended, each as <width><height><size><data>.
 *   \see loadCompressedTexture
 */
 void saveCompressedTexture(const std::string& compressed_tex)
 {
-    int internal_format, width, height, size, compressionSuccessful;
+    int internal_format, compressionSuccessful;
     glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, (GLint *)&internal_format);
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, (GLint *)&width);
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, (GLint *)&height);
     glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, (GLint *)&compressionSuccessful);
     if (!compressionSuccessful)
         return;
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, (GLint *)&size);
 
-    char *data = new char[size];
-    glGetCompressedTexImage(GL_TEXTURE_2D, 0, (GLvoid*)data);
     std::ofstream ofs(compressed_tex.c_str(), std::ios::out | std::ios::binary);
-    if (ofs.is_open())
+    if (!ofs.is_open())
+        return;
+    ofs.write((char*)&internal_format, sizeof(int));
+    for (int level = 0; ; level++)
     {
-        ofs.write((char*)&internal_format, sizeof(int));
+        int width, height, size;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, (GLint *)&width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, (GLint *)&height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, (GLint *)&compressionSuccessful);
+        if (!compressionSuccessful || width == 0 || height == 0)
+            break;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, (GLint *)&size);
+
+        char *data = new char[size];
+        glGetCompressedTexImage(GL_TEXTURE_2D, level, (GLvoid*)data);
         ofs.write((char*)&width, sizeof(int));
         ofs.write((char*)&height, sizeof(int));
         ofs.write((char*)&size, sizeof(int));
         ofs.write(data, size);
-        ofs.close();
+        delete[] data;
+        if (width == 1 && height == 1)
+            break;
     }
-    delete[] data;
+    ofs.close();
 }
 
 video::ITexture* getUnicolorTexture(const video::SColor &c)
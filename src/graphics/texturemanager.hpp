@@ -27,7 +27,10 @@ GLuint getTextureGLuint(irr::video::ITexture *tex);
 GLuint getDepthTexture(irr::video::ITexture *tex);
 void resetTextureTable();
 void compressTexture(irr::video::ITexture *tex, bool srgb, bool premul_alpha = false);
-bool loadCompressedTexture(const std::string& compressed_tex);
+bool loadCompressedTexture(const std::string& compressed_tex,
+                           unsigned expected_format = 0,
+                           const irr::core::dimension2du &expected_size =
+                                            irr::core::dimension2du(0, 0));
 void saveCompressedTexture(const std::string& compressed_tex);
 
 #endif
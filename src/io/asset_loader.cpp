@@ -0,0 +1,483 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "io/asset_loader.hpp"
+
+#include "config/user_config.hpp"
+#include "graphics/irr_driver.hpp"
+#include "io/file_manager.hpp"
+#include "io/xml_node.hpp"
+#include "utils/log.hpp"
+#include "utils/profiler.hpp"
+#include "utils/string_utils.hpp"
+
+#include <IImageLoader.h>
+
+#include <algorithm>
+#include <set>
+#include <stdio.h>
+#include <string.h>
+
+int          AssetLoader::m_main_thread_jobs = 0;
+AssetLoader *AssetLoader::m_texture_source   = NULL;
+
+// ----------------------------------------------------------------------------
+/** An image loader that is registered with the video driver, and returns
+ *  the images decoded by the jobs of the loader set by decodeTextures().
+ *  It only handles files loaded by the main thread, so that the jobs (which
+ *  decode the images with the same video driver) use the normal loaders.
+ */
+class AssetLoader::ImageSource : public video::IImageLoader
+{
+public:
+    virtual bool isALoadableFileExtension(const io::path &filename) const
+    {
+        return m_texture_source &&
+               m_texture_source->isImageQueued(filename.c_str());
+    }   // isALoadableFileExtension
+    // ------------------------------------------------------------------------
+    virtual bool isALoadableFileFormat(io::IReadFile *file) const
+    {
+        return false;
+    }   // isALoadableFileFormat
+    // ------------------------------------------------------------------------
+    /** Returns the decoded image, or NULL if it could not be decoded (then
+     *  irrlicht tries the other loaders, which print the usual errors). */
+    virtual video::IImage *loadImage(io::IReadFile *file) const
+    {
+        const std::string filename = file->getFileName().c_str();
+        if(!m_texture_source || !m_texture_source->isImageQueued(filename))
+            return NULL;
+        FileJob *job = m_texture_source->waitForJob(JOB_IMAGE, filename);
+        video::IImage *image = job->m_image;
+        delete job;
+        return image;
+    }   // loadImage
+};   // ImageSource
+
+// ----------------------------------------------------------------------------
+/** Creates the loader.
+ *  \param name Name used when printing the statistics.
+ */
+AssetLoader::AssetLoader(const std::string &name)
+{
+    m_name        = name;
+    m_start_time  = getTimeMilliseconds();
+    m_main_thread = pthread_self();
+    for(unsigned int i=0; i<STAGE_COUNT; i++)
+        m_stage_time[i] = 0;
+    pthread_mutex_init(&m_mutex, NULL);
+}   // AssetLoader
+
+// ----------------------------------------------------------------------------
+/** Waits for all jobs that are still running and frees all results that
+ *  were not collected.
+ */
+AssetLoader::~AssetLoader()
+{
+    if(m_texture_source==this)
+        m_texture_source = NULL;
+    for(unsigned int i=0; i<m_jobs.size(); i++)
+    {
+        FileJob *job = m_jobs[i];
+        if(job->m_submitted)
+            JobSystem::get()->wait(job);
+        delete job->m_xml;
+        if(job->m_image)
+            job->m_image->drop();
+        delete job;
+    }
+    pthread_mutex_destroy(&m_mutex);
+}   // ~AssetLoader
+
+// ----------------------------------------------------------------------------
+/** Reads a file into an irrlicht memory file. This does not use irrlicht's
+ *  file system to open the file, so it can be called from any thread.
+ *  \param filename Name of the file.
+ *  \return The memory file (which must be dropped), or NULL if the file
+ *          could not be read.
+ */
+io::IReadFile *AssetLoader::readFile(const std::string &filename)
+{
+    char *data = NULL;
+    long  size = 0;
+    FILE *f = fopen(filename.c_str(), "rb");
+    if(f)
+    {
+        fseek(f, 0, SEEK_END);
+        size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        if(size>0)
+        {
+            data = new char[size];
+            if(fread(data, 1, size, f)!=(size_t)size)
+            {
+                delete [] data;
+                data = NULL;
+            }
+        }
+        fclose(f);
+    }
+    if(!data)
+        return NULL;
+
+    // The memory file takes ownership of the data
+    return file_manager->getFileSystem()
+        ->createMemoryReadFile(data, size, filename.c_str(),
+                               /*delete when dropped*/true);
+}   // readFile
+
+// ----------------------------------------------------------------------------
+/** Reads the file of a job into memory and parses or decodes it. This is
+ *  called by any thread, and only uses irrlicht functions that do not
+ *  modify shared data (creating a memory file, an xml reader, and decoding
+ *  an image).
+ */
+void AssetLoader::runJob(FileJob *job)
+{
+    const bool main_thread = pthread_equal(pthread_self(), m_main_thread)!=0;
+    if(main_thread)
+        m_main_thread_jobs++;
+    const double start = getTimeMilliseconds();
+    io::IReadFile *file = readFile(job->m_filename);
+    const double read_done = getTimeMilliseconds();
+
+    if(file)
+    {
+        if(job->m_type==JOB_XML)
+        {
+            io::IXMLReader *reader =
+                file_manager->getFileSystem()->createXMLReader(file);
+            if(reader)
+            {
+                job->m_xml = new XMLNode(reader, job->m_filename);
+                reader->drop();
+            }
+        }
+        else
+        {
+            job->m_image =
+                irr_driver->getVideoDriver()->createImageFromFile(file);
+        }
+        file->drop();
+    }
+
+    const double end = getTimeMilliseconds();
+    pthread_mutex_lock(&m_mutex);
+    m_stage_time[STAGE_READ] += read_done - start;
+    m_stage_time[job->m_type==JOB_XML ? STAGE_PARSE : STAGE_DECODE]
+                             += end - read_done;
+    pthread_mutex_unlock(&m_mutex);
+    if(main_thread)
+        m_main_thread_jobs--;
+}   // runJob
+
+// ----------------------------------------------------------------------------
+/** Adds a job and submits it to the job system, unless threaded loading is
+ *  disabled (then the file is loaded when it is requested).
+ */
+void AssetLoader::addJob(JobType type, const std::string &filename)
+{
+    FileJob *job = new FileJob();
+    job->m_loader    = this;
+    job->m_type      = type;
+    job->m_filename  = filename;
+    job->m_xml       = NULL;
+    job->m_image     = NULL;
+    job->m_submitted = UserConfigParams::m_threaded_loading &&
+                       JobSystem::get();
+    m_jobs.push_back(job);
+    if(job->m_submitted)
+        JobSystem::get()->submit(job);
+}   // addJob
+
+// ----------------------------------------------------------------------------
+/** Queues an XML file to be read and parsed. */
+void AssetLoader::loadXML(const std::string &filename)
+{
+    addJob(JOB_XML, filename);
+}   // loadXML
+
+// ----------------------------------------------------------------------------
+/** Queues an image file to be read and decoded. */
+void AssetLoader::loadImage(const std::string &filename)
+{
+    addJob(JOB_IMAGE, filename);
+}   // loadImage
+
+// ----------------------------------------------------------------------------
+/** Adds the names of the textures that a b3d model uses (i.e. the entries
+ *  of its TEXS chunk) to a set. Only the chunk headers before the TEXS
+ *  chunk are read, which is usually the first chunk of the file.
+ *  \param filename Name of the model file.
+ *  \param textures The texture names (without the path) are added here.
+ */
+static void readB3DTextures(const std::string &filename,
+                            std::set<std::string> *textures)
+{
+    FILE *f = fopen(filename.c_str(), "rb");
+    if(!f)
+        return;
+    // The header is the chunk "BB3D" followed by the version
+    unsigned char header[12];
+    if(fread(header, 1, 12, f)!=12 || memcmp(header, "BB3D", 4)!=0)
+    {
+        fclose(f);
+        return;
+    }
+    unsigned char chunk[8];
+    while(fread(chunk, 1, 8, f)==8)
+    {
+        // Sizes are little endian
+        const long size = (long)chunk[4]         | ((long)chunk[5] << 8)
+                       | ((long)chunk[6] << 16) | ((long)chunk[7] << 24);
+        if(memcmp(chunk, "TEXS", 4)!=0)
+        {
+            if(size<0 || fseek(f, size, SEEK_CUR)!=0)
+                break;
+            continue;
+        }
+        std::vector<char> data(size>0 ? size : 0);
+        if(data.empty() || fread(&data[0], 1, data.size(), f)!=data.size())
+            break;
+        // Each entry is a zero terminated name followed by the flags,
+        // blend mode, position, scale and rotation (7 x 4 bytes).
+        size_t pos = 0;
+        while(pos<data.size())
+        {
+            const size_t end = std::find(data.begin()+pos, data.end(), 0)
+                             - data.begin();
+            if(end==data.size())
+                break;
+            std::string name(&data[pos], end-pos);
+            std::replace(name.begin(), name.end(), '\\', '/');
+            if(!name.empty())
+                textures->insert(StringUtils::getBasename(name));
+            pos = end + 1 + 7*4;
+        }
+        break;
+    }
+    fclose(f);
+}   // readB3DTextures
+
+// ----------------------------------------------------------------------------
+/** Collects the textures that a node of a scene file and all its children
+ *  use: the textures of their b3d models, and the images named in texture
+ *  attributes (e.g. of the sky).
+ *  \param node The node.
+ *  \param dir The directory of the scene file.
+ *  \param textures The texture names are added here.
+ */
+static void findSceneTextures(const XMLNode &node, const std::string &dir,
+                              std::set<std::string> *textures)
+{
+    std::string model;
+    if(node.get("model", &model) &&
+        StringUtils::toLowerCase(StringUtils::getExtension(model))=="b3d")
+        readB3DTextures(dir+model, textures);
+    std::vector<std::string> names;
+    if(node.get("texture", &names))
+        textures->insert(names.begin(), names.end());
+    for(unsigned int i=0; i<node.getNumNodes(); i++)
+        findSceneTextures(*node.getNode(i), dir, textures);
+}   // findSceneTextures
+
+// ----------------------------------------------------------------------------
+/** Decodes the images in a directory that a scene uses (see
+ *  findSceneTextures()) with jobs, and uses the decoded images when the
+ *  main thread loads any of these files as texture (until this loader is
+ *  deleted). This is used for the textures that the mesh loaders of
+ *  irrlicht load, which can then be decoded in parallel even though the
+ *  meshes are loaded (and the textures are created) in the main thread.
+ *  Textures outside of the directory are loaded the normal way. Does
+ *  nothing if threaded loading is disabled, since the images would then be
+ *  decoded in the main thread anyway.
+ *  \param scene The scene file.
+ *  \param dir The directory of the scene file and its textures.
+ */
+void AssetLoader::decodeTextures(const XMLNode &scene, const std::string &dir)
+{
+    if(!UserConfigParams::m_threaded_loading || !JobSystem::get())
+        return;
+
+    // The image source is registered once with each video driver (which
+    // is recreated e.g. when the resolution is changed).
+    static video::IVideoDriver *registered_driver = NULL;
+    video::IVideoDriver *driver = irr_driver->getVideoDriver();
+    if(driver!=registered_driver)
+    {
+        ImageSource *source = new ImageSource();
+        driver->addExternalImageLoader(source);
+        source->drop();
+        registered_driver = driver;
+    }
+
+    std::set<std::string> textures;
+    findSceneTextures(scene, dir, &textures);
+    for(std::set<std::string>::iterator i=textures.begin();
+        i!=textures.end(); i++)
+    {
+        const std::string ext =
+            StringUtils::toLowerCase(StringUtils::getExtension(*i));
+        if(ext!="png" && ext!="jpg" && ext!="jpeg")
+            continue;
+        const std::string file = dir + *i;
+        if(!file_manager->fileExists(file))
+            continue;
+        // Use the name of the file that irrlicht opens for the texture
+        const io::path path =
+            file_manager->getFileSystem()->getAbsolutePath(file.c_str());
+        loadImage(path.c_str());
+    }
+    m_texture_source = this;
+}   // decodeTextures
+
+// ----------------------------------------------------------------------------
+/** Returns true if an image with this name is queued and not collected
+ *  yet, and the main thread is asking for it (and not running a job
+ *  itself, which must decode the image the normal way).
+ */
+bool AssetLoader::isImageQueued(const std::string &filename) const
+{
+    if(!pthread_equal(pthread_self(), m_main_thread) || m_main_thread_jobs>0)
+        return false;
+    for(unsigned int i=0; i<m_jobs.size(); i++)
+    {
+        if(m_jobs[i]->m_type==JOB_IMAGE && m_jobs[i]->m_filename==filename)
+            return true;
+    }
+    return false;
+}   // isImageQueued
+
+// ----------------------------------------------------------------------------
+/** Waits till the (first) job for the given file is finished, and removes
+ *  it from the list of jobs. If the file was not submitted to the job
+ *  system (or not queued at all), the job is done by the calling thread.
+ *  \return The finished job, which must be deleted by the caller.
+ */
+AssetLoader::FileJob *AssetLoader::waitForJob(JobType type,
+                                              const std::string &filename)
+{
+    unsigned int index = 0;
+    while(index<m_jobs.size() && (m_jobs[index]->m_type!=type ||
+                                  m_jobs[index]->m_filename!=filename))
+        index++;
+    FileJob *job;
+    if(index<m_jobs.size())
+    {
+        job = m_jobs[index];
+        m_jobs.erase(m_jobs.begin()+index);
+    }
+    else
+    {
+        job = new FileJob();
+        job->m_loader    = this;
+        job->m_type      = type;
+        job->m_filename  = filename;
+        job->m_xml       = NULL;
+        job->m_image     = NULL;
+        job->m_submitted = false;
+    }
+
+    if(job->m_submitted)
+        JobSystem::get()->wait(job);
+    else
+        runJob(job);
+    return job;
+}   // waitForJob
+
+// ----------------------------------------------------------------------------
+/** Returns the parsed XML file. If the file was not queued with loadXML()
+ *  it is loaded now.
+ *  \return The XML tree, which must be deleted by the caller, or NULL if
+ *          the file could not be read or parsed.
+ */
+XMLNode *AssetLoader::getXML(const std::string &filename)
+{
+    FileJob *job = waitForJob(JOB_XML, filename);
+    XMLNode *xml = job->m_xml;
+    delete job;
+    return xml;
+}   // getXML
+
+// ----------------------------------------------------------------------------
+/** Returns the texture for an image file. The decoded image is uploaded in
+ *  the main thread using the same name that irrlicht would use when loading
+ *  the texture, so that later calls to IrrDriver::getTexture() for this file
+ *  return this texture. If the texture already exists it is returned. If
+ *  the image could not be decoded, the texture is loaded the normal way
+ *  (which also prints the usual error messages).
+ *  \param filename Name of the image file.
+ */
+video::ITexture *AssetLoader::getTexture(const std::string &filename)
+{
+    FileJob *job = waitForJob(JOB_IMAGE, filename);
+    video::IImage *image = job->m_image;
+    delete job;
+
+    const double start = getTimeMilliseconds();
+    video::ITexture *texture = NULL;
+    if(image)
+    {
+        video::IVideoDriver *driver = irr_driver->getVideoDriver();
+        const io::path path =
+            file_manager->getFileSystem()->getAbsolutePath(filename.c_str());
+        texture = driver->findTexture(path);
+        if(!texture)
+            texture = driver->addTexture(path, image);
+        image->drop();
+    }
+    if(!texture)
+        texture = irr_driver->getTexture(filename);
+    addStageTime(STAGE_UPLOAD, getTimeMilliseconds()-start);
+    return texture;
+}   // getTexture
+
+// ----------------------------------------------------------------------------
+/** Adds time spent in a stage, e.g. for work in the main thread that is
+ *  not done by the loader itself.
+ *  \param stage The stage.
+ *  \param ms The time in milliseconds.
+ */
+void AssetLoader::addStageTime(Stage stage, double ms)
+{
+    pthread_mutex_lock(&m_mutex);
+    m_stage_time[stage] += ms;
+    pthread_mutex_unlock(&m_mutex);
+}   // addStageTime
+
+// ----------------------------------------------------------------------------
+/** Prints the total time since this loader was created, and the time spent
+ *  in each stage. The job stages are summed over all threads, so they can
+ *  be larger than the total time.
+ */
+void AssetLoader::printStatistics() const
+{
+    int num_threads = 1;
+    if(UserConfigParams::m_threaded_loading && JobSystem::get())
+        num_threads += JobSystem::get()->getNumWorkers();
+    pthread_mutex_lock(&m_mutex);
+    Log::info("AssetLoader", "%s: %.1f ms with %d threads. Read %.1f ms, "
+              "parse %.1f ms, decode %.1f ms, upload %.1f ms, "
+              "models %.1f ms, physics %.1f ms.", m_name.c_str(),
+              getTimeMilliseconds()-m_start_time, num_threads,
+              m_stage_time[STAGE_READ],   m_stage_time[STAGE_PARSE],
+              m_stage_time[STAGE_DECODE], m_stage_time[STAGE_UPLOAD],
+              m_stage_time[STAGE_MODELS], m_stage_time[STAGE_PHYSICS]);
+    pthread_mutex_unlock(&m_mutex);
+}   // printStatistics
@@ -0,0 +1,132 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_ASSET_LOADER_HPP
+#define HEADER_ASSET_LOADER_HPP
+
+#include "utils/job_system.hpp"
+#include "utils/no_copy.hpp"
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace irr
+{
+    namespace io    { class IReadFile; }
+    namespace video { class IImage; class ITexture; }
+}
+using namespace irr;
+
+class XMLNode;
+
+/**
+ * \brief Reads, parses and decodes files with the job system while loading.
+ * The files that will be needed are announced with loadXML() and
+ * loadImage(), which submits a job for each file. The results are then
+ * collected in the main thread with getXML() and getTexture(). File reads,
+ * XML parsing and image decoding are done by the jobs, while creating the
+ * texture (i.e. the GPU upload) is done in the main thread. While waiting
+ * for a result, the main thread runs queued jobs itself, so the loader
+ * also works without worker threads.
+ * Textures that are loaded by irrlicht itself (e.g. by the mesh loaders)
+ * can be decoded ahead with decodeTextures(): the images that the models
+ * of a scene use are decoded by jobs, and an image loader that is
+ * registered with the video driver hands the decoded image to irrlicht
+ * when the main thread loads such a texture.
+ * The time spent in each stage is collected and can be printed, together
+ * with any time spent in other (main thread) stages that is added using
+ * addStageTime().
+ * \ingroup io
+ */
+class AssetLoader : public NoCopy
+{
+public:
+    /** The stages of loading, used for the timing statistics. Read, parse
+     *  and decode are done on the worker threads. */
+    enum Stage { STAGE_READ, STAGE_PARSE, STAGE_DECODE, STAGE_UPLOAD,
+                 STAGE_MODELS, STAGE_PHYSICS, STAGE_COUNT };
+
+private:
+    enum JobType { JOB_XML, JOB_IMAGE };
+
+    class ImageSource;
+    friend class ImageSource;
+
+    /** A file to load. */
+    class FileJob : public Job
+    {
+    public:
+        AssetLoader   *m_loader;
+        JobType        m_type;
+        std::string    m_filename;
+        /** The parsed file for XML jobs, or NULL if it could not be read. */
+        XMLNode       *m_xml;
+        /** The decoded image for image jobs, or NULL. */
+        video::IImage *m_image;
+        /** Set if the job was submitted to the job system. */
+        bool           m_submitted;
+        virtual void run() { m_loader->runJob(this); }
+    };   // FileJob
+
+    /** Name used when printing the statistics. */
+    std::string           m_name;
+
+    /** All jobs that were not collected yet, in the order in which they
+     *  were added. Only used by the main thread. */
+    std::vector<FileJob*> m_jobs;
+
+    /** Protects the statistics. */
+    mutable pthread_mutex_t m_mutex;
+
+    /** Time spent in each stage in ms (summed over all threads). */
+    double              m_stage_time[STAGE_COUNT];
+
+    /** Time at which this loader was created in ms. */
+    double              m_start_time;
+
+    /** The thread that created this loader, i.e. the main thread. */
+    pthread_t           m_main_thread;
+
+    /** Number of jobs the main thread is running itself (while waiting
+     *  for another job). Only accessed by the main thread. */
+    static int          m_main_thread_jobs;
+
+    /** The loader whose decoded images are used when irrlicht loads a
+     *  texture, see decodeTextures(). */
+    static AssetLoader *m_texture_source;
+
+    void     addJob(JobType type, const std::string &filename);
+    void     runJob(FileJob *job);
+    FileJob *waitForJob(JobType type, const std::string &filename);
+    bool     isImageQueued(const std::string &filename) const;
+
+public:
+         AssetLoader(const std::string &name);
+        ~AssetLoader();
+    void loadXML(const std::string &filename);
+    void loadImage(const std::string &filename);
+    void decodeTextures(const XMLNode &scene, const std::string &dir);
+    XMLNode         *getXML(const std::string &filename);
+    video::ITexture *getTexture(const std::string &filename);
+    void addStageTime(Stage stage, double ms);
+    void printStatistics() const;
+    static io::IReadFile *readFile(const std::string &filename);
+};   // AssetLoader
+
+#endif
@@ -0,0 +1,169 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "io/stream_writer.hpp"
+
+#include "utils/log.hpp"
+
+/** The thread is woken up once this many bytes are waiting. */
+static const size_t WRITE_BLOCK_SIZE = 16*1024;
+
+// ----------------------------------------------------------------------------
+StreamWriter::StreamWriter()
+{
+    m_file            = NULL;
+    m_busy            = false;
+    m_stop            = false;
+    m_flush_requested = false;
+    m_bytes_written   = 0;
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond_data, NULL);
+    pthread_cond_init(&m_cond_written, NULL);
+}   // StreamWriter
+
+// ----------------------------------------------------------------------------
+StreamWriter::~StreamWriter()
+{
+    close();
+    pthread_cond_destroy(&m_cond_written);
+    pthread_cond_destroy(&m_cond_data);
+    pthread_mutex_destroy(&m_mutex);
+}   // ~StreamWriter
+
+// ----------------------------------------------------------------------------
+/** Creates (or truncates) the file and starts the writer thread. A file
+ *  that is still open is closed first.
+ *  \param filename Name of the file.
+ *  \return True if the file could be opened.
+ */
+bool StreamWriter::open(const std::string &filename)
+{
+    close();
+    m_file = fopen(filename.c_str(), "wb");
+    if(!m_file)
+        return false;
+    m_filename        = filename;
+    m_stop            = false;
+    m_flush_requested = false;
+    m_bytes_written   = 0;
+    m_pending.clear();
+    if(pthread_create(&m_thread, NULL, &StreamWriter::mainLoop, this)!=0)
+    {
+        Log::error("StreamWriter", "Could not create thread for '%s'.",
+                   filename.c_str());
+        fclose(m_file);
+        m_file = NULL;
+        return false;
+    }
+    return true;
+}   // open
+
+// ----------------------------------------------------------------------------
+/** Adds data to the end of the file. The data is only copied, the actual
+ *  writing is done by the writer thread.
+ *  \param data Pointer to the data.
+ *  \param size Number of bytes.
+ */
+void StreamWriter::append(const void *data, size_t size)
+{
+    if(!m_file) return;
+    pthread_mutex_lock(&m_mutex);
+    m_pending.insert(m_pending.end(), (const char*)data,
+                     (const char*)data+size);
+    if(m_pending.size()>=WRITE_BLOCK_SIZE)
+        pthread_cond_signal(&m_cond_data);
+    pthread_mutex_unlock(&m_mutex);
+}   // append
+
+// ----------------------------------------------------------------------------
+/** Waits till all data appended so far has been written to the file.
+ */
+void StreamWriter::flush()
+{
+    if(!m_file) return;
+    pthread_mutex_lock(&m_mutex);
+    m_flush_requested = true;
+    pthread_cond_signal(&m_cond_data);
+    while(m_busy || !m_pending.empty())
+        pthread_cond_wait(&m_cond_written, &m_mutex);
+    m_flush_requested = false;
+    pthread_mutex_unlock(&m_mutex);
+    fflush(m_file);
+}   // flush
+
+// ----------------------------------------------------------------------------
+/** Writes all remaining data, stops the thread and closes the file.
+ */
+void StreamWriter::close()
+{
+    if(!m_file) return;
+    pthread_mutex_lock(&m_mutex);
+    m_stop = true;
+    pthread_cond_signal(&m_cond_data);
+    pthread_mutex_unlock(&m_mutex);
+    pthread_join(m_thread, NULL);
+    fclose(m_file);
+    m_file = NULL;
+    Log::verbose("StreamWriter", "Wrote %lu bytes to '%s'.",
+                 (unsigned long)m_bytes_written, m_filename.c_str());
+}   // close
+
+// ----------------------------------------------------------------------------
+/** The writer thread: waits for enough data (or a flush or stop request),
+ *  and writes the data without holding the lock.
+ *  \param obj Pointer to the StreamWriter.
+ */
+void *StreamWriter::mainLoop(void *obj)
+{
+    StreamWriter *me = (StreamWriter*)obj;
+    pthread_mutex_lock(&me->m_mutex);
+    while(true)
+    {
+        while(!me->m_stop && !me->m_flush_requested &&
+              me->m_pending.size()<WRITE_BLOCK_SIZE)
+            pthread_cond_wait(&me->m_cond_data, &me->m_mutex);
+
+        if(me->m_pending.empty())
+        {
+            pthread_cond_broadcast(&me->m_cond_written);
+            if(me->m_stop) break;
+            // A flush with nothing to write: wait till flush() resets
+            // the flag, otherwise this would spin.
+            pthread_cond_wait(&me->m_cond_data, &me->m_mutex);
+            continue;
+        }
+
+        me->m_writing.swap(me->m_pending);
+        me->m_busy = true;
+        pthread_mutex_unlock(&me->m_mutex);
+
+        size_t n = fwrite(&me->m_writing[0], 1, me->m_writing.size(),
+                          me->m_file);
+        if(n!=me->m_writing.size())
+            Log::error("StreamWriter", "Could not write to '%s'.",
+                       me->m_filename.c_str());
+        me->m_bytes_written += n;
+        me->m_writing.clear();
+
+        pthread_mutex_lock(&me->m_mutex);
+        me->m_busy = false;
+        pthread_cond_broadcast(&me->m_cond_written);
+    }   // while true
+    pthread_mutex_unlock(&me->m_mutex);
+    return NULL;
+}   // mainLoop
@@ -0,0 +1,91 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_STREAM_WRITER_HPP
+#define HEADER_STREAM_WRITER_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Appends binary data to a file from a background thread.
+ * The data is collected in memory, and written by a separate thread once
+ * enough data is available (or flush() is called), so that the caller
+ * (e.g. the main loop recording a race) is never blocked by disk I/O.
+ * \ingroup io
+ */
+class StreamWriter : public NoCopy
+{
+private:
+    /** The file written to, NULL if no file is open. */
+    FILE             *m_file;
+
+    /** Name of the file. */
+    std::string       m_filename;
+
+    /** Data that still needs to be written. */
+    std::vector<char> m_pending;
+
+    /** The data currently written by the thread. Kept as a member so that
+     *  its memory can be reused. */
+    std::vector<char> m_writing;
+
+    /** True while the thread is writing m_writing. */
+    bool              m_busy;
+
+    /** Set to stop the thread. */
+    bool              m_stop;
+
+    /** Set by flush() to write the pending data even if it is small. */
+    bool              m_flush_requested;
+
+    /** Total number of bytes written to the file. */
+    size_t            m_bytes_written;
+
+    pthread_t         m_thread;
+    pthread_mutex_t   m_mutex;
+
+    /** Signalled when there is data to write (or the thread must stop). */
+    pthread_cond_t    m_cond_data;
+
+    /** Signalled when the thread has finished writing a block. */
+    pthread_cond_t    m_cond_written;
+
+    static void *mainLoop(void *obj);
+
+public:
+         StreamWriter();
+        ~StreamWriter();
+    bool open(const std::string &filename);
+    void append(const void *data, size_t size);
+    void flush();
+    void close();
+
+    // ------------------------------------------------------------------------
+    /** Returns true if a file is open. */
+    bool isOpen() const { return m_file!=NULL; }
+    // ------------------------------------------------------------------------
+    /** Returns the name of the file. */
+    const std::string &getFilename() const { return m_filename; }
+};   // StreamWriter
+
+#endif
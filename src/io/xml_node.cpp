@@ -24,9 +24,13 @@
 
 #include <stdexcept>
 
-XMLNode::XMLNode(io::IXMLReader *xml)
+/** Reads XML data from a reader and converts it into a XMLNode tree.
+ *  \param xml The reader to use.
+ *  \param filename Name of the file, only used in error messages.
+ */
+XMLNode::XMLNode(io::IXMLReader *xml, const std::string &filename)
 {
-    m_file_name = "[unknown]";
+    m_file_name = filename;
 
     while(xml->getNodeType()!=io::EXN_ELEMENT && xml->read());
     readXML(xml);
@@ -59,7 +59,8 @@ private:
 
 public:
          LEAK_CHECK();
-         XMLNode(io::IXMLReader *xml);
+         XMLNode(io::IXMLReader *xml,
+                 const std::string &filename="[unknown]");
 
          /** \throw runtime_error if the file is not found */
          XMLNode(const std::string &filename);
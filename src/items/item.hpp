@@ -269,6 +269,9 @@ public:
     /** Returns the XYZ position of the item. */
     const Vec3&   getXYZ() const { return m_xyz; }
     // ------------------------------------------------------------------------
+    /** Returns the square of the distance at which this item is hit. */
+    float         getDistance2() const { return m_distance_2; }
+    // ------------------------------------------------------------------------
     /** Returns the index of the graph node this item is on. */
     int           getGraphNode() const { return m_graph_node; }
     // ------------------------------------------------------------------------
@@ -18,6 +18,8 @@
 
 #include "items/item_manager.hpp"
 
+#include <algorithm>
+#include <math.h>
 #include <stdexcept>
 #include <string>
 #include <sstream>
@@ -43,6 +45,15 @@ std::vector<scene::IMesh *> ItemManager::m_item_lowres_mesh;
 std::vector<video::SColorf> ItemManager::m_glow_color;
 ItemManager *               ItemManager::m_item_manager = NULL;
 
+/** Size of a cell of the item grid used for collision detection. */
+static const float        ITEM_GRID_CELL_SIZE = 4.0f;
+
+/** Number of buckets the grid cells are hashed into. */
+static const unsigned int ITEM_GRID_BUCKETS   = 1024;
+
+/** Items that would be stored in more grid cells than this are instead
+ *  tested against each kart. */
+static const int          ITEM_GRID_MAX_CELLS = 16;
 
 //-----------------------------------------------------------------------------
 /** Creates one instance of the item manager. */
@@ -145,6 +156,7 @@ void ItemManager::removeTextures()
 ItemManager::ItemManager()
 {
     m_switch_time = -1.0f;
+    m_item_grid.resize(ITEM_GRID_BUCKETS);
     // The actual loading is done in loadDefaultItems
 
     // Prepare the switch to array, which stores which item should be
@@ -231,8 +243,81 @@ void ItemManager::insertItem(Item *item)
         else  // otherwise store it in the 'outside' index
             (*m_items_in_quads)[m_items_in_quads->size()-1].push_back(item);
     }   // if m_items_in_quads
+
+    addToGrid(item);
 }   // insertItem
 
+//-----------------------------------------------------------------------------
+/** Computes the range of grid cells that are overlapped by the hit distance
+ *  of an item on the x/z plane.
+ */
+void ItemManager::getGridCells(const Item *item, int *min_x, int *min_z,
+                               int *max_x, int *max_z) const
+{
+    const Vec3 &xyz = item->getXYZ();
+    const float r   = sqrtf(item->getDistance2());
+    *min_x = (int)floorf((xyz.getX()-r)/ITEM_GRID_CELL_SIZE);
+    *max_x = (int)floorf((xyz.getX()+r)/ITEM_GRID_CELL_SIZE);
+    *min_z = (int)floorf((xyz.getZ()-r)/ITEM_GRID_CELL_SIZE);
+    *max_z = (int)floorf((xyz.getZ()+r)/ITEM_GRID_CELL_SIZE);
+}   // getGridCells
+
+//-----------------------------------------------------------------------------
+/** Adds an item to all grid cells it can be hit from, or to the list of
+ *  large items if it would cover too many cells.
+ */
+void ItemManager::addToGrid(Item *item)
+{
+    int min_x, min_z, max_x, max_z;
+    getGridCells(item, &min_x, &min_z, &max_x, &max_z);
+    if((max_x-min_x+1)*(max_z-min_z+1) > ITEM_GRID_MAX_CELLS)
+    {
+        m_large_items.push_back(item);
+        return;
+    }
+
+    for(int x=min_x; x<=max_x; x++)
+    {
+        for(int z=min_z; z<=max_z; z++)
+        {
+            AllItemTypes &bucket = m_item_grid[getGridBucket(x, z)];
+            // Two cells of the same item can be hashed into the same bucket
+            if(std::find(bucket.begin(), bucket.end(), item)==bucket.end())
+                bucket.push_back(item);
+        }
+    }
+}   // addToGrid
+
+//-----------------------------------------------------------------------------
+/** Removes an item from the grid (or the list of large items).
+ */
+void ItemManager::removeFromGrid(Item *item)
+{
+    int min_x, min_z, max_x, max_z;
+    getGridCells(item, &min_x, &min_z, &max_x, &max_z);
+    if((max_x-min_x+1)*(max_z-min_z+1) > ITEM_GRID_MAX_CELLS)
+    {
+        AllItemTypes::iterator it = std::find(m_large_items.begin(),
+                                              m_large_items.end(), item);
+        assert(it!=m_large_items.end());
+        m_large_items.erase(it);
+        return;
+    }
+
+    for(int x=min_x; x<=max_x; x++)
+    {
+        for(int z=min_z; z<=max_z; z++)
+        {
+            AllItemTypes &bucket = m_item_grid[getGridBucket(x, z)];
+            AllItemTypes::iterator it = std::find(bucket.begin(),
+                                                  bucket.end(), item);
+            // Not found if this bucket was already handled for another cell
+            if(it!=bucket.end())
+                bucket.erase(it);
+        }
+    }
+}   // removeFromGrid
+
 //-----------------------------------------------------------------------------
 /** Creates a new item.
  *  \param type Type of the item.
@@ -293,6 +378,13 @@ void ItemManager::collectedItem(Item *item, AbstractKart *kart, int add_info)
     kart->collectedItem(item, add_info);
 }   // collectedItem
 
+//-----------------------------------------------------------------------------
+/** Used to sort items by their index in m_all_items. */
+static bool compareItemId(const Item *a, const Item *b)
+{
+    return a->getItemId() < b->getItemId();
+}   // compareItemId
+
 //-----------------------------------------------------------------------------
 /** Checks if any item was collected by the given kart. This function calls
  *  collectedItem if an item was collected.
@@ -300,33 +392,43 @@ void ItemManager::collectedItem(Item *item, AbstractKart *kart, int add_info)
  */
 void  ItemManager::checkItemHit(AbstractKart* kart)
 {
-    // We could use m_items_in_quads to to check for item hits: take the quad
-    // of the graph node of the kart, and only check items in that quad. But
-    // then we also need to check for any adjacent quads (since an item just
-    // on the order of one quad might get hit from an adjacent quad). Then
-    // it is possible that a quad is that short that we need to test adjacent
-    // of adjacent quads. And check for items outside of the track.
-    // Since at this stace item detection is by far not a bottle neck,
-    // the original, simple and stable algorithm is left in place.
-
-    for(AllItemTypes::iterator i =m_all_items.begin();
-        i!=m_all_items.end();  i++)
+    // Only the items in the grid cell of the kart (each item is stored in
+    // all cells from which it can be hit) and the large items need to be
+    // tested. Note that a bucket can also contain items of other cells that
+    // are hashed to the same bucket, which are rejected by hitKart.
+    const Vec3 &xyz = kart->getXYZ();
+    const int cell_x = (int)floorf(xyz.getX()/ITEM_GRID_CELL_SIZE);
+    const int cell_z = (int)floorf(xyz.getZ()/ITEM_GRID_CELL_SIZE);
+    const AllItemTypes &bucket = m_item_grid[getGridBucket(cell_x, cell_z)];
+
+    m_hit_items.clear();
+    for(unsigned int n=0; n<bucket.size()+m_large_items.size(); n++)
     {
-        if((!*i) || (*i)->wasCollected()) continue;
+        Item *item = n<bucket.size() ? bucket[n]
+                                     : m_large_items[n-bucket.size()];
+        if(item->wasCollected()) continue;
         // To allow inlining and avoid including kart.hpp in item.hpp,
         // we pass the kart and the position separately.
-        if((*i)->hitKart(kart->getXYZ(), kart))
+        if(item->hitKart(xyz, kart))
+            m_hit_items.push_back(item);
+    }   // for n
+
+    // Collect the items in the same order as a test of all items would,
+    // since e.g. the powerup a kart gets depends on that order.
+    if(m_hit_items.size()>1)
+        std::sort(m_hit_items.begin(), m_hit_items.end(), compareItemId);
+
+    for(unsigned int i=0; i<m_hit_items.size(); i++)
+    {
+        // if we're not playing online, pick the item.
+        if (!NetworkWorld::getInstance()->isRunning())
+            collectedItem(m_hit_items[i], kart);
+        else if (NetworkManager::getInstance()->isServer())
         {
-            // if we're not playing online, pick the item.
-            if (!NetworkWorld::getInstance()->isRunning())
-                collectedItem(*i, kart);
-            else if (NetworkManager::getInstance()->isServer())
-            {
-                collectedItem(*i, kart);
-                NetworkWorld::getInstance()->collectedItem(*i, kart);
-            }
-        }   // if hit
-    }   // for m_all_items
+            collectedItem(m_hit_items[i], kart);
+            NetworkWorld::getInstance()->collectedItem(m_hit_items[i], kart);
+        }
+    }   // for i in m_hit_items
 }   // checkItemHit
 
 //-----------------------------------------------------------------------------
@@ -409,8 +511,8 @@ void ItemManager::update(float dt)
 }   // update
 
 //-----------------------------------------------------------------------------
-/** Removes an items from the items-in-quad list, from the list of all
- *  items, and then frees the item itself.
+/** Removes an items from the items-in-quad list, from the item grid, from
+ *  the list of all items, and then frees the item itself.
  *  \param The item to delete.
  */
 void ItemManager::deleteItem(Item *item)
@@ -430,6 +532,8 @@ void ItemManager::deleteItem(Item *item)
         items.erase(it);
     }   // if m_items_in_quads
 
+    removeFromGrid(item);
+
     int index = item->getItemId();
     m_all_items[index] = NULL;
     delete item;
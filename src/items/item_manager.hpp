@@ -82,6 +82,21 @@ private:
      *  field is undefined if no QuadGraph exist, e.g. in battle mode. */
     std::vector< AllItemTypes > *m_items_in_quads;
 
+    /** Used by checkItemHit to find the items close to a kart: a uniform
+     *  grid on the x/z plane, where each item is stored in all cells that
+     *  its hit distance overlaps. The (unbounded) cells are hashed into a
+     *  fixed number of buckets, so the grid works for any track or arena
+     *  without knowing its size in advance. */
+    std::vector< AllItemTypes > m_item_grid;
+
+    /** Items with a hit distance so large that they would cover too many
+     *  grid cells (e.g. big trigger items). They are tested for each kart. */
+    AllItemTypes m_large_items;
+
+    /** The items hit by a kart in checkItemHit, kept to avoid allocating
+     *  memory in each frame. */
+    AllItemTypes m_hit_items;
+
     /** What item this item is switched to. */
     std::vector<Item::ItemType> m_switch_to;
 
@@ -91,6 +106,18 @@ private:
 
     void  insertItem(Item *item);
     void  deleteItem(Item *item);
+    void  getGridCells(const Item *item, int *min_x, int *min_z,
+                       int *max_x, int *max_z) const;
+    void  addToGrid(Item *item);
+    void  removeFromGrid(Item *item);
+    // ------------------------------------------------------------------------
+    /** Returns the index of the bucket in m_item_grid in which the grid
+     *  cell with the given coordinates is stored. */
+    unsigned int getGridBucket(int cell_x, int cell_z) const
+    {
+        return ( (unsigned int)cell_x*73856093u
+               ^ (unsigned int)cell_z*19349663u ) % m_item_grid.size();
+    }   // getGridBucket
 
     // Make those private so only create/destroy functions can call them.
                    ItemManager();
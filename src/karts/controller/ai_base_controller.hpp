@@ -85,7 +85,6 @@ protected:
     virtual void setSteering   (float angle, float dt);
     float    steerToAngle  (const unsigned int sector, const float angle);
     float    steerToPoint  (const Vec3 &point);
-    float    normalizeAngle(float angle);
     void     computePath();
     virtual bool doSkid(float steer_fraction);
     // ------------------------------------------------------------------------
@@ -115,6 +114,7 @@ public:
     virtual void action(PlayerAction action, int value) {};
     virtual void  skidBonusTriggered() {};
     virtual bool  disableSlipstreamBonus() const;
+    static float  normalizeAngle(float angle);
 };   // AIBaseController
 
 #endif
@@ -0,0 +1,385 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "karts/controller/ai_lookahead_table.hpp"
+
+#include "karts/controller/ai_base_controller.hpp"
+#include "tracks/quad_graph.hpp"
+#include "utils/job_system.hpp"
+#include "utils/log.hpp"
+#include "utils/time.hpp"
+#include "utils/vec3.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+AILookaheadTable *AILookaheadTable::m_ai_lookahead_table = NULL;
+bool              AILookaheadTable::m_check              = false;
+
+// ----------------------------------------------------------------------------
+/** Creates the table for the current quad graph.
+ *  \param kart_length, kart_width The size of the karts. Using the shortest
+ *         length and the biggest width of all karts gives a table that
+ *         rarely needs to fall back to the complete search.
+ */
+void AILookaheadTable::create(float kart_length, float kart_width)
+{
+    assert(!m_ai_lookahead_table);
+    if(!QuadGraph::get() || QuadGraph::get()->getNumNodes()==0)
+        return;
+    m_ai_lookahead_table = new AILookaheadTable(kart_length, kart_width);
+    if(m_check)
+        m_ai_lookahead_table->check();
+}   // create
+
+// ----------------------------------------------------------------------------
+void AILookaheadTable::destroy()
+{
+    delete m_ai_lookahead_table;
+    m_ai_lookahead_table = NULL;
+}   // destroy
+
+// ----------------------------------------------------------------------------
+AILookaheadTable::AILookaheadTable(float kart_length, float kart_width)
+{
+    m_kart_length = kart_length;
+    m_kart_width  = kart_width;
+
+    const QuadGraph *qg = QuadGraph::get();
+    const unsigned int num_nodes = qg->getNumNodes();
+    m_next.resize(num_nodes);
+    m_successor.resize(num_nodes, 0);
+    for(unsigned int i=0; i<num_nodes; i++)
+        m_next[i] = qg->getNode(i).getSuccessor(0);
+    m_left.resize(num_nodes);
+    m_right.resize(num_nodes);
+    m_steps.resize(num_nodes*NUM_OFFSETS*LOOKAHEAD_COUNT);
+
+    double start = StkTime::getRealTime();
+    ComputeNodes compute;
+    compute.m_table = this;
+    JobSystem::parallelFor(0, (int)num_nodes, &compute);
+    Log::info("AILookaheadTable", "Computed %d nodes in %f s.", num_nodes,
+              StkTime::getRealTime() - start);
+}   // AILookaheadTable
+
+// ----------------------------------------------------------------------------
+void AILookaheadTable::ComputeNodes::operator()(int begin, int end)
+{
+    for(int i=begin; i<end; i++)
+        m_table->computeNode(i);
+}   // ComputeNodes::operator()
+
+// ----------------------------------------------------------------------------
+/** Computes the table entries of one node. Each lateral position is tested
+ *  at the lower and upper end of the quad, and the smaller result is used,
+ *  so that the entry is valid for most of the quad.
+ *  \param node The graph node.
+ */
+void AILookaheadTable::computeNode(int node)
+{
+    const QuadGraph *qg = QuadGraph::get();
+    const Quad &quad    = qg->getQuadOfNode(node);
+    Vec3 track_coord;
+    qg->spatialToTrack(&track_coord, (quad[0]+quad[3])*0.5f, node);
+    m_left[node] = track_coord.getX();
+    qg->spatialToTrack(&track_coord, (quad[1]+quad[2])*0.5f, node);
+    m_right[node] = track_coord.getX();
+
+    for(int offset=0; offset<NUM_OFFSETS; offset++)
+    {
+        const float f = (offset+0.5f)/NUM_OFFSETS;
+        const Vec3 lower = quad[0] + (quad[1]-quad[0])*f;
+        const Vec3 upper = quad[3] + (quad[2]-quad[3])*f;
+        for(int a=0; a<LOOKAHEAD_COUNT; a++)
+        {
+            Vec3 aim_position;
+            int  last_node;
+            unsigned int steps_lower =
+                findNonCrashingPoint((Algorithm)a, lower, node, m_next,
+                                     m_successor, m_kart_length, m_kart_width,
+                                     0, &aim_position, &last_node);
+            unsigned int steps_upper =
+                findNonCrashingPoint((Algorithm)a, upper, node, m_next,
+                                     m_successor, m_kart_length, m_kart_width,
+                                     0, &aim_position, &last_node);
+            m_steps[getIndex((Algorithm)a, node, offset)] =
+                (unsigned char)std::min(steps_lower, steps_upper);
+        }
+    }   // for offset
+}   // computeNode
+
+// ----------------------------------------------------------------------------
+/** Compares the search with the table to the complete search, for a grid
+ *  of positions on each node that is finer than the one of the table (and
+ *  includes positions between those used to compute the table). For each
+ *  position that the table has an entry for, the aim nodes and aim
+ *  positions of both searches are compared, and the number of positions
+ *  with a different result and the largest distance between the aim
+ *  positions are printed.
+ */
+void AILookaheadTable::check() const
+{
+    const QuadGraph *qg = QuadGraph::get();
+    unsigned int tested[LOOKAHEAD_COUNT]    = { 0 };
+    unsigned int different[LOOKAHEAD_COUNT] = { 0 };
+    float max_distance[LOOKAHEAD_COUNT]     = { 0 };
+    for(unsigned int node=0; node<m_left.size(); node++)
+    {
+        const Quad &quad = qg->getQuadOfNode(node);
+        for(int offset=0; offset<NUM_CHECK_OFFSETS; offset++)
+        {
+            const float f = (offset+0.5f)/NUM_CHECK_OFFSETS;
+            const Vec3 lower = quad[0] + (quad[1]-quad[0])*f;
+            const Vec3 upper = quad[3] + (quad[2]-quad[3])*f;
+            for(int row=0; row<NUM_CHECK_ROWS; row++)
+            {
+                const Vec3 xyz =
+                    lower + (upper-lower)*((row+0.5f)/NUM_CHECK_ROWS);
+                for(int a=0; a<LOOKAHEAD_COUNT; a++)
+                {
+                    const unsigned int known =
+                        getKnownSteps((Algorithm)a, node, xyz);
+                    if(known==0)
+                        continue;
+                    Vec3 aim_table, aim_full;
+                    int  node_table, node_full;
+                    findNonCrashingPoint((Algorithm)a, xyz, node, m_next,
+                                         m_successor, m_kart_length,
+                                         m_kart_width, known, &aim_table,
+                                         &node_table);
+                    findNonCrashingPoint((Algorithm)a, xyz, node, m_next,
+                                         m_successor, m_kart_length,
+                                         m_kart_width, 0, &aim_full,
+                                         &node_full);
+                    tested[a]++;
+                    if(node_table==node_full)
+                        continue;
+                    different[a]++;
+                    max_distance[a] = std::max(max_distance[a],
+                                               (aim_table-aim_full).length());
+                }
+            }   // for row
+        }   // for offset
+    }   // for node
+
+    const char *names[LOOKAHEAD_COUNT] = { "default", "fixed" };
+    for(int a=0; a<LOOKAHEAD_COUNT; a++)
+    {
+        Log::info("AILookaheadTable", "Check (%s): %u of %u positions aim "
+                  "at a different node (%.1f%%), up to %.1f m away.",
+                  names[a], different[a], tested[a],
+                  tested[a] ? 100.0f*different[a]/tested[a] : 0.0f,
+                  max_distance[a]);
+    }
+}   // check
+
+// ----------------------------------------------------------------------------
+/** Returns the number of nodes that can be skipped by findNonCrashingPoint()
+ *  for a kart on the given node.
+ *  \param algorithm The variant of the search.
+ *  \param node The graph node the kart is on.
+ *  \param xyz Position of the kart.
+ */
+unsigned int AILookaheadTable::getKnownSteps(Algorithm algorithm, int node,
+                                             const Vec3 &xyz) const
+{
+    if(node<0 || node>=(int)m_left.size())
+        return 0;
+    Vec3 track_coord;
+    QuadGraph::get()->spatialToTrack(&track_coord, xyz, node);
+    const int offset = getOffset(track_coord.getX(), m_left[node],
+                                 m_right[node]);
+    if(offset<0)
+        return 0;
+    return m_steps[getIndex(algorithm, node, offset)];
+}   // getKnownSteps
+
+// ----------------------------------------------------------------------------
+/** Returns the lateral position in the table (0 at the left side of the
+ *  node, NUM_OFFSETS-1 at the right side) of a lateral coordinate. The
+ *  track coordinates of the left and right side have opposite signs, and
+ *  which one is positive depends on the driving direction (since reverse
+ *  mode swaps the upper and lower end of the quads), so the signed width
+ *  is used.
+ *  \param x Lateral track coordinate of the kart.
+ *  \param left, right Lateral track coordinates of the sides of the node.
+ *  \return The lateral position, or -1 if the node has no width.
+ */
+int AILookaheadTable::getOffset(float x, float left, float right)
+{
+    const float width = right - left;
+    if(fabsf(width)<0.001f)
+        return -1;
+    int offset = (int)((x-left)/width*NUM_OFFSETS);
+    if(offset<0) offset = 0;
+    else if(offset>=NUM_OFFSETS) offset = NUM_OFFSETS-1;
+    return offset;
+}   // getOffset
+
+// ----------------------------------------------------------------------------
+/** Tests the mapping of lateral coordinates to table positions for both
+ *  driving directions: in one direction the left side of a node has a
+ *  negative lateral coordinate, in the other a positive one.
+ */
+void AILookaheadTable::unitTesting()
+{
+    // A node that is 10 m wide, in both directions
+    const float sides[2][2] = { { -5.0f, 5.0f }, { 5.0f, -5.0f } };
+    for(unsigned int d=0; d<2; d++)
+    {
+        const float left = sides[d][0], right = sides[d][1];
+        for(int offset=0; offset<NUM_OFFSETS; offset++)
+        {
+            // The positions used to compute this entry (see computeNode)
+            const float f = (offset+0.5f)/NUM_OFFSETS;
+            const float x = left + (right-left)*f;
+            assert(getOffset(x, left, right)==offset);
+        }
+        // Positions beyond the sides use the outermost entries
+        assert(getOffset(left  - (right-left), left, right)==0);
+        assert(getOffset(right + (right-left), left, right)==NUM_OFFSETS-1);
+    }
+    assert(getOffset(1.0f, 2.0f, 2.0f)==-1);
+}   // unitTesting
+
+// ----------------------------------------------------------------------------
+/** Finds the furthest node that can be driven to in a straight line without
+ *  leaving the track (see SkiddingAI::findNonCrashingPoint() for the
+ *  details of the two variants). Without known steps the result is the same
+ *  as the original search of the AI.
+ *  \param algorithm The variant of the search.
+ *  \param xyz Position of the kart.
+ *  \param node The graph node the kart is on.
+ *  \param next, successor The path of the kart (see AIBaseController).
+ *  \param kart_length, kart_width Size of the kart.
+ *  \param known_steps Number of nodes that are known to pass the test
+ *         (see getKnownSteps()), 0 to test all nodes.
+ *  \param aim_position On exit contains the point to aim at.
+ *  \param last_node On exit contains the graph node of the aim position.
+ *  \return The number of nodes that passed the test.
+ */
+unsigned int AILookaheadTable::findNonCrashingPoint(Algorithm algorithm,
+                                             const Vec3 &xyz, int node,
+                                             const std::vector<int> &next,
+                                             const std::vector<int> &successor,
+                                             float kart_length,
+                                             float kart_width,
+                                             unsigned int known_steps,
+                                             Vec3 *aim_position,
+                                             int *last_node)
+{
+    const QuadGraph *qg = QuadGraph::get();
+    // The table was computed along the first successors only, which
+    // includes the first step from the kart's node
+    if(known_steps>0 && next[node]!=(int)qg->getNode(node).getSuccessor(0))
+        known_steps = 0;
+    *last_node = next[node];
+    float angle = qg->getAngleToNext(node, successor[node]);
+
+    Vec3 direction;
+    Vec3 step_track_coord;
+
+    // The original while(1) loop is replaced with a for loop to avoid
+    // infinite loops (which we had once or twice). Usually the number
+    // of iterations in the while loop is less than 7.
+    for(unsigned int j=0; j<100; j++)
+    {
+        // target_sector is the sector at the longest distance that we can
+        // drive to without crashing with the track.
+        int target_sector = next[*last_node];
+        if(algorithm==LOOKAHEAD_DEFAULT)
+        {
+            float angle1 = qg->getAngleToNext(target_sector,
+                                              successor[target_sector]);
+            // In very sharp turns this algorithm tends to aim at off track
+            // points, resulting in hitting a corner. So test for this
+            // special case and prevent a too-far look-ahead in this case
+            float diff = AIBaseController::normalizeAngle(angle1-angle);
+            if(fabsf(diff)>1.5f)
+            {
+                *aim_position = qg->getQuadOfNode(target_sector).getCenter();
+                return j;
+            }
+            angle = angle1;
+        }
+
+        // The table was computed along the first successors only
+        if(j+1<known_steps)
+        {
+            if(target_sector!=(int)qg->getNode(*last_node).getSuccessor(0))
+                return findNonCrashingPoint(algorithm, xyz, node, next,
+                                            successor, kart_length,
+                                            kart_width, 0, aim_position,
+                                            last_node);
+            *last_node = target_sector;
+            continue;
+        }
+
+        //direction is a vector from our kart to the sectors we are testing
+        direction = qg->getQuadOfNode(target_sector).getCenter() - xyz;
+
+        float len=direction.length_2d();
+        unsigned int steps = (unsigned int)( len / kart_length );
+        if( steps < 3 ) steps = 3;
+
+        // That shouldn't happen, but since we had one instance of
+        // STK hanging, add an upper limit here (usually it's at most
+        // 20 steps)
+        if( steps>1000) steps = 1000;
+
+        // Protection against having vel_normal with nan values
+        if(len>0.0f) {
+            direction*= 1.0f/len;
+        }
+
+        // The original algorithm compares with the full path width
+        // (see SkiddingAI::findNonCrashingPoint)
+        float path_width = qg->getNode(*last_node).getPathWidth();
+        if(algorithm==LOOKAHEAD_FIXED)
+            path_width *= 0.5f;
+
+        Vec3 step_coord;
+        //Test if we crash if we drive towards the target sector
+        for(unsigned int i = 2; i < steps; ++i )
+        {
+            step_coord = xyz+direction*kart_length * float(i);
+
+            qg->spatialToTrack(&step_track_coord, step_coord, *last_node);
+
+            float distance = fabsf(step_track_coord[0]);
+
+            //If we are outside, the previous node is what we are looking for
+            if ( distance + kart_width * 0.5f > path_width )
+            {
+                // The table was wrong for this position, do the full search
+                if(j+1==known_steps)
+                    return findNonCrashingPoint(algorithm, xyz, node, next,
+                                                successor, kart_length,
+                                                kart_width, 0, aim_position,
+                                                last_node);
+                *aim_position = qg->getQuadOfNode(*last_node).getCenter();
+                return j;
+            }
+        }
+        *last_node = target_sector;
+    }   // for j<100
+    *aim_position = qg->getQuadOfNode(*last_node).getCenter();
+    return 100;
+}   // findNonCrashingPoint
@@ -0,0 +1,122 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_AI_LOOKAHEAD_TABLE_HPP
+#define HEADER_AI_LOOKAHEAD_TABLE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <vector>
+
+class Vec3;
+
+/**
+ * \brief A per-track table of how far the AI can look ahead.
+ * The AI searches the furthest graph node it can drive to in a straight
+ * line (see SkiddingAI::findNonCrashingPoint()) by testing points along the
+ * line to each following node, which is by far the most expensive part of
+ * the AI. This table stores, for each graph node and a few lateral
+ * positions on it, how many of the following nodes passed this test. The
+ * AI then only tests the line to the last of these nodes (to verify the
+ * table for its actual position) and continues the search from there. If
+ * the verification fails, or the AI does not follow the first successor of
+ * the nodes, the complete search is done.
+ * The table is computed when a race is started, using the job system.
+ * Since the table is an approximation, check() can compare the aim
+ * positions found with it to the ones of the complete search.
+ * \ingroup controller
+ */
+class AILookaheadTable : public NoCopy
+{
+public:
+    /** The variants of the search (see SkiddingAI). */
+    enum Algorithm { LOOKAHEAD_DEFAULT, LOOKAHEAD_FIXED, LOOKAHEAD_COUNT };
+
+private:
+    static AILookaheadTable *m_ai_lookahead_table;
+
+    /** If the table is checked after it was computed. */
+    static bool              m_check;
+
+    /** Number of lateral positions per graph node. */
+    static const int NUM_OFFSETS = 5;
+
+    /** Number of lateral and longitudinal positions per graph node that
+     *  are tested by check(). */
+    static const int NUM_CHECK_OFFSETS = 9;
+    static const int NUM_CHECK_ROWS    = 3;
+
+    /** The number of nodes that passed the test, for each node, lateral
+     *  position and algorithm. */
+    std::vector<unsigned char> m_steps;
+
+    /** The lateral coordinate (see QuadGraph::spatialToTrack()) of the
+     *  left and right side of each node, i.e. of the side of quad[0] and
+     *  quad[3] and the side of quad[1] and quad[2]. Which one is larger
+     *  depends on the driving direction. */
+    std::vector<float>         m_left, m_right;
+
+    /** The first successor of each node, and the index of this successor
+     *  (i.e. 0), in the format used by the AI. */
+    std::vector<int>           m_next, m_successor;
+
+    /** Kart size used to compute the table. */
+    float                      m_kart_length, m_kart_width;
+
+    /** Computes the table entries for a range of nodes. */
+    struct ComputeNodes
+    {
+        AILookaheadTable *m_table;
+        void operator()(int begin, int end);
+    };   // ComputeNodes
+
+         AILookaheadTable(float kart_length, float kart_width);
+    void computeNode(int node);
+    void check() const;
+    static int getOffset(float x, float left, float right);
+    int  getIndex(Algorithm algorithm, int node, int offset) const
+    {
+        return (node*NUM_OFFSETS + offset)*LOOKAHEAD_COUNT + algorithm;
+    }   // getIndex
+
+public:
+    static void create(float kart_length, float kart_width);
+    static void destroy();
+    // ------------------------------------------------------------------------
+    /** Returns the table, or NULL if it was not created. */
+    static AILookaheadTable *get() { return m_ai_lookahead_table; }
+    // ------------------------------------------------------------------------
+    /** Sets if the table is checked after it was computed (see check()). */
+    static void setCheck(bool check) { m_check = check; }
+    // ------------------------------------------------------------------------
+    static void unitTesting();
+    // ------------------------------------------------------------------------
+    unsigned int getKnownSteps(Algorithm algorithm, int node,
+                               const Vec3 &xyz) const;
+    static unsigned int findNonCrashingPoint(Algorithm algorithm,
+                                             const Vec3 &xyz, int node,
+                                             const std::vector<int> &next,
+                                             const std::vector<int> &successor,
+                                             float kart_length,
+                                             float kart_width,
+                                             unsigned int known_steps,
+                                             Vec3 *aim_position,
+                                             int *last_node);
+};   // AILookaheadTable
+
+#endif
@@ -63,6 +63,12 @@ public:
     virtual      ~Controller         () {};
     virtual void  reset              () = 0;
     virtual void  update             (float dt) = 0;
+    // ---------------------------------------------------------------------------
+    /** Called for all karts before any kart is updated, on several threads
+     *  at the same time. A controller can compute its decisions here, which
+     *  are then used by update(). It must only read the state of the world
+     *  and the karts, and only modify data of this controller. */
+    virtual void  prepareUpdate      (float dt) {}
     virtual void  handleZipper       (bool play_sound) = 0;
     virtual void  collectedItem      (const Item &item, int add_info=-1,
                                       float previous_energy=0) = 0;
@@ -36,6 +36,7 @@
 
 #include "karts/controller/skidding_ai.hpp"
 
+#include "config/user_config.hpp"
 #ifdef AI_DEBUG
 #  include "graphics/irr_driver.hpp"
 #endif
@@ -46,6 +47,7 @@
 #include "items/powerup.hpp"
 #include "items/projectile_manager.hpp"
 #include "karts/abstract_kart.hpp"
+#include "karts/controller/ai_lookahead_table.hpp"
 #include "karts/controller/kart_control.hpp"
 #include "karts/controller/ai_properties.hpp"
 #include "karts/kart_properties.hpp"
@@ -190,6 +192,10 @@ void SkiddingAI::reset()
     m_avoid_item_close           = false;
     m_skid_probability_state     = SKID_PROBAB_NOT_YET;
     m_last_item_random           = NULL;
+    m_decisions_prepared         = false;
+    m_aim_point                  = Vec3(0,0,0);
+    m_aim_node                   = QuadGraph::UNKNOWN_SECTOR;
+    m_aim_point_valid            = false;
 
     AIBaseController::reset();
     m_track_node               = QuadGraph::UNKNOWN_SECTOR;
@@ -235,6 +241,10 @@ unsigned int SkiddingAI::getNextSector(unsigned int index)
  */
 void SkiddingAI::update(float dt)
 {
+    // The decisions of prepareUpdate() are only valid for this update
+    const bool decisions_prepared = m_decisions_prepared;
+    m_decisions_prepared = false;
+
     // This is used to enable firing an item backwards.
     m_controls->m_look_back = false;
     m_controls->m_nitro     = false;
@@ -319,15 +329,14 @@ void SkiddingAI::update(float dt)
         return;
     }
 
-    // Get information that is needed by more than 1 of the handling funcs
-    computeNearestKarts();
+    // Get information that is needed by more than 1 of the handling funcs,
+    // unless it was already computed in prepareUpdate()
+    if(!decisions_prepared)
+        computeDecisions();
 
     m_kart->setSlowdown(MaxSpeed::MS_DECREASE_AI,
                         m_ai_properties->getSpeedCap(m_distance_to_player),
                         /*fade_in_time*/0.0f);
-    //Detect if we are going to crash with the track and/or kart
-    checkCrashes(m_kart->getXYZ());
-    determineTrackDirection();
 
     // Special behaviour if we have a bomb attach: try to hit the kart ahead
     // of us.
@@ -393,6 +402,96 @@ void SkiddingAI::update(float dt)
     AIBaseController::update(dt);
 }   // update
 
+//-----------------------------------------------------------------------------
+/** Computes the data the handling functions are based on: the nearest karts,
+ *  expected crashes, the track direction and the point to aim for. This
+ *  only reads the state of the world and the karts, so it can be called
+ *  for all AI karts in parallel, see prepareUpdate().
+ */
+void SkiddingAI::computeDecisions()
+{
+    computeNearestKarts();
+    //Detect if we are going to crash with the track and/or kart
+    checkCrashes(m_kart->getXYZ());
+    determineTrackDirection();
+
+    // The point selection is the most expensive part of the AI, so it is
+    // only done if handleSteering() will use the aim point. If the state
+    // of the kart changes before update() (e.g. it is hit by an item),
+    // handleSteering() does it itself.
+    m_aim_point_valid = false;
+    if(needsAimPoint())
+        computeAimPoint();
+}   // computeDecisions
+
+//-----------------------------------------------------------------------------
+/** Finds the point to aim for with the selected point selection algorithm.
+ */
+void SkiddingAI::computeAimPoint()
+{
+    m_aim_node = QuadGraph::UNKNOWN_SECTOR;
+    switch(m_point_selection_algorithm)
+    {
+    case PSA_FIXED : findNonCrashingPointFixed(&m_aim_point, &m_aim_node);
+                     break;
+    case PSA_NEW:    findNonCrashingPointNew(&m_aim_point, &m_aim_node);
+                     break;
+    case PSA_DEFAULT:findNonCrashingPoint(&m_aim_point, &m_aim_node);
+                     break;
+    }
+    m_aim_point_valid = true;
+}   // computeAimPoint
+
+//-----------------------------------------------------------------------------
+/** Returns true if the steering will use the aim point, i.e. if the kart
+ *  does not try to hit the kart ahead with a bomb (see update()), and is
+ *  neither outside of the road nor avoiding a kart (see handleSteering()).
+ *  Must be called after checkCrashes() and computeNearestKarts().
+ */
+bool SkiddingAI::needsAimPoint() const
+{
+    if(m_ai_properties->m_handle_bomb &&
+       m_kart->getAttachment()->getType()==Attachment::ATTACH_BOMB &&
+       m_kart_ahead && m_distance_ahead<=10)
+        return false;
+    if(isOutsideOfRoad())
+        return false;
+    return m_crashes.m_kart == -1 || m_crashes.m_road;
+}   // needsAimPoint
+
+//-----------------------------------------------------------------------------
+/** Returns true if the kart is that far away from the center of the road
+ *  that it steers back to the center, see handleSteering().
+ */
+bool SkiddingAI::isOutsideOfRoad() const
+{
+    const float side_dist =
+        m_world->getDistanceToCenterForKart( m_kart->getWorldKartId() );
+    return fabsf(side_dist) >
+        0.5f* QuadGraph::get()->getNode(m_track_node).getPathWidth()+0.5f;
+}   // isOutsideOfRoad
+
+//-----------------------------------------------------------------------------
+/** Called before any kart is updated, possibly on several threads at the
+ *  same time: computes the decisions with the state of all karts after the
+ *  physics step. Since all AI karts see the same state, the result does
+ *  not depend on the order in which the karts are updated or on the
+ *  number of threads. Decisions that change the kart or the world (and
+ *  decisions using random numbers) are made in update().
+ *  \param dt Time step size.
+ */
+void SkiddingAI::prepareUpdate(float dt)
+{
+    if(m_kart->getKartAnimation() || m_world->isStartPhase())
+        return;
+#if defined(AI_DEBUG) || defined(AI_DEBUG_KART_HEADING)
+    // The debug code modifies scene nodes, so it is done in update()
+    return;
+#endif
+    computeDecisions();
+    m_decisions_prepared = true;
+}   // prepareUpdate
+
 //-----------------------------------------------------------------------------
 /** This function decides if the AI should brake.
  *  The decision can be based on race mode (e.g. in follow the leader the AI
@@ -485,11 +584,7 @@ void SkiddingAI::handleSteering(float dt)
      *finite state machine.
      */
     //Reaction to being outside of the road
-    float side_dist =
-        m_world->getDistanceToCenterForKart( m_kart->getWorldKartId() );
-
-    if( fabsf(side_dist)  >
-       0.5f* QuadGraph::get()->getNode(m_track_node).getPathWidth()+0.5f )
+    if( isOutsideOfRoad() )
     {
         steer_angle = steerToPoint(QuadGraph::get()->getQuadOfNode(next)
                                                     .getCenter());
@@ -540,18 +635,12 @@ void SkiddingAI::handleSteering(float dt)
     else
     {
         m_start_kart_crash_direction = 0;
-        Vec3 aim_point;
-        int last_node = QuadGraph::UNKNOWN_SECTOR;
+        // The aim point is usually computed in computeDecisions()
+        if(!m_aim_point_valid)
+            computeAimPoint();
+        Vec3 aim_point = m_aim_point;
+        int last_node  = m_aim_node;
 
-        switch(m_point_selection_algorithm)
-        {
-        case PSA_FIXED : findNonCrashingPointFixed(&aim_point, &last_node);
-                         break;
-        case PSA_NEW:    findNonCrashingPointNew(&aim_point, &last_node);
-                         break;
-        case PSA_DEFAULT:findNonCrashingPoint(&aim_point, &last_node);
-                         break;
-        }
 #ifdef AI_DEBUG
         m_debug_sphere[m_point_selection_algorithm]->setPosition(aim_point.toIrrVector());
 #endif
@@ -1921,62 +2010,8 @@ void SkiddingAI::findNonCrashingPointFixed(Vec3 *aim_position, int *last_node)
     Vec3 forw(0, 0, 50);
     m_curve[CURVE_KART]->addPoint(m_kart->getTrans()(forw)+eps);
 #endif
-    *last_node = m_next_node_index[m_track_node];
-    int target_sector;
-
-    Vec3 direction;
-    Vec3 step_track_coord;
-
-    // The original while(1) loop is replaced with a for loop to avoid
-    // infinite loops (which we had once or twice). Usually the number
-    // of iterations in the while loop is less than 7.
-    for(unsigned int j=0; j<100; j++)
-    {
-        // target_sector is the sector at the longest distance that we can
-        // drive to without crashing with the track.
-        target_sector = m_next_node_index[*last_node];
-
-        //direction is a vector from our kart to the sectors we are testing
-        direction = QuadGraph::get()->getQuadOfNode(target_sector).getCenter()
-                  - m_kart->getXYZ();
-
-        float len=direction.length_2d();
-        unsigned int steps = (unsigned int)( len / m_kart_length );
-        if( steps < 3 ) steps = 3;
-
-        // That shouldn't happen, but since we had one instance of
-        // STK hanging, add an upper limit here (usually it's at most
-        // 20 steps)
-        if( steps>1000) steps = 1000;
-
-        // Protection against having vel_normal with nan values
-        if(len>0.0f) {
-            direction*= 1.0f/len;
-        }
-
-        Vec3 step_coord;
-        //Test if we crash if we drive towards the target sector
-        for(unsigned int i = 2; i < steps; ++i )
-        {
-            step_coord = m_kart->getXYZ()+direction*m_kart_length * float(i);
-
-            QuadGraph::get()->spatialToTrack(&step_track_coord, step_coord,
-                                             *last_node );
-
-            float distance = fabsf(step_track_coord[0]);
-
-            //If we are outside, the previous node is what we are looking for
-            if ( distance + m_kart_width * 0.5f
-                 > QuadGraph::get()->getNode(*last_node).getPathWidth()*0.5f )
-            {
-                *aim_position = QuadGraph::get()->getQuadOfNode(*last_node)
-                                                 .getCenter();
-                return;
-            }
-        }
-        *last_node = target_sector;
-    }   // for i<100
-    *aim_position = QuadGraph::get()->getQuadOfNode(*last_node).getCenter();
+    findNonCrashingPointWithTable(AILookaheadTable::LOOKAHEAD_FIXED,
+                                  aim_position, last_node);
 }   // findNonCrashingPointFixed
 
 //-----------------------------------------------------------------------------
@@ -2015,78 +2050,32 @@ void SkiddingAI::findNonCrashingPointFixed(Vec3 *aim_position, int *last_node)
     Vec3 forw(0, 0, 50);
     m_curve[CURVE_KART]->addPoint(m_kart->getTrans()(forw)+eps);
 #endif
-    *last_node = m_next_node_index[m_track_node];
-    float angle = QuadGraph::get()->getAngleToNext(m_track_node,
-                                              m_successor_index[m_track_node]);
-    int target_sector;
-
-    Vec3 direction;
-    Vec3 step_track_coord;
-
-    float angle1;
-    // The original while(1) loop is replaced with a for loop to avoid
-    // infinite loops (which we had once or twice). Usually the number
-    // of iterations in the while loop is less than 7.
-    for(unsigned int j=0; j<100; j++)
-    {
-        // target_sector is the sector at the longest distance that we can
-        // drive to without crashing with the track.
-        target_sector = m_next_node_index[*last_node];
-        angle1 = QuadGraph::get()->getAngleToNext(target_sector,
-                                                m_successor_index[target_sector]);
-        // In very sharp turns this algorithm tends to aim at off track points,
-        // resulting in hitting a corner. So test for this special case and
-        // prevent a too-far look-ahead in this case
-        float diff = normalizeAngle(angle1-angle);
-        if(fabsf(diff)>1.5f)
-        {
-            *aim_position = QuadGraph::get()->getQuadOfNode(target_sector)
-                                                 .getCenter();
-            return;
-        }
-
-        //direction is a vector from our kart to the sectors we are testing
-        direction = QuadGraph::get()->getQuadOfNode(target_sector).getCenter()
-                  - m_kart->getXYZ();
-
-        float len=direction.length_2d();
-        unsigned int steps = (unsigned int)( len / m_kart_length );
-        if( steps < 3 ) steps = 3;
-
-        // That shouldn't happen, but since we had one instance of
-        // STK hanging, add an upper limit here (usually it's at most
-        // 20 steps)
-        if( steps>1000) steps = 1000;
-
-        // Protection against having vel_normal with nan values
-        if(len>0.0f) {
-            direction*= 1.0f/len;
-        }
-
-        Vec3 step_coord;
-        //Test if we crash if we drive towards the target sector
-        for(unsigned int i = 2; i < steps; ++i )
-        {
-            step_coord = m_kart->getXYZ()+direction*m_kart_length * float(i);
-
-            QuadGraph::get()->spatialToTrack(&step_track_coord, step_coord,
-                                             *last_node );
-
-            float distance = fabsf(step_track_coord[0]);
+    findNonCrashingPointWithTable(AILookaheadTable::LOOKAHEAD_DEFAULT,
+                                  aim_position, last_node);
+}   // findNonCrashingPoint
 
-            //If we are outside, the previous node is what we are looking for
-            if ( distance + m_kart_width * 0.5f
-                 > QuadGraph::get()->getNode(*last_node).getPathWidth() )
-            {
-                *aim_position = QuadGraph::get()->getQuadOfNode(*last_node)
-                                                 .getCenter();
-                return;
-            }
-        }
-        angle = angle1;
-        *last_node = target_sector;
-    }   // for i<100
-    *aim_position = QuadGraph::get()->getQuadOfNode(*last_node).getCenter();
+//-----------------------------------------------------------------------------
+/** Does the actual search of findNonCrashingPoint() and
+ *  findNonCrashingPointFixed(). If the lookahead table exists (see
+ *  AILookaheadTable), the nodes it knows to be reachable are not tested.
+ *  \param algorithm Which variant of the search to use.
+ *  \param aim_position On exit contains the point the AI should aim at.
+ *  \param last_node On exit contais the graph node the AI is aiming at.
+ */
+void SkiddingAI::findNonCrashingPointWithTable(
+                                       AILookaheadTable::Algorithm algorithm,
+                                       Vec3 *aim_position, int *last_node)
+{
+    unsigned int known_steps = 0;
+    const AILookaheadTable *table = AILookaheadTable::get();
+    if(table && UserConfigParams::m_ai_lookahead_table)
+        known_steps = table->getKnownSteps(algorithm, m_track_node,
+                                           m_kart->getXYZ());
+    AILookaheadTable::findNonCrashingPoint(algorithm, m_kart->getXYZ(),
+                                           m_track_node, m_next_node_index,
+                                           m_successor_index, m_kart_length,
+                                           m_kart_width, known_steps,
+                                           aim_position, last_node);
 }   // findNonCrashingPoint
 
 //-----------------------------------------------------------------------------
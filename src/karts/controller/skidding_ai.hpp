@@ -23,6 +23,7 @@
 #define HEADER_SKIDDING_AI_HPP
 
 #include "karts/controller/ai_base_controller.hpp"
+#include "karts/controller/ai_lookahead_table.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/graph_node.hpp"
 #include "utils/random_generator.hpp"
@@ -199,6 +200,18 @@ private:
     enum {PSA_DEFAULT, PSA_FIXED, PSA_NEW}
           m_point_selection_algorithm;
 
+    /** True if prepareUpdate() computed the nearest karts, crashes, track
+     *  direction and aim point for the next call of update(). */
+    bool m_decisions_prepared;
+
+    /** The point to aim for as found by the point selection algorithm,
+     *  and the graph node this point is on. */
+    Vec3 m_aim_point;
+    int  m_aim_node;
+
+    /** True if m_aim_point was computed for this update. */
+    bool m_aim_point_valid;
+
 #ifdef DEBUG
     /** For skidding debugging: shows the estimated turn shape. */
     ShowCurve **m_curve;
@@ -226,6 +239,10 @@ private:
     void  handleBraking();
     void  handleNitroAndZipper();
     void  computeNearestKarts();
+    void  computeDecisions();
+    void  computeAimPoint();
+    bool  needsAimPoint() const;
+    bool  isOutsideOfRoad() const;
     void  handleItemCollectionAndAvoidance(Vec3 *aim_point,
                                            int last_node);
     bool  handleSelectedItem(float kart_aim_angle, Vec3 *aim_point);
@@ -242,6 +259,8 @@ private:
     void  findNonCrashingPointFixed(Vec3 *result, int *last_node);
     void  findNonCrashingPointNew(Vec3 *result, int *last_node);
     void  findNonCrashingPoint(Vec3 *result, int *last_node);
+    void  findNonCrashingPointWithTable(AILookaheadTable::Algorithm algorithm,
+                                        Vec3 *result, int *last_node);
 
     void  determineTrackDirection();
     void  determineTurnRadius(const Vec3 &start,
@@ -260,6 +279,7 @@ public:
                  SkiddingAI(AbstractKart *kart);
                 ~SkiddingAI();
     virtual void update      (float delta) ;
+    virtual void prepareUpdate(float delta);
     virtual void reset       ();
     virtual const irr::core::stringw& getNamePostfix() const;
 };
@@ -27,7 +27,9 @@ GhostKart::GhostKart(const std::string& ident)
                     /*position*/-1, btTransform(), stk_config->getPlayerDifficulty(
                         PLAYER_DIFFICULTY_NORMAL))
 {
-    m_current_transform = 0;
+    m_previous_time     = 0;
+    m_next_time         = 0;
+    m_has_next          = false;
     m_next_event        = 0;
 }   // GhostKart
 
@@ -36,27 +38,47 @@ void GhostKart::reset()
 {
     m_node->setVisible(true);
     Kart::reset();
-    m_current_transform = 0;
-    m_next_event        = 0;
+    seek(0);
     // This will set the correct start position
     update(0);
 }   // reset
 
 // ----------------------------------------------------------------------------
-/** Sets the next time and transform. The current time and transform becomes
- *  the previous time and transform.
- *  \param
+/** Sets the encoded transforms of this kart. The data is not copied, it must
+ *  be kept alive while this kart exists.
+ *  \param data The encoded transforms.
+ *  \param size Size of the data.
+ *  \param keyframes Keyframe index of the data.
  */
-void GhostKart::addTransform(float time, const btTransform &trans)
+void GhostKart::setTransforms(const uint8_t *data, uint32_t size,
+                              const std::vector<ReplayStream::KeyFrame> &keyframes)
 {
-    // FIXME: for now avoid that transforms for the same time are set
-    // twice (to avoid division by zero in update). This should be
-    // done when saving in replay
-    if(m_all_times.size()>0 && m_all_times.back()==time)
-        return;
-    m_all_times.push_back(time);
-    m_all_transform.push_back(trans);
-}   // addTransform
+    m_stream.init(data, size, keyframes);
+    seek(0);
+}   // setTransforms
+
+// ----------------------------------------------------------------------------
+/** Continues the replay at the given time: the transforms are decoded
+ *  starting at the last keyframe before this time.
+ *  \param time The race time.
+ */
+void GhostKart::seek(float time)
+{
+    m_stream.seek(time);
+    m_has_next = m_stream.next(&m_previous_time, &m_previous_transform) &&
+                 m_stream.next(&m_next_time, &m_next_transform);
+    while(m_has_next && time>=m_next_time)
+    {
+        m_previous_time      = m_next_time;
+        m_previous_transform = m_next_transform;
+        m_has_next = m_stream.next(&m_next_time, &m_next_transform);
+    }
+
+    m_next_event = 0;
+    while(m_next_event < m_replay_events.size() &&
+          m_replay_events[m_next_event].m_time < time)
+        m_next_event++;
+}   // seek
 
 // ----------------------------------------------------------------------------
 /** Adds a replay event for this kart.
@@ -92,28 +114,31 @@ void GhostKart::update(float dt)
  */
 void GhostKart::updateTransform(float t, float dt)
 {
+    // If the time jumped back (or too far ahead to decode all transforms
+    // in between), continue at the keyframe before the current time.
+    if( (t<m_previous_time && m_previous_time>m_stream.getStartTime()) ||
+        (m_has_next &&
+         t>m_next_time+stk_config->m_replay_keyframe_interval)          )
+        seek(t);
 
-    // Find (if necessary) the next index to use
-    while(m_current_transform+1 < m_all_times.size() &&
-          t>=m_all_times[m_current_transform+1])
+    // Find (if necessary) the next transform to use
+    while(m_has_next && t>=m_next_time)
     {
-          m_current_transform ++;
+        m_previous_time      = m_next_time;
+        m_previous_transform = m_next_transform;
+        m_has_next = m_stream.next(&m_next_time, &m_next_transform);
     }
-    if(m_current_transform+1>=m_all_times.size())
+    if(!m_has_next)
     {
         m_node->setVisible(false);
         return;
     }
 
-    float f =(t - m_all_times[m_current_transform])
-           / (  m_all_times[m_current_transform+1]
-              - m_all_times[m_current_transform]  );
-    setXYZ((1-f)*m_all_transform[m_current_transform  ].getOrigin()
-           + f  *m_all_transform[m_current_transform+1].getOrigin() );
-    const btQuaternion q = m_all_transform[m_current_transform].getRotation()
-                          .slerp(m_all_transform[m_current_transform+1]
-                                 .getRotation(),
-                                 f);
+    float f =(t - m_previous_time) / (m_next_time - m_previous_time);
+    setXYZ((1-f)*m_previous_transform.getOrigin()
+           + f  *m_next_transform.getOrigin() );
+    const btQuaternion q = m_previous_transform.getRotation()
+                          .slerp(m_next_transform.getRotation(), f);
     setRotation(q);
     Moveable::updateGraphics(dt, Vec3(0,0,0), btQuaternion(0, 0, 0, 1));
 }   // update
@@ -21,6 +21,7 @@
 
 #include "karts/kart.hpp"
 #include "replay/replay_base.hpp"
+#include "replay/replay_stream.hpp"
 
 #include "LinearMath/btTransform.h"
 
@@ -28,25 +29,30 @@
 
 /** \defgroup karts */
 
-/** A ghost kart. It does not have a phsyics representation. It gets two
- *  transforms from the replay objects at two consecutive time steps,
- *  and will interpolate between those positions depending on the current
- *  time
+/** A ghost kart. It does not have a phsyics representation. It decodes
+ *  the transforms from the replay data while racing, and keeps the two
+ *  transforms at the consecutive time steps before and after the current
+ *  time, and will interpolate between those positions depending on the
+ *  current time.
  */
 class GhostKart : public Kart
 {
 private:
-    /** The list of the times at which the transform were reached. */
-    std::vector<float>       m_all_times;
+    /** Decodes the transforms of this kart. */
+    ReplayStream             m_stream;
 
-    /** The transforms to assume at the corresponding time in m_all_times. */
-    std::vector<btTransform> m_all_transform;
+    /** The time and transform at or before the current world time. */
+    float                    m_previous_time;
+    btTransform              m_previous_transform;
 
-    std::vector<ReplayBase::KartReplayEvent> m_replay_events;
+    /** The time and transform after the current world time. */
+    float                    m_next_time;
+    btTransform              m_next_transform;
+
+    /** False if there are no more transforms after m_previous_time. */
+    bool                     m_has_next;
 
-    /** Pointer to the last index in m_all_times that is smaller than
-     *  the current world time. */
-    unsigned int m_current_transform;
+    std::vector<ReplayBase::KartReplayEvent> m_replay_events;
 
     /** Index of the next kart replay event. */
     unsigned int m_next_event;
@@ -55,9 +61,11 @@ private:
 public:
                  GhostKart(const std::string& ident);
     virtual void update (float dt);
-    virtual void addTransform(float time, const btTransform &trans);
+    virtual void setTransforms(const uint8_t *data, uint32_t size,
+                          const std::vector<ReplayStream::KeyFrame> &keyframes);
     virtual void addReplayEvent(const ReplayBase::KartReplayEvent &kre);
     virtual void reset();
+    void         seek(float time);
     // ------------------------------------------------------------------------
     /** No physics body for ghost kart, so nothing to adjust. */
     virtual void updateWeight() {};
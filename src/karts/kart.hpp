@@ -36,6 +36,7 @@
 #include "utils/no_copy.hpp"
 
 class btKart;
+class btKartRaycaster;
 
 class Attachment;
 class Controller;
@@ -157,7 +158,7 @@ private:
     // Bullet physics parameters
     // -------------------------
     btCompoundShape          m_kart_chassis;
-    btVehicleRaycaster      *m_vehicle_raycaster;
+    btKartRaycaster         *m_vehicle_raycaster;
     btKart                  *m_vehicle;
 
      /** The amount of energy collected by hitting coins. Note that it
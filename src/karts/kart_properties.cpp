@@ -47,7 +47,8 @@ float KartProperties::UNDEFINED = -99.9f;
  *  Otherwise the defaults are taken from STKConfig (and since they are all
  *  defined, it is guaranteed that each kart has well defined physics values).
  */
-KartProperties::KartProperties(const std::string &filename)
+KartProperties::KartProperties(const std::string &filename,
+                               const XMLNode *root)
 {
     m_icon_material = NULL;
     m_minimap_icon  = NULL;
@@ -119,7 +120,7 @@ KartProperties::KartProperties(const std::string &filename)
         m_skidding_properties = NULL;
         for(unsigned int i=0; i<RaceManager::DIFFICULTY_COUNT; i++)
             m_ai_properties[i]= NULL;
-        load(filename, "kart");
+        load(filename, "kart", root);
     }
     else
     {
@@ -170,13 +171,16 @@ void KartProperties::copyFrom(const KartProperties *source)
 /** Loads the kart properties from a file.
  *  \param filename Filename to load.
  *  \param node Name of the xml node to load the data from
+ *  \param xml The already parsed file, or NULL to read the file here.
+ *         This tree is not deleted.
  */
-void KartProperties::load(const std::string &filename, const std::string &node)
+void KartProperties::load(const std::string &filename, const std::string &node,
+                          const XMLNode *xml)
 {
     // Get the default values from STKConfig. This will also allocate any
     // pointers used in KartProperties
 
-    const XMLNode* root = new XMLNode(filename);
+    const XMLNode* root = xml ? xml : new XMLNode(filename);
     std::string kart_type;
     if (root->get("type", &kart_type))
         copyFrom(&stk_config->getKartProperties(kart_type));
@@ -214,7 +218,7 @@ void KartProperties::load(const std::string &filename, const std::string &node)
                    filename.c_str());
         Log::error("[KartProperties]", "%s", err.what());
     }
-    if(root) delete root;
+    if(root && root!=xml) delete root;
 
     // Set a default group (that has to happen after init_default and load)
     if(m_groups.size()==0)
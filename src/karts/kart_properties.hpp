@@ -400,11 +400,13 @@ private:
 
 
     void  load              (const std::string &filename,
-                             const std::string &node);
+                             const std::string &node,
+                             const XMLNode *root);
 
 
 public:
-          KartProperties    (const std::string &filename="");
+          KartProperties    (const std::string &filename="",
+                             const XMLNode *root=NULL);
          ~KartProperties    ();
     void  copyFrom          (const KartProperties *source);
     void  getAllData        (const XMLNode * root);
@@ -26,9 +26,12 @@
 #include "config/user_config.hpp"
 #include "graphics/irr_driver.hpp"
 #include "guiengine/engine.hpp"
+#include "io/asset_loader.hpp"
 #include "io/file_manager.hpp"
+#include "io/xml_node.hpp"
 #include "karts/kart_properties.hpp"
 #include "utils/log.hpp"
+#include "utils/profiler.hpp"
 #include "utils/string_utils.hpp"
 
 #include <algorithm>
@@ -142,43 +145,116 @@ void KartPropertiesManager::removeKart(const std::string &ident)
 }   // removeKart
 
 //-----------------------------------------------------------------------------
-/** Loads all kart properties and models.
+/** Loads all kart properties and models. The kart.xml files and the icons
+ *  of all karts are read, parsed and decoded by an AssetLoader on worker
+ *  threads, while the main thread creates the textures and loads the models
+ *  (irrlicht's mesh loading is not thread-safe).
+ *  \param loading_icon If the icons of the karts should be added to the
+ *         loading screen.
  */
 void KartPropertiesManager::loadAllKarts(bool loading_icon)
 {
     m_all_kart_dirs.clear();
+    AssetLoader loader("Karts");
+
+    // First collect all directories with a kart: either a directory in the
+    // search path is a kart, or each of its subdirs can be a kart.
+    std::vector<std::string> kart_dirs;
+    std::vector<bool> is_search_path;
     std::vector<std::string>::const_iterator dir;
     for(dir = m_kart_search_path.begin(); dir!=m_kart_search_path.end(); dir++)
     {
-        // First check if there is a kart in the current directory
-        // -------------------------------------------------------
-        if(loadKart(*dir)) continue;
-
-        // If not, check each subdir of this directory.
-        // --------------------------------------------
+        if(file_manager->fileExists(*dir+"/kart.xml"))
+        {
+            kart_dirs.push_back(*dir);
+            is_search_path.push_back(true);
+            continue;
+        }
         std::set<std::string> result;
         file_manager->listFiles(result, *dir);
         for(std::set<std::string>::const_iterator subdir=result.begin();
             subdir!=result.end(); subdir++)
         {
-            const bool loaded = loadKart(*dir+*subdir);
+            if(!file_manager->fileExists(*dir+*subdir+"/kart.xml")) continue;
+            kart_dirs.push_back(*dir+*subdir);
+            is_search_path.push_back(false);
+        }   // for all files in the currently handled directory
+    }   // for i
+
+    for(unsigned int i=0; i<kart_dirs.size(); i++)
+        loader.loadXML(kart_dirs[i]+"/kart.xml");
+
+    // As soon as a kart.xml file is parsed, queue its icons
+    std::vector<XMLNode*> roots;
+    for(unsigned int i=0; i<kart_dirs.size(); i++)
+    {
+        XMLNode *root = loader.getXML(kart_dirs[i]+"/kart.xml");
+        roots.push_back(root);
+        if(!root) continue;
+        std::string icon;
+        if(root->get("icon-file", &icon))
+            loader.loadImage(kart_dirs[i]+"/"+icon);
+        std::string minimap_icon;
+        if(root->get("minimap-icon-file", &minimap_icon) && minimap_icon!="")
+            loader.loadImage(kart_dirs[i]+"/"+minimap_icon);
+    }
 
-            if (loaded && loading_icon)
+    for(unsigned int i=0; i<kart_dirs.size(); i++)
+    {
+        if(roots[i])
+        {
+            // Create the textures of the icons, which are then found in
+            // the texture cache when the kart is loaded.
+            std::string icon;
+            if(roots[i]->get("icon-file", &icon))
+                loader.getTexture(kart_dirs[i]+"/"+icon);
+            std::string minimap_icon;
+            if(roots[i]->get("minimap-icon-file", &minimap_icon) &&
+                minimap_icon!="")
+                loader.getTexture(kart_dirs[i]+"/"+minimap_icon);
+        }
+        const double start = getTimeMilliseconds();
+        const bool loaded = loadKart(kart_dirs[i], roots[i]);
+        loader.addStageTime(AssetLoader::STAGE_MODELS,
+                            getTimeMilliseconds()-start);
+        delete roots[i];
+
+        if(!loaded && is_search_path[i])
+        {
+            // Check each subdir of an invalid kart in the search path.
+            std::set<std::string> result;
+            file_manager->listFiles(result, kart_dirs[i]);
+            for(std::set<std::string>::const_iterator subdir=result.begin();
+                subdir!=result.end(); subdir++)
             {
-                GUIEngine::addLoadingIcon(irr_driver->getTexture(
-                    m_karts_properties[m_karts_properties.size()-1]
-                            .getAbsoluteIconFile()              )
-                                          );
+                if(loadKart(kart_dirs[i]+*subdir) && loading_icon)
+                {
+                    GUIEngine::addLoadingIcon(irr_driver->getTexture(
+                        m_karts_properties[m_karts_properties.size()-1]
+                                .getAbsoluteIconFile()              )
+                                              );
+                }
             }
-        }   // for all files in the currently handled directory
-    }   // for i
+        }
+        else if (loaded && loading_icon && !is_search_path[i])
+        {
+            GUIEngine::addLoadingIcon(irr_driver->getTexture(
+                m_karts_properties[m_karts_properties.size()-1]
+                        .getAbsoluteIconFile()              )
+                                      );
+        }
+    }   // for i < kart_dirs.size()
+    loader.printStatistics();
 }   // loadAllKarts
 
 //-----------------------------------------------------------------------------
 /** Loads a single kart and (if not disabled) the oorresponding 3d model.
  *  \param filename Full path to the kart config file.
+ *  \param root The already parsed kart.xml file, or NULL if the file
+ *         should be read here. The tree is not deleted.
  */
-bool KartPropertiesManager::loadKart(const std::string &dir)
+bool KartPropertiesManager::loadKart(const std::string &dir,
+                                     const XMLNode *root)
 {
     std::string config_filename=dir+"/kart.xml";
     if(!file_manager->fileExists(config_filename))
@@ -187,7 +263,7 @@ bool KartPropertiesManager::loadKart(const std::string &dir)
     KartProperties* kart_properties;
     try
     {
-        kart_properties = new KartProperties(config_filename);
+        kart_properties = new KartProperties(config_filename, root);
     }
     catch (std::runtime_error& err)
     {
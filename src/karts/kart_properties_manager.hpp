@@ -29,6 +29,7 @@
 #define ALL_KART_GROUPS_ID  "all"
 
 class KartProperties;
+class XMLNode;
 
 /**
   * \ingroup karts
@@ -74,7 +75,8 @@ public:
     int                      getKartByGroup(const std::string& group,
                                            int i) const;
 
-    bool                     loadKart               (const std::string &dir);
+    bool                     loadKart               (const std::string &dir,
+                                                     const XMLNode *root=NULL);
     void                     loadAllKarts           (bool loading_icon = true);
     void                     unloadAllKarts         ();
     void                     removeKart(const std::string &id);
@@ -125,6 +125,17 @@ void Moveable::stopFlying()
  *  \param float dt Time step size.
  */
 void Moveable::update(float dt)
+{
+    updatePosition();
+    updateGraphics(dt, Vec3(0,0,0), btQuaternion(0, 0, 0, 1));
+}   // update
+
+//-----------------------------------------------------------------------------
+/** Updates the current position, rotation and velocity from the physics
+ *  body. This can be called more than once per time step, e.g. to get the
+ *  positions of all karts before any kart is updated.
+ */
+void Moveable::updatePosition()
 {
     if(m_body->getInvMass()!=0)
         m_motion_state->getWorldTransform(m_transform);
@@ -138,9 +149,7 @@ void Moveable::update(float dt)
     Vec3 up       = getTrans().getBasis().getColumn(1);
     m_pitch       = atan2(up.getZ(), fabsf(up.getY()));
     m_roll        = atan2(up.getX(), up.getY());
-
-    updateGraphics(dt, Vec3(0,0,0), btQuaternion(0, 0, 0, 1));
-}   // update
+}   // updatePosition
 
 //-----------------------------------------------------------------------------
 /** Creates the bullet rigid body for this moveable.
@@ -104,6 +104,7 @@ public:
                                  const btQuaternion& off_rotation);
     virtual void  reset();
     virtual void  update(float dt) ;
+    void          updatePosition();
     btRigidBody  *getBody() const {return m_body; }
     void          createBody(float mass, btTransform& trans,
                              btCollisionShape *shape,
@@ -129,6 +129,9 @@
 #    include <direct.h>
 #  endif
 #else
+#  include <errno.h>
+#  include <signal.h>
+#  include <sys/wait.h>
 #  include <unistd.h>
 #endif
 #include <stdexcept>
@@ -158,6 +161,8 @@
 #include "graphics/material_manager.hpp"
 #include "graphics/particle_kind_manager.hpp"
 #include "graphics/referee.hpp"
+#include "graphics/scene_culler.hpp"
+#include "graphics/texture_compressor.hpp"
 #include "guiengine/engine.hpp"
 #include "guiengine/event_handler.hpp"
 #include "guiengine/dialog_queue.hpp"
@@ -170,14 +175,22 @@
 #include "items/item_manager.hpp"
 #include "items/projectile_manager.hpp"
 #include "karts/controller/ai_base_controller.hpp"
+#include "karts/controller/ai_lookahead_table.hpp"
 #include "karts/kart_properties.hpp"
 #include "karts/kart_properties_manager.hpp"
 #include "modes/demo_world.hpp"
 #include "modes/profile_world.hpp"
 #include "network/client_network_manager.hpp"
+#include "network/jitter_buffer.hpp"
+#include "network/kart_relevance.hpp"
+#include "network/kart_snapshot.hpp"
+#include "network/loopback_transport.hpp"
+#include "network/message_batch.hpp"
 #include "network/network_manager.hpp"
+#include "network/network_string.hpp"
 #include "network/protocol_manager.hpp"
 #include "network/protocols/server_lobby_room_protocol.hpp"
+#include "network/server_snapshot_benchmark.hpp"
 #include "network/client_network_manager.hpp"
 #include "network/server_network_manager.hpp"
 #include "network/protocol_manager.hpp"
@@ -191,6 +204,7 @@
 #include "race/race_manager.hpp"
 #include "replay/replay_play.hpp"
 #include "replay/replay_recorder.hpp"
+#include "replay/replay_stream.hpp"
 #include "states_screens/main_menu_screen.hpp"
 #include "states_screens/register_screen.hpp"
 #include "states_screens/state_manager.hpp"
@@ -201,6 +215,7 @@
 #include "utils/command_line.hpp"
 #include "utils/constants.hpp"
 #include "utils/crash_reporting.hpp"
+#include "utils/job_system.hpp"
 #include "utils/leak_check.hpp"
 #include "utils/log.hpp"
 #include "utils/translation.hpp"
@@ -526,7 +541,19 @@ void cmdLineHelp()
     "       --profile-time=n   Enable automatic driven profile mode for n "
                               "seconds.\n"
     "       --no-graphics      Do not display the actual race.\n"
+    "       --seed=n           Seed for the random numbers (e.g. to compare\n"
+    "                          several runs of the same profile race).\n"
+    "       --profile-stats=f  Append the kart statistics of a profile race to\n"
+    "                          file f in CSV format.\n"
     "       --with-profile     Enables the profile mode.\n"
+    "       --snapshot-bench=n Run a profile race as server that sends kart\n"
+    "                          snapshots to n simulated clients (message\n"
+    "                          emitters, not full clients). Reports the\n"
+    "                          server tick time and bandwidth per client.\n"
+    "       --snapshot-bench-latency=ms, --snapshot-bench-jitter=ms,\n"
+    "       --snapshot-bench-loss=percent, --snapshot-bench-reorder=percent,\n"
+    "       --snapshot-bench-bandwidth=bytes/s Simulated network conditions\n"
+    "                          of the snapshot benchmark.\n"
     "       --demo-mode=t      Enables demo mode after t seconds idle time in "
                                "main menu.\n"
     "       --demo-tracks=t1,t2 List of tracks to be used in demo mode. No\n"
@@ -534,15 +561,38 @@ void cmdLineHelp()
     "       --demo-laps=n      Number of laps in a demo.\n"
     "       --demo-karts=n     Number of karts to use in a demo.\n"
     "       --ghost            Replay ghost data together with one player kart.\n"
-    // "       --history          Replay history file 'history.dat'.\n"
-    // "       --history=n        Replay history file 'history.dat' using:\n"
+    // "       --history          Replay history file 'history.bin'.\n"
+    // "       --history=n        Replay history file 'history.bin' using:\n"
     // "                            n=1: recorded positions\n"
     // "                            n=2: recorded key strokes\n"
+    "       --record-history   Write the history of each race to history.bin\n"
+    "                          while racing.\n"
     "       --server           Start a server (not a playing client).\n"
+    "       --dedicated-server Start a server without graphics and GUI.\n"
+    "       --server-tick-rate=n Number of simulation steps per second on a\n"
+    "                          dedicated server.\n"
+    "       --physics-threads=n Number of threads used for collision detection\n"
+    "                          and kart raycasts (0: no threads).\n"
+    "       --ai-lookahead-table=n Use (n=1) or don't use (n=0) the look-ahead\n"
+    "                          table of the AI.\n"
+    "       --ai-lookahead-check Compare the aim points of the AI with and\n"
+    "                          without the look-ahead table for each race.\n"
+    "       --interest-management=n Send the states of distant karts less\n"
+    "                          often (n=1) or always at the full rate (n=0).\n"
+    "       --client-bandwidth=n Maximum bytes per second of kart states per\n"
+    "                          client (0: no limit).\n"
     "       --login=s          Automatically log in (set the login).\n"
     "       --password=s       Automatically log in (set the password).\n"
     "       --port=n           Port number to use.\n"
+    "       --lobbies=n        Number of races a dedicated server hosts, each\n"
+    "                          using its own port starting at --port.\n"
+    "       --auto-start=n     Start the kart selection when n players have\n"
+    "                          joined (server only, 0: from the console).\n"
     "       --max-players=n    Maximum number of clients (server only).\n"
+    "       --compress-textures[=n] Compress all textures of the game and the\n"
+    "                          installed addons into the texture cache with\n"
+    "                          n threads (default: the job system), then\n"
+    "                          exit. Use together with --no-graphics.\n"
     "       --no-console       Does not write messages in the console but to\n"
     "                          stdout.log.\n"
     "       --console          Write messages in the console and files\n"
@@ -629,6 +679,13 @@ int handleCmdLinePreliminary()
         UserConfigParams::m_log_errors_to_console=true;
     }
 
+    if(CommandLine::has("--dedicated-server"))
+    {
+        UserConfigParams::m_dedicated_server = true;
+        ProfileWorld::disableGraphics();
+        UserConfigParams::m_log_errors_to_console=true;
+    }
+
     if(CommandLine::has("--screensize", &s) || CommandLine::has("-s", &s))
     {
         //Check if fullscreen and new res is blacklisted
@@ -757,7 +814,7 @@ int handleCmdLine()
     }
 
     // Networking command lines
-    if(CommandLine::has("--server") )
+    if(CommandLine::has("--server") || UserConfigParams::m_dedicated_server)
     {
         NetworkManager::getInstance<ServerNetworkManager>();
         Log::info("main", "Creating a server network manager.");
@@ -766,6 +823,33 @@ int handleCmdLine()
     if(CommandLine::has("--max-players", &n))
         UserConfigParams::m_server_max_players=n;
 
+    if(CommandLine::has("--server-tick-rate", &n))
+        UserConfigParams::m_server_tick_rate=n;
+
+    if(CommandLine::has("--physics-threads", &n))
+        UserConfigParams::m_physics_threads=n;
+
+    if(CommandLine::has("--ai-lookahead-table", &n))
+        UserConfigParams::m_ai_lookahead_table = n!=0;
+
+    if(CommandLine::has("--ai-lookahead-check"))
+        AILookaheadTable::setCheck(true);
+
+    if(CommandLine::has("--interest-management", &n))
+        UserConfigParams::m_network_interest_management = n!=0;
+
+    if(CommandLine::has("--client-bandwidth", &n))
+        UserConfigParams::m_network_client_bandwidth = n;
+
+    if(CommandLine::has("--port", &n))
+        UserConfigParams::m_server_port=n;
+
+    if(CommandLine::has("--lobbies", &n))
+        UserConfigParams::m_server_lobbies=n;
+
+    if(CommandLine::has("--auto-start", &n))
+        UserConfigParams::m_server_auto_start=n;
+
     if(CommandLine::has("--login", &s) )
     {
         login = s.c_str();
@@ -896,6 +980,36 @@ int handleCmdLine()
         race_manager->setGrandPrix(*gp);
     }   // --gp
 
+    if(CommandLine::has("--snapshot-bench", &n))
+    {
+        if (n <= 0)
+        {
+            Log::error("main", "Invalid number of benchmark clients: %d.", n);
+            return 0;
+        }
+        ServerSnapshotBenchmark::setNumClients(n);
+        // One kart per client, unless --numkarts is used as well
+        race_manager->setNumKarts(std::min(n, stk_config->m_max_karts));
+        if (!ProfileWorld::isProfileMode())
+        {
+            UserConfigParams::m_no_start_screen = true;
+            ProfileWorld::setProfileModeLaps(1);
+            race_manager->setNumLaps(1);
+        }
+    }   // --snapshot-bench
+
+    NetworkConditions &conditions = ServerSnapshotBenchmark::getConditions();
+    if(CommandLine::has("--snapshot-bench-latency", &n))
+        conditions.m_latency   = n/1000.0f;
+    if(CommandLine::has("--snapshot-bench-jitter", &n))
+        conditions.m_jitter    = n/1000.0f;
+    if(CommandLine::has("--snapshot-bench-loss", &n))
+        conditions.m_loss      = n/100.0f;
+    if(CommandLine::has("--snapshot-bench-reorder", &n))
+        conditions.m_reorder   = n/100.0f;
+    if(CommandLine::has("--snapshot-bench-bandwidth", &n))
+        conditions.m_bandwidth = (float)n;
+
     if(CommandLine::has("--numkarts", &n) ||CommandLine::has("-k", &n))
     {
         UserConfigParams::m_num_karts = n;
@@ -958,6 +1072,16 @@ int handleCmdLine()
         race_manager->setNumLaps(999999); // profile end depends on time
     }   // --profile-time
 
+    if(CommandLine::has("--seed",  &n))
+    {
+        Log::verbose("main", "Using random seed %d.", n);
+        srand((unsigned int)n);
+        ProfileWorld::setSeed(n);
+    }   // --seed
+
+    if(CommandLine::has("--profile-stats", &s))
+        ProfileWorld::setStatsFile(s);
+
     if(CommandLine::has("--with-profile") )
     {
         // Set default profile mode of 1 lap if we haven't already set one
@@ -987,6 +1111,9 @@ int handleCmdLine()
         UserConfigParams::m_no_start_screen = true;
     }   // --history
 
+    if(CommandLine::has("--record-history"))
+        UserConfigParams::m_record_history = true;
+
     // Demo mode
     if(CommandLine::has("--demo-mode", &s))
     {
@@ -1113,7 +1240,10 @@ void initRest()
     // The rest will be read later (since the rest needs the unlock- and
     // achievement managers to be created, which can only be created later).
     PlayerManager::create();
-    Online::RequestManager::get()->startNetworkThread();
+    // A dedicated server might fork several lobbies after loading all data,
+    // and threads do not survive a fork. So the thread is started later.
+    if (!UserConfigParams::m_dedicated_server)
+        Online::RequestManager::get()->startNetworkThread();
     NewsManager::get();   // this will create the news manager
 
     music_manager = new MusicManager();
@@ -1216,6 +1346,317 @@ void askForInternetPermission()
     GUIEngine::DialogQueue::get()->pushDialog(dialog, false);
 }   // askForInternetPermission
 
+//=============================================================================
+#ifndef WIN32
+/** Set by the signal handler of the lobby supervisor to stop all lobbies. */
+static volatile sig_atomic_t g_stop_lobbies = 0;
+
+static void stopLobbies(int sig)
+{
+    g_stop_lobbies = 1;
+}   // stopLobbies
+#endif
+
+//=============================================================================
+/** Allows a dedicated server to host several races at the same time. All
+ *  other managers are singletons, so a process can only run one race; but
+ *  once all karts and other data are loaded, the process forks one child per
+ *  lobby. Before forking, the collision meshes (triangles and bvh) of all
+ *  tracks with a physics cache are loaded, which the lobbies then use for
+ *  each race on these tracks. Since the lobbies never write to them, and
+ *  neither to the karts, materials, powerups and items loaded before, this
+ *  memory is shared by all lobbies (copy on write). The scene meshes of a
+ *  track are still loaded by each lobby for each race, since loading a track
+ *  merges them into new meshes anyway. Each child listens on its own port
+ *  (--port plus the lobby index).
+ *  The lobbies have no console, so they start the kart selection by
+ *  themselves once server_auto_start players have joined.
+ *  The original process only supervises the lobbies: a lobby that crashed
+ *  is forked again (after a delay that grows if it keeps crashing right
+ *  after its start, and not at all after MAX_FAST_CRASHES such crashes),
+ *  and the supervisor exits once all lobbies have exited. SIGTERM or
+ *  SIGINT sent to the supervisor stop all lobbies.
+ *  This must be called before any thread is started (except the workers of
+ *  the job system, which are restarted), since only the calling thread
+ *  exists in a forked process. The function only returns in the
+ *  lobby processes (or if only one lobby is used).
+ */
+void forkServerLobbies()
+{
+    const int num_lobbies = UserConfigParams::m_server_lobbies;
+    if (num_lobbies <= 1)
+        return;
+
+#ifdef WIN32
+    Log::warn("main", "Several lobbies are not supported on Windows, "
+              "only one lobby will be started.");
+    UserConfigParams::m_server_lobbies = 1;
+#else
+    if (UserConfigParams::m_server_auto_start <= 0)
+    {
+        Log::warn("main", "Lobbies have no console, so they start the kart "
+                  "selection when the first player joins (see "
+                  "server_auto_start).");
+        UserConfigParams::m_server_auto_start = 1;
+    }
+
+    // A lobby that crashes within MIN_RUN_TIME seconds after its start is
+    // restarted after a delay, which doubles with each such crash, up to
+    // MAX_FAST_CRASHES times.
+    const time_t MIN_RUN_TIME     = 10;
+    const int    MAX_FAST_CRASHES = 5;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopLobbies;
+    // No SA_RESTART, so that waitpid is interrupted by the signal
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT,  &action, NULL);
+
+    if (UserConfigParams::m_cache_physics)
+    {
+        unsigned int num_preloaded = 0;
+        for (unsigned int i = 0; i < track_manager->getNumberOfTracks(); i++)
+        {
+            Track *track = track_manager->getTrack(i);
+            if (!track->isInternal() && track->preloadPhysicsCache())
+                num_preloaded++;
+        }
+        Log::info("main", "Loaded the collision meshes of %d tracks for all "
+                  "lobbies, the other tracks are loaded by each lobby.",
+                  num_preloaded);
+    }
+
+    // The workers of the job system would not exist in the children, so
+    // the job system is stopped and created again in each lobby.
+    JobSystem::destroy();
+    const int first_port = UserConfigParams::m_server_port;
+    std::vector<pid_t>  lobbies(num_lobbies, 0);
+    std::vector<time_t> start_times(num_lobbies, 0);
+    std::vector<int>    fast_crashes(num_lobbies, 0);
+    int running = 0;
+    while (!g_stop_lobbies)
+    {
+        for (int i = 0; i < num_lobbies; i++)
+        {
+            if (lobbies[i] != 0)
+                continue;
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                signal(SIGTERM, SIG_DFL);
+                signal(SIGINT,  SIG_DFL);
+                // All lobbies inherited the same random numbers (which are
+                // used e.g. for the tokens of the players)
+                srand((unsigned int)time(0) ^ ((unsigned int)getpid() << 16)
+                      ^ (unsigned int)rand());
+                UserConfigParams::m_server_port = first_port + i;
+                Log::info("main", "Lobby %d listening on port %d.", i,
+                          first_port + i);
+                JobSystem::create();
+                return;
+            }
+            if (pid < 0)
+            {
+                Log::error("main", "Could not fork lobby %d.", i);
+                lobbies[i] = -1;
+                continue;
+            }
+            lobbies[i]     = pid;
+            start_times[i] = time(0);
+            running++;
+        }
+        if (running == 0)
+            exit(-1);
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (int i = 0; i < num_lobbies; i++)
+        {
+            if (lobbies[i] != pid)
+                continue;
+            running--;
+            if (!WIFSIGNALED(status))
+            {
+                Log::info("main", "Lobby %d has finished.", i);
+                // Don't restart a lobby that exited normally
+                lobbies[i] = -1;
+                continue;
+            }
+            if (time(0) - start_times[i] >= MIN_RUN_TIME)
+                fast_crashes[i] = 0;
+            else if (++fast_crashes[i] > MAX_FAST_CRASHES)
+            {
+                Log::error("main", "Lobby %d was terminated by signal %d "
+                           "%d times right after its start, it is not "
+                           "restarted.", i, WTERMSIG(status),
+                           MAX_FAST_CRASHES + 1);
+                lobbies[i] = -1;
+                continue;
+            }
+            const int delay = fast_crashes[i] > 0
+                            ? 1 << (fast_crashes[i] - 1) : 0;
+            Log::error("main", "Lobby %d was terminated by signal %d, "
+                       "restarting it in %d s.", i, WTERMSIG(status), delay);
+            if (delay > 0)
+                sleep(delay);
+            lobbies[i] = 0;
+        }
+        if (running == 0 &&
+            std::find(lobbies.begin(), lobbies.end(), 0) == lobbies.end())
+            break;
+    }   // while !g_stop_lobbies
+
+    if (g_stop_lobbies)
+    {
+        Log::info("main", "Stopping all lobbies.");
+        for (int i = 0; i < num_lobbies; i++)
+        {
+            if (lobbies[i] > 0)
+                kill(lobbies[i], SIGTERM);
+        }
+        while (running > 0 && waitpid(-1, NULL, 0) > 0)
+            running--;
+    }
+    exit(0);
+#endif
+}   // forkServerLobbies
+
+//=============================================================================
+/** Starts the game after everything is loaded: shows the first screen (or
+ *  starts a race directly, replays a history file or starts a profile race,
+ *  depending on the command line), and then runs the main loop.
+ */
+void runGame()
+{
+    if (!ProfileWorld::isNoGraphics() &&
+        GraphicsRestrictions::isDisabled(GraphicsRestrictions::GR_DRIVER_RECENT_ENOUGH))
+    {
+        if (UserConfigParams::m_old_driver_popup)
+        {
+            MessageDialog *dialog =
+                new MessageDialog(_("Your driver version is too old. Please install "
+                "the latest video drivers."),
+                /*from queue*/ true);
+            GUIEngine::DialogQueue::get()->pushDialog(dialog);
+        }
+        Log::warn("OpenGL", "Driver is too old!");
+    }
+    else if (!CVS->isGLSL())
+    {
+        if (UserConfigParams::m_old_driver_popup)
+        {
+            MessageDialog *dialog =
+                new MessageDialog(_("Your OpenGL version appears to be too old. Please verify "
+                "if an update for your video driver is available. SuperTuxKart requires OpenGL 3.1 or better."),
+                /*from queue*/ true);
+            GUIEngine::DialogQueue::get()->pushDialog(dialog);
+        }
+        Log::warn("OpenGL", "OpenGL version is too old!");
+    }
+
+    // Note that on the very first run of STK internet status is set to
+    // "not asked", so the report will only be sent in the next run.
+    if(UserConfigParams::m_internet_status==Online::RequestManager::IPERM_ALLOWED)
+    {
+        HardwareStats::reportHardwareStats();
+    }
+
+    if(!UserConfigParams::m_no_start_screen)
+    {
+        // If there is a current player, it was saved in the config file,
+        // so we immediately start the main menu (unless it was requested
+        // to always show the login screen). Otherwise show the login
+        // screen first.
+        if(PlayerManager::getCurrentPlayer() && !
+            UserConfigParams::m_always_show_login_screen)
+        {
+            MainMenuScreen::getInstance()->push();
+        }
+        else
+        {
+            UserScreen::getInstance()->push();
+            // If there is no player, push the RegisterScreen on top of
+            // the login screen. This way on first start players are
+            // forced to create a player.
+            if (PlayerManager::get()->getNumPlayers() == 0)
+            {
+                RegisterScreen::getInstance()->push();
+                RegisterScreen::getInstance()->setParent(UserScreen::getInstance());
+            }
+        }
+#ifdef ENABLE_WIIUSE
+        // Show a dialog to allow connection of wiimotes. */
+        if(WiimoteManager::isEnabled())
+        {
+            wiimote_manager->askUserToConnectWiimotes();
+        }
+#endif
+        askForInternetPermission();
+    }
+    else
+    {
+        setupRaceStart();
+        // Go straight to the race
+        StateManager::get()->enterGameState();
+    }
+
+    // If an important news message exists it is shown in a popup dialog.
+    const core::stringw important_message =
+                                 NewsManager::get()->getImportantMessage();
+    if(important_message!="")
+    {
+        new MessageDialog(important_message,
+                          MessageDialog::MESSAGE_DIALOG_OK,
+                          NULL, true);
+    }   // if important_message
+
+
+    // Replay a race
+    // =============
+    if(history->replayHistory())
+    {
+        // This will setup the race manager etc.
+        history->Load();
+        race_manager->setupPlayerKartInfo();
+        race_manager->startNew(false);
+        main_loop->run();
+        // well, actually run() will never return, since
+        // it exits after replaying history (see history::GetNextDT()).
+        // So the next line is just to make this obvious here!
+        exit(-3);
+    }
+
+    // Not replaying
+    // =============
+    if(!ProfileWorld::isProfileMode())
+    {
+        if(UserConfigParams::m_no_start_screen)
+        {
+            // Quickstart (-N)
+            // ===============
+            // all defaults are set in InitTuxkart()
+            race_manager->setupPlayerKartInfo();
+            race_manager->startNew(false);
+        }
+    }
+    else  // profile
+    {
+        // Profiling
+        // =========
+        race_manager->setMajorMode (RaceManager::MAJOR_MODE_SINGLE);
+        race_manager->setupPlayerKartInfo();
+        race_manager->startNew(false);
+    }
+    main_loop->run();
+}   // runGame
+
 //=============================================================================
 
 #if defined(WIN32) && defined(_MSC_VER)
@@ -1250,8 +1691,20 @@ int main(int argc, char *argv[] )
 
         handleCmdLinePreliminary();
 
+        // Loading already uses the job system
+        JobSystem::create();
+
         initRest();
 
+        // Create the compressed texture cache ahead of time and exit
+        int compress_threads = 0;
+        if(CommandLine::has("--compress-textures", &compress_threads) ||
+           CommandLine::has("--compress-textures"))
+        {
+            TextureCompressor::compressAllTextures(compress_threads);
+            exit(0);
+        }
+
         input_manager = new InputManager ();
 
 #ifdef ENABLE_WIIUSE
@@ -1324,6 +1777,12 @@ int main(int argc, char *argv[] )
         //handleCmdLine() needs InitTuxkart() so it can't be called first
         if(!handleCmdLine()) exit(0);
 
+        if (UserConfigParams::m_dedicated_server)
+        {
+            forkServerLobbies();
+            Online::RequestManager::get()->startNetworkThread();
+        }
+
         // load the network manager
         // If the server has been created (--server option), this will do nothing (just a warning):
         NetworkManager::getInstance<ClientNetworkManager>();
@@ -1366,127 +1825,17 @@ int main(int argc, char *argv[] )
             exit(0);
         }
 
-        if (!ProfileWorld::isNoGraphics() &&
-            GraphicsRestrictions::isDisabled(GraphicsRestrictions::GR_DRIVER_RECENT_ENOUGH))
+        if(UserConfigParams::m_dedicated_server)
         {
-            if (UserConfigParams::m_old_driver_popup)
-            {
-                MessageDialog *dialog =
-                    new MessageDialog(_("Your driver version is too old. Please install "
-                    "the latest video drivers."),
-                    /*from queue*/ true);
-                GUIEngine::DialogQueue::get()->pushDialog(dialog);
-            }
-            Log::warn("OpenGL", "Driver is too old!");
-        }
-        else if (!CVS->isGLSL())
-        {
-            if (UserConfigParams::m_old_driver_popup)
-            {
-                MessageDialog *dialog =
-                    new MessageDialog(_("Your OpenGL version appears to be too old. Please verify "
-                    "if an update for your video driver is available. SuperTuxKart requires OpenGL 3.1 or better."),
-                    /*from queue*/ true);
-                GUIEngine::DialogQueue::get()->pushDialog(dialog);
-            }
-            Log::warn("OpenGL", "OpenGL version is too old!");
-        }
-
-        // Note that on the very first run of STK internet status is set to
-        // "not asked", so the report will only be sent in the next run.
-        if(UserConfigParams::m_internet_status==Online::RequestManager::IPERM_ALLOWED)
-        {
-            HardwareStats::reportHardwareStats();
-        }
-
-        if(!UserConfigParams::m_no_start_screen)
-        {
-            // If there is a current player, it was saved in the config file,
-            // so we immediately start the main menu (unless it was requested
-            // to always show the login screen). Otherwise show the login
-            // screen first.
-            if(PlayerManager::getCurrentPlayer() && !
-                UserConfigParams::m_always_show_login_screen)
-            {
-                MainMenuScreen::getInstance()->push();
-            }
-            else
-            {
-                UserScreen::getInstance()->push();
-                // If there is no player, push the RegisterScreen on top of
-                // the login screen. This way on first start players are
-                // forced to create a player.
-                if (PlayerManager::get()->getNumPlayers() == 0)
-                {
-                    RegisterScreen::getInstance()->push();
-                    RegisterScreen::getInstance()->setParent(UserScreen::getInstance());
-                }
-            }
-#ifdef ENABLE_WIIUSE
-            // Show a dialog to allow connection of wiimotes. */
-            if(WiimoteManager::isEnabled())
-            {
-                wiimote_manager->askUserToConnectWiimotes();
-            }
-#endif
-            askForInternetPermission();
+            // A dedicated server shows no screens, it only waits for
+            // clients and runs their races at a fixed tick rate.
+            main_loop->runDedicatedServer();
         }
         else
         {
-            setupRaceStart();
-            // Go straight to the race
-            StateManager::get()->enterGameState();
+            runGame();
         }
 
-        // If an important news message exists it is shown in a popup dialog.
-        const core::stringw important_message =
-                                     NewsManager::get()->getImportantMessage();
-        if(important_message!="")
-        {
-            new MessageDialog(important_message,
-                              MessageDialog::MESSAGE_DIALOG_OK,
-                              NULL, true);
-        }   // if important_message
-
-
-        // Replay a race
-        // =============
-        if(history->replayHistory())
-        {
-            // This will setup the race manager etc.
-            history->Load();
-            race_manager->setupPlayerKartInfo();
-            race_manager->startNew(false);
-            main_loop->run();
-            // well, actually run() will never return, since
-            // it exits after replaying history (see history::GetNextDT()).
-            // So the next line is just to make this obvious here!
-            exit(-3);
-        }
-
-        // Not replaying
-        // =============
-        if(!ProfileWorld::isProfileMode())
-        {
-            if(UserConfigParams::m_no_start_screen)
-            {
-                // Quickstart (-N)
-                // ===============
-                // all defaults are set in InitTuxkart()
-                race_manager->setupPlayerKartInfo();
-                race_manager->startNew(false);
-            }
-        }
-        else  // profile
-        {
-            // Profiling
-            // =========
-            race_manager->setMajorMode (RaceManager::MAJOR_MODE_SINGLE);
-            race_manager->setupPlayerKartInfo();
-            race_manager->startNew(false);
-        }
-        main_loop->run();
-
     }  // try
     catch (std::exception &e)
     {
@@ -1616,6 +1965,9 @@ static void cleanSuperTuxKart()
     Online::ServersManager::deallocate();
     NetworkManager::kill();
 
+    // All users of the job system are deleted now
+    JobSystem::destroy();
+
     cleanUserConfig();
 
     StateManager::deallocate();
@@ -1644,7 +1996,18 @@ static void cleanUserConfig()
 //=============================================================================
 void runUnitTests()
 {
+    AILookaheadTable::unitTesting();
     GraphicsRestrictions::unitTesting();
+    JitterBuffer::unitTesting();
+    KartRelevance::unitTesting();
+    KartSnapshotCodec::unitTesting();
+    LoopbackTransport::unitTesting();
+    MessageBatch::unitTesting();
+    NetworkString::unitTesting();
+    ReplayStream::unitTesting();
+    SceneCuller::unitTesting();
+    TextureCompressor::unitTesting();
+    JobSystem::unitTesting();
     // Test easter mode: in 2015 Easter is 5th of April - check with 0 days
     // before and after
     int saved_easter_mode = UserConfigParams::m_easter_ear_mode;
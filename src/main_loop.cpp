@@ -32,10 +32,12 @@
 #include "modes/world.hpp"
 #include "network/protocol_manager.hpp"
 #include "network/network_world.hpp"
+#include "network/server_snapshot_benchmark.hpp"
 #include "online/request_manager.hpp"
 #include "race/race_manager.hpp"
 #include "states_screens/state_manager.hpp"
 #include "utils/profiler.hpp"
+#include "utils/time.hpp"
 
 MainLoop* main_loop = 0;
 
@@ -102,7 +104,9 @@ void MainLoop::updateRace(float dt)
 {
     if(ProfileWorld::isProfileMode()) dt=1.0f/60.0f;
 
-    if (NetworkWorld::getInstance<NetworkWorld>()->isRunning())
+    if (ServerSnapshotBenchmark::get())
+        ServerSnapshotBenchmark::get()->update(dt);
+    else if (NetworkWorld::getInstance<NetworkWorld>()->isRunning())
         NetworkWorld::getInstance<NetworkWorld>()->update(dt);
     else
         World::getWorld()->updateWorld(dt);
@@ -183,6 +187,90 @@ void MainLoop::run()
 
 }   // run
 
+//-----------------------------------------------------------------------------
+/** The main loop of a dedicated server: there is no GUI, no graphics and no
+ *  sound, only the network protocols and the world are updated. The world
+ *  is updated with a fixed time step. The time of each tick is computed
+ *  from the start time (and not from the end of the previous tick), so
+ *  the simulation does not drift against the real time. If the server
+ *  falls behind, ticks are computed without sleeping till it has caught
+ *  up; if it falls behind too much (e.g. while loading a track), the
+ *  missed ticks are skipped.
+ *  Every 10 seconds the time used per tick is logged, compared to the time
+ *  available for a tick (the CPU budget).
+ */
+void MainLoop::runDedicatedServer()
+{
+    int tick_rate = UserConfigParams::m_server_tick_rate;
+    if (tick_rate < 1)
+        tick_rate = 1;
+    const double tick_length = 1.0 / tick_rate;
+    // Number of ticks the server can fall behind before skipping ticks
+    const int max_ticks_behind = 5;
+
+    Log::info("MainLoop", "Running dedicated server with %d ticks per "
+              "second.", tick_rate);
+
+    double next_tick = StkTime::getRealTime();
+    double last_report = next_tick;
+    int    ticks = 0, overruns = 0, skipped = 0;
+    double busy_sum = 0, busy_max = 0;
+
+    while (!m_abort)
+    {
+        const double start = StkTime::getRealTime();
+
+        if (World::getWorld())  // race is active if world exists
+            updateRace((float)tick_length);
+
+        if (!m_abort)
+        {
+            ProtocolManager::getInstance()->update();
+            Online::RequestManager::get()->update((float)tick_length);
+        }
+
+        const double now = StkTime::getRealTime();
+        const double busy = now - start;
+        ticks++;
+        busy_sum += busy;
+        if (busy > busy_max)
+            busy_max = busy;
+        if (busy > tick_length)
+            overruns++;
+
+        next_tick += tick_length;
+        if (now > next_tick + max_ticks_behind*tick_length)
+        {
+            // Too far behind, skip the missed ticks
+            int missed = (int)((now - next_tick) / tick_length);
+            skipped   += missed;
+            next_tick += missed*tick_length;
+        }
+
+        // Sleep till the next tick is due. StkTime::sleep has a
+        // resolution of 1 ms, so don't sleep for the last fraction.
+        double wait = next_tick - StkTime::getRealTime();
+        while (wait > 0.001)
+        {
+            StkTime::sleep((int)(wait*1000));
+            wait = next_tick - StkTime::getRealTime();
+        }
+
+        if (now - last_report > 10.0)
+        {
+            Log::info("MainLoop", "%d ticks: %.2f ms average, %.2f ms max, "
+                      "%.1f%% of the budget of %.2f ms used; %d ticks over "
+                      "budget, %d skipped.", ticks,
+                      busy_sum * 1000.0 / ticks, busy_max * 1000.0,
+                      busy_sum * 100.0 / (ticks * tick_length),
+                      tick_length * 1000.0, overruns, skipped);
+            last_report = now;
+            ticks = overruns = skipped = 0;
+            busy_sum = busy_max = 0;
+        }
+    }   // while !m_abort
+}   // runDedicatedServer
+
 //-----------------------------------------------------------------------------
 /** Set the abort flag, causing the mainloop to be left.
  */
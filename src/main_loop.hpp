@@ -40,6 +40,7 @@ public:
          MainLoop();
         ~MainLoop();
     void run();
+    void runDedicatedServer();
     void abort();
     void setThrottleFPS(bool throttle) { m_throttle_fps = throttle; }
     // ------------------------------------------------------------------------
@@ -22,11 +22,15 @@
 #include "graphics/camera.hpp"
 #include "graphics/irr_driver.hpp"
 #include "karts/kart_with_stats.hpp"
+#include "karts/controller/ai_lookahead_table.hpp"
 #include "karts/controller/controller.hpp"
+#include "network/server_snapshot_benchmark.hpp"
+#include "physics/physics.hpp"
 #include "tracks/track.hpp"
 
 #include <ISceneManager.h>
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 
@@ -34,6 +38,8 @@ ProfileWorld::ProfileType ProfileWorld::m_profile_mode=PROFILE_NONE;
 int   ProfileWorld::m_num_laps    = 0;
 float ProfileWorld::m_time        = 0.0f;
 bool  ProfileWorld::m_no_graphics = false;
+std::string ProfileWorld::m_stats_file;
+int   ProfileWorld::m_seed        = -1;
 
 //-----------------------------------------------------------------------------
 /** The constructor sets the number of (local) players to 0, since only AI
@@ -167,6 +173,27 @@ void ProfileWorld::update(float dt)
 
 }   // update
 
+//-----------------------------------------------------------------------------
+/** Returns a hash of the positions and rotations of all karts, which is
+ *  used to compare the result of different physics settings.
+ */
+unsigned int ProfileWorld::getKartChecksum() const
+{
+    unsigned int hash = 2166136261u;   // FNV-1a
+    for(unsigned int i=0; i<m_karts.size(); i++)
+    {
+        const btTransform &t = m_karts[i]->getTrans();
+        float values[7] = { t.getOrigin().getX(), t.getOrigin().getY(),
+                            t.getOrigin().getZ(), t.getRotation().getX(),
+                            t.getRotation().getY(), t.getRotation().getZ(),
+                            t.getRotation().getW()                       };
+        const unsigned char *bytes = (const unsigned char*)values;
+        for(unsigned int j=0; j<sizeof(values); j++)
+            hash = (hash ^ bytes[j]) * 16777619u;
+    }
+    return hash;
+}   // getKartChecksum
+
 //-----------------------------------------------------------------------------
 /** This function is called when the race is finished, but end-of-race
  *  animations have still to be played. In the case of profiling,
@@ -204,6 +231,28 @@ void ProfileWorld::enterRaceOverState()
     Log::verbose("profile", "Number of frames: %d time %f, Average FPS: %f",
                  m_frame_count, runtime, (float)m_frame_count/runtime);
 
+    // Print physics statistics. The checksum of the final kart positions
+    // allows to check that the parallel physics give the same result
+    // independent of the number of threads (using --seed).
+    Log::verbose("profile", "Physics threads: %d, updates: %d, "
+                 "time: %f s (%f ms per update), checksum: %08x",
+                 m_physics->getNumThreads(), m_physics->getNumUpdates(),
+                 m_physics->getStepTime(),
+                 1000.0f*m_physics->getStepTime()
+                        /std::max(1, m_physics->getNumUpdates()),
+                 getKartChecksum());
+
+    // Print the time used by the AI (and the kart updates), which is
+    // used to compare the AI with and without its look-ahead table.
+    Log::verbose("profile", "AI lookahead table: %d, updates: %d, "
+                 "time: %f s (%f ms per update)",
+                 AILookaheadTable::get()!=NULL, getNumAIUpdates(),
+                 getAITime(),
+                 1000.0f*getAITime()/std::max(1, getNumAIUpdates()));
+
+    if(ServerSnapshotBenchmark::get())
+        ServerSnapshotBenchmark::get()->printReport();
+
     // Print geometry statistics if we're not in no-graphics mode
     if(!m_no_graphics)
     {
@@ -255,6 +304,9 @@ void ProfileWorld::enterRaceOverState()
         Log::verbose("profile", ss.str().c_str());
     }
 
+    if(!m_stats_file.empty())
+        writeStatsFile();
+
     // Print group statistics of all karts
     Log::verbose("profile", "min %f  max %f  av %f\n",
                   min_t, max_t, av_t/m_karts.size());
@@ -347,3 +399,56 @@ void ProfileWorld::enterRaceOverState()
     delete this;
     main_loop->abort();
 }   // enterRaceOverState
+
+//-----------------------------------------------------------------------------
+/** Appends the statistics of all karts to the statistics file, one line
+ *  per kart in CSV format. A header line is written if the file is empty.
+ *  Each line contains the race settings, so that the results of many races
+ *  (e.g. from tools/profile_farm.sh) can simply be concatenated.
+ */
+void ProfileWorld::writeStatsFile() const
+{
+    FILE *fout = fopen(m_stats_file.c_str(), "a");
+    if(!fout)
+    {
+        Log::error("profile", "Can't open statistics file '%s'.",
+                   m_stats_file.c_str());
+        return;
+    }
+    fseek(fout, 0, SEEK_END);
+    if(ftell(fout)==0)
+    {
+        fprintf(fout, "track,difficulty,laps,num_karts,seed,kart,controller,"
+                      "start_position,end_position,time,average_speed,"
+                      "top_speed,skid_time,rescue_time,rescue_count,"
+                      "brake_count,explosion_time,explosion_count,"
+                      "bonus_count,banana_count,small_nitro_count,"
+                      "large_nitro_count,bubblegum_count,off_track_count\n");
+    }
+
+    const int laps = m_profile_mode==PROFILE_LAPS ? race_manager->getNumLaps()
+                                                  : 1;
+    const float distance = laps * m_track->getTrackLength();
+    const std::string difficulty =
+        race_manager->getDifficultyAsString(race_manager->getDifficulty());
+    for(unsigned int i=0; i<m_karts.size(); i++)
+    {
+        const KartWithStats *kart =
+            dynamic_cast<const KartWithStats*>(m_karts[i]);
+        fprintf(fout, "%s,%s,%d,%d,%d,%s,%s,%d,%d,%f,%f,%f,%f,%f,%d,%d,"
+                      "%f,%d,%d,%d,%d,%d,%d,%d\n",
+                race_manager->getTrackName().c_str(), difficulty.c_str(),
+                laps, (int)m_karts.size(), m_seed,
+                kart->getIdent().c_str(),
+                kart->getController()->getControllerName().c_str(),
+                1+i, kart->getPosition(), kart->getFinishTime(),
+                distance/kart->getFinishTime(), kart->getTopSpeed(),
+                kart->getSkiddingTime(),    kart->getRescueTime(),
+                kart->getRescueCount(),     kart->getBrakeCount(),
+                kart->getExplosionTime(),   kart->getExplosionCount(),
+                kart->getBonusCount(),      kart->getBananaCount(),
+                kart->getSmallNitroCount(), kart->getLargeNitroCount(),
+                kart->getBubblegumCount(),  kart->getOffTrackCount());
+    }
+    fclose(fout);
+}   // writeStatsFile
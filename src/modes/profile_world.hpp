@@ -21,6 +21,8 @@
 
 #include "modes/standard_race.hpp"
 
+#include <string>
+
 class Kart;
 
 /**
@@ -43,6 +45,14 @@ private:
     /** In time based profiling only: time to run. */
     static float m_time;
 
+    /** If not empty, the statistics of all karts are appended to this file
+     *  in CSV format at the end of the race. */
+    static std::string m_stats_file;
+
+    /** The random seed used (if set with --seed), which is written to the
+     *  statistics file so that a race can be repeated. */
+    static int   m_seed;
+
     /** Return value of real time at start of race. */
     unsigned int m_start_time;
 
@@ -67,6 +77,9 @@ private:
     /** Number of calls to draw. */
     long long    m_num_calls;
 
+    unsigned int getKartChecksum() const;
+    void         writeStatsFile() const;
+
 protected:
     /** In laps based profiling: number of laps to run. Also
      *  used by DemoWorld. */
@@ -97,6 +110,13 @@ public:
     // ------------------------------------------------------------------------
     /** Returns true if no graphics should be displayed. */
     static   bool isNoGraphics()  {return m_no_graphics; }
+    // ------------------------------------------------------------------------
+    /** Sets the name of the file to which the kart statistics are
+     *  appended. */
+    static   void setStatsFile(const std::string &f) { m_stats_file = f; }
+    // ------------------------------------------------------------------------
+    /** Sets the random seed, which is only written to the statistics. */
+    static   void setSeed(int seed) { m_seed = seed; }
 };
 
 #endif
@@ -31,6 +31,7 @@
 #include "input/device_manager.hpp"
 #include "input/keyboard_device.hpp"
 #include "items/projectile_manager.hpp"
+#include "karts/controller/ai_lookahead_table.hpp"
 #include "karts/controller/player_controller.hpp"
 #include "karts/controller/end_controller.hpp"
 #include "karts/controller/skidding_ai.hpp"
@@ -39,6 +40,7 @@
 #include "karts/kart_properties_manager.hpp"
 #include "modes/overworld.hpp"
 #include "modes/profile_world.hpp"
+#include "network/server_snapshot_benchmark.hpp"
 #include "physics/btKart.hpp"
 #include "physics/physics.hpp"
 #include "physics/triangle_mesh.hpp"
@@ -57,7 +59,9 @@
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
 #include "utils/constants.hpp"
+#include "utils/job_system.hpp"
 #include "utils/profiler.hpp"
+#include "utils/time.hpp"
 #include "utils/translation.hpp"
 #include "utils/string_utils.hpp"
 
@@ -123,6 +127,8 @@ World::World() : WorldStatus(), m_clear_color(255,100,101,140)
     m_schedule_tutorial  = false;
     m_is_network_world   = false;
     m_weather            = NULL;
+    m_ai_time            = 0;
+    m_num_ai_updates     = 0;
 
     m_stop_music_when_dialog_open = true;
 
@@ -191,6 +197,28 @@ void World::init()
 
     }  // for i
 
+    // The look-ahead table of the AI is computed for the shortest and
+    // widest kart, so that it is valid for all AI karts.
+    bool has_ai = false;
+    float kart_length = 0, kart_width = 0;
+    for(unsigned int i=0; i<num_karts; i++)
+    {
+        if(race_manager->getKartType(i)!=RaceManager::KT_AI &&
+           race_manager->getKartType(i)!=RaceManager::KT_LEADER)
+            continue;
+        float length = m_karts[i]->getKartLength();
+        if(!has_ai || length<kart_length) kart_length = length;
+        kart_width = std::max(kart_width, m_karts[i]->getKartWidth());
+        has_ai = true;
+    }
+    if(has_ai && UserConfigParams::m_ai_lookahead_table &&
+       !history->replayHistory())
+        AILookaheadTable::create(kart_length, kart_width);
+
+    if(ProfileWorld::isProfileMode() &&
+       ServerSnapshotBenchmark::getNumClients()>0)
+        ServerSnapshotBenchmark::create();
+
     // Now that all models are loaded, apply the overrides
     irr_driver->applyObjectPassShader();
 
@@ -398,6 +426,8 @@ World::~World()
 
     m_karts.clear();
     Camera::removeAllCameras();
+    AILookaheadTable::destroy();
+    ServerSnapshotBenchmark::destroy();
 
     projectile_manager->cleanup();
     // In case that the track is not found, m_physics is still undefined.
@@ -899,6 +929,24 @@ void World::scheduleTutorial()
     m_schedule_tutorial = true;
 }
 
+//-----------------------------------------------------------------------------
+/** Calls Controller::prepareUpdate for a range of karts, used with
+ *  JobSystem::parallelFor. */
+struct PrepareControllers
+{
+    const World::KartList *m_karts;
+    float                  m_dt;
+    void operator()(int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            AbstractKart *kart = (*m_karts)[i];
+            if(!kart->isEliminated())
+                kart->getController()->prepareUpdate(m_dt);
+        }
+    }
+};   // PrepareControllers
+
 //-----------------------------------------------------------------------------
 /** Updates the physics, all karts, the track, and projectile manager.
  *  \param dt Time step size.
@@ -936,12 +984,31 @@ void World::update(float dt)
     }
 
     PROFILER_PUSH_CPU_MARKER("World::update (AI)", 0x40, 0x7F, 0x00);
+    double ai_start = StkTime::getRealTime();
     const int kart_amount = (int)m_karts.size();
+    if(!history->replayHistory())
+    {
+        // The controllers compute their decisions in parallel with the
+        // positions of all karts after the physics step, so the result does
+        // not depend on the order of the karts or the number of threads.
+        for (int i = 0 ; i < kart_amount; ++i)
+        {
+            if(!m_karts[i]->isEliminated()) m_karts[i]->updatePosition();
+        }
+        PrepareControllers prepare;
+        prepare.m_karts = &m_karts;
+        prepare.m_dt    = dt;
+        const int ai_threads = UserConfigParams::m_ai_threads;
+        JobSystem::parallelFor(0, kart_amount, &prepare,
+                               ai_threads < 0 ? 0 : core::max_(ai_threads, 1));
+    }
     for (int i = 0 ; i < kart_amount; ++i)
     {
         // Update all karts that are not eliminated
         if(!m_karts[i]->isEliminated()) m_karts[i]->update(dt) ;
     }
+    m_ai_time += StkTime::getRealTime() - ai_start;
+    m_num_ai_updates++;
     PROFILER_POP_CPU_MARKER();
 
     PROFILER_PUSH_CPU_MARKER("World::update (camera)", 0x60, 0x7F, 0x00);
@@ -176,6 +176,12 @@ protected:
     /** Used to show weather graphical effects. */
     Weather* m_weather;
 
+    /** Time spent updating the AI and the karts (for profiling). */
+    double   m_ai_time;
+
+    /** Number of AI and kart updates included in m_ai_time. */
+    int      m_num_ai_updates;
+
 
     virtual void  onGo();
     /** Returns true if the race is over. Must be defined by all modes. */
@@ -320,6 +326,12 @@ public:
     /** Returns a pointer to the physics. */
     Physics        *getPhysics() const { return m_physics; }
     // ------------------------------------------------------------------------
+    /** Returns the time spent updating the AI and the karts. */
+    double          getAITime() const { return m_ai_time; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of AI and kart updates. */
+    int             getNumAIUpdates() const { return m_num_ai_updates; }
+    // ------------------------------------------------------------------------
     /** Returns a pointer to the track. */
     Track          *getTrack() const { return m_track; }
     // ------------------------------------------------------------------------
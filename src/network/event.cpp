@@ -42,16 +42,12 @@ Event::Event(ENetEvent* event)
     }
     if (type == EVENT_TYPE_MESSAGE)
     {
-        m_data = NetworkString(std::string((char*)(event->packet->data), event->packet->dataLength-1));
+        // The data is not copied, the packet is destroyed once the data
+        // is not used anymore.
+        m_data = NetworkString(event->packet);
     }
-
-    m_packet = NULL;
-    if (event->packet)
-        m_packet = event->packet;
-
-    if (m_packet)
-        enet_packet_destroy(m_packet); // we got all we need, just remove the data.
-    m_packet = NULL;
+    else if (event->packet)
+        enet_packet_destroy(event->packet);
 
     std::vector<STKPeer*> peers = NetworkManager::getInstance()->getPeers();
     peer = new STKPeer*;
@@ -76,10 +72,10 @@ Event::Event(ENetEvent* event)
 
 Event::Event(const Event& event)
 {
-    m_packet = NULL;
     m_data = event.m_data;
-    // copy the peer
-    peer = event.peer;
+    // copy the peer, each event frees its own pointer
+    peer = new STKPeer*;
+    *peer = *event.peer;
     type = event.type;
 }
 
@@ -87,7 +83,6 @@ Event::~Event()
 {
     delete peer;
     peer = NULL;
-    m_packet = NULL;
 }
 
 void Event::removeFront(int size)
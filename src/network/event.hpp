@@ -61,7 +61,8 @@ class Event
          */
         Event(const Event& event);
         /*! \brief Destructor
-         *  frees the memory of the ENetPacket.
+         *  releases the data (the ENetPacket is freed when no copy of the
+         *  data is used anymore).
          */
         ~Event();
 
@@ -71,17 +72,22 @@ class Event
         void removeFront(int size);
 
         /*! \brief Get a copy of the data.
-         *  \return A copy of the message data. This is empty for events like
-         *  connection or disconnections.
+         *  \return A copy of the message data (which shares the memory with
+         *  the received packet). This is empty for events like connection
+         *  or disconnections.
          */
         NetworkString data() const { return m_data; }
 
+        /*! \brief Replaces the data (e.g. by one message of a batch).
+         *  \param data : The new data.
+         */
+        void setData(const NetworkString& data) { m_data = data; }
+
         EVENT_TYPE type;    //!< Type of the event.
         STKPeer** peer;     //!< Pointer to the peer that triggered that event.
 
     private:
-        NetworkString m_data; //!< Copy of the data passed by the event.
-        ENetPacket* m_packet; //!< A pointer on the ENetPacket to be deleted.
+        NetworkString m_data; //!< The data passed by the event.
 };
 
 #endif // EVENT_HPP
@@ -0,0 +1,307 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/jitter_buffer.hpp"
+
+#include "utils/log.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <utility>
+#include <vector>
+
+/** Gains of the running averages of the transit time, its deviation and
+ *  the interval between states (as in RFC 3550). */
+static const double TRANSIT_GAIN  = 1.0/16.0;
+static const double JITTER_GAIN   = 1.0/16.0;
+static const double INTERVAL_GAIN = 1.0/8.0;
+
+/** Multiple of the jitter added to the playout delay. */
+static const double JITTER_FACTOR = 3.0;
+
+/** Maximum change of the playout delay per second. */
+static const double DELAY_SLEW    = 0.1;
+
+/** Maximum time (in s) a position is extrapolated. */
+static const double MAX_EXTRAPOLATION = 0.25;
+
+// ----------------------------------------------------------------------------
+JitterBuffer::JitterBuffer()
+{
+    reset();
+}   // JitterBuffer
+
+// ----------------------------------------------------------------------------
+/** Removes all states and resets the delay estimation.
+ */
+void JitterBuffer::reset()
+{
+    m_first         = 0;
+    m_count         = 0;
+    m_num_added     = 0;
+    m_transit       = 0;
+    m_jitter        = 0;
+    m_interval      = 0;
+    m_delay         = 0;
+    m_last_get_time = -1;
+    m_extrapolating = false;
+}   // reset
+
+// ----------------------------------------------------------------------------
+/** Adds a received state. States that are not newer than the last state
+ *  are ignored.
+ *  \param sample_time Time of the state on the sender's clock.
+ *  \param arrival_time Local time at which the state was received.
+ *  \param xyz Position of the kart.
+ *  \param rotation Rotation of the kart.
+ */
+void JitterBuffer::add(double sample_time, double arrival_time,
+                       const Vec3 &xyz, const btQuaternion &rotation)
+{
+    if(m_count>0)
+    {
+        const double last_time = getSample(m_count-1).m_time;
+        if(sample_time<=last_time)
+            return;
+        const double interval = sample_time - last_time;
+        if(m_num_added==1)
+            m_interval = interval;
+        else
+            m_interval += (interval-m_interval)*INTERVAL_GAIN;
+    }
+
+    const double transit = arrival_time - sample_time;
+    if(m_num_added==0)
+    {
+        m_transit = transit;
+        m_jitter  = 0;
+    }
+    else
+    {
+        m_jitter  += (fabs(transit-m_transit)-m_jitter)*JITTER_GAIN;
+        m_transit += (transit-m_transit)*TRANSIT_GAIN;
+    }
+    m_num_added++;
+
+    if(m_count==BUFFER_SIZE)
+    {
+        m_first = (m_first+1) % BUFFER_SIZE;
+        m_count--;
+    }
+    Sample &sample    = m_samples[(m_first+m_count) % BUFFER_SIZE];
+    sample.m_time     = sample_time;
+    sample.m_xyz      = xyz;
+    sample.m_rotation = rotation;
+    m_count++;
+}   // add
+
+// ----------------------------------------------------------------------------
+/** Returns the velocity at the i-th oldest sample, computed from the
+ *  neighbouring samples.
+ */
+Vec3 JitterBuffer::getTangent(unsigned int i) const
+{
+    const unsigned int prev = i>0 ? i-1 : i;
+    const unsigned int next = i+1<m_count ? i+1 : i;
+    if(prev==next)
+        return Vec3(0, 0, 0);
+    const Sample &a = getSample(prev);
+    const Sample &b = getSample(next);
+    return (b.m_xyz-a.m_xyz) / (float)(b.m_time-a.m_time);
+}   // getTangent
+
+// ----------------------------------------------------------------------------
+/** Computes the state to show at the given local time.
+ *  \param time The local time.
+ *  \param xyz On return the position.
+ *  \param rotation On return the rotation.
+ *  \return False if no state was received yet.
+ */
+bool JitterBuffer::get(double time, Vec3 *xyz, btQuaternion *rotation)
+{
+    if(m_count==0)
+        return false;
+
+    const double target = m_transit + m_interval + JITTER_FACTOR*m_jitter;
+    if(m_last_get_time<0)
+        m_delay = target;
+    else
+    {
+        const double max_change =
+            std::max(0.0, DELAY_SLEW*(time-m_last_get_time));
+        m_delay += std::min(max_change, std::max(-max_change, target-m_delay));
+    }
+    m_last_get_time = time;
+
+    // The time to show on the sender's clock
+    const double t = time - m_delay;
+    m_extrapolating = false;
+
+    const Sample &first = getSample(0);
+    if(t<=first.m_time)
+    {
+        *xyz      = first.m_xyz;
+        *rotation = first.m_rotation;
+        return true;
+    }
+
+    const Sample &last = getSample(m_count-1);
+    if(t>=last.m_time)
+    {
+        const double dt = std::min(t-last.m_time, MAX_EXTRAPOLATION);
+        *xyz      = last.m_xyz + getTangent(m_count-1)*(float)dt;
+        *rotation = last.m_rotation;
+        m_extrapolating = t>last.m_time;
+        return true;
+    }
+
+    unsigned int i = m_count-2;
+    while(getSample(i).m_time>t)
+        i--;
+    const Sample &a = getSample(i);
+    const Sample &b = getSample(i+1);
+    const float h  = (float)(b.m_time-a.m_time);
+    const float s  = (float)((t-a.m_time)/h);
+    const float s2 = s*s;
+    const float s3 = s2*s;
+    // Cubic Hermite basis functions
+    const float h00 =  2*s3 - 3*s2 + 1;
+    const float h10 =    s3 - 2*s2 + s;
+    const float h01 = -2*s3 + 3*s2;
+    const float h11 =    s3 -   s2;
+    *xyz = a.m_xyz*h00 + getTangent(i)*(h10*h) + b.m_xyz*h01
+         + getTangent(i+1)*(h11*h);
+
+    // Take the shorter way between the two rotations
+    btQuaternion qa = a.m_rotation;
+    if(qa.dot(b.m_rotation)<0)
+        qa = -qa;
+    *rotation = qa.slerp(b.m_rotation, s);
+    return true;
+}   // get
+
+// ----------------------------------------------------------------------------
+/** Position of the test kart, which drives on a circle, at a given time. */
+static Vec3 getTestPosition(double t)
+{
+    const double radius = 50.0, speed = 20.0;
+    const double angle  = t*speed/radius;
+    return Vec3((float)(radius*cos(angle)), 0, (float)(radius*sin(angle)));
+}   // getTestPosition
+
+// ----------------------------------------------------------------------------
+/** Replays a packet timing trace: states of a kart are sent every 0.1 s and
+ *  arrive at the given times, and the kart is shown at 60 frames per second.
+ *  The smoothness is measured as the RMS of the acceleration of the shown
+ *  position, which is compared with showing the most recent state (as
+ *  without jitter buffer). The true acceleration is 8 m/s^2.
+ *  \param name Name of the trace.
+ *  \param arrival Arrival time of each state, negative if it is lost.
+ */
+static void replayTrace(const char *name, const std::vector<double> &arrival)
+{
+    const double interval = 0.1, frame = 1.0/60.0;
+    std::vector<std::pair<double, double> > packets;
+    for(unsigned int i=0; i<arrival.size(); i++)
+    {
+        if(arrival[i]>=0)
+            packets.push_back(std::make_pair(arrival[i], i*interval));
+    }
+    std::sort(packets.begin(), packets.end());
+
+    JitterBuffer buffer;
+    Vec3 latest;
+    bool has_latest = false;
+    unsigned int next = 0, frames = 0, extrapolated = 0;
+    double accel2 = 0, accel2_latest = 0, error = 0, delay = 0;
+    Vec3 shown[3], shown_latest[3];
+    const double end = arrival.size()*interval;
+    for(double now=0; now<end; now+=frame)
+    {
+        while(next<packets.size() && packets[next].first<=now)
+        {
+            const double t = packets[next].second;
+            buffer.add(t, packets[next].first, getTestPosition(t),
+                       btQuaternion(Vec3(0, 1, 0), (float)t));
+            latest     = getTestPosition(t);
+            has_latest = true;
+            next++;
+        }
+        Vec3 xyz;
+        btQuaternion q;
+        if(!buffer.get(now, &xyz, &q) || !has_latest || now<1.0)
+            continue;
+
+        shown[0] = shown[1];                shown[1] = shown[2];
+        shown[2] = xyz;
+        shown_latest[0] = shown_latest[1];  shown_latest[1] = shown_latest[2];
+        shown_latest[2] = latest;
+        frames++;
+        error += (xyz-getTestPosition(now-buffer.getPlayoutDelay())).length();
+        delay += buffer.getPlayoutDelay();
+        if(buffer.isExtrapolating())
+            extrapolated++;
+        if(frames<3)
+            continue;
+        accel2 += ((shown[2]-shown[1]*2+shown[0])/(float)(frame*frame))
+                  .length2();
+        accel2_latest += ((shown_latest[2] - shown_latest[1]*2
+                          + shown_latest[0])/(float)(frame*frame)).length2();
+    }
+    assert(frames>2);
+    const double rms        = sqrt(accel2/(frames-2));
+    const double rms_latest = sqrt(accel2_latest/(frames-2));
+    Log::info("JitterBuffer", "%-8s delay %.0f ms, error %.3f m, %.1f%% "
+              "extrapolated, RMS acceleration %.1f m/s^2 (latest state: "
+              "%.1f m/s^2).", name, delay/frames*1000.0, error/frames,
+              extrapolated*100.0/frames, rms, rms_latest);
+    assert(rms < rms_latest);
+    assert(error/frames < 1.0);
+}   // replayTrace
+
+// ----------------------------------------------------------------------------
+/** Replays several packet timing traces (constant latency, random jitter,
+ *  bursts, and packet loss) and prints how smooth the output is.
+ */
+void JitterBuffer::unitTesting()
+{
+    const unsigned int num_states = 300;
+    const double interval = 0.1, latency = 0.05;
+    // A simple random generator, so that the traces are always the same
+    unsigned int seed = 12345;
+    std::vector<double> constant, jitter, bursts, loss;
+    for(unsigned int i=0; i<num_states; i++)
+    {
+        const double t = i*interval;
+        constant.push_back(t+latency);
+
+        seed = seed*1103515245 + 12345;
+        const double r = ((seed>>16) & 0x7fff)/32768.0;
+        jitter.push_back(t+latency+0.08*r);
+
+        // Packets are delivered in groups every 0.3 s
+        bursts.push_back(ceil((t+latency)/0.3)*0.3);
+
+        loss.push_back(r<0.15 ? -1.0 : t+latency);
+    }
+    replayTrace("constant", constant);
+    replayTrace("jitter",   jitter);
+    replayTrace("bursts",   bursts);
+    replayTrace("loss",     loss);
+}   // unitTesting
@@ -0,0 +1,115 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+/*! \file jitter_buffer.hpp
+ *  \brief Smooth playback of the received states of a remote kart.
+ */
+
+#ifndef HEADER_JITTER_BUFFER_HPP
+#define HEADER_JITTER_BUFFER_HPP
+
+#include "utils/vec3.hpp"
+
+#include "LinearMath/btQuaternion.h"
+
+/** \brief Buffers the timestamped states of a remote kart and plays them
+ *  back with a delay.
+ *  Snapshots are sent at a low rate and arrive with varying latency, often
+ *  in bursts. Instead of showing the most recent state, the kart is shown
+ *  at a time that lags behind the received states by an adaptive playout
+ *  delay, so that there is usually a state before and after the shown time.
+ *  The position is interpolated with a cubic Hermite spline (using tangents
+ *  computed from the neighbouring states), the rotation with slerp. If no
+ *  newer state is available, the position is extrapolated for a limited
+ *  time.
+ *  The playout delay is the average interval between states, plus the
+ *  average transit time (which includes the clock offset between sender
+ *  and receiver), plus a multiple of the transit time jitter. These are
+ *  estimated as in RFC 3550. The delay changes slowly, so that the motion
+ *  does not jump when it adapts.
+ *  \ingroup network
+ */
+class JitterBuffer
+{
+public:
+    /** A received state. */
+    struct Sample
+    {
+        /** Time of the state on the sender's clock. */
+        double       m_time;
+        Vec3         m_xyz;
+        btQuaternion m_rotation;
+    };   // Sample
+
+private:
+    /** Number of states kept. */
+    static const unsigned int BUFFER_SIZE = 32;
+
+    /** The states in a ring buffer, m_first is the oldest one. */
+    Sample       m_samples[BUFFER_SIZE];
+    unsigned int m_first;
+    unsigned int m_count;
+
+    /** Number of states added since the last reset. */
+    unsigned int m_num_added;
+
+    /** Smoothed transit time (arrival time minus sample time). */
+    double       m_transit;
+
+    /** Smoothed deviation of the transit time. */
+    double       m_jitter;
+
+    /** Smoothed interval between samples. */
+    double       m_interval;
+
+    /** The playout delay currently used. */
+    double       m_delay;
+
+    /** Local time of the last call to get(), or -1. */
+    double       m_last_get_time;
+
+    /** True if the last call to get() had to extrapolate. */
+    bool         m_extrapolating;
+
+    // ------------------------------------------------------------------------
+    /** Returns the i-th oldest sample. */
+    const Sample &getSample(unsigned int i) const
+    {
+        return m_samples[(m_first + i) % BUFFER_SIZE];
+    }   // getSample
+    // ------------------------------------------------------------------------
+    Vec3 getTangent(unsigned int i) const;
+
+public:
+         JitterBuffer();
+    void reset();
+    void add(double sample_time, double arrival_time, const Vec3 &xyz,
+             const btQuaternion &rotation);
+    bool get(double time, Vec3 *xyz, btQuaternion *rotation);
+    static void unitTesting();
+
+    // ------------------------------------------------------------------------
+    /** Returns the playout delay in seconds. */
+    double getPlayoutDelay() const { return m_delay; }
+    // ------------------------------------------------------------------------
+    /** Returns true if the last call to get() had no newer state and
+     *  extrapolated the position. */
+    bool isExtrapolating() const { return m_extrapolating; }
+};   // JitterBuffer
+
+#endif
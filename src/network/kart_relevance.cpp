@@ -0,0 +1,317 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/kart_relevance.hpp"
+
+#include "config/user_config.hpp"
+#include "karts/abstract_kart.hpp"
+#include "modes/linear_world.hpp"
+#include "tracks/track.hpp"
+#include "utils/log.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <functional>
+#include <math.h>
+#include <stdlib.h>
+#include <utility>
+
+/** Karts closer than this (in m) have the full relevance. */
+static const float NEAR_DISTANCE     = 25.0f;
+
+/** Minimum relevance, i.e. each kart is sent at least every 8 snapshots. */
+static const float MIN_RELEVANCE     = 0.125f;
+
+/** Minimum relevance of a kart that can be seen. */
+static const float VISIBLE_RELEVANCE = 0.5f;
+
+/** Maximum distance (in m), and cosine of the maximum angle to the driving
+ *  direction, at which a kart can be seen. */
+static const float VIEW_DISTANCE     = 100.0f;
+static const float VIEW_COS          = 0.7f;
+
+/** Karts up to this many positions before or after a kart in the race are
+ *  its rivals. */
+static const int   RIVAL_POSITIONS   = 1;
+
+// ----------------------------------------------------------------------------
+KartRelevance::KartRelevance()
+{
+    m_track_length = 0;
+    m_enabled      = false;
+    m_budget       = 0;
+}   // KartRelevance
+
+// ----------------------------------------------------------------------------
+/** Reads the settings of interest management and the positions of all
+ *  karts from the world. Called once before the snapshots for all clients
+ *  are prepared.
+ */
+void KartRelevance::update()
+{
+    m_enabled = UserConfigParams::m_network_interest_management;
+    if(!m_enabled)
+        return;
+    int frequency = UserConfigParams::m_kart_update_frequency;
+    if(frequency < 1)
+        frequency = 1;
+    m_budget = UserConfigParams::m_network_client_bandwidth / frequency;
+
+    World *world = World::getWorld();
+    const LinearWorld *linear_world = dynamic_cast<LinearWorld*>(world);
+    m_track_length = linear_world ? world->getTrack()->getTrackLength() : 0;
+    m_karts.resize(world->getNumKarts());
+    for(unsigned int i=0; i<m_karts.size(); i++)
+    {
+        const AbstractKart *kart = world->getKart(i);
+        KartInfo &info = m_karts[i];
+        info.m_xyz      = kart->getXYZ();
+        info.m_forward  = kart->getTrans().getBasis().getColumn(2);
+        info.m_distance = linear_world ? linear_world->getOverallDistance(i)
+                                       : 0;
+        info.m_position = kart->getPosition();
+    }
+}   // update
+
+// ----------------------------------------------------------------------------
+/** Sets the karts directly (instead of reading them from the world).
+ *  \param track_length Length of a lap, 0 to use the straight line
+ *         distance between karts.
+ */
+void KartRelevance::setKarts(const std::vector<KartInfo> &karts,
+                             float track_length)
+{
+    m_karts        = karts;
+    m_track_length = track_length;
+}   // setKarts
+
+// ----------------------------------------------------------------------------
+/** Returns the relevance (in (0, 1]) of a kart for the client that drives
+ *  another kart (see the class description).
+ *  \param viewer World kart id of the kart of the client.
+ *  \param kart World kart id of the kart to rank.
+ */
+float KartRelevance::getRelevance(unsigned int viewer, unsigned int kart) const
+{
+    assert(viewer<m_karts.size() && kart<m_karts.size());
+    if(kart==viewer)
+        return 1.0f;
+    const KartInfo &v = m_karts[viewer];
+    const KartInfo &k = m_karts[kart];
+    if(abs(k.m_position-v.m_position) <= RIVAL_POSITIONS)
+        return 1.0f;
+
+    const Vec3 delta      = k.m_xyz - v.m_xyz;
+    const float straight  = delta.length();
+    float distance        = straight;
+    if(m_track_length>0)
+    {
+        // Karts that are laps apart can still be close to each other
+        distance = fmodf(fabsf(k.m_distance-v.m_distance), m_track_length);
+        distance = std::min(distance, m_track_length-distance);
+    }
+    float relevance = distance>NEAR_DISTANCE ? NEAR_DISTANCE/distance : 1.0f;
+    relevance = std::max(relevance, MIN_RELEVANCE);
+    if(straight<VIEW_DISTANCE && delta.dot(v.m_forward) > straight*VIEW_COS)
+        relevance = std::max(relevance, VISIBLE_RELEVANCE);
+    return relevance;
+}   // getRelevance
+
+// ----------------------------------------------------------------------------
+/** Selects the karts whose state is sent to a client in the next snapshot.
+ *  The client's own kart is always sent.
+ *  \param viewer World kart id of the kart of the client, or -1 if the
+ *         client has no kart (then all karts are equally relevant).
+ *  \param budget Bytes available for the snapshot, 0 for no limit.
+ *  \param priority The priorities of the karts for this client, which are
+ *         updated. If it has not the size of the number of karts, all karts
+ *         are sent.
+ *  \param send On return true for each kart that is sent.
+ */
+void KartRelevance::select(int viewer, int budget,
+                           std::vector<float> *priority,
+                           std::vector<bool> *send) const
+{
+    const unsigned int num_karts = (unsigned int)m_karts.size();
+    if(priority->size()!=num_karts)
+        priority->assign(num_karts, 1.0f);
+    send->assign(num_karts, false);
+
+    unsigned int max_karts = num_karts;
+    if(budget>0)
+    {
+        const int available = budget - SNAPSHOT_OVERHEAD
+                            - (int)num_karts*UNCHANGED_KART_SIZE;
+        max_karts = std::max(available, 0)
+                  / (CHANGED_KART_SIZE-UNCHANGED_KART_SIZE);
+    }
+
+    unsigned int count = 0;
+    std::vector<std::pair<float, unsigned int> > due;
+    for(unsigned int i=0; i<num_karts; i++)
+    {
+        if((int)i==viewer)
+        {
+            (*send)[i]     = true;
+            (*priority)[i] = 0;
+            count++;
+            continue;
+        }
+        (*priority)[i] += viewer<0 ? 1.0f : getRelevance(viewer, i);
+        if((*priority)[i]>=1.0f)
+            due.push_back(std::make_pair((*priority)[i], i));
+    }
+    std::sort(due.begin(), due.end(),
+              std::greater<std::pair<float, unsigned int> >());
+    for(unsigned int i=0; i<due.size() && count<max_karts; i++)
+    {
+        (*send)[due[i].second]     = true;
+        (*priority)[due[i].second] = 0;
+        count++;
+    }
+}   // select
+
+// ----------------------------------------------------------------------------
+/** Prepares the snapshot that is sent to one client: finds the baseline
+ *  for the delta compression (the last snapshot the client acknowledged,
+ *  if it is still in the history), and with interest management marks the
+ *  karts that are not selected for this client as skipped, with the state
+ *  of the baseline. The result is kept in the history of the client.
+ *  \param snapshot The current state of all karts.
+ *  \param acked The last snapshot the client acknowledged, or
+ *         KartSnapshot::NO_SEQUENCE.
+ *  \param viewer World kart id of the kart of the client, or -1.
+ *  \param client What was sent to this client, will be updated.
+ *  \param baseline On return the baseline, NULL if a full snapshot must be
+ *         sent.
+ *  \param num_sent On return the number of karts whose state is sent.
+ *  \return The snapshot to encode for this client.
+ */
+const KartSnapshot&
+    KartRelevance::prepareSnapshot(const KartSnapshot &snapshot,
+                                   uint16_t acked, int viewer,
+                                   ClientView *client,
+                                   const KartSnapshot **baseline,
+                                   unsigned int *num_sent) const
+{
+    *baseline = NULL;
+    if(acked!=KartSnapshot::NO_SEQUENCE)
+    {
+        const KartSnapshot &b = client->m_snapshots[acked % SNAPSHOT_HISTORY];
+        // The baseline must still be in the history and can not be the
+        // snapshot that is written now.
+        if(b.m_sequence==acked && acked!=snapshot.m_sequence)
+            *baseline = &b;
+    }
+
+    KartSnapshot &view =
+        client->m_snapshots[snapshot.m_sequence % SNAPSHOT_HISTORY];
+    view = snapshot;
+    view.m_skipped.clear();
+    *num_sent = (unsigned int)snapshot.m_karts.size();
+    if(!m_enabled || !*baseline ||
+       (*baseline)->m_karts.size()!=snapshot.m_karts.size())
+        return view;
+
+    std::vector<bool> send;
+    select(viewer, m_budget, &client->m_priority, &send);
+    view.m_skipped.assign(send.size(), false);
+    for(unsigned int k=0; k<send.size() && k<view.m_karts.size(); k++)
+    {
+        if(send[k])
+            continue;
+        view.m_karts[k]   = (*baseline)->m_karts[k];
+        view.m_skipped[k] = true;
+        (*num_sent)--;
+    }
+    return view;
+}   // prepareSnapshot
+
+// ----------------------------------------------------------------------------
+/** Checks the relevance of karts at different distances, and that the
+ *  karts are sent at the expected rates, also with a bandwidth budget.
+ */
+void KartRelevance::unitTesting()
+{
+    // Kart 0 is the viewer, the others are 10, 100, 500 m in front and
+    // 10 m behind on a 1000 m track. All are placed side by side (and
+    // drive along the z axis), so no kart can be seen.
+    const float distances[] = { 0, 10, 100, 500, 990 };
+    std::vector<KartInfo> karts(5);
+    for(unsigned int i=0; i<karts.size(); i++)
+    {
+        karts[i].m_xyz      = Vec3(i*200.0f, 0, 0);
+        karts[i].m_forward  = Vec3(0, 0, 1);
+        karts[i].m_distance = distances[i];
+        karts[i].m_position = i+1;
+    }
+    KartRelevance relevance;
+    relevance.setKarts(karts, 1000.0f);
+    assert(relevance.getRelevance(0, 0)==1.0f);
+    assert(relevance.getRelevance(0, 1)==1.0f);    // rival
+    assert(relevance.getRelevance(0, 2)==0.25f);
+    assert(relevance.getRelevance(0, 3)==MIN_RELEVANCE);
+    assert(relevance.getRelevance(0, 4)==1.0f);    // close across the line
+
+    // A kart in front of the viewer can be seen
+    karts[3].m_xyz = Vec3(0, 0, 50.0f);
+    relevance.setKarts(karts, 1000.0f);
+    assert(relevance.getRelevance(0, 3)==VISIBLE_RELEVANCE);
+    karts[3].m_xyz = Vec3(600.0f, 0, 0);
+    relevance.setKarts(karts, 1000.0f);
+
+    // Without a limit all karts are sent in the first snapshot, then at
+    // their relevance: 8 snapshots have 8+8+2+1+8 kart states.
+    std::vector<float> priority;
+    std::vector<bool> send;
+    unsigned int counts[5] = { 0, 0, 0, 0, 0 };
+    for(unsigned int n=0; n<8; n++)
+    {
+        relevance.select(0, 0, &priority, &send);
+        for(unsigned int i=0; i<send.size(); i++)
+            counts[i] += send[i] ? 1 : 0;
+    }
+    assert(counts[0]==8 && counts[1]==8 && counts[2]==2 && counts[3]==1 &&
+           counts[4]==8);
+
+    // With a budget for two kart states per snapshot the own kart is always
+    // sent, and no other kart starves.
+    const int budget = SNAPSHOT_OVERHEAD + 5*UNCHANGED_KART_SIZE
+                     + 2*(CHANGED_KART_SIZE-UNCHANGED_KART_SIZE);
+    priority.clear();
+    unsigned int total = 0;
+    for(unsigned int i=0; i<5; i++)
+        counts[i] = 0;
+    for(unsigned int n=0; n<20; n++)
+    {
+        relevance.select(0, budget, &priority, &send);
+        assert(send[0]);
+        for(unsigned int i=0; i<send.size(); i++)
+        {
+            counts[i] += send[i] ? 1 : 0;
+            total     += send[i] ? 1 : 0;
+        }
+    }
+    assert(total==40);
+    for(unsigned int i=0; i<5; i++)
+        assert(counts[i]>0);
+
+    Log::info("KartRelevance", "%u %u %u %u states of the other karts in "
+              "20 snapshots with a budget.",
+              counts[1], counts[2], counts[3], counts[4]);
+}   // unitTesting
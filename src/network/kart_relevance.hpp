@@ -0,0 +1,118 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+/*! \file kart_relevance.hpp
+ *  \brief Decides which kart states are sent to which client.
+ */
+
+#ifndef HEADER_KART_RELEVANCE_HPP
+#define HEADER_KART_RELEVANCE_HPP
+
+#include "network/kart_snapshot.hpp"
+#include "utils/vec3.hpp"
+
+#include <vector>
+
+/** \brief Ranks the karts for each client, so that the states of karts
+ *  that matter to a client are sent at the full rate, and the states of
+ *  other karts less often.
+ *  The relevance of a kart for the kart of a client is 1 for the client's
+ *  own kart, for its rivals (the karts directly in front of and behind it
+ *  in the race) and for karts that are close along the track (using the
+ *  distance along the quad graph, so that a kart on the other side of a
+ *  wall is not close). It drops with the distance along the track down to
+ *  a minimum, but is at least VISIBLE_RELEVANCE for karts that are in front
+ *  of the client's kart and within the view distance, which handles e.g.
+ *  karts that can be seen across a hairpin. Without a quad graph (battle
+ *  and soccer) the straight line distance is used.
+ *  For each client the relevance of each kart is added to a priority once
+ *  per snapshot. Karts with a priority of at least 1 are sent (highest
+ *  priority first, as long as the snapshot fits into the bandwidth budget
+ *  of the client), which resets their priority. So a kart with relevance
+ *  r is sent about every 1/r snapshots, and a kart that did not fit into
+ *  the budget is sent first in the next snapshot.
+ *  \ingroup network
+ */
+class KartRelevance
+{
+public:
+    /** What is known about a kart to rank it. */
+    struct KartInfo
+    {
+        Vec3  m_xyz;
+        /** Unit vector in driving direction. */
+        Vec3  m_forward;
+        /** Distance driven along the track (including finished laps). */
+        float m_distance;
+        /** Position in the race, starting at 1. */
+        int   m_position;
+    };   // KartInfo
+
+    /** Estimated size of a snapshot without the karts (protocol type,
+     *  sequence numbers, ticks and the velocities of the client's kart). */
+    static const int SNAPSHOT_OVERHEAD = 26;
+
+    /** Estimated size of a kart whose state is sent (a delta compressed
+     *  position and a rotation), and of a kart that is unchanged. */
+    static const int CHANGED_KART_SIZE   = 8;
+    static const int UNCHANGED_KART_SIZE = 1;
+
+    /** Number of snapshots kept as possible baselines for delta
+     *  compression. If a client's last acknowledged snapshot is older, a
+     *  full snapshot is sent. */
+    static const unsigned int SNAPSHOT_HISTORY = 32;
+
+    /** What was sent to one client. */
+    struct ClientView
+    {
+        /** The snapshots as the client received them, indexed by sequence
+         *  number modulo SNAPSHOT_HISTORY. Karts that were not selected
+         *  have the state of the baseline of the snapshot. */
+        KartSnapshot       m_snapshots[SNAPSHOT_HISTORY];
+        /** The update priority of each kart for this client. */
+        std::vector<float> m_priority;
+    };   // ClientView
+
+private:
+    /** The karts, indexed by world kart id. */
+    std::vector<KartInfo> m_karts;
+
+    /** Length of a lap, 0 if there is no quad graph. */
+    float                 m_track_length;
+
+    /** True if interest management is enabled, and the bytes available
+     *  per snapshot and client (both read from the config in update()). */
+    bool                  m_enabled;
+    int                   m_budget;
+
+public:
+          KartRelevance();
+    void  update();
+    void  setKarts(const std::vector<KartInfo> &karts, float track_length);
+    float getRelevance(unsigned int viewer, unsigned int kart) const;
+    void  select(int viewer, int budget, std::vector<float> *priority,
+                 std::vector<bool> *send) const;
+    const KartSnapshot& prepareSnapshot(const KartSnapshot &snapshot,
+                                        uint16_t acked, int viewer,
+                                        ClientView *client,
+                                        const KartSnapshot **baseline,
+                                        unsigned int *num_sent) const;
+    static void unitTesting();
+};   // KartRelevance
+
+#endif
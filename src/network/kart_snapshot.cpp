@@ -0,0 +1,461 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/kart_snapshot.hpp"
+
+#include "network/network_string.hpp"
+#include "utils/log.hpp"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+/** Additional space (in m) around the track bounding box that is still
+ *  covered by the quantisation (e.g. karts flying over the track). */
+static const float TRACK_MARGIN = 20.0f;
+
+/** Range of the three quaternion components that are sent: since the
+ *  largest component is dropped, the others are in [-1/sqrt(2), 1/sqrt(2)].
+ */
+static const float QUATERNION_RANGE = 0.70710678f;
+
+/** Number of bits used for each of the three quaternion components. */
+static const int   QUATERNION_BITS  = 10;
+static const int   QUATERNION_MAX   = (1<<QUATERNION_BITS) - 1;
+
+/** Quantisation steps per m/s (linear) and rad/s (angular) used to send the
+ *  velocities of a kart as 16 bit integers. */
+static const float LINEAR_VELOCITY_SCALE  = 100.0f;
+static const float ANGULAR_VELOCITY_SCALE = 1000.0f;
+
+// ----------------------------------------------------------------------------
+/** Creates a codec for a track with the given bounding box.
+ *  \param min Minimum point of the track bounding box.
+ *  \param max Maximum point of the track bounding box.
+ */
+KartSnapshotCodec::KartSnapshotCodec(const Vec3 &min, const Vec3 &max)
+{
+    m_min = min - Vec3(TRACK_MARGIN);
+    Vec3 extent = max + Vec3(TRACK_MARGIN) - m_min;
+    for(unsigned int i=0; i<3; i++)
+    {
+        if(extent[i] < 1.0f) extent[i] = 1.0f;
+        m_scale[i] = 65535.0f / extent[i];
+        m_step[i]  = extent[i] / 65535.0f;
+    }
+}   // KartSnapshotCodec
+
+// ----------------------------------------------------------------------------
+/** Quantises a position and rotation.
+ *  \param xyz The position to quantise.
+ *  \param q The rotation to compress.
+ *  \param state On return the quantised state.
+ */
+void KartSnapshotCodec::quantise(const Vec3 &xyz, const btQuaternion &q,
+                                 KartSnapshot::KartState *state) const
+{
+    for(unsigned int i=0; i<3; i++)
+    {
+        float f = (xyz[i]-m_min[i]) * m_scale[i] + 0.5f;
+        if(f < 0)        f = 0;
+        if(f > 65535.0f) f = 65535.0f;
+        state->m_position[i] = (uint16_t)f;
+    }
+    state->m_rotation = compressQuaternion(q);
+}   // quantise
+
+// ----------------------------------------------------------------------------
+/** Converts a quantised state back into a position and rotation.
+ *  \param state The quantised state.
+ *  \param xyz On return the position.
+ *  \param q On return the rotation.
+ */
+void KartSnapshotCodec::dequantise(const KartSnapshot::KartState &state,
+                                   Vec3 *xyz, btQuaternion *q) const
+{
+    for(unsigned int i=0; i<3; i++)
+        (*xyz)[i] = m_min[i] + state.m_position[i]*m_step[i];
+    *q = decompressQuaternion(state.m_rotation);
+}   // dequantise
+
+// ----------------------------------------------------------------------------
+/** Packs a unit quaternion into 32 bits: the index of the largest component
+ *  is stored in the two top bits, followed by the other three components
+ *  with 10 bits each. Since q and -q describe the same rotation, the sign
+ *  is chosen so that the dropped component is positive.
+ */
+uint32_t KartSnapshotCodec::compressQuaternion(const btQuaternion &q)
+{
+    btQuaternion n = q;
+    if(n.length2()>0)
+        n.normalize();
+    else
+        n = btQuaternion(0, 0, 0, 1);
+
+    const btScalar *c = n;
+    unsigned int largest = 0;
+    for(unsigned int i=1; i<4; i++)
+    {
+        if(fabsf(c[i]) > fabsf(c[largest]))
+            largest = i;
+    }
+    const float sign = c[largest] < 0 ? -1.0f : 1.0f;
+
+    uint32_t result = largest;
+    for(unsigned int i=0; i<4; i++)
+    {
+        if(i==largest) continue;
+        float f = (sign*c[i]/QUATERNION_RANGE + 1.0f)*0.5f*QUATERNION_MAX
+                + 0.5f;
+        if(f < 0)              f = 0;
+        if(f > QUATERNION_MAX) f = (float)QUATERNION_MAX;
+        result = (result << QUATERNION_BITS) | (uint32_t)f;
+    }
+    return result;
+}   // compressQuaternion
+
+// ----------------------------------------------------------------------------
+/** Restores a quaternion compressed with compressQuaternion.
+ */
+btQuaternion KartSnapshotCodec::decompressQuaternion(uint32_t c)
+{
+    const unsigned int largest = c >> (3*QUATERNION_BITS);
+    float v[4];
+    float sum = 0;
+    for(int i=3; i>=0; i--)
+    {
+        if(i==(int)largest) continue;
+        const uint32_t bits = c & QUATERNION_MAX;
+        c >>= QUATERNION_BITS;
+        v[i] = (bits*2.0f/QUATERNION_MAX - 1.0f) * QUATERNION_RANGE;
+        sum += v[i]*v[i];
+    }
+    v[largest] = sum < 1.0f ? sqrtf(1.0f-sum) : 0.0f;
+    btQuaternion q(v[0], v[1], v[2], v[3]);
+    q.normalize();
+    return q;
+}   // decompressQuaternion
+
+// ----------------------------------------------------------------------------
+/** Writes one kart state. If a baseline is given, only the values that
+ *  differ from the baseline are written.
+ */
+void KartSnapshotCodec::encodeKart(const KartSnapshot::KartState &state,
+                                   const KartSnapshot::KartState *baseline,
+                                   NetworkString *ns) const
+{
+    uint8_t mask = 0;
+    int delta[3];
+    for(unsigned int i=0; i<3; i++)
+    {
+        int mode = POS_ABSOLUTE;
+        if(baseline)
+        {
+            delta[i] = (int)state.m_position[i] - baseline->m_position[i];
+            if(delta[i]==0)
+                mode = POS_UNCHANGED;
+            else if(delta[i]>=-128 && delta[i]<=127)
+                mode = POS_DELTA;
+        }
+        mask |= mode << (2*i);
+    }
+    if(!baseline || baseline->m_rotation != state.m_rotation)
+        mask |= ROTATION_CHANGED;
+
+    ns->ai8(mask);
+    for(unsigned int i=0; i<3; i++)
+    {
+        switch((mask >> (2*i)) & 3)
+        {
+        case POS_DELTA:    ns->ai8((uint8_t)(int8_t)delta[i]);   break;
+        case POS_ABSOLUTE: ns->ai16(state.m_position[i]);        break;
+        default:           break;
+        }
+    }
+    if(mask & ROTATION_CHANGED)
+        ns->ai32(state.m_rotation);
+}   // encodeKart
+
+// ----------------------------------------------------------------------------
+/** Reads one kart state written by encodeKart.
+ *  \param ns The string to read from.
+ *  \param pos Read position in ns, will be advanced.
+ *  \param baseline The same baseline that was used when encoding.
+ *  \param state On return the decoded state.
+ *  \return False if the data was invalid.
+ */
+bool KartSnapshotCodec::decodeKart(const NetworkString &ns, int *pos,
+                                   const KartSnapshot::KartState *baseline,
+                                   KartSnapshot::KartState *state) const
+{
+    if(*pos >= ns.size()) return false;
+    const uint8_t mask = ns.getUInt8((*pos)++);
+    // Skipped karts are handled by decode()
+    if(mask & KART_SKIPPED) return false;
+    for(unsigned int i=0; i<3; i++)
+    {
+        switch((mask >> (2*i)) & 3)
+        {
+        case POS_UNCHANGED:
+            if(!baseline) return false;
+            state->m_position[i] = baseline->m_position[i];
+            break;
+        case POS_DELTA:
+            if(!baseline || *pos+1 > ns.size()) return false;
+            state->m_position[i] = (uint16_t)(baseline->m_position[i]
+                                        + (int8_t)ns.getUInt8(*pos));
+            *pos += 1;
+            break;
+        case POS_ABSOLUTE:
+            if(*pos+2 > ns.size()) return false;
+            state->m_position[i] = ns.getUInt16(*pos);
+            *pos += 2;
+            break;
+        default:
+            return false;
+        }
+    }
+    if(mask & ROTATION_CHANGED)
+    {
+        if(*pos+4 > ns.size()) return false;
+        state->m_rotation = ns.getUInt32(*pos);
+        *pos += 4;
+    }
+    else
+    {
+        if(!baseline) return false;
+        state->m_rotation = baseline->m_rotation;
+    }
+    return true;
+}   // decodeKart
+
+// ----------------------------------------------------------------------------
+/** Appends a snapshot to a network string. Karts that are marked as
+ *  skipped in the snapshot are sent as a single byte (if there is a
+ *  baseline), so that the receiver knows that they have no new state.
+ *  \param snapshot The snapshot to encode.
+ *  \param baseline A snapshot the receiver has acknowledged, or NULL if the
+ *         full snapshot must be sent.
+ *  \param ns The network string to append the data to.
+ */
+void KartSnapshotCodec::encode(const KartSnapshot &snapshot,
+                               const KartSnapshot *baseline,
+                               NetworkString *ns) const
+{
+    assert(snapshot.m_karts.size() < 256);
+    if(baseline && baseline->m_karts.size()!=snapshot.m_karts.size())
+        baseline = NULL;
+    ns->ai8((uint8_t)snapshot.m_karts.size());
+    for(unsigned int i=0; i<snapshot.m_karts.size(); i++)
+    {
+        if(baseline && snapshot.isSkipped(i))
+            ns->ai8(KART_SKIPPED);
+        else
+            encodeKart(snapshot.m_karts[i],
+                       baseline ? &baseline->m_karts[i] : NULL, ns);
+    }
+}   // encode
+
+// ----------------------------------------------------------------------------
+/** Reads a snapshot written by encode. The sequence number of the result
+ *  is not modified, the karts that the sender skipped are marked.
+ *  \param ns The network string to read from.
+ *  \param pos Read position in ns, will be advanced.
+ *  \param baseline The baseline used when encoding (or NULL).
+ *  \param snapshot On return the decoded snapshot.
+ *  \return False if the data was invalid or the baseline does not match.
+ */
+bool KartSnapshotCodec::decode(const NetworkString &ns, int *pos,
+                               const KartSnapshot *baseline,
+                               KartSnapshot *snapshot) const
+{
+    if(*pos >= ns.size()) return false;
+    const unsigned int num_karts = ns.getUInt8((*pos)++);
+    if(baseline && baseline->m_karts.size()!=num_karts)
+        baseline = NULL;
+    snapshot->m_karts.resize(num_karts);
+    snapshot->m_skipped.assign(num_karts, false);
+    for(unsigned int i=0; i<num_karts; i++)
+    {
+        if(*pos < ns.size() && ns.getUInt8(*pos)==KART_SKIPPED)
+        {
+            if(!baseline) return false;
+            snapshot->m_karts[i]   = baseline->m_karts[i];
+            snapshot->m_skipped[i] = true;
+            (*pos)++;
+            continue;
+        }
+        if(!decodeKart(ns, pos, baseline ? &baseline->m_karts[i] : NULL,
+                       &snapshot->m_karts[i]))
+            return false;
+    }
+    return true;
+}   // decode
+
+// ----------------------------------------------------------------------------
+/** Appends the full state of a single kart (used by clients to send the
+ *  state of their own kart).
+ */
+void KartSnapshotCodec::encodeSingleKart(const KartSnapshot::KartState &state,
+                                         NetworkString *ns) const
+{
+    encodeKart(state, NULL, ns);
+}   // encodeSingleKart
+
+// ----------------------------------------------------------------------------
+/** Reads a kart state written by encodeSingleKart.
+ */
+bool KartSnapshotCodec::decodeSingleKart(const NetworkString &ns, int *pos,
+                                         KartSnapshot::KartState *state) const
+{
+    return decodeKart(ns, pos, NULL, state);
+}   // decodeSingleKart
+
+// ----------------------------------------------------------------------------
+/** Appends a velocity quantised to 16 bits per axis. */
+static void encodeVelocity(const Vec3 &v, float scale, NetworkString *ns)
+{
+    for(unsigned int i=0; i<3; i++)
+    {
+        float f = v[i]*scale;
+        if(f < -32767.0f) f = -32767.0f;
+        if(f >  32767.0f) f =  32767.0f;
+        ns->ai16((uint16_t)(int16_t)(f<0 ? f-0.5f : f+0.5f));
+    }
+}   // encodeVelocity
+
+// ----------------------------------------------------------------------------
+/** Reads a velocity written by encodeVelocity. */
+static Vec3 decodeVelocity(const NetworkString &ns, int pos, float scale)
+{
+    Vec3 v;
+    for(unsigned int i=0; i<3; i++)
+        v[i] = (int16_t)ns.getUInt16(pos+2*i)/scale;
+    return v;
+}   // decodeVelocity
+
+// ----------------------------------------------------------------------------
+/** Appends the linear and angular velocity of a kart (12 bytes), which a
+ *  client needs to rewind its kart to the state of the server.
+ */
+void KartSnapshotCodec::encodeVelocities(const Vec3 &linear,
+                                         const Vec3 &angular,
+                                         NetworkString *ns)
+{
+    encodeVelocity(linear,  LINEAR_VELOCITY_SCALE,  ns);
+    encodeVelocity(angular, ANGULAR_VELOCITY_SCALE, ns);
+}   // encodeVelocities
+
+// ----------------------------------------------------------------------------
+/** Reads the velocities written by encodeVelocities.
+ *  \return False if the message is too short.
+ */
+bool KartSnapshotCodec::decodeVelocities(const NetworkString &ns, int *pos,
+                                         Vec3 *linear, Vec3 *angular)
+{
+    if(*pos+12 > ns.size())
+        return false;
+    *linear  = decodeVelocity(ns, *pos,   LINEAR_VELOCITY_SCALE);
+    *angular = decodeVelocity(ns, *pos+6, ANGULAR_VELOCITY_SCALE);
+    *pos += 12;
+    return true;
+}   // decodeVelocities
+
+// ----------------------------------------------------------------------------
+/** Tests the quantisation and delta compression, and reports the number of
+ *  bytes per tick for a simulated race compared with sending seven floats
+ *  per kart.
+ */
+void KartSnapshotCodec::unitTesting()
+{
+    KartSnapshotCodec codec(Vec3(-300, -10, -500), Vec3(400, 50, 200));
+
+    // Test rotations: the maximum error of each component must be small
+    for(unsigned int i=0; i<1000; i++)
+    {
+        btQuaternion q(rand()/(float)RAND_MAX-0.5f, rand()/(float)RAND_MAX-0.5f,
+                       rand()/(float)RAND_MAX-0.5f, rand()/(float)RAND_MAX-0.5f);
+        q.normalize();
+        btQuaternion r = decompressQuaternion(compressQuaternion(q));
+        // q and -q are the same rotation
+        if(q.dot(r)<0) r = -r;
+        for(unsigned int j=0; j<4; j++)
+            assert(fabsf(((const btScalar*)q)[j]-((const btScalar*)r)[j])
+                   < 0.003f);
+    }
+
+    // Simulate 8 karts driving on circles for 30 seconds at 10 Hz, some
+    // of them standing still.
+    const unsigned int num_karts = 8;
+    const unsigned int num_ticks = 300;
+    KartSnapshot baseline, current;
+    int bytes_full = 0, bytes_delta = 0;
+    for(unsigned int tick=0; tick<num_ticks; tick++)
+    {
+        current.m_karts.resize(num_karts);
+        for(unsigned int k=0; k<num_karts; k++)
+        {
+            float t = tick*0.1f;
+            float r = 100.0f+10.0f*k;
+            float speed = k<6 ? 0.2f : 0.0f;
+            Vec3 xyz(r*cosf(speed*t), 1.0f, r*sinf(speed*t)-150.0f);
+            btQuaternion q(Vec3(0,1,0), speed*t);
+            codec.quantise(xyz, q, &current.m_karts[k]);
+
+            Vec3 xyz2;
+            btQuaternion q2;
+            codec.dequantise(current.m_karts[k], &xyz2, &q2);
+            for(unsigned int i=0; i<3; i++)
+                assert(fabsf(xyz[i]-xyz2[i]) <= codec.getPrecision()[i]);
+        }
+
+        // The last kart stands still: every other tick it is skipped by
+        // the sender, which must not look like an unchanged kart.
+        current.m_skipped.assign(num_karts, false);
+        current.m_skipped[num_karts-1] = tick%2==1;
+
+        NetworkString full, delta;
+        codec.encode(current, NULL, &full);
+        codec.encode(current, tick>0 ? &baseline : NULL, &delta);
+        bytes_full  += full.size();
+        bytes_delta += delta.size();
+
+        KartSnapshot decoded;
+        int pos = 0;
+        if(!codec.decode(delta, &pos, tick>0 ? &baseline : NULL, &decoded))
+            Log::error("KartSnapshotCodec", "Decoding failed in tick %d.",
+                       tick);
+        assert(pos==delta.size());
+        for(unsigned int k=0; k<num_karts; k++)
+        {
+            assert(decoded.isSkipped(k) == (tick>0 && current.isSkipped(k)));
+            assert(decoded.m_karts[k].m_rotation ==
+                   current.m_karts[k].m_rotation);
+            for(unsigned int i=0; i<3; i++)
+                assert(decoded.m_karts[k].m_position[i] ==
+                       current.m_karts[k].m_position[i]);
+        }
+        baseline = current;
+    }
+    const int bytes_raw = num_ticks * (4 + num_karts*32);
+    Log::info("KartSnapshotCodec",
+              "%d karts: %.1f bytes/tick uncompressed, %.1f quantised, "
+              "%.1f delta compressed.", num_karts,
+              bytes_raw/(float)num_ticks, bytes_full/(float)num_ticks,
+              bytes_delta/(float)num_ticks);
+}   // unitTesting
@@ -0,0 +1,158 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+/*! \file kart_snapshot.hpp
+ *  \brief Quantised and delta compressed kart states for the network.
+ */
+
+#ifndef HEADER_KART_SNAPSHOT_HPP
+#define HEADER_KART_SNAPSHOT_HPP
+
+#include "utils/types.hpp"
+#include "utils/vec3.hpp"
+
+#include "LinearMath/btQuaternion.h"
+
+#include <vector>
+
+class NetworkString;
+
+/** \brief The quantised state of all karts at one point in time.
+ *  Snapshots are numbered with a 16 bit sequence number (which wraps
+ *  around), so that a receiver can acknowledge the last snapshot it
+ *  received, and the sender can then use this snapshot as baseline
+ *  for delta compression.
+ *  \ingroup network
+ */
+class KartSnapshot
+{
+public:
+    /** Sequence number that indicates 'no snapshot'. */
+    static const uint16_t NO_SEQUENCE = 0xffff;
+
+    /** The quantised state of a single kart. */
+    struct KartState
+    {
+        /** Position relative to the track bounds, 16 bit per axis. */
+        uint16_t m_position[3];
+        /** Rotation, compressed using the smallest-three method. */
+        uint32_t m_rotation;
+        // --------------------------------------------------------------------
+        bool operator==(const KartState &other) const
+        {
+            return m_position[0]==other.m_position[0] &&
+                   m_position[1]==other.m_position[1] &&
+                   m_position[2]==other.m_position[2] &&
+                   m_rotation==other.m_rotation;
+        }   // operator==
+    };   // KartState
+
+    /** Sequence number of this snapshot. */
+    uint16_t               m_sequence;
+
+    /** The state of all karts, indexed by world kart id. */
+    std::vector<KartState> m_karts;
+
+    /** True for each kart whose state was not updated by the sender (see
+     *  KartRelevance), it has the state of the baseline. Empty if all
+     *  karts were updated. */
+    std::vector<bool>      m_skipped;
+
+    KartSnapshot() : m_sequence(NO_SEQUENCE) {}
+    // ------------------------------------------------------------------------
+    /** Returns true if the sender did not update the state of a kart. */
+    bool isSkipped(unsigned int kart) const
+    {
+        return kart<m_skipped.size() && m_skipped[kart];
+    }   // isSkipped
+    // ------------------------------------------------------------------------
+    /** Returns true if sequence number a is more recent than b, taking
+     *  wrap around of the sequence numbers into account. */
+    static bool isNewer(uint16_t a, uint16_t b)
+    {
+        return a!=b && (uint16_t)(a-b) < 0x8000;
+    }   // isNewer
+};   // KartSnapshot
+
+// ============================================================================
+/** \brief Converts kart states into a compact network representation.
+ *  Positions are quantised to 16 bits per axis relative to the bounding
+ *  box of the track, rotations are packed into 32 bits using the
+ *  'smallest three' method (the largest component of the unit quaternion
+ *  is dropped and reconstructed on the receiving side). A snapshot can be
+ *  encoded relative to a baseline snapshot that the receiver is known to
+ *  have, in which case unchanged values are not sent at all, and small
+ *  position changes are sent as 8 bit deltas.
+ *  \ingroup network
+ */
+class KartSnapshotCodec
+{
+private:
+    /** Minimum of the quantisation range. */
+    Vec3 m_min;
+
+    /** Quantisation steps per meter for each axis. */
+    Vec3 m_scale;
+
+    /** Size of one quantisation step in meters for each axis. */
+    Vec3 m_step;
+
+    /** Bits used in the per-kart change mask: two bits per axis for the
+     *  position (unchanged, 8 bit delta, 16 bit value), one bit for the
+     *  rotation, and one bit for a kart that was skipped by the sender
+     *  (which is not the same as a kart that did not move). */
+    enum { POS_UNCHANGED = 0, POS_DELTA = 1, POS_ABSOLUTE = 2,
+           ROTATION_CHANGED = 0x40, KART_SKIPPED = 0x80 };
+
+    void encodeKart(const KartSnapshot::KartState &state,
+                    const KartSnapshot::KartState *baseline,
+                    NetworkString *ns) const;
+    bool decodeKart(const NetworkString &ns, int *pos,
+                    const KartSnapshot::KartState *baseline,
+                    KartSnapshot::KartState *state) const;
+
+public:
+         KartSnapshotCodec(const Vec3 &min, const Vec3 &max);
+    void quantise(const Vec3 &xyz, const btQuaternion &q,
+                  KartSnapshot::KartState *state) const;
+    void dequantise(const KartSnapshot::KartState &state, Vec3 *xyz,
+                    btQuaternion *q) const;
+    void encode(const KartSnapshot &snapshot, const KartSnapshot *baseline,
+                NetworkString *ns) const;
+    bool decode(const NetworkString &ns, int *pos,
+                const KartSnapshot *baseline, KartSnapshot *snapshot) const;
+    void encodeSingleKart(const KartSnapshot::KartState &state,
+                          NetworkString *ns) const;
+    bool decodeSingleKart(const NetworkString &ns, int *pos,
+                          KartSnapshot::KartState *state) const;
+
+    static void         encodeVelocities(const Vec3 &linear,
+                                         const Vec3 &angular,
+                                         NetworkString *ns);
+    static bool         decodeVelocities(const NetworkString &ns, int *pos,
+                                         Vec3 *linear, Vec3 *angular);
+    static uint32_t     compressQuaternion(const btQuaternion &q);
+    static btQuaternion decompressQuaternion(uint32_t c);
+    static void         unitTesting();
+
+    // ------------------------------------------------------------------------
+    /** Returns the size of one quantisation step along each axis. */
+    const Vec3& getPrecision() const { return m_step; }
+};   // KartSnapshotCodec
+
+#endif
@@ -0,0 +1,271 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/loopback_transport.hpp"
+
+#include "utils/log.hpp"
+
+#include <algorithm>
+#include <assert.h>
+
+const float LoopbackTransport::MAX_QUEUE_DELAY   = 0.5f;
+const float LoopbackTransport::MIN_REORDER_DELAY = 0.05f;
+
+// ----------------------------------------------------------------------------
+/** Creates a transport without endpoints.
+ *  \param conditions The conditions of all links.
+ *  \param seed Seed of the random numbers (loss, jitter and reordering).
+ */
+LoopbackTransport::LoopbackTransport(const NetworkConditions &conditions,
+                                     uint32_t seed)
+{
+    m_default_conditions = conditions;
+    m_random             = seed;
+    m_next_order         = 0;
+    pthread_mutex_init(&m_mutex, NULL);
+}   // LoopbackTransport
+
+// ----------------------------------------------------------------------------
+LoopbackTransport::~LoopbackTransport()
+{
+    pthread_mutex_destroy(&m_mutex);
+}   // ~LoopbackTransport
+
+// ----------------------------------------------------------------------------
+/** Returns a random number in [0, 1). Must be called with m_mutex locked.
+ */
+float LoopbackTransport::getRandom()
+{
+    m_random = m_random*1103515245 + 12345;
+    return ((m_random>>16) & 0x7fff)/32768.0f;
+}   // getRandom
+
+// ----------------------------------------------------------------------------
+/** Returns the link between two endpoints, creating it with the default
+ *  conditions if necessary. Must be called with m_mutex locked.
+ */
+LoopbackTransport::Link &LoopbackTransport::getLink(int from, int to)
+{
+    std::map<std::pair<int, int>, Link>::iterator it =
+        m_links.find(std::make_pair(from, to));
+    if(it!=m_links.end())
+        return it->second;
+    Link &link = m_links[std::make_pair(from, to)];
+    link.m_conditions = m_default_conditions;
+    return link;
+}   // getLink
+
+// ----------------------------------------------------------------------------
+int LoopbackTransport::addEndpoint()
+{
+    pthread_mutex_lock(&m_mutex);
+    m_endpoints.push_back(Endpoint());
+    const int id = (int)m_endpoints.size()-1;
+    pthread_mutex_unlock(&m_mutex);
+    return id;
+}   // addEndpoint
+
+// ----------------------------------------------------------------------------
+/** Changes the conditions of the link from one endpoint to another.
+ */
+void LoopbackTransport::setConditions(int from, int to,
+                                      const NetworkConditions &conditions)
+{
+    pthread_mutex_lock(&m_mutex);
+    getLink(from, to).m_conditions = conditions;
+    pthread_mutex_unlock(&m_mutex);
+}   // setConditions
+
+// ----------------------------------------------------------------------------
+/** Sends a packet (see the class description for what happens to it).
+ *  \param from, to The sending and receiving endpoint.
+ *  \param data The packet.
+ *  \param now The current time.
+ */
+void LoopbackTransport::send(int from, int to, const NetworkString &data,
+                             double now)
+{
+    pthread_mutex_lock(&m_mutex);
+    assert(from>=0 && from<(int)m_endpoints.size());
+    assert(to>=0 && to<(int)m_endpoints.size());
+    Statistics &statistics = m_endpoints[from].m_statistics;
+    statistics.m_packets_sent++;
+    statistics.m_bytes_sent += data.size();
+
+    Link &link = getLink(from, to);
+    const NetworkConditions &conditions = link.m_conditions;
+    double sent_time = now;
+    if(conditions.m_bandwidth>0)
+    {
+        const double start = std::max(now, link.m_free_time);
+        if(start-now > MAX_QUEUE_DELAY)
+        {
+            statistics.m_packets_dropped++;
+            pthread_mutex_unlock(&m_mutex);
+            return;
+        }
+        sent_time = start + data.size()/conditions.m_bandwidth;
+        link.m_free_time = sent_time;
+    }
+
+    // Always draw the same random numbers, so that a change of one
+    // condition does not change the fate of all other packets.
+    const float r_loss    = getRandom();
+    const float r_jitter  = getRandom();
+    const float r_reorder = getRandom();
+    const float r_delay   = getRandom();
+    if(r_loss < conditions.m_loss)
+    {
+        statistics.m_packets_dropped++;
+        pthread_mutex_unlock(&m_mutex);
+        return;
+    }
+
+    double arrival = sent_time + conditions.m_latency
+                   + conditions.m_jitter*r_jitter;
+    if(r_reorder < conditions.m_reorder)
+    {
+        arrival += std::max(conditions.m_jitter, MIN_REORDER_DELAY)*r_delay;
+    }
+    else
+    {
+        arrival = std::max(arrival, link.m_last_arrival);
+        link.m_last_arrival = arrival;
+    }
+
+    Packet packet;
+    packet.m_arrival_time = arrival;
+    packet.m_order        = m_next_order++;
+    packet.m_from         = from;
+    packet.m_data         = data;
+    std::vector<Packet> &inbox = m_endpoints[to].m_inbox;
+    inbox.push_back(packet);
+    std::push_heap(inbox.begin(), inbox.end(), LaterArrival());
+    pthread_mutex_unlock(&m_mutex);
+}   // send
+
+// ----------------------------------------------------------------------------
+/** Returns the next packet that has arrived at an endpoint.
+ *  \param to The receiving endpoint.
+ *  \param now The current time.
+ *  \param from On return the sender of the packet.
+ *  \param data On return the packet.
+ *  \return False if no packet has arrived by this time.
+ */
+bool LoopbackTransport::receive(int to, double now, int *from,
+                                NetworkString *data)
+{
+    pthread_mutex_lock(&m_mutex);
+    assert(to>=0 && to<(int)m_endpoints.size());
+    std::vector<Packet> &inbox = m_endpoints[to].m_inbox;
+    if(inbox.empty() || inbox.front().m_arrival_time > now)
+    {
+        pthread_mutex_unlock(&m_mutex);
+        return false;
+    }
+    std::pop_heap(inbox.begin(), inbox.end(), LaterArrival());
+    *from = inbox.back().m_from;
+    *data = inbox.back().m_data;
+    inbox.pop_back();
+    Statistics &statistics = m_endpoints[to].m_statistics;
+    statistics.m_packets_received++;
+    statistics.m_bytes_received += data->size();
+    pthread_mutex_unlock(&m_mutex);
+    return true;
+}   // receive
+
+// ----------------------------------------------------------------------------
+Transport::Statistics LoopbackTransport::getStatistics(int endpoint) const
+{
+    pthread_mutex_lock(&m_mutex);
+    assert(endpoint>=0 && endpoint<(int)m_endpoints.size());
+    Statistics statistics = m_endpoints[endpoint].m_statistics;
+    pthread_mutex_unlock(&m_mutex);
+    return statistics;
+}   // getStatistics
+
+// ----------------------------------------------------------------------------
+/** Sends packets over links with different conditions and checks that
+ *  latency, loss, reordering and the bandwidth limit are simulated.
+ */
+void LoopbackTransport::unitTesting()
+{
+    NetworkConditions perfect;
+    perfect.m_latency = 0.1f;
+    LoopbackTransport transport(perfect);
+    const int a = transport.addEndpoint();
+    const int b = transport.addEndpoint();
+
+    // Latency only: the packets arrive in order after the latency
+    int from;
+    NetworkString ns;
+    for(unsigned int i=0; i<10; i++)
+        transport.send(a, b, NetworkString().ai32(i), i*0.01);
+    assert(!transport.receive(b, 0.099, &from, &ns));
+    for(unsigned int i=0; i<10; i++)
+    {
+        assert(transport.receive(b, 0.2, &from, &ns));
+        assert(from==a && ns.getUInt32(0)==i);
+    }
+    assert(!transport.receive(b, 1.0, &from, &ns));
+
+    // Loss, jitter and reordering
+    NetworkConditions bad;
+    bad.m_latency = 0.05f;
+    bad.m_jitter  = 0.04f;
+    bad.m_loss    = 0.1f;
+    bad.m_reorder = 0.1f;
+    transport.setConditions(b, a, bad);
+    const unsigned int num_packets = 1000;
+    for(unsigned int i=0; i<num_packets; i++)
+        transport.send(b, a, NetworkString().ai32(i), 1.0+i*0.01);
+    unsigned int received = 0, reordered = 0, last = 0;
+    while(transport.receive(a, 100.0, &from, &ns))
+    {
+        const unsigned int n = ns.getUInt32(0);
+        if(received>0 && n<last)
+            reordered++;
+        last = std::max(last, n);
+        received++;
+    }
+    const Statistics sb = transport.getStatistics(b);
+    assert(sb.m_packets_sent==num_packets);
+    assert(sb.m_packets_dropped+received==num_packets);
+    assert(received>850 && received<950);
+    assert(reordered>0);
+
+    // Bandwidth: 100 bytes every 10 ms is 10000 bytes/s, on a link with
+    // 5000 bytes/s the queue grows until packets are dropped.
+    NetworkConditions slow;
+    slow.m_bandwidth = 5000.0f;
+    transport.setConditions(a, b, slow);
+    NetworkString big;
+    for(unsigned int i=0; i<25; i++)
+        big.ai32(i);
+    for(unsigned int i=0; i<200; i++)
+        transport.send(a, b, big, 10.0+i*0.01);
+    received = 0;
+    while(transport.receive(b, 100.0, &from, &ns))
+        received++;
+    assert(received>110 && received<135);
+
+    Log::info("LoopbackTransport", "%u of %u packets received with loss, "
+              "%u reordered; %u of 200 packets with half the bandwidth.",
+              sb.m_packets_sent-sb.m_packets_dropped, sb.m_packets_sent,
+              reordered, received);
+}   // unitTesting
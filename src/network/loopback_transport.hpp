@@ -0,0 +1,135 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+/*! \file loopback_transport.hpp
+ *  \brief In-memory transport that simulates network conditions.
+ */
+
+#ifndef HEADER_LOOPBACK_TRANSPORT_HPP
+#define HEADER_LOOPBACK_TRANSPORT_HPP
+
+#include "network/network_string.hpp"
+#include "network/transport.hpp"
+
+#include <pthread.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+/** \brief Delivers packets between endpoints in the same process.
+ *  Each packet that is sent is put into the inbox of the receiving
+ *  endpoint together with the time at which it arrives, which is computed
+ *  from the conditions of the link between the two endpoints:
+ *  - The link sends one packet after the other with its bandwidth. If the
+ *    queue of the link would delay a packet for more than MAX_QUEUE_DELAY,
+ *    the packet is dropped (like a router with a full queue).
+ *  - Then the latency and a random jitter are added, and the packet is
+ *    lost with the given probability.
+ *  - Packets on a link arrive in the order they were sent, unless a packet
+ *    is selected to be reordered, in which case it is held back.
+ *  The random numbers come from a generator with a fixed seed, so the same
+ *  sequence of packets always has the same fate. The data of a packet is
+ *  not copied (see NetworkBuffer). All functions are thread-safe.
+ *  \ingroup network
+ */
+class LoopbackTransport : public Transport
+{
+private:
+    /** Packets that would wait longer than this (in s) in the queue of a
+     *  link are dropped. */
+    static const float MAX_QUEUE_DELAY;
+
+    /** Minimum time a reordered packet is held back. */
+    static const float MIN_REORDER_DELAY;
+
+    /** A packet on its way. */
+    struct Packet
+    {
+        /** Time at which the packet arrives. */
+        double        m_arrival_time;
+        /** Sequence number of the packet, to keep the order of packets
+         *  with the same arrival time. */
+        uint32_t      m_order;
+        int           m_from;
+        NetworkString m_data;
+    };   // Packet
+
+    /** Sorts the inbox (a heap) so that the first packet to arrive is on
+     *  top. */
+    struct LaterArrival
+    {
+        bool operator()(const Packet &a, const Packet &b) const
+        {
+            if(a.m_arrival_time!=b.m_arrival_time)
+                return a.m_arrival_time > b.m_arrival_time;
+            return a.m_order > b.m_order;
+        }
+    };   // LaterArrival
+
+    /** The state of a link from one endpoint to another. */
+    struct Link
+    {
+        NetworkConditions m_conditions;
+        /** Time at which the link has sent all queued packets. */
+        double            m_free_time;
+        /** Arrival time of the last packet that was not reordered. */
+        double            m_last_arrival;
+        Link() : m_free_time(0), m_last_arrival(0) {}
+    };   // Link
+
+    struct Endpoint
+    {
+        std::vector<Packet> m_inbox;
+        Statistics          m_statistics;
+    };   // Endpoint
+
+    std::vector<Endpoint>                m_endpoints;
+
+    /** The links that were used, indexed by sender and receiver. */
+    std::map<std::pair<int, int>, Link>  m_links;
+
+    /** Conditions of links that were not set explicitly. */
+    NetworkConditions                    m_default_conditions;
+
+    /** State of the random number generator. */
+    uint32_t                             m_random;
+
+    /** Counts the packets sent. */
+    uint32_t                             m_next_order;
+
+    mutable pthread_mutex_t              m_mutex;
+
+    float getRandom();
+    Link &getLink(int from, int to);
+
+public:
+                 LoopbackTransport(const NetworkConditions &conditions,
+                                   uint32_t seed=1);
+    virtual     ~LoopbackTransport();
+    virtual int  addEndpoint();
+    virtual void send(int from, int to, const NetworkString &data,
+                      double now);
+    virtual bool receive(int to, double now, int *from,
+                         NetworkString *data);
+    virtual Statistics getStatistics(int endpoint) const;
+    void         setConditions(int from, int to,
+                               const NetworkConditions &conditions);
+    static void  unitTesting();
+};   // LoopbackTransport
+
+#endif
@@ -0,0 +1,330 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/message_batch.hpp"
+
+#include "network/protocol.hpp"
+#include "network/stk_peer.hpp"
+#include "utils/log.hpp"
+
+#include <assert.h>
+#include <enet/enet.h>
+
+// ----------------------------------------------------------------------------
+/** Returns true if the message can be added without exceeding the maximum
+ *  packet size. An empty batch accepts any message (which is then sent on
+ *  its own).
+ */
+bool MessageBatch::canAdd(const NetworkString &message) const
+{
+    if(m_messages.empty())
+        return true;
+    return message.size() <= MAX_MESSAGE_SIZE &&
+           m_size + getLengthSize(message.size()) + message.size()
+                  <= MAX_PACKET_SIZE;
+}   // canAdd
+
+// ----------------------------------------------------------------------------
+/** Adds a message. The data is not copied until the batch is taken.
+ *  \param message The message, starting with its protocol type.
+ */
+void MessageBatch::add(const NetworkString &message)
+{
+    assert(canAdd(message));
+    m_messages.push_back(message);
+    m_size    += getLengthSize(message.size()) + message.size();
+    m_payload += message.size();
+}   // add
+
+// ----------------------------------------------------------------------------
+/** Returns the packet to send for all messages added, and empties the
+ *  batch.
+ *  \param packet On return the packet.
+ *  \param num_messages On return the number of messages in the packet.
+ */
+void MessageBatch::take(NetworkString *packet, unsigned int *num_messages)
+{
+    assert(!m_messages.empty());
+    *num_messages = (unsigned int)m_messages.size();
+    if(m_messages.size()==1)
+    {
+        *packet = m_messages[0];
+    }
+    else
+    {
+        NetworkString batch;
+        batch.ai8(PROTOCOL_BATCH);
+        for(unsigned int i=0; i<m_messages.size(); i++)
+        {
+            const int length = m_messages[i].size();
+            if(length<0x80)
+                batch.ai8((uint8_t)length);
+            else
+                batch.ai16((uint16_t)(0x8000 | length));
+            batch += m_messages[i];
+        }
+        assert(batch.size()==m_size);
+        *packet = batch;
+    }
+    m_messages.clear();
+    m_size    = 1;
+    m_payload = 0;
+}   // take
+
+// ----------------------------------------------------------------------------
+/** Splits a received batch packet into its messages. The data of the
+ *  messages is not copied.
+ *  \param packet The packet, starting with PROTOCOL_BATCH.
+ *  \param messages The messages are appended to this vector.
+ *  \return False if the packet is malformed (the messages before the
+ *          error are still appended).
+ */
+bool MessageBatch::split(const NetworkString &packet,
+                         std::vector<NetworkString> *messages)
+{
+    if(packet.size()<1 || packet.getUInt8(0)!=PROTOCOL_BATCH)
+        return false;
+    int pos = 1;
+    while(pos<packet.size())
+    {
+        int length = packet.getUInt8(pos);
+        if(length & 0x80)
+        {
+            if(pos+2>packet.size())
+                return false;
+            length = packet.getUInt16(pos) & 0x7fff;
+            pos += 2;
+        }
+        else
+            pos++;
+        if(length==0 || pos+length>packet.size())
+            return false;
+        messages->push_back(packet.getSlice(pos, length));
+        pos += length;
+    }
+    return true;
+}   // split
+
+// ============================================================================
+MessageQueue::MessageQueue(PacketSender *sender)
+{
+    m_sender        = sender;
+    m_messages_sent    = 0;
+    m_packets_sent     = 0;
+    m_bytes_saved      = 0;
+    m_messages_dropped = 0;
+}   // MessageQueue
+
+// ----------------------------------------------------------------------------
+/** Adds a message to the open batch of a peer, which is sent in the next
+ *  flush(). If the batch is full, or its messages are sent with a different
+ *  reliability, it is sent first.
+ *  \param peer The receiver.
+ *  \param message The message, starting with the protocol type.
+ *  \param reliable If the message must be sent reliably.
+ */
+void MessageQueue::queue(STKPeer *peer, const NetworkString &message,
+                         bool reliable)
+{
+    OpenBatch &open = m_outgoing[peer];
+    if(!open.m_batch.isEmpty() &&
+        (open.m_reliable!=reliable || !open.m_batch.canAdd(message)))
+    {
+        sendBatch(peer, &open.m_batch, open.m_reliable);
+    }
+    open.m_reliable = reliable;
+    open.m_batch.add(message);
+}   // queue
+
+// ----------------------------------------------------------------------------
+/** Sends all messages of a batch as one packet, and counts the bytes saved:
+ *  each packet that is saved would have had its own ENet command header
+ *  (and for reliable packets an acknowledgement), while the batch adds one
+ *  byte for its type and one or two bytes per message for the length.
+ */
+void MessageQueue::sendBatch(STKPeer *peer, MessageBatch *batch,
+                             bool reliable)
+{
+    const int framing = batch->getFramingSize();
+    NetworkString packet;
+    unsigned int num_messages;
+    batch->take(&packet, &num_messages);
+    m_sender->sendPacket(peer, packet, reliable);
+
+    m_messages_sent += num_messages;
+    m_packets_sent++;
+    if(num_messages > 1)
+    {
+        const int header = reliable ? sizeof(ENetProtocolSendReliable)
+                                      + sizeof(ENetProtocolAcknowledge)
+                                    : sizeof(ENetProtocolSendUnsequenced);
+        m_bytes_saved += (num_messages - 1) * header - framing;
+    }
+}   // sendBatch
+
+// ----------------------------------------------------------------------------
+/** Sends the open batch of each peer. The batches of peers that are not in
+ *  the list (e.g. because they are not connected anymore) are dropped, and
+ *  their messages are counted in the statistics.
+ *  \param peers The peers that are connected.
+ */
+void MessageQueue::flush(const std::vector<STKPeer*> &peers)
+{
+    if(m_outgoing.empty())
+        return;
+    for(unsigned int i=0; i<peers.size(); i++)
+    {
+        std::map<STKPeer*, OpenBatch>::iterator it = m_outgoing.find(peers[i]);
+        if(it==m_outgoing.end())
+            continue;
+        if(!it->second.m_batch.isEmpty())
+            sendBatch(peers[i], &it->second.m_batch, it->second.m_reliable);
+        m_outgoing.erase(it);
+    }
+    clear();
+}   // flush
+
+// ----------------------------------------------------------------------------
+/** Drops all messages that were not sent yet, and counts them. */
+void MessageQueue::clear()
+{
+    std::map<STKPeer*, OpenBatch>::iterator it;
+    for(it=m_outgoing.begin(); it!=m_outgoing.end(); it++)
+        m_messages_dropped += it->second.m_batch.getNumMessages();
+    m_outgoing.clear();
+}   // clear
+
+// ----------------------------------------------------------------------------
+/** Returns the statistics since the last call and resets them.
+ *  \param messages_sent Number of messages sent.
+ *  \param packets_sent Number of packets these messages were sent in.
+ *  \param bytes_saved Estimated number of bytes saved by batching.
+ *  \param messages_dropped Number of messages that were not sent.
+ */
+void MessageQueue::getAndResetStatistics(unsigned int *messages_sent,
+                                         unsigned int *packets_sent,
+                                         double *bytes_saved,
+                                         unsigned int *messages_dropped)
+{
+    *messages_sent     = m_messages_sent;
+    *packets_sent      = m_packets_sent;
+    *bytes_saved       = m_bytes_saved;
+    *messages_dropped  = m_messages_dropped;
+    m_messages_sent    = 0;
+    m_packets_sent     = 0;
+    m_bytes_saved      = 0;
+    m_messages_dropped = 0;
+}   // getAndResetStatistics
+
+// ----------------------------------------------------------------------------
+/** Counts the packets sent by a MessageQueue in the unit test. */
+class CountingSender : public MessageQueue::PacketSender
+{
+public:
+    std::vector<STKPeer*> m_peers;
+    std::vector<bool>     m_reliable;
+    virtual void sendPacket(STKPeer *peer, const NetworkString &packet,
+                            bool reliable)
+    {
+        m_peers.push_back(peer);
+        m_reliable.push_back(reliable);
+    }   // sendPacket
+};   // CountingSender
+
+// ----------------------------------------------------------------------------
+/** Tests that messages of different sizes survive batching and splitting,
+ *  that malformed batches are detected, and that a MessageQueue combines
+ *  the messages of a peer without changing their order.
+ */
+void MessageBatch::unitTesting()
+{
+    MessageBatch batch;
+    std::vector<NetworkString> sent;
+    const int sizes[] = { 1, 17, 127, 128, 300 };
+    for(unsigned int i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++)
+    {
+        NetworkString ns;
+        ns.ai8(PROTOCOL_CONTROLLER_EVENTS);
+        for(int j=1; j<sizes[i]; j++)
+            ns.ai8((uint8_t)(i+j));
+        assert(batch.canAdd(ns));
+        batch.add(ns);
+        sent.push_back(ns);
+    }
+    assert(batch.getFramingSize()==1+3+2*2);
+    NetworkString packet;
+    unsigned int num_messages;
+    batch.take(&packet, &num_messages);
+    assert(batch.isEmpty());
+    assert(num_messages==sent.size());
+    // One byte type, 3 one byte and 2 two byte lengths
+    assert(packet.size()==1+3+2*2+1+17+127+128+300);
+
+    std::vector<NetworkString> received;
+    assert(split(packet, &received));
+    assert(received.size()==sent.size());
+    for(unsigned int i=0; i<sent.size(); i++)
+        assert(received[i].std_string()==sent[i].std_string());
+
+    // A single message is sent unchanged
+    batch.add(sent[1]);
+    batch.take(&packet, &num_messages);
+    assert(num_messages==1 && packet.std_string()==sent[1].std_string());
+
+    // The batch is limited to MAX_PACKET_SIZE
+    NetworkString big;
+    for(int j=0; j<MAX_PACKET_SIZE-100; j++)
+        big.ai8(1);
+    batch.add(big);
+    assert(!batch.canAdd(big));
+    batch.take(&packet, &num_messages);
+
+    // Truncated batches are rejected
+    NetworkString truncated;
+    truncated.ai8(PROTOCOL_BATCH).ai8(5).ai8(1).ai8(2);
+    received.clear();
+    assert(!split(truncated, &received) && received.empty());
+
+    // Consecutive messages to a peer with the same reliability are sent in
+    // one packet, in the order they were queued. The messages of a peer
+    // that is not connected anymore are dropped.
+    STKPeer peer_objects[3];
+    std::vector<STKPeer*> peers;
+    for(unsigned int i=0; i<3; i++)
+        peers.push_back(&peer_objects[i]);
+    CountingSender sender;
+    MessageQueue queue(&sender);
+    for(unsigned int i=0; i<3; i++)
+    {
+        queue.queue(peers[0], sent[i], false);
+        queue.queue(peers[1], sent[i], i==0);
+        queue.queue(peers[2], sent[i], false);
+    }
+    peers.pop_back();
+    queue.flush(peers);
+    // Peer 1: the reliable message is sent before the unreliable ones
+    assert(sender.m_peers.size()==3);
+    assert(sender.m_peers[0]==peers[1] && sender.m_reliable[0]);
+    unsigned int messages_sent, packets_sent, messages_dropped;
+    double bytes_saved;
+    queue.getAndResetStatistics(&messages_sent, &packets_sent, &bytes_saved,
+                                &messages_dropped);
+    assert(messages_sent==6 && packets_sent==3 && bytes_saved>0);
+    assert(messages_dropped==3);
+    Log::info("MessageBatch", "Batching tests passed.");
+}   // unitTesting
@@ -0,0 +1,153 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+/*! \file message_batch.hpp
+ *  \brief Combines several messages into one packet.
+ */
+
+#ifndef HEADER_MESSAGE_BATCH_HPP
+#define HEADER_MESSAGE_BATCH_HPP
+
+#include "network/network_string.hpp"
+
+#include <map>
+#include <vector>
+
+class STKPeer;
+
+/** \brief Collects the messages that are sent to one peer on one channel
+ *  during a tick, so that they can be sent as a single packet.
+ *  A single message is sent unchanged. Several messages are sent as one
+ *  packet which starts with PROTOCOL_BATCH, followed by each message with
+ *  its length in front of it. The length takes one byte for messages
+ *  shorter than 128 bytes, otherwise two bytes (with the highest bit of
+ *  the first byte set). Messages are only combined up to MAX_PACKET_SIZE,
+ *  so that a batch fits into one UDP datagram and does not need to be
+ *  fragmented by ENet.
+ *  \ingroup network
+ */
+class MessageBatch
+{
+public:
+    /** Maximum size of a batch in bytes. */
+    static const int MAX_PACKET_SIZE = 1200;
+
+    /** Maximum size of a message in a batch. */
+    static const int MAX_MESSAGE_SIZE = 0x7fff;
+
+private:
+    /** The messages, each starting with its protocol type. */
+    std::vector<NetworkString> m_messages;
+
+    /** Size of the batch packet for the current messages. */
+    int m_size;
+
+    /** Sum of the sizes of the current messages. */
+    int m_payload;
+
+    // ------------------------------------------------------------------------
+    /** Returns the number of bytes used for the length of a message. */
+    static int getLengthSize(int length) { return length<0x80 ? 1 : 2; }
+
+public:
+         MessageBatch() : m_size(1), m_payload(0) {}
+    bool canAdd(const NetworkString &message) const;
+    void add(const NetworkString &message);
+    void take(NetworkString *packet, unsigned int *num_messages);
+    static bool split(const NetworkString &packet,
+                      std::vector<NetworkString> *messages);
+    static void unitTesting();
+
+    // ------------------------------------------------------------------------
+    /** Returns true if no message was added since the last take(). */
+    bool isEmpty() const { return m_messages.empty(); }
+    // ------------------------------------------------------------------------
+    /** Returns the number of messages added since the last take(). */
+    unsigned int getNumMessages() const
+    {
+        return (unsigned int)m_messages.size();
+    }   // getNumMessages
+    // ------------------------------------------------------------------------
+    /** Returns the number of bytes the batch adds to the messages (0 if
+     *  there is only one message, which is sent unchanged). */
+    int getFramingSize() const
+    {
+        return m_messages.size()>1 ? m_size-m_payload : 0;
+    }   // getFramingSize
+};   // MessageBatch
+
+// ============================================================================
+/** \brief The messages to send in one tick, combined into MessageBatches.
+ *  Each peer has one open batch, which contains consecutive messages that
+ *  are all reliable or all unreliable. When a message with the other
+ *  reliability is queued, the open batch is sent first, so the packets to
+ *  a peer are always sent in the order the messages were queued. The
+ *  packets are given to a PacketSender, which sends them with the
+ *  NetworkManager in the game, and through a Transport in the
+ *  ServerSnapshotBenchmark. Not thread-safe, the ProtocolManager locks it.
+ *  \ingroup network
+ */
+class MessageQueue
+{
+public:
+    /** Sends the packets of a MessageQueue. */
+    class PacketSender
+    {
+    public:
+        virtual ~PacketSender() {}
+        virtual void sendPacket(STKPeer *peer, const NetworkString &packet,
+                                bool reliable) = 0;
+    };   // PacketSender
+
+private:
+    PacketSender *m_sender;
+
+    /** The open batch of a peer. */
+    struct OpenBatch
+    {
+        MessageBatch m_batch;
+        /** If the messages in the batch are sent reliably. */
+        bool         m_reliable;
+    };   // OpenBatch
+
+    /** The open batch of each peer. */
+    std::map<STKPeer*, OpenBatch> m_outgoing;
+
+    /** Number of messages and of packets sent, the estimated number of
+     *  bytes saved by batching, and the number of messages dropped because
+     *  their peer was not connected anymore, since the statistics were last
+     *  taken. */
+    unsigned int m_messages_sent;
+    unsigned int m_packets_sent;
+    double       m_bytes_saved;
+    unsigned int m_messages_dropped;
+
+    void sendBatch(STKPeer *peer, MessageBatch *batch, bool reliable);
+
+public:
+         MessageQueue(PacketSender *sender);
+    void queue(STKPeer *peer, const NetworkString &message, bool reliable);
+    void flush(const std::vector<STKPeer*> &peers);
+    void clear();
+    void getAndResetStatistics(unsigned int *messages_sent,
+                               unsigned int *packets_sent,
+                               double *bytes_saved,
+                               unsigned int *messages_dropped);
+};   // MessageQueue
+
+#endif
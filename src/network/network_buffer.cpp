@@ -0,0 +1,231 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/network_buffer.hpp"
+
+#include "utils/log.hpp"
+
+#include <assert.h>
+#include <stdlib.h>
+
+/** Maximum number of unused buffers kept in the pool. */
+static const unsigned int MAX_POOL_SIZE = 256;
+
+/** Buffers larger than this are freed instead of being kept in the pool. */
+static const uint32_t MAX_POOLED_CAPACITY = 64*1024;
+
+Synchronised<std::vector<NetworkBuffer*> > NetworkBuffer::m_pool;
+Synchronised<std::map<ENetPacket*, NetworkBuffer*> >
+                                           NetworkBuffer::m_packet_buffers;
+
+// ----------------------------------------------------------------------------
+NetworkBuffer::NetworkBuffer()
+{
+    m_data      = NULL;
+    m_capacity  = 0;
+    m_front     = HEADROOM;
+    m_ref_count = 0;
+    m_packet    = NULL;
+    pthread_mutex_init(&m_mutex, NULL);
+}   // NetworkBuffer
+
+// ----------------------------------------------------------------------------
+NetworkBuffer::~NetworkBuffer()
+{
+    assert(m_packet==NULL);
+    free(m_data);
+    pthread_mutex_destroy(&m_mutex);
+}   // ~NetworkBuffer
+
+// ----------------------------------------------------------------------------
+/** Returns a buffer with at least the given capacity and a reference
+ *  count of 1. The buffer is taken from the pool if possible.
+ *  \param capacity Minimum number of bytes needed, including HEADROOM.
+ */
+NetworkBuffer *NetworkBuffer::create(uint32_t capacity)
+{
+    NetworkBuffer *buffer = NULL;
+    m_pool.lock();
+    if(!m_pool.getData().empty())
+    {
+        buffer = m_pool.getData().back();
+        m_pool.getData().pop_back();
+    }
+    m_pool.unlock();
+
+    if(!buffer)
+        buffer = new NetworkBuffer();
+    buffer->m_ref_count = 1;
+    buffer->m_front     = HEADROOM;
+    buffer->reserve(capacity);
+    return buffer;
+}   // create
+
+// ----------------------------------------------------------------------------
+/** Returns a read-only buffer that uses the data of a received packet. The
+ *  packet will be destroyed when the buffer is not used anymore.
+ *  \param packet The received packet.
+ */
+NetworkBuffer *NetworkBuffer::create(ENetPacket *packet)
+{
+    NetworkBuffer *buffer = create((uint32_t)0);
+    // Keep the own memory (if any) for when the buffer is reused.
+    buffer->m_packet = packet;
+    buffer->m_front  = 0;
+    return buffer;
+}   // create(ENetPacket)
+
+// ----------------------------------------------------------------------------
+/** Frees all buffers in the pool.
+ */
+void NetworkBuffer::clearPool()
+{
+    m_pool.lock();
+    for(unsigned int i=0; i<m_pool.getData().size(); i++)
+        delete m_pool.getData()[i];
+    m_pool.getData().clear();
+    m_pool.unlock();
+}   // clearPool
+
+// ----------------------------------------------------------------------------
+/** Increases the reference count. */
+void NetworkBuffer::grab()
+{
+    pthread_mutex_lock(&m_mutex);
+    m_ref_count++;
+    pthread_mutex_unlock(&m_mutex);
+}   // grab
+
+// ----------------------------------------------------------------------------
+/** Decreases the reference count, and returns the buffer to the pool if it
+ *  is not used anymore.
+ */
+void NetworkBuffer::drop()
+{
+    pthread_mutex_lock(&m_mutex);
+    assert(m_ref_count>0);
+    const bool unused = --m_ref_count == 0;
+    pthread_mutex_unlock(&m_mutex);
+    if(!unused) return;
+
+    if(m_packet)
+    {
+        enet_packet_destroy(m_packet);
+        m_packet = NULL;
+    }
+
+    m_pool.lock();
+    if(m_pool.getData().size() < MAX_POOL_SIZE &&
+       m_capacity <= MAX_POOLED_CAPACITY)
+    {
+        m_pool.getData().push_back(this);
+        m_pool.unlock();
+        return;
+    }
+    m_pool.unlock();
+    delete this;
+}   // drop
+
+// ----------------------------------------------------------------------------
+/** Returns true if the memory of this buffer can be modified, i.e. it is
+ *  owned by this buffer and only used by a single NetworkString.
+ */
+bool NetworkBuffer::isWritable() const
+{
+    pthread_mutex_lock(&m_mutex);
+    const bool writable = m_ref_count==1 && !m_packet;
+    pthread_mutex_unlock(&m_mutex);
+    return writable;
+}   // isWritable
+
+// ----------------------------------------------------------------------------
+/** Tries to claim the byte in front of index start, so that a NetworkString
+ *  starting at start can prepend a byte. This is possible if the buffer is
+ *  not shared, or if nobody else has claimed that byte yet (which allows
+ *  e.g. several copies of a message to be sent with different headers
+ *  without copying the message for the first one).
+ *  \param start The current start index of the NetworkString.
+ *  \return True if the byte at start-1 can be written.
+ */
+bool NetworkBuffer::claimFront(uint32_t start)
+{
+    if(start==0 || m_packet) return false;
+    pthread_mutex_lock(&m_mutex);
+    const bool can_claim = start==m_front || m_ref_count==1;
+    if(can_claim && start-1 < m_front)
+        m_front = start-1;
+    pthread_mutex_unlock(&m_mutex);
+    return can_claim;
+}   // claimFront
+
+// ----------------------------------------------------------------------------
+/** Makes sure that at least the given number of bytes are allocated. Must
+ *  only be called for writable buffers, since the memory might move.
+ */
+void NetworkBuffer::reserve(uint32_t capacity)
+{
+    if(capacity <= m_capacity) return;
+    assert(!m_packet);
+    uint32_t new_capacity = m_capacity < 64 ? 64 : m_capacity;
+    while(new_capacity < capacity)
+        new_capacity *= 2;
+    m_data     = (uint8_t*)realloc(m_data, new_capacity);
+    m_capacity = new_capacity;
+}   // reserve
+
+// ----------------------------------------------------------------------------
+/** Creates an ENet packet that uses (and does not copy) the data of this
+ *  buffer. The buffer is kept alive until ENet destroys the packet.
+ *  \param start Index of the first byte of the packet.
+ *  \param size Number of bytes in the packet.
+ *  \param flags ENet packet flags.
+ */
+ENetPacket *NetworkBuffer::createPacket(uint32_t start, uint32_t size,
+                                        enet_uint32 flags)
+{
+    ENetPacket *packet = enet_packet_create(getData()+start, size,
+                                         flags | ENET_PACKET_FLAG_NO_ALLOCATE);
+    if(!packet) return NULL;
+    grab();
+    packet->freeCallback = &NetworkBuffer::packetFreed;
+    m_packet_buffers.lock();
+    m_packet_buffers.getData()[packet] = this;
+    m_packet_buffers.unlock();
+    return packet;
+}   // createPacket
+
+// ----------------------------------------------------------------------------
+/** Called by ENet when a packet created by createPacket is destroyed.
+ */
+void NetworkBuffer::packetFreed(ENetPacket *packet)
+{
+    NetworkBuffer *buffer = NULL;
+    m_packet_buffers.lock();
+    std::map<ENetPacket*, NetworkBuffer*>::iterator i =
+        m_packet_buffers.getData().find(packet);
+    if(i!=m_packet_buffers.getData().end())
+    {
+        buffer = i->second;
+        m_packet_buffers.getData().erase(i);
+    }
+    m_packet_buffers.unlock();
+    if(buffer)
+        buffer->drop();
+    else
+        Log::warn("NetworkBuffer", "Unknown packet freed.");
+}   // packetFreed
@@ -0,0 +1,117 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+/*! \file network_buffer.hpp
+ *  \brief Reference counted, pooled memory used by NetworkString.
+ */
+
+#ifndef HEADER_NETWORK_BUFFER_HPP
+#define HEADER_NETWORK_BUFFER_HPP
+
+#include "utils/no_copy.hpp"
+#include "utils/synchronised.hpp"
+#include "utils/types.hpp"
+
+// enet.h includes win32.h, which without lean_and_mean includes
+// winspool.h, which defines MAX_PRIORITY as a macro, which then
+// results in request_manager.hpp not being compilable.
+#define WIN32_LEAN_AND_MEAN
+#include <enet/enet.h>
+
+#include <map>
+#include <vector>
+
+/** \class NetworkBuffer
+ *  \brief A block of memory that can be shared by several NetworkStrings
+ *  and by ENet packets.
+ *  The buffer is reference counted (thread-safe, since packets are freed
+ *  by the ENet listening thread), and is returned to a pool when it is
+ *  not used anymore, so that sending and receiving messages does not
+ *  need to allocate memory. A buffer either owns its memory, or wraps the
+ *  data of a received ENet packet, in which case it is read only and the
+ *  packet is destroyed once the buffer is not used anymore.
+ *  A small amount of space is kept free in front of the data, so that
+ *  headers (e.g. the protocol type) can be prepended without copying.
+ *  \ingroup network
+ */
+class NetworkBuffer : public NoCopy
+{
+private:
+    /** The memory, either owned or the data of m_packet. */
+    uint8_t         *m_data;
+
+    /** Number of bytes allocated in m_data. */
+    uint32_t         m_capacity;
+
+    /** Index of the first byte that is in use. The bytes before this
+     *  index can be claimed by a NetworkString to prepend data. */
+    uint32_t         m_front;
+
+    /** Number of NetworkStrings and ENet packets using this buffer. */
+    int              m_ref_count;
+
+    /** If not NULL the received packet whose data is used. */
+    ENetPacket      *m_packet;
+
+    /** Protects the reference count and m_front. */
+    mutable pthread_mutex_t m_mutex;
+
+    /** The unused buffers. */
+    static Synchronised<std::vector<NetworkBuffer*> > m_pool;
+
+    /** Maps packets that were created from a buffer to the buffer, so
+     *  that the buffer can be released once ENet frees the packet. */
+    static Synchronised<std::map<ENetPacket*, NetworkBuffer*> >
+                                                      m_packet_buffers;
+
+    static void packetFreed(ENetPacket *packet);
+
+             NetworkBuffer();
+            ~NetworkBuffer();
+
+public:
+    /** Free space kept in front of the data of a new buffer. */
+    static const uint32_t HEADROOM = 8;
+
+    static NetworkBuffer *create(uint32_t capacity);
+    static NetworkBuffer *create(ENetPacket *packet);
+    static void           clearPool();
+
+    void        grab();
+    void        drop();
+    bool        isWritable() const;
+    bool        claimFront(uint32_t start);
+    void        reserve(uint32_t capacity);
+    ENetPacket *createPacket(uint32_t start, uint32_t size,
+                             enet_uint32 flags);
+
+    // ------------------------------------------------------------------------
+    /** Returns a pointer to the memory of this buffer. */
+    uint8_t *getData() const
+    {
+        return m_packet ? m_packet->data : m_data;
+    }   // getData
+    // ------------------------------------------------------------------------
+    /** Returns the number of bytes that can be used. */
+    uint32_t getCapacity() const
+    {
+        return m_packet ? (uint32_t)m_packet->dataLength : m_capacity;
+    }   // getCapacity
+};   // NetworkBuffer
+
+#endif
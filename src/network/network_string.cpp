@@ -16,9 +16,345 @@
 //  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "network/network_string.hpp"
 
+#include "network/kart_snapshot.hpp"
+#include "utils/log.hpp"
+#include "utils/time.hpp"
+
+#include <math.h>
+
+NetworkString::NetworkString(const uint8_t& value)
+             : m_buffer(NULL), m_bytes(NULL), m_start(0), m_end(0),
+               m_writable_end(0)
+{
+    addUInt8(value);
+}   // NetworkString(uint8_t)
+
+// ----------------------------------------------------------------------------
+NetworkString::NetworkString(NetworkString const& copy)
+             : m_buffer(copy.m_buffer), m_bytes(copy.m_bytes),
+               m_start(copy.m_start), m_end(copy.m_end),
+               m_writable_end(copy.m_end)
+{
+    if(m_buffer)
+    {
+        m_buffer->grab();
+        copy.m_writable_end = copy.m_end;
+    }
+}   // NetworkString(NetworkString)
+
+// ----------------------------------------------------------------------------
+NetworkString::NetworkString(const std::string & value)
+             : m_buffer(NULL), m_bytes(NULL), m_start(0), m_end(0),
+               m_writable_end(0)
+{
+    addString(value);
+}   // NetworkString(std::string)
+
+// ----------------------------------------------------------------------------
+/** Creates a string that uses the data of a received packet without copying
+ *  it. The packet is destroyed once no string uses it anymore.
+ */
+NetworkString::NetworkString(ENetPacket *packet)
+             : m_buffer(NULL), m_bytes(NULL), m_start(0), m_end(0),
+               m_writable_end(0)
+{
+    if(packet->dataLength==0)
+    {
+        enet_packet_destroy(packet);
+        return;
+    }
+    m_buffer       = NetworkBuffer::create(packet);
+    m_bytes        = m_buffer->getData();
+    m_end          = (uint32_t)packet->dataLength;
+    m_writable_end = m_end;
+}   // NetworkString(ENetPacket)
+
+// ----------------------------------------------------------------------------
+NetworkString& NetworkString::operator=(NetworkString const& copy)
+{
+    if(&copy==this) return *this;
+    if(copy.m_buffer)
+    {
+        copy.m_buffer->grab();
+        copy.m_writable_end = copy.m_end;
+    }
+    release();
+    m_buffer       = copy.m_buffer;
+    m_bytes        = copy.m_bytes;
+    m_start        = copy.m_start;
+    m_end          = copy.m_end;
+    m_writable_end = copy.m_end;
+    return *this;
+}   // operator=
+
+// ----------------------------------------------------------------------------
+/** Releases the buffer, which leaves this string empty. */
+void NetworkString::release()
+{
+    if(m_buffer)
+        m_buffer->drop();
+    m_buffer       = NULL;
+    m_bytes        = NULL;
+    m_start        = 0;
+    m_end          = 0;
+    m_writable_end = 0;
+}   // release
+
+// ----------------------------------------------------------------------------
+/** Copies the data of this string into a new buffer, with HEADROOM free
+ *  bytes in front of it.
+ *  \param additional Number of bytes that will be added at the end.
+ */
+void NetworkString::copyToNewBuffer(uint32_t additional)
+{
+    const uint32_t size = m_end - m_start;
+    NetworkBuffer *buffer =
+        NetworkBuffer::create(NetworkBuffer::HEADROOM+size+additional);
+    if(size>0)
+        memcpy(buffer->getData()+NetworkBuffer::HEADROOM, m_bytes+m_start,
+               size);
+    if(m_buffer)
+        m_buffer->drop();
+    m_buffer       = buffer;
+    m_bytes        = m_buffer->getData();
+    m_start        = NetworkBuffer::HEADROOM;
+    m_end          = m_start + size;
+    m_writable_end = m_buffer->getCapacity();
+}   // copyToNewBuffer
+
+// ----------------------------------------------------------------------------
+/** Makes sure that this string is the only user of its buffer and that
+ *  there is space for the given number of additional bytes. If the buffer
+ *  is shared (or is a received packet), the data is copied into a new
+ *  buffer.
+ *  \param additional Number of bytes that will be added at the end.
+ */
+void NetworkString::makeWritable(uint32_t additional)
+{
+    if(!m_buffer || !m_buffer->isWritable())
+    {
+        copyToNewBuffer(additional);
+        return;
+    }
+    m_buffer->reserve(m_end+additional);
+    m_bytes        = m_buffer->getData();
+    m_writable_end = m_buffer->getCapacity();
+}   // makeWritable
+
+// ----------------------------------------------------------------------------
+/** Removes bytes from this string. Removing bytes at the front does not
+ *  copy any data.
+ *  \param pos Index of the first byte to remove.
+ *  \param size Number of bytes to remove.
+ */
+NetworkString& NetworkString::remove(int pos, int size)
+{
+    assert(pos>=0 && size>=0 && pos+size<=this->size());
+    if(pos==0)
+        return removeFront(size);
+    if(pos+size==this->size())
+    {
+        m_end -= size;
+        // Another string might share the removed bytes
+        m_writable_end = m_end;
+        return *this;
+    }
+    makeWritable(0);
+    memmove(m_bytes+m_start+pos, m_bytes+m_start+pos+size,
+            m_end-m_start-pos-size);
+    m_end -= size;
+    return *this;
+}   // remove
+
+// ----------------------------------------------------------------------------
+/** Returns a part of this string. The returned string shares the data with
+ *  this string.
+ *  \param pos Index of the first byte of the slice.
+ *  \param len Number of bytes in the slice.
+ */
+NetworkString NetworkString::getSlice(int pos, int len) const
+{
+    assert(pos>=0 && len>=0 && pos+len<=size());
+    NetworkString slice(*this);
+    slice.m_start        = m_start+pos;
+    slice.m_end          = slice.m_start+len;
+    slice.m_writable_end = slice.m_end;
+    return slice;
+}   // getSlice
+
+// ----------------------------------------------------------------------------
+/** Adds a byte in front of this string. This uses the free space in front
+ *  of the data if possible, so that e.g. a header can be added to a message
+ *  without copying it.
+ */
+NetworkString& NetworkString::prependUInt8(const uint8_t& value)
+{
+    if(!m_buffer || !m_buffer->claimFront(m_start))
+    {
+        copyToNewBuffer(0);
+        m_buffer->claimFront(m_start);
+    }
+    m_start--;
+    m_bytes[m_start] = value;
+    return *this;
+}   // prependUInt8
+
+// ----------------------------------------------------------------------------
+/** Appends another string. If this string is empty, the data is shared
+ *  instead of copied.
+ */
+NetworkString& NetworkString::operator+=(NetworkString const& value)
+{
+    if(value.size()==0)
+        return *this;
+    if(size()==0)
+        return *this = value;
+    // Keep the data alive in case value is a slice of this string
+    NetworkString source(value);
+    memcpy(grow(source.size()), source.getBytes(), source.size());
+    return *this;
+}   // operator+=
+
+// ----------------------------------------------------------------------------
+/** Creates an ENet packet containing this string without copying the data.
+ *  The buffer is kept alive until ENet destroys the packet.
+ *  \param flags ENet packet flags.
+ */
+ENetPacket* NetworkString::createPacket(enet_uint32 flags) const
+{
+    if(!m_buffer)
+        return enet_packet_create(NULL, 0, flags);
+    // The packet uses the buffer now, so it must not be changed anymore
+    m_writable_end = m_end;
+    return m_buffer->createPacket(m_start, size(), flags);
+}   // createPacket
+
+// ----------------------------------------------------------------------------
 NetworkString operator+(NetworkString const& a, NetworkString const& b)
 {
     NetworkString ns(a);
     ns += b;
     return ns;
 }
+
+// ----------------------------------------------------------------------------
+/** Tests sharing and copy on write, and measures the time to encode and
+ *  decode a 64 kart snapshot the way it is passed through the network code
+ *  (the protocol type is prepended, and the receiving protocol gets a copy
+ *  of the event data).
+ */
+void NetworkString::unitTesting()
+{
+    NetworkString a;
+    a.ai8(1).ai16(0x0203).ai32(0x04050607);
+    NetworkString b(a), c = a.getSlice(1, 2);
+    assert(b.getBytes()==a.getBytes());
+    assert(c.size()==2 && c.getUInt16()==0x0203);
+    b.ai8(8);
+    // b must have been detached, a and c are unchanged
+    assert(a.size()==7 && b.size()==8 && b.getUInt8(7)==8);
+    assert(c.getBytes()==a.getBytes()+1);
+    a.prependUInt8(0);
+    b.prependUInt8(9);
+    assert(a.getUInt8(0)==0 && a.getUInt32(4)==0x04050607);
+    assert(b.getUInt8(0)==9 && b.getUInt8(1)==1);
+    uint8_t u8;
+    uint16_t u16;
+    a.gui8(&u8).gui8(&u8).gui16(&u16);
+    assert(u8==1 && u16==0x0203 && a.getUInt32()==0x04050607);
+    b.remove(2, 2);
+    assert(b.size()==7 && b.getUInt8(2)==4);
+    float f = 1.5f;
+    NetworkString d;
+    d.af(f).af(2.5f);
+    assert(d.getAndRemoveFloat()==1.5f && d.size()==4 && d.getFloat()==2.5f);
+
+    // A packet shares the data, and the string must not change it anymore
+    ENetPacket *packet = b.createPacket(ENET_PACKET_FLAG_RELIABLE);
+    assert(packet->data==b.getBytes() && (int)packet->dataLength==b.size());
+    b.ai8(10);
+    assert(packet->data[0]==9 && packet->data!=b.getBytes());
+    enet_packet_destroy(packet);
+    NetworkString e(enet_packet_create(b.getBytes(), b.size(), 0));
+    assert(e.size()==b.size() && e.getUInt8(0)==9);
+
+    // Benchmark with 64 karts driving on circles
+    const unsigned int num_karts = 64;
+    const unsigned int num_ticks = 2000;
+    KartSnapshotCodec codec(Vec3(-300, -10, -500), Vec3(400, 50, 200));
+    KartSnapshot snapshot, baseline, decoded;
+    snapshot.m_karts.resize(num_karts);
+    std::vector<Vec3> xyz(num_karts);
+    std::vector<btQuaternion> q(num_karts);
+
+    double encode_time = 0, decode_time = 0, legacy_time = 0;
+    unsigned int bytes = 0, legacy_bytes = 0;
+    for(unsigned int tick=0; tick<num_ticks; tick++)
+    {
+        for(unsigned int k=0; k<num_karts; k++)
+        {
+            float t = tick*0.1f;
+            float r = 50.0f+3.0f*k;
+            xyz[k] = Vec3(r*cosf(0.2f*t), 1.0f, r*sinf(0.2f*t)-150.0f);
+            q[k]   = btQuaternion(Vec3(0,1,0), 0.2f*t);
+        }
+
+        double start = StkTime::getRealTime();
+        for(unsigned int k=0; k<num_karts; k++)
+            codec.quantise(xyz[k], q[k], &snapshot.m_karts[k]);
+        NetworkString message;
+        codec.encode(snapshot, tick>0 ? &baseline : NULL, &message);
+        NetworkString packet(message);
+        packet.prependUInt8(1);
+        bytes += packet.size();
+        double middle = StkTime::getRealTime();
+
+        NetworkString event_data(packet);
+        event_data.removeFront(1);
+        int pos = 0;
+        if(!codec.decode(event_data, &pos, tick>0 ? &baseline : NULL,
+                         &decoded))
+            Log::error("NetworkString", "Decoding failed in tick %d.", tick);
+        for(unsigned int k=0; k<num_karts; k++)
+        {
+            Vec3 v;
+            btQuaternion r;
+            codec.dequantise(decoded.m_karts[k], &v, &r);
+        }
+        double end = StkTime::getRealTime();
+        encode_time += middle-start;
+        decode_time += end-middle;
+        baseline = snapshot;
+
+        // The uncompressed format: kart id and 7 floats per kart,
+        // parsed by removing the data at the front.
+        start = StkTime::getRealTime();
+        NetworkString legacy;
+        for(unsigned int k=0; k<num_karts; k++)
+        {
+            legacy.ai32(k).af(xyz[k].getX()).af(xyz[k].getY())
+                  .af(xyz[k].getZ()).af(q[k].getX()).af(q[k].getY())
+                  .af(q[k].getZ()).af(q[k].getW());
+        }
+        legacy_bytes += legacy.size();
+        NetworkString received(legacy);
+        float sum = 0;
+        while(received.size()>=32)
+        {
+            uint32_t id;
+            float values[7];
+            received.gui32(&id);
+            for(unsigned int i=0; i<7; i++)
+                received.gf(&values[i]);
+            sum += values[0];
+        }
+        legacy_time += StkTime::getRealTime()-start;
+        assert(sum!=0);
+    }
+
+    Log::info("NetworkString", "%d karts: encode %.2f us, decode %.2f us "
+              "for %.1f bytes per tick; uncompressed %.2f us for %.1f bytes.",
+              num_karts, encode_time*1e6/num_ticks, decode_time*1e6/num_ticks,
+              bytes/(float)num_ticks, legacy_time*1e6/num_ticks,
+              legacy_bytes/(float)num_ticks);
+}   // unitTesting
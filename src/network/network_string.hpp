@@ -23,45 +23,87 @@
 #ifndef NETWORK_STRING_HPP
 #define NETWORK_STRING_HPP
 
+#include "network/network_buffer.hpp"
 #include "utils/types.hpp"
 
 #include <string>
 #include <vector>
 #include <stdarg.h>
 #include <assert.h>
+#include <string.h>
 
 typedef unsigned char uchar;
 
 /** \class NetworkString
  *  \brief Describes a chain of 8-bit unsigned integers.
  *  This class allows you to easily create and parse 8-bit strings.
+ *  The data is stored in a reference counted NetworkBuffer: copying a
+ *  string, taking a slice of it or removing bytes at the front does not
+ *  copy any data. The data is only copied when a string that shares its
+ *  buffer is modified (copy on write). Removing data from the front just
+ *  advances the start index, so parsing a message with removeFront or the
+ *  gui8(&value)-style functions is linear in the size of the message.
  */
 class NetworkString
 {
-    union {
-    float f;
-    uint8_t i[4];
-    } f_as_i; // float as integer
-    union {
-    double d;
-    uint8_t i[8];
-    } d_as_i; // double as integer
+    private:
+        /** The buffer with the data, NULL if the string is empty. */
+        NetworkBuffer *m_buffer;
+
+        /** Cached pointer to the data of m_buffer. */
+        uint8_t *m_bytes;
+
+        /** Index of the first byte of this string in m_buffer. */
+        uint32_t m_start;
+
+        /** Index after the last byte of this string in m_buffer. */
+        uint32_t m_end;
+
+        /** Data can be appended without further checks as long as the end
+         *  stays below this index. This is set to m_end as soon as the
+         *  buffer gets shared, so that the next append detaches the string
+         *  (which is why it must be mutable). */
+        mutable uint32_t m_writable_end;
+
+        void copyToNewBuffer(uint32_t additional);
+        void makeWritable(uint32_t additional);
+        void release();
+
+        // --------------------------------------------------------------------
+        /** Returns a pointer to where the next 'additional' bytes can be
+         *  written, and increases the size of the string accordingly. */
+        uint8_t *grow(uint32_t additional)
+        {
+            if(m_end+additional > m_writable_end)
+                makeWritable(additional);
+            uint8_t *p = m_bytes+m_end;
+            m_end += additional;
+            return p;
+        }   // grow
+
     public:
-        NetworkString() { }
-        NetworkString(const uint8_t& value) { m_string.push_back(value); }
-        NetworkString(NetworkString const& copy) { m_string = copy.m_string; }
-        NetworkString(const std::string & value) { m_string = std::vector<uint8_t>(value.begin(), value.end()); }
+        NetworkString()
+            : m_buffer(NULL), m_bytes(NULL), m_start(0), m_end(0),
+              m_writable_end(0) { }
+        NetworkString(const uint8_t& value);
+        NetworkString(NetworkString const& copy);
+        NetworkString(const std::string & value);
+        NetworkString(ENetPacket *packet);
+        ~NetworkString() { release(); }
+
+        NetworkString& operator=(NetworkString const& copy);
 
         NetworkString& removeFront(int size)
         {
-            m_string.erase(m_string.begin(), m_string.begin()+size);
-            return *this;
-        }
-        NetworkString& remove(int pos, int size)
-        {
-            m_string.erase(m_string.begin()+pos, m_string.begin()+pos+size);
+            assert(size>=0 && size<=this->size());
+            m_start += size;
             return *this;
         }
+        NetworkString& remove(int pos, int size);
+        NetworkString getSlice(int pos, int len) const;
+        NetworkString& prependUInt8(const uint8_t& value);
+        ENetPacket* createPacket(enet_uint32 flags) const;
+        static void unitTesting();
 
         uint8_t operator[](const int& pos) const
         {
@@ -70,105 +112,86 @@ class NetworkString
 
         NetworkString& addUInt8(const uint8_t& value)
         {
-            m_string.push_back(value);
+            *grow(1) = value;
             return *this;
         }
         inline NetworkString& ai8(const uint8_t& value) { return addUInt8(value); }
         NetworkString& addUInt16(const uint16_t& value)
         {
-            m_string.push_back((value>>8)&0xff);
-            m_string.push_back(value&0xff);
+            uint8_t *p = grow(2);
+            p[0] = (value>>8)&0xff;
+            p[1] = value&0xff;
             return *this;
         }
         inline NetworkString& ai16(const uint16_t& value) { return addUInt16(value); }
         NetworkString& addUInt32(const uint32_t& value)
         {
-            m_string.push_back((value>>24)&0xff);
-            m_string.push_back((value>>16)&0xff);
-            m_string.push_back((value>>8)&0xff);
-            m_string.push_back(value&0xff);
+            uint8_t *p = grow(4);
+            p[0] = (value>>24)&0xff;
+            p[1] = (value>>16)&0xff;
+            p[2] = (value>>8)&0xff;
+            p[3] = value&0xff;
             return *this;
         }
         inline NetworkString& ai32(const uint32_t& value) { return addUInt32(value); }
         NetworkString& addInt(const int& value)
         {
-            m_string.push_back((value>>24)&0xff);
-            m_string.push_back((value>>16)&0xff);
-            m_string.push_back((value>>8)&0xff);
-            m_string.push_back(value&0xff);
-            return *this;
+            return addUInt32((uint32_t)value);
         }
         inline NetworkString& ai(const int& value) { return addInt(value); }
         NetworkString& addFloat(const float& value) //!< BEWARE OF PRECISION
         {
             assert(sizeof(float)==4);
-            f_as_i.f = value;
-            m_string.push_back(f_as_i.i[0]);
-            m_string.push_back(f_as_i.i[1]);
-            m_string.push_back(f_as_i.i[2]);
-            m_string.push_back(f_as_i.i[3]);
+            memcpy(grow(4), &value, 4);
             return *this;
         }
         inline NetworkString& af(const float& value) { return addFloat(value); }
         NetworkString& addDouble(const double& value) //!< BEWARE OF PRECISION
         {
             assert(sizeof(double)==8);
-            d_as_i.d = value;
-            m_string.push_back(d_as_i.i[0]);
-            m_string.push_back(d_as_i.i[1]);
-            m_string.push_back(d_as_i.i[2]);
-            m_string.push_back(d_as_i.i[3]);
-            m_string.push_back(d_as_i.i[4]);
-            m_string.push_back(d_as_i.i[5]);
-            m_string.push_back(d_as_i.i[6]);
-            m_string.push_back(d_as_i.i[7]);
+            memcpy(grow(8), &value, 8);
             return *this;
         }
         inline NetworkString& ad(const double& value) { return addDouble(value); }
         NetworkString& addChar(const char& value)
         {
-            m_string.push_back((uint8_t)(value));
+            *grow(1) = (uint8_t)(value);
             return *this;
         }
         inline NetworkString& ac(const char& value) { return addChar(value); }
 
         NetworkString& addString(const std::string& value)
         {
-            for (unsigned int i = 0; i < value.size(); i++)
-                m_string.push_back((uint8_t)(value[i]));
+            if(!value.empty())
+                memcpy(grow((uint32_t)value.size()), value.data(), value.size());
             return *this;
         }
         inline NetworkString& as(const std::string& value) { return addString(value); }
 
-        NetworkString& operator+=(NetworkString const& value)
-        {
-            m_string.insert( m_string.end(), value.m_string.begin(), value.m_string.end() );
-            return *this;
-        }
+        NetworkString& operator+=(NetworkString const& value);
 
         const std::string std_string() const
         {
-            std::string str(m_string.begin(), m_string.end());
-            return str;
+            return std::string((const char*)getBytes(), size());
         }
 
         int size() const
         {
-            return (int)m_string.size();
+            return (int)(m_end-m_start);
         }
 
-        uint8_t* getBytes() { return &m_string[0]; };
-        const uint8_t* getBytes() const { return &m_string[0]; };
+        const uint8_t* getBytes() const { return m_bytes+m_start; };
 
         template<typename T, size_t n>
         T get(int pos) const
         {
-            int a = n;
+            assert(pos>=0 && pos+(int)n<=size());
+            const uint8_t *p = m_bytes+m_start+pos;
             T result = 0;
-            while(a--)
+            for(size_t i=0; i<n; i++)
             {
                 result <<= 8; // offset one byte
-                result += ((uint8_t)(m_string[pos+n-1-a]) & 0xff); // add the data to result
+                result += (p[i] & 0xff); // add the data to result
             }
             return result;
         }
@@ -180,7 +203,7 @@ class NetworkString
         inline uint8_t      getUInt8(int pos = 0)  const { return get<uint8_t,1>(pos);         }
         inline char         getChar(int pos = 0)   const { return get<char,1>(pos);            }
         inline unsigned char getUChar(int pos = 0) const { return get<unsigned char,1>(pos);   }
-        std::string         getString(int pos, int len) const { return std::string(m_string.begin()+pos, m_string.begin()+pos+len); }
+        std::string         getString(int pos, int len) const { return std::string((const char*)getBytes()+pos, len); }
 
         inline int          gi(int pos = 0)        const { return get<int,4>(pos);             }
         inline uint32_t     gui(int pos = 0)       const { return get<uint32_t,4>(pos);        }
@@ -189,32 +212,28 @@ class NetworkString
         inline uint8_t      gui8(int pos = 0)      const { return get<uint8_t,1>(pos);         }
         inline char         gc(int pos = 0)        const { return get<char,1>(pos);            }
         inline unsigned char guc(int pos = 0)      const { return get<unsigned char,1>(pos);   }
-        std::string         gs(int pos, int len)   const { return std::string(m_string.begin()+pos, m_string.begin()+pos+len); }
+        std::string         gs(int pos, int len)   const { return getString(pos, len); }
 
-        double getDouble(int pos = 0) //!< BEWARE OF PRECISION
+        double getDouble(int pos = 0) const //!< BEWARE OF PRECISION
         {
-            for (int i = 0; i < 8; i++)
-                d_as_i.i[i] = m_string[pos+i];
-            return d_as_i.d;
+            assert(pos>=0 && pos+8<=size());
+            double d;
+            memcpy(&d, getBytes()+pos, 8);
+            return d;
         }
-        float getFloat(int pos = 0) //!< BEWARE OF PRECISION
+        float getFloat(int pos = 0) const //!< BEWARE OF PRECISION
         {
-            for (int i = 0; i < 4; i++)
-                f_as_i.i[i] = m_string[pos+i];
-            return f_as_i.f;
+            assert(pos>=0 && pos+4<=size());
+            float f;
+            memcpy(&f, getBytes()+pos, 4);
+            return f;
         }
 
         //! Functions to get while removing
         template<typename T, size_t n>
         T getAndRemove(int pos)
         {
-            int a = n;
-            T result = 0;
-            while(a--)
-            {
-                result <<= 8; // offset one byte
-                result += ((uint8_t)(m_string[pos+n-1-a]) & 0xff); // add the data
-            }
+            T result = get<T, n>(pos);
             remove(pos,n);
             return result;
         }
@@ -228,17 +247,15 @@ class NetworkString
         inline unsigned char getAndRemoveUChar(int pos = 0)  { return getAndRemove<unsigned char,1>(pos);   }
         double getAndRemoveDouble(int pos = 0) //!< BEWARE OF PRECISION
         {
-            for (int i = 0; i < 8; i++)
-                d_as_i.i[i] = m_string[pos+i];
-            return d_as_i.d;
+            double d = getDouble(pos);
             remove(pos, 8);
+            return d;
         }
         float getAndRemoveFloat(int pos = 0) //!< BEWARE OF PRECISION
         {
-            for (int i = 0; i < 4; i++)
-                f_as_i.i[i] = m_string[pos+i];
-            return f_as_i.f;
+            float f = getFloat(pos);
             remove(pos, 4);
+            return f;
         }
 
         inline NetworkString& gui8(uint8_t* dst)   { *dst = getAndRemoveUInt8(0);  return *this; }
@@ -250,9 +267,6 @@ class NetworkString
         inline NetworkString& guc(uchar* dst)      { *dst = getAndRemoveUChar(0);  return *this; }
         inline NetworkString& gd(double* dst)      { *dst = getAndRemoveDouble(0); return *this; }
         inline NetworkString& gf(float* dst)       { *dst = getAndRemoveFloat(0);  return *this; }
-
-    protected:
-        std::vector<uint8_t> m_string;
 };
 
 NetworkString operator+(NetworkString const& a, NetworkString const& b);
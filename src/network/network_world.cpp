@@ -1,10 +1,12 @@
 #include "network/network_world.hpp"
 
+#include "config/user_config.hpp"
 #include "network/network_manager.hpp"
 #include "network/protocol_manager.hpp"
 #include "network/protocols/synchronization_protocol.hpp"
 #include "network/protocols/controller_events_protocol.hpp"
 #include "network/protocols/game_events_protocol.hpp"
+#include "network/rewind_manager.hpp"
 #include "modes/world.hpp"
 
 #include "karts/controller/controller.hpp"
@@ -13,6 +15,8 @@ NetworkWorld::NetworkWorld()
 {
     m_running = false;
     m_has_run = false;
+    m_tick = 0;
+    m_tick_time = 0;
 }
 
 NetworkWorld::~NetworkWorld()
@@ -34,7 +38,25 @@ void NetworkWorld::update(float dt)
         }
         World::getWorld()->setNetworkWorld(true);
     }
-    World::getWorld()->updateWorld(dt);
+    // The world is updated with a fixed time step, so that the ticks of the
+    // server and the clients can be compared (see RewindManager). If the
+    // game falls too far behind, the missing time is skipped.
+    const float tick_length = getTickLength();
+    const int max_ticks = 5;
+    m_tick_time += dt;
+    if (m_tick_time > max_ticks*tick_length)
+        m_tick_time = max_ticks*tick_length;
+    // Allow for rounding errors if dt is exactly one tick
+    while (m_tick_time >= tick_length*0.999f)
+    {
+        m_tick_time -= tick_length;
+        World::getWorld()->updateWorld(tick_length);
+        m_tick++;
+        if (RewindManager::get())
+            RewindManager::get()->saveState(m_tick);
+        if (!World::getWorld())
+            return;
+    }
     if (World::getWorld()->getPhase() >= WorldStatus::RESULT_DISPLAY_PHASE) // means it's the end
     {
         // consider the world finished.
@@ -46,6 +68,8 @@ void NetworkWorld::update(float dt)
 void NetworkWorld::start()
 {
     m_running = true;
+    m_tick = 0;
+    m_tick_time = 0;
 }
 
 void NetworkWorld::stop()
@@ -53,6 +77,17 @@ void NetworkWorld::stop()
     m_running = false;
 }
 
+/** Returns the time step of the network game, which must be the same on the
+ *  server and the clients.
+ */
+float NetworkWorld::getTickLength() const
+{
+    int tick_rate = UserConfigParams::m_server_tick_rate;
+    if (tick_rate < 1)
+        tick_rate = 1;
+    return 1.0f / tick_rate;
+}
+
 bool NetworkWorld::isRaceOver()
 {
     if (!World::getWorld())
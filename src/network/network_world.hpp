@@ -24,6 +24,7 @@
 
 #include "input/input.hpp"
 #include "utils/singleton.hpp"
+#include "utils/types.hpp"
 #include <map>
 
 class Controller;
@@ -47,6 +48,10 @@ class NetworkWorld : public AbstractSingleton<NetworkWorld>
 
         void collectedItem(Item *item, AbstractKart *kart);
         void controllerAction(Controller* controller, PlayerAction action, int value);
+        float getTickLength() const;
+
+        /** Returns the number of ticks computed since the race started. */
+        uint32_t getTick() const { return m_tick; }
 
         std::string m_self_kart;
     protected:
@@ -54,6 +59,12 @@ class NetworkWorld : public AbstractSingleton<NetworkWorld>
         float m_race_time;
         bool m_has_run;
 
+        /** Number of ticks computed since the race started. */
+        uint32_t m_tick;
+
+        /** Time that was not yet simulated (less than one tick). */
+        double m_tick_time;
+
     private:
         NetworkWorld();
         virtual ~NetworkWorld();
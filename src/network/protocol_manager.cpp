@@ -18,16 +18,32 @@
 
 #include "network/protocol_manager.hpp"
 
+#include "config/user_config.hpp"
 #include "network/protocol.hpp"
 #include "network/network_manager.hpp"
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 
+#include <algorithm>
 #include <assert.h>
 #include <cstdlib>
 #include <errno.h>
+#include <iterator>
 #include <typeinfo>
 
+/** Sends the batched messages with the network manager. */
+class NetworkManagerSender : public MessageQueue::PacketSender
+{
+public:
+    virtual void sendPacket(STKPeer *peer, const NetworkString &packet,
+                            bool reliable)
+    {
+        NetworkManager::getInstance()->sendPacket(peer, packet, reliable);
+    }
+};   // NetworkManagerSender
+
+static NetworkManagerSender network_manager_sender;
+
 void* protocolManagerUpdate(void* data)
 {
     ProtocolManager* manager = static_cast<ProtocolManager*>(data);
@@ -45,30 +61,50 @@ void* protocolManagerAsynchronousUpdate(void* data)
     while(manager && !manager->exit())
     {
         manager->asynchronousUpdate();
-        StkTime::sleep(2);
+        // Sleep till an event arrives, but not longer than 2 ms, since the
+        // asynchronous update of the protocols must be called regularly.
+        manager->m_incoming_events.waitForData(2);
     }
     manager->m_asynchronous_thread_running = false;
     return NULL;
 }
 
 ProtocolManager::ProtocolManager()
+               : m_incoming_events(EVENT_QUEUE_SIZE, MAX_EVENT_QUEUE_SIZE,
+                                   RESERVED_EVENT_SLOTS),
+                 m_outgoing(&network_manager_sender)
 {
     pthread_mutex_init(&m_events_mutex, NULL);
+    pthread_mutex_init(&m_dispatch_mutex, NULL);
     pthread_mutex_init(&m_protocols_mutex, NULL);
     pthread_mutex_init(&m_asynchronous_protocols_mutex, NULL);
     pthread_mutex_init(&m_requests_mutex, NULL);
     pthread_mutex_init(&m_id_mutex, NULL);
     pthread_mutex_init(&m_exit_mutex, NULL);
+    pthread_mutex_init(&m_statistics_mutex, NULL);
+    pthread_mutex_init(&m_outgoing_mutex, NULL);
     m_next_protocol_id = 0;
+    m_next_event_sequence = 0;
+    m_event_dropped       = false;
+
+    m_events_dispatched       = 0;
+    m_event_latency_sum       = 0;
+    m_event_latency_max       = 0;
+    m_total_events_dispatched = 0;
+    m_total_event_latency_sum = 0;
+    m_total_event_latency_max = 0;
+    m_max_queue_depth         = 0;
+    m_total_messages_sent     = 0;
+    m_total_packets_sent      = 0;
+    m_total_bytes_saved       = 0;
+    m_total_messages_dropped  = 0;
+    m_last_statistics_time    = StkTime::getRealTime();
+    m_start_time              = m_last_statistics_time;
 
 
     pthread_mutex_lock(&m_exit_mutex); // will let the update function run
-    /// FIXME used on server because mainloop never running
-    /*if (NetworkManager::getInstance()->isServer())
-    {
-        m_update_thread = (pthread_t*)(malloc(sizeof(pthread_t)));
-        pthread_create(m_update_thread, NULL, protocolManagerUpdate, this);
-    }*/
+    // The synchronous update is called from the main loop, on a dedicated
+    // server from MainLoop::runDedicatedServer().
     // always run this one
     m_asynchronous_update_thread = (pthread_t*)(malloc(sizeof(pthread_t)));
     pthread_create(m_asynchronous_update_thread, NULL, protocolManagerAsynchronousUpdate, this);
@@ -82,7 +118,9 @@ ProtocolManager::~ProtocolManager()
 void ProtocolManager::abort()
 {
     pthread_mutex_unlock(&m_exit_mutex); // will stop the update function
+    m_incoming_events.close(); // wakes up the thread if it is waiting
     pthread_join(*m_asynchronous_update_thread, NULL); // wait the thread to finish
+    logEventStatistics();
     pthread_mutex_lock(&m_events_mutex);
     pthread_mutex_lock(&m_protocols_mutex);
     pthread_mutex_lock(&m_asynchronous_protocols_mutex);
@@ -92,9 +130,15 @@ void ProtocolManager::abort()
         delete m_protocols[i].protocol;
     for (unsigned int i = 0; i < m_events_to_process.size() ; i++)
         delete m_events_to_process[i].event;
+    EventProcessingInfo epi;
+    while (m_incoming_events.tryPop(&epi))
+        delete epi.event;
     m_protocols.clear();
     m_requests.clear();
     m_events_to_process.clear();
+    pthread_mutex_lock(&m_outgoing_mutex);
+    m_outgoing.clear();
+    pthread_mutex_unlock(&m_outgoing_mutex);
     pthread_mutex_unlock(&m_events_mutex);
     pthread_mutex_unlock(&m_protocols_mutex);
     pthread_mutex_unlock(&m_asynchronous_protocols_mutex);
@@ -102,16 +146,34 @@ void ProtocolManager::abort()
     pthread_mutex_unlock(&m_id_mutex);
 
     pthread_mutex_destroy(&m_events_mutex);
+    pthread_mutex_destroy(&m_dispatch_mutex);
     pthread_mutex_destroy(&m_protocols_mutex);
     pthread_mutex_destroy(&m_asynchronous_protocols_mutex);
     pthread_mutex_destroy(&m_requests_mutex);
     pthread_mutex_destroy(&m_id_mutex);
     pthread_mutex_destroy(&m_exit_mutex);
+    pthread_mutex_destroy(&m_statistics_mutex);
+    pthread_mutex_destroy(&m_outgoing_mutex);
 }
 
 void ProtocolManager::notifyEvent(Event* event)
 {
-    pthread_mutex_lock(&m_events_mutex);
+    if (event->type == EVENT_TYPE_MESSAGE && event->data().size() > 0 &&
+        event->data()[0] == PROTOCOL_BATCH)
+    {
+        // Pass each message of a batch on as an event of its own
+        std::vector<NetworkString> messages;
+        if (!MessageBatch::split(event->data(), &messages))
+            Log::warn("ProtocolManager", "Received a malformed batch.");
+        for (unsigned int i = 0; i < messages.size(); i++)
+        {
+            Event message(*event);
+            message.setData(messages[i]);
+            notifyEvent(&message);
+        }
+        return;
+    }
+    const double arrival_time = StkTime::getRealTime();
     Event* event2 = new Event(*event);
     // register protocols that will receive this event
     std::vector<unsigned int> protocols_ids;
@@ -150,37 +212,111 @@ void ProtocolManager::notifyEvent(Event* event)
     if (protocols_ids.size() != 0)
     {
         EventProcessingInfo epi;
-        epi.arrival_time = (double)StkTime::getTimeSinceEpoch();
+        epi.arrival_time = arrival_time;
         epi.event = event2;
         epi.protocols_ids = protocols_ids;
-        m_events_to_process.push_back(epi); // add the event to the queue
+        pthread_mutex_lock(&m_events_mutex);
+        epi.sequence = m_next_event_sequence++;
+        pthread_mutex_unlock(&m_events_mutex);
+        // add the event to the queue, this wakes up the asynchronous thread.
+        // (Dis)connections can use the reserved part of the queue, so that
+        // they are still added when messages are dropped: a lost
+        // disconnection would leave a peer registered forever.
+        const bool is_connection_event =
+                                 event2->type == EVENT_TYPE_CONNECTED ||
+                                 event2->type == EVENT_TYPE_DISCONNECTED;
+        if (!m_incoming_events.push(epi, /*high_priority*/is_connection_event))
+        {
+            // shutting down, or the queue is full
+            if (is_connection_event && !m_incoming_events.isClosed())
+            {
+                Log::error("ProtocolManager", "The event queue is full, a "
+                           "(dis)connection event is dropped.");
+            }
+            else if (!m_incoming_events.isClosed())
+            {
+                pthread_mutex_lock(&m_events_mutex);
+                const bool first_drop = !m_event_dropped;
+                m_event_dropped = true;
+                pthread_mutex_unlock(&m_events_mutex);
+                if (first_drop)
+                    Log::warn("ProtocolManager", "The event queue is full "
+                              "(%u events), received messages are dropped.",
+                              MAX_EVENT_QUEUE_SIZE);
+            }
+            delete event2;
+        }
     }
     else
         Log::warn("ProtocolManager", "Received an event for %d that has no destination protocol.", searchedProtocol);
-    pthread_mutex_unlock(&m_events_mutex);
 }
 
 void ProtocolManager::sendMessage(Protocol* sender, const NetworkString& message, bool reliable)
 {
-    NetworkString newMessage;
-    newMessage.ai8(sender->getProtocolType()); // add one byte to add protocol type
-    newMessage += message;
-    NetworkManager::getInstance()->sendPacket(newMessage, reliable);
+    NetworkString newMessage(message); // shares the data with message
+    newMessage.prependUInt8(sender->getProtocolType()); // add one byte to add protocol type
+    if (!UserConfigParams::m_network_batching)
+    {
+        NetworkManager::getInstance()->sendPacket(newMessage, reliable);
+        return;
+    }
+    std::vector<STKPeer*> peers = NetworkManager::getInstance()->getPeers();
+    for (unsigned int i = 0; i < peers.size(); i++)
+        queueMessage(peers[i], newMessage, reliable);
 }
 
 void ProtocolManager::sendMessage(Protocol* sender, STKPeer* peer, const NetworkString& message, bool reliable)
 {
-    NetworkString newMessage;
-    newMessage.ai8(sender->getProtocolType()); // add one byte to add protocol type
-    newMessage += message;
-    NetworkManager::getInstance()->sendPacket(peer, newMessage, reliable);
+    NetworkString newMessage(message); // shares the data with message
+    newMessage.prependUInt8(sender->getProtocolType()); // add one byte to add protocol type
+    if (!UserConfigParams::m_network_batching)
+    {
+        NetworkManager::getInstance()->sendPacket(peer, newMessage, reliable);
+        return;
+    }
+    if (peer)
+        queueMessage(peer, newMessage, reliable);
 }
 void ProtocolManager::sendMessageExcept(Protocol* sender, STKPeer* peer, const NetworkString& message, bool reliable)
 {
-    NetworkString newMessage;
-    newMessage.ai8(sender->getProtocolType()); // add one byte to add protocol type
-    newMessage += message;
-    NetworkManager::getInstance()->sendPacketExcept(peer, newMessage, reliable);
+    NetworkString newMessage(message); // shares the data with message
+    newMessage.prependUInt8(sender->getProtocolType()); // add one byte to add protocol type
+    if (!UserConfigParams::m_network_batching)
+    {
+        NetworkManager::getInstance()->sendPacketExcept(peer, newMessage, reliable);
+        return;
+    }
+    std::vector<STKPeer*> peers = NetworkManager::getInstance()->getPeers();
+    for (unsigned int i = 0; i < peers.size(); i++)
+    {
+        if (!peers[i]->isSamePeer(peer))
+            queueMessage(peers[i], newMessage, reliable);
+    }
+}
+
+/** Adds a message to the batch of a peer, which is sent at the end of the
+ *  next update().
+ *  \param peer The receiver.
+ *  \param message The message, starting with the protocol type.
+ *  \param reliable If the message must be sent reliably.
+ */
+void ProtocolManager::queueMessage(STKPeer* peer, const NetworkString& message, bool reliable)
+{
+    pthread_mutex_lock(&m_outgoing_mutex);
+    m_outgoing.queue(peer, message, reliable);
+    pthread_mutex_unlock(&m_outgoing_mutex);
+}
+
+/** Sends the messages queued since the last flush. This is called at the
+ *  end of the update of both the main and the asynchronous thread. The
+ *  batches of peers that are not connected anymore are dropped.
+ */
+void ProtocolManager::flushMessages()
+{
+    std::vector<STKPeer*> peers = NetworkManager::getInstance()->getPeers();
+    pthread_mutex_lock(&m_outgoing_mutex);
+    m_outgoing.flush(peers);
+    pthread_mutex_unlock(&m_outgoing_mutex);
 }
 
 uint32_t ProtocolManager::requestStart(Protocol* protocol)
@@ -343,10 +479,12 @@ bool ProtocolManager::propagateEvent(EventProcessingInfo* event, bool synchronou
                 index++;
         }
     }
-    if (event->protocols_ids.size() == 0 || (StkTime::getTimeSinceEpoch()-event->arrival_time) >= TIME_TO_KEEP_EVENTS)
+    const double age = StkTime::getRealTime() - event->arrival_time;
+    if (event->protocols_ids.size() == 0 || age >= TIME_TO_KEEP_EVENTS)
     {
+        if (event->protocols_ids.size() == 0)
+            addEventLatency(age);
         // because we made a copy of the event
-        delete event->event->peer; // no more need of that
         delete event->event;
         return true;
     }
@@ -356,19 +494,7 @@ bool ProtocolManager::propagateEvent(EventProcessingInfo* event, bool synchronou
 void ProtocolManager::update()
 {
     // before updating, notice protocols that they have received events
-    pthread_mutex_lock(&m_events_mutex); // secure threads
-    int size = (int)m_events_to_process.size();
-    int offset = 0;
-    for (int i = 0; i < size; i++)
-    {
-        bool result = propagateEvent(&m_events_to_process[i+offset], true);
-        if (result)
-        {
-            m_events_to_process.erase(m_events_to_process.begin()+i+offset,m_events_to_process.begin()+i+offset+1);
-            offset --;
-        }
-    }
-    pthread_mutex_unlock(&m_events_mutex); // release the mutex
+    dispatchEvents(true);
     // now update all protocols
     pthread_mutex_lock(&m_protocols_mutex);
     for (unsigned int i = 0; i < m_protocols.size(); i++)
@@ -377,24 +503,170 @@ void ProtocolManager::update()
             m_protocols[i].protocol->update();
     }
     pthread_mutex_unlock(&m_protocols_mutex);
+    // send all messages of this tick
+    flushMessages();
 }
 
-void ProtocolManager::asynchronousUpdate()
+/** Passes the events to the protocols. The events are taken out of
+ *  m_events_to_process (the asynchronous thread also takes the newly
+ *  received events from m_incoming_events), so that the events mutex is not
+ *  held while the protocols handle them, and the events that were not
+ *  handled are put back.
+ *  \param synchronous True if called from the main thread.
+ */
+void ProtocolManager::dispatchEvents(bool synchronous)
 {
-    // before updating, notice protocols that they have received information
-    pthread_mutex_lock(&m_events_mutex); // secure threads
-    int size = (int)m_events_to_process.size();
-    int offset = 0;
-    for (int i = 0; i < size; i++)
+    std::vector<EventProcessingInfo> events;
+    pthread_mutex_lock(&m_events_mutex);
+    events.swap(m_events_to_process);
+    pthread_mutex_unlock(&m_events_mutex);
+
+    if (!synchronous)
     {
-        bool result = propagateEvent(&m_events_to_process[i+offset], false);
-        if (result)
-        {
-            m_events_to_process.erase(m_events_to_process.begin()+i+offset,m_events_to_process.begin()+i+offset+1);
-            offset --;
-        }
+        EventProcessingInfo epi;
+        while (m_incoming_events.tryPop(&epi))
+            events.push_back(epi);
+        // Events received by different threads can be numbered and queued
+        // in a different order
+        std::sort(events.begin(), events.end(), EarlierEvent());
+    }
+    if (events.empty())
+        return;
+
+    unsigned int kept = 0;
+    pthread_mutex_lock(&m_dispatch_mutex);
+    for (unsigned int i = 0; i < events.size(); i++)
+    {
+        if (propagateEvent(&events[i], synchronous))
+            continue;
+        if (kept != i)
+            events[kept] = events[i];
+        kept++;
+    }
+    pthread_mutex_unlock(&m_dispatch_mutex);
+    if (kept == 0)
+        return;
+    events.resize(kept);
+
+    pthread_mutex_lock(&m_events_mutex);
+    // Merge with the events that the other thread has put back in the
+    // meantime, so that the events stay in the order they were received.
+    // Both lists are already in this order.
+    std::vector<EventProcessingInfo> merged;
+    merged.reserve(events.size() + m_events_to_process.size());
+    std::merge(events.begin(), events.end(), m_events_to_process.begin(),
+               m_events_to_process.end(), std::back_inserter(merged),
+               EarlierEvent());
+    m_events_to_process.swap(merged);
+    pthread_mutex_unlock(&m_events_mutex);
+}   // dispatchEvents
+
+/** Records the time between receiving and dispatching an event.
+ */
+void ProtocolManager::addEventLatency(double latency)
+{
+    pthread_mutex_lock(&m_statistics_mutex);
+    m_events_dispatched++;
+    m_event_latency_sum += latency;
+    if (latency > m_event_latency_max)
+        m_event_latency_max = latency;
+    pthread_mutex_unlock(&m_statistics_mutex);
+}   // addEventLatency
+
+/** Logs the event statistics since the last call, and adds them to the
+ *  totals. This is called every few seconds by the asynchronous thread.
+ */
+void ProtocolManager::updateEventStatistics()
+{
+    unsigned int max_depth, grow_count, drop_count;
+    m_incoming_events.getAndResetStatistics(&max_depth, &grow_count,
+                                            &drop_count);
+    if (drop_count > 0)
+        Log::warn("ProtocolManager", "%u received events dropped because "
+                  "the event queue was full.", drop_count);
+
+    pthread_mutex_lock(&m_statistics_mutex);
+    if (max_depth > m_max_queue_depth)
+        m_max_queue_depth = max_depth;
+    if (m_events_dispatched > 0)
+    {
+        Log::debug("ProtocolManager", "%u events dispatched, latency "
+                   "%.2f ms average, %.2f ms max; queue depth %u max, "
+                   "grown %u times.", m_events_dispatched,
+                   m_event_latency_sum * 1000.0 / m_events_dispatched,
+                   m_event_latency_max * 1000.0, max_depth, grow_count);
+    }
+    m_total_events_dispatched += m_events_dispatched;
+    m_total_event_latency_sum += m_event_latency_sum;
+    if (m_event_latency_max > m_total_event_latency_max)
+        m_total_event_latency_max = m_event_latency_max;
+    m_events_dispatched = 0;
+    m_event_latency_sum = 0;
+    m_event_latency_max = 0;
+    const double now = StkTime::getRealTime();
+    const double interval = now - m_last_statistics_time;
+    m_last_statistics_time = now;
+    pthread_mutex_unlock(&m_statistics_mutex);
+
+    pthread_mutex_lock(&m_outgoing_mutex);
+    unsigned int messages_sent, packets_sent, messages_dropped;
+    double bytes_saved;
+    m_outgoing.getAndResetStatistics(&messages_sent, &packets_sent,
+                                      &bytes_saved, &messages_dropped);
+    if (messages_dropped > 0)
+        Log::warn("ProtocolManager", "%u messages dropped because their "
+                  "peer was not connected anymore.", messages_dropped);
+    if (messages_sent > 0 && interval > 0)
+    {
+        Log::debug("ProtocolManager", "%u messages sent in %u packets, "
+                   "%.1f packets/s and %.1f bytes/s saved by batching.",
+                   messages_sent, packets_sent,
+                   (messages_sent - packets_sent) / interval,
+                   bytes_saved / interval);
+    }
+    m_total_messages_sent    += messages_sent;
+    m_total_packets_sent     += packets_sent;
+    m_total_bytes_saved      += bytes_saved;
+    m_total_messages_dropped += messages_dropped;
+    pthread_mutex_unlock(&m_outgoing_mutex);
+}   // updateEventStatistics
+
+void ProtocolManager::logEventStatistics()
+{
+    updateEventStatistics();
+    pthread_mutex_lock(&m_statistics_mutex);
+    if (m_total_events_dispatched > 0)
+    {
+        Log::info("ProtocolManager", "%u events dispatched, latency %.2f ms "
+                  "average, %.2f ms max; queue depth %u max.",
+                  m_total_events_dispatched,
+                  m_total_event_latency_sum * 1000.0 / m_total_events_dispatched,
+                  m_total_event_latency_max * 1000.0, m_max_queue_depth);
     }
-    pthread_mutex_unlock(&m_events_mutex); // release the mutex
+    pthread_mutex_unlock(&m_statistics_mutex);
+
+    pthread_mutex_lock(&m_outgoing_mutex);
+    const double duration = StkTime::getRealTime() - m_start_time;
+    if (m_total_messages_sent > 0 && duration > 0)
+    {
+        Log::info("ProtocolManager", "%u messages sent in %u packets; "
+                  "%.1f packets/s and %.1f bytes/s saved by batching.",
+                  m_total_messages_sent, m_total_packets_sent,
+                  (m_total_messages_sent - m_total_packets_sent) / duration,
+                  m_total_bytes_saved / duration);
+    }
+    if (m_total_messages_dropped > 0)
+        Log::info("ProtocolManager", "%u messages dropped for peers that "
+                  "were not connected anymore.", m_total_messages_dropped);
+    pthread_mutex_unlock(&m_outgoing_mutex);
+}   // logEventStatistics
+
+void ProtocolManager::asynchronousUpdate()
+{
+    // before updating, notice protocols that they have received information
+    dispatchEvents(false);
+    if (StkTime::getRealTime() > m_last_statistics_time + 10.0)
+        updateEventStatistics();
 
     // now update all protocols that need to be updated in asynchronous mode
     pthread_mutex_lock(&m_asynchronous_protocols_mutex);
@@ -431,6 +703,11 @@ void ProtocolManager::asynchronousUpdate()
     }
     m_requests.clear();
     pthread_mutex_unlock(&m_requests_mutex);
+
+    // Send the messages of the asynchronous protocols (e.g. pings and their
+    // replies, and relayed events) now, so that they don't wait for the
+    // next update of the main thread, which does not run during loading.
+    flushMessages();
 }
 
 int ProtocolManager::runningProtocolsCount()
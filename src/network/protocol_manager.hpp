@@ -24,11 +24,14 @@
 #define PROTOCOL_MANAGER_HPP
 
 #include "network/event.hpp"
+#include "network/message_batch.hpp"
 #include "network/network_string.hpp"
 #include "network/protocol.hpp"
+#include "utils/bounded_queue.hpp"
 #include "utils/singleton.hpp"
 #include "utils/types.hpp"
 
+#include <map>
 #include <vector>
 
 #define TIME_TO_KEEP_EVENTS 1.0
@@ -86,10 +89,21 @@ typedef struct ProtocolRequest
 typedef struct EventProcessingInfo
 {
     Event* event;
-    double arrival_time;
+    double arrival_time; //!< Real time at which the event was received.
+    uint64_t sequence;   //!< Number of the event in the order received.
     std::vector<unsigned int> protocols_ids;
 } EventProcessingInfo;
 
+/** Orders events by the order in which they were received. */
+struct EarlierEvent
+{
+    bool operator()(const EventProcessingInfo &a,
+                    const EventProcessingInfo &b) const
+    {
+        return a.sequence < b.sequence;
+    }
+};
+
 /*!
  * \class ProtocolManager
  * \brief Manages the protocols at runtime.
@@ -234,6 +248,10 @@ class ProtocolManager : public AbstractSingleton<ProtocolManager>
         /*! \brief Tells if we need to stop the update thread. */
         int                     exit();
 
+        /*! \brief Logs the event queue depth and the time between receiving
+         *  and dispatching events since the manager was started. */
+        void                    logEventStatistics();
+
     protected:
         // protected functions
         /*!
@@ -285,6 +303,11 @@ class ProtocolManager : public AbstractSingleton<ProtocolManager>
         virtual void            protocolTerminated(ProtocolInfo protocol);
 
         bool                    propagateEvent(EventProcessingInfo* event, bool synchronous);
+        void                    dispatchEvents(bool synchronous);
+        void                    addEventLatency(double latency);
+        void                    updateEventStatistics();
+        void                    queueMessage(STKPeer* peer, const NetworkString& message, bool reliable);
+        void                    flushMessages();
 
         // protected members
         /*!
@@ -293,10 +316,39 @@ class ProtocolManager : public AbstractSingleton<ProtocolManager>
          * state and their unique id.
          */
         std::vector<ProtocolInfo>       m_protocols;
+        /*! Initial and maximum number of received events that are not yet
+         *  taken by the asynchronous update thread. */
+        static const unsigned int EVENT_QUEUE_SIZE     = 1024;
+        static const unsigned int MAX_EVENT_QUEUE_SIZE = 65536;
+        /*! Part of the maximum queue size that only connection and
+         *  disconnection events can use, far more than the number of peers
+         *  (each of which causes at most two such events). */
+        static const unsigned int RESERVED_EVENT_SLOTS = 1024;
+        /*! Number of the next received event, protected by m_events_mutex. */
+        uint64_t                        m_next_event_sequence;
+        /*! True once an event was dropped because the event queue was full,
+         *  so that only the first drop is logged right away. Protected by
+         *  m_events_mutex. */
+        bool                            m_event_dropped;
+        /*!
+         * \brief The events received by the network thread.
+         * They are moved into m_events_to_process by the asynchronous update
+         * thread, which sleeps till an event arrives here.
+         */
+        BoundedQueue<EventProcessingInfo> m_incoming_events;
         /*!
          * \brief Contains the network events to pass to protocols.
+         * The update functions take all events out of this vector, so that
+         * the mutex is not held while the events are processed, and put
+         * back the events that were not handled.
          */
         std::vector<EventProcessingInfo>             m_events_to_process;
+        /*!
+         * \brief The messages to send in this tick. They are combined into
+         * batches per peer, which are sent at the end of update() and of
+         * asynchronousUpdate().
+         */
+        MessageQueue                    m_outgoing;
         /*!
          * \brief Contains the requests to start/stop etc... protocols.
          */
@@ -311,6 +363,10 @@ class ProtocolManager : public AbstractSingleton<ProtocolManager>
         // mutexes:
         /*! Used to ensure that the event queue is used thread-safely.       */
         pthread_mutex_t                 m_events_mutex;
+        /*! Held while events are passed to the protocols, so that the main
+         *  thread and the asynchronous thread never do this at the same
+         *  time (the events mutex is not held meanwhile). */
+        pthread_mutex_t                 m_dispatch_mutex;
         /*! Used to ensure that the protocol vector is used thread-safely.   */
         pthread_mutex_t                 m_protocols_mutex;
         /*! Used to ensure that the protocol vector is used thread-safely.   */
@@ -321,6 +377,36 @@ class ProtocolManager : public AbstractSingleton<ProtocolManager>
         pthread_mutex_t                 m_id_mutex;
         /*! Used when need to quit.*/
         pthread_mutex_t                 m_exit_mutex;
+        /*! Used to ensure that the event statistics are updated
+         *  thread-safely.*/
+        pthread_mutex_t                 m_statistics_mutex;
+        /*! Used to ensure that the outgoing messages and their statistics
+         *  are used thread-safely.*/
+        pthread_mutex_t                 m_outgoing_mutex;
+
+        /*! Event statistics: number of events dispatched, the sum and the
+         *  maximum of the time between receiving and dispatching them, both
+         *  since the last report and in total. */
+        unsigned int                    m_events_dispatched;
+        double                          m_event_latency_sum;
+        double                          m_event_latency_max;
+        unsigned int                    m_total_events_dispatched;
+        double                          m_total_event_latency_sum;
+        double                          m_total_event_latency_max;
+        unsigned int                    m_max_queue_depth;
+        /*! Outgoing statistics: number of messages and of packets sent,
+         *  the estimated number of bytes saved by batching (the ENet
+         *  headers of the packets that were saved, minus the framing), and
+         *  the number of messages dropped because their peer was not
+         *  connected anymore, in total. */
+        unsigned int                    m_total_messages_sent;
+        unsigned int                    m_total_packets_sent;
+        double                          m_total_bytes_saved;
+        unsigned int                    m_total_messages_dropped;
+        /*! Time at which event statistics were last reported, and at which
+         *  the protocol manager was created. */
+        double                          m_last_statistics_time;
+        double                          m_start_time;
 
         /*! Update thread.*/
         pthread_t* m_update_thread;
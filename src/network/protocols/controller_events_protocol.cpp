@@ -4,6 +4,7 @@
 #include "karts/abstract_kart.hpp"
 #include "network/network_manager.hpp"
 #include "network/network_world.hpp"
+#include "network/rewind_manager.hpp"
 #include "utils/log.hpp"
 
 //-----------------------------------------------------------------------------
@@ -11,12 +12,14 @@
 ControllerEventsProtocol::ControllerEventsProtocol() :
         Protocol(NULL, PROTOCOL_CONTROLLER_EVENTS)
 {
+    pthread_mutex_init(&m_ticks_mutex, NULL);
 }
 
 //-----------------------------------------------------------------------------
 
 ControllerEventsProtocol::~ControllerEventsProtocol()
 {
+    pthread_mutex_destroy(&m_ticks_mutex);
 }
 
 //-----------------------------------------------------------------------------
@@ -57,6 +60,10 @@ void ControllerEventsProtocol::setup()
         }
         m_controllers.push_back(std::pair<Controller*, STKPeer*>(karts[i]->getController(), peer));
     }
+    pthread_mutex_lock(&m_ticks_mutex);
+    m_client_ticks.resize(karts.size(), RewindManager::NO_TICK);
+    m_receive_ticks.resize(karts.size(), 0);
+    pthread_mutex_unlock(&m_ticks_mutex);
 }
 
 //-----------------------------------------------------------------------------
@@ -64,55 +71,46 @@ void ControllerEventsProtocol::setup()
 bool ControllerEventsProtocol::notifyEventAsynchronous(Event* event)
 {
     NetworkString data = event->data();
-    if (data.size() < 17)
+    uint32_t token, client_tick;
+    std::vector<Action> actions;
+    if (!readActions(data, &token, &client_tick, &actions))
     {
-        Log::error("ControllerEventsProtocol", "The data supplied was not complete. Size was %d.", data.size());
+        Log::warn("ControllerEventProtocol", "The data seems corrupted. Size was %d.", data.size());
         return true;
     }
-    uint32_t token = data.gui32();
-    NetworkString pure_message = data;
-    pure_message.removeFront(4);
     if (token != (*event->peer)->getClientServerToken())
     {
         Log::error("ControllerEventsProtocol", "Bad token from peer.");
         return true;
     }
-    NetworkString ns = pure_message;
+    NetworkString pure_message = data;
+    pure_message.removeFront(4);
 
-    ns.removeFront(4);
-    uint8_t client_index = -1;
-    while (ns.size() >= 9)
-    {
-        uint8_t controller_index = ns.gui8();
-        client_index = controller_index;
-        uint8_t serialized_1 = ns.gui8(1);
-        PlayerAction action  = (PlayerAction)(ns.gui8(4));
-        int action_value = ns.gui32(5);
-
-        KartControl* controls   = m_controllers[controller_index].first->getControls();
-        controls->m_brake       = (serialized_1 & 0x40)!=0;
-        controls->m_nitro       = (serialized_1 & 0x20)!=0;
-        controls->m_rescue      = (serialized_1 & 0x10)!=0;
-        controls->m_fire        = (serialized_1 & 0x08)!=0;
-        controls->m_look_back   = (serialized_1 & 0x04)!=0;
-        controls->m_skid        = KartControl::SkidControl(serialized_1 & 0x03);
-
-        m_controllers[controller_index].first->action(action, action_value);
-        ns.removeFront(9);
-        //Log::info("ControllerEventProtocol", "Registered one action.");
-    }
-    if (ns.size() > 0 && ns.size() != 9)
+    uint8_t client_index = 0;
+    for (unsigned int i = 0; i < actions.size(); i++)
     {
-        Log::warn("ControllerEventProtocol", "The data seems corrupted. Remains %d", ns.size());
-        return true;
-    }
-    if (client_index < 0)
-    {
-        Log::warn("ControllerEventProtocol", "Couldn't have a client id.");
-        return true;
+        const Action &a = actions[i];
+        if (a.m_kart >= m_controllers.size())
+        {
+            Log::warn("ControllerEventProtocol", "Invalid kart %d.", a.m_kart);
+            return true;
+        }
+        client_index = a.m_kart;
+        applyButtons(a.m_buttons, m_controllers[a.m_kart].first->getControls());
+        m_controllers[a.m_kart].first->action(a.m_action, a.m_value);
     }
     if (m_listener->isServer())
     {
+        // Remember which client tick corresponds to the current server tick
+        pthread_mutex_lock(&m_ticks_mutex);
+        if (client_index < m_client_ticks.size())
+        {
+            m_client_ticks[client_index]  = client_tick;
+            m_receive_ticks[client_index] =
+                NetworkWorld::getInstance()->getTick();
+        }
+        pthread_mutex_unlock(&m_ticks_mutex);
+
         // notify everybody of the event :
         for (unsigned int i = 0; i < m_controllers.size(); i++)
         {
@@ -142,30 +140,119 @@ void ControllerEventsProtocol::controllerAction(Controller* controller,
     assert(!m_listener->isServer());
 
     KartControl* controls = controller->getControls();
+    NetworkString ns;
+    writeAction(m_controllers[m_self_controller_index].second->getClientServerToken(),
+                NetworkWorld::getInstance()->getTick(),
+                m_self_controller_index, *controls, action, value, &ns);
+
+    Log::info("ControllerEventsProtocol", "Action %d value %d", action, value);
+    m_listener->sendMessage(this, ns, false); // send message to server
+}
+
+//-----------------------------------------------------------------------------
+/** Returns the index of the kart of a peer, or -1 if the peer has no kart.
+ */
+int ControllerEventsProtocol::findKart(const STKPeer* peer) const
+{
+    for (unsigned int i = 0; i < m_controllers.size(); i++)
+    {
+        if (m_controllers[i].second == peer)
+            return i;
+    }
+    return -1;
+}
+
+//-----------------------------------------------------------------------------
+/** Returns the tick of the client that controls a kart which corresponds to
+ *  the given tick of the server (based on the tick of the last input of the
+ *  client), or RewindManager::NO_TICK if no input was received yet.
+ *  \param kart_index The kart of the client.
+ *  \param server_tick The tick of the server.
+ */
+uint32_t ControllerEventsProtocol::getClientTick(int kart_index,
+                                                 uint32_t server_tick)
+{
+    uint32_t tick = RewindManager::NO_TICK;
+    pthread_mutex_lock(&m_ticks_mutex);
+    if (kart_index >= 0 && kart_index < (int)m_client_ticks.size() &&
+        m_client_ticks[kart_index] != RewindManager::NO_TICK)
+    {
+        tick = m_client_ticks[kart_index] + server_tick
+             - m_receive_ticks[kart_index];
+    }
+    pthread_mutex_unlock(&m_ticks_mutex);
+    return tick;
+}
+
+//-----------------------------------------------------------------------------
+/** Writes the message a client sends for an action: the token of the
+ *  client, its tick, and the action with the state of the buttons.
+ */
+void ControllerEventsProtocol::writeAction(uint32_t token, uint32_t tick,
+                                           uint8_t kart,
+                                           const KartControl &controls,
+                                           PlayerAction action, int value,
+                                           NetworkString *ns)
+{
     uint8_t serialized_1 = 0;
-    serialized_1 |= (controls->m_brake==true);
+    serialized_1 |= (controls.m_brake==true);
     serialized_1 <<= 1;
-    serialized_1 |= (controls->m_nitro==true);
+    serialized_1 |= (controls.m_nitro==true);
     serialized_1 <<= 1;
-    serialized_1 |= (controls->m_rescue==true);
+    serialized_1 |= (controls.m_rescue==true);
     serialized_1 <<= 1;
-    serialized_1 |= (controls->m_fire==true);
+    serialized_1 |= (controls.m_fire==true);
     serialized_1 <<= 1;
-    serialized_1 |= (controls->m_look_back==true);
+    serialized_1 |= (controls.m_look_back==true);
     serialized_1 <<= 2;
-    serialized_1 += controls->m_skid;
-    uint8_t serialized_2 = (uint8_t)(controls->m_accel*255.0);
-    uint8_t serialized_3 = (uint8_t)(controls->m_steer*127.0);
-
-    NetworkString ns;
-    ns.ai32(m_controllers[m_self_controller_index].second->getClientServerToken());
-    ns.af(World::getWorld()->getTime());
-    ns.ai8(m_self_controller_index);
-    ns.ai8(serialized_1).ai8(serialized_2).ai8(serialized_3);
-    ns.ai8((uint8_t)(action)).ai32(value);
+    serialized_1 += controls.m_skid;
+    uint8_t serialized_2 = (uint8_t)(controls.m_accel*255.0);
+    uint8_t serialized_3 = (uint8_t)(controls.m_steer*127.0);
 
-    Log::info("ControllerEventsProtocol", "Action %d value %d", action, value);
-    m_listener->sendMessage(this, ns, false); // send message to server
+    ns->ai32(token);
+    ns->ai32(tick);
+    ns->ai8(kart);
+    ns->ai8(serialized_1).ai8(serialized_2).ai8(serialized_3);
+    ns->ai8((uint8_t)(action)).ai32(value);
 }
 
+//-----------------------------------------------------------------------------
+/** Reads a message written by writeAction() (the server relays the same
+ *  message to the other clients, so it can contain several actions).
+ *  \return False if the message is incomplete or corrupted.
+ */
+bool ControllerEventsProtocol::readActions(const NetworkString &data,
+                                           uint32_t *token,
+                                           uint32_t *client_tick,
+                                           std::vector<Action> *actions)
+{
+    if (data.size() < 17)
+        return false;
+    *token       = data.getUInt32(0);
+    *client_tick = data.getUInt32(4);
+    int pos = 8;
+    while (pos + 9 <= data.size())
+    {
+        Action action;
+        action.m_kart    = data.getUInt8(pos);
+        action.m_buttons = data.getUInt8(pos + 1);
+        action.m_action  = (PlayerAction)data.getUInt8(pos + 4);
+        action.m_value   = (int)data.getUInt32(pos + 5);
+        actions->push_back(action);
+        pos += 9;
+    }
+    return pos == data.size();
+}
 
+//-----------------------------------------------------------------------------
+/** Sets the buttons of a kart as sent in an action. */
+void ControllerEventsProtocol::applyButtons(uint8_t buttons,
+                                            KartControl *controls)
+{
+    controls->m_brake     = (buttons & 0x40)!=0;
+    controls->m_nitro     = (buttons & 0x20)!=0;
+    controls->m_rescue    = (buttons & 0x10)!=0;
+    controls->m_fire      = (buttons & 0x08)!=0;
+    controls->m_look_back = (buttons & 0x04)!=0;
+    controls->m_skid      = KartControl::SkidControl(buttons & 0x03);
+}
@@ -12,7 +12,23 @@ class ControllerEventsProtocol : public Protocol
         std::vector<std::pair<Controller*, STKPeer*> > m_controllers;
         uint32_t m_self_controller_index;
 
+        /** Server: for each kart the tick of the client when it sent the
+         *  last input, and the tick of the server when it was received. */
+        std::vector<uint32_t> m_client_ticks;
+        std::vector<uint32_t> m_receive_ticks;
+        pthread_mutex_t m_ticks_mutex;
+
     public:
+        /** An action read from a message of a client. */
+        struct Action
+        {
+            uint8_t      m_kart;
+            /** The buttons of the kart (see applyButtons()). */
+            uint8_t      m_buttons;
+            PlayerAction m_action;
+            int          m_value;
+        };
+
         ControllerEventsProtocol();
         virtual ~ControllerEventsProtocol();
 
@@ -22,6 +38,17 @@ class ControllerEventsProtocol : public Protocol
         virtual void asynchronousUpdate() {}
 
         void controllerAction(Controller* controller, PlayerAction action, int value);
+        int findKart(const STKPeer* peer) const;
+        uint32_t getClientTick(int kart_index, uint32_t server_tick);
+
+        static void writeAction(uint32_t token, uint32_t tick, uint8_t kart,
+                                const KartControl &controls,
+                                PlayerAction action, int value,
+                                NetworkString *ns);
+        static bool readActions(const NetworkString &data, uint32_t *token,
+                                uint32_t *client_tick,
+                                std::vector<Action> *actions);
+        static void applyButtons(uint8_t buttons, KartControl *controls);
 
 };
 
@@ -1,9 +1,13 @@
 #include "network/protocols/kart_update_protocol.hpp"
 
+#include "config/user_config.hpp"
 #include "karts/abstract_kart.hpp"
 #include "modes/world.hpp"
+#include "network/network_manager.hpp"
 #include "network/protocol_manager.hpp"
 #include "network/network_world.hpp"
+#include "network/protocols/controller_events_protocol.hpp"
+#include "tracks/track.hpp"
 #include "utils/time.hpp"
 
 KartUpdateProtocol::KartUpdateProtocol()
@@ -23,43 +27,164 @@ KartUpdateProtocol::KartUpdateProtocol()
         }
     }
     pthread_mutex_init(&m_positions_updates_mutex, NULL);
+
+    const Vec3 *min, *max;
+    World::getWorld()->getTrack()->getAABB(&min, &max);
+    m_codec = new KartSnapshotCodec(*min, *max);
+
+    m_next_sequence          = 0;
+    m_last_received_sequence = KartSnapshot::NO_SEQUENCE;
+    m_jitter_buffers.resize(m_karts.size());
+    m_has_rewind_state       = false;
+    m_rewind_tick            = RewindManager::NO_TICK;
+    m_last_update_time       = 0;
+    m_ticks_sent             = 0;
+    m_bytes_sent             = 0;
+    m_bytes_uncompressed     = 0;
+    m_kart_states_sent       = 0;
+    m_kart_states_total      = 0;
+
+    // The client predicts its own kart, which is corrected when the state
+    // sent by the server differs.
+    if (!NetworkManager::getInstance()->isServer() &&
+        UserConfigParams::m_network_rollback)
+        RewindManager::create(m_karts[m_self_kart_index]);
 }
 
 KartUpdateProtocol::~KartUpdateProtocol()
 {
+    if (m_ticks_sent > 0)
+    {
+        Log::info("KartUpdateProtocol", "Sent %u bytes in %u ticks: %.1f "
+                  "bytes per tick, uncompressed %.1f bytes per tick.",
+                  m_bytes_sent, m_ticks_sent,
+                  m_bytes_sent / (float)m_ticks_sent,
+                  m_bytes_uncompressed / (float)m_ticks_sent);
+    }
+    if (m_kart_states_total > 0)
+    {
+        Log::info("KartUpdateProtocol", "Sent %u of %u kart states (%.1f%%).",
+                  m_kart_states_sent, m_kart_states_total,
+                  100.0f * m_kart_states_sent / m_kart_states_total);
+    }
+    RewindManager::destroy();
+    delete m_codec;
+    pthread_mutex_destroy(&m_positions_updates_mutex);
+}
+
+/** Stores a received kart state, which will be applied in the next
+ *  synchronous update. Must be called with m_positions_updates_mutex
+ *  locked.
+ */
+void KartUpdateProtocol::addNextPosition(uint32_t kart_id,
+                                         const KartSnapshot::KartState &state)
+{
+    if (kart_id >= m_karts.size())
+        return;
+    Vec3 xyz;
+    btQuaternion q;
+    m_codec->dequantise(state, &xyz, &q);
+    m_next_positions.push_back(xyz);
+    m_next_quaternions.push_back(q);
+    m_karts_ids.push_back(kart_id);
 }
 
 bool KartUpdateProtocol::notifyEventAsynchronous(Event* event)
 {
+    if (event->type == EVENT_TYPE_DISCONNECTED)
+    {
+        pthread_mutex_lock(&m_positions_updates_mutex);
+        m_acked_sequence.erase(*event->peer);
+        m_peer_states.erase(*event->peer);
+        pthread_mutex_unlock(&m_positions_updates_mutex);
+        return true;
+    }
     if (event->type != EVENT_TYPE_MESSAGE)
         return true;
     NetworkString ns = event->data();
-    if (ns.size() < 36)
+
+    if (m_listener->isServer())
     {
-        Log::info("KartUpdateProtocol", "Message too short.");
+        uint16_t ack;
+        uint32_t kart_id;
+        KartSnapshot::KartState state;
+        if (!readClientState(*m_codec, ns, &ack, &kart_id, &state))
+        {
+            Log::warn("KartUpdateProtocol", "Invalid kart state received.");
+            return true;
+        }
+        pthread_mutex_lock(&m_positions_updates_mutex);
+        if (ack != KartSnapshot::NO_SEQUENCE)
+        {
+            std::map<STKPeer*, uint16_t>::iterator it =
+                m_acked_sequence.find(*event->peer);
+            if (it == m_acked_sequence.end())
+                m_acked_sequence[*event->peer] = ack;
+            else if (KartSnapshot::isNewer(ack, it->second))
+                it->second = ack;
+        }
+        // With rollback the server simulates the kart from the inputs of
+        // the client, and only uses the acknowledgement.
+        if (!UserConfigParams::m_network_rollback)
+            addNextPosition(kart_id, state);
+        pthread_mutex_unlock(&m_positions_updates_mutex);
         return true;
     }
-    ns.removeFront(4);
-    while(ns.size() >= 16)
-    {
-        uint32_t kart_id = ns.getUInt32(0);
-
-        float a,b,c;
-        a = ns.getFloat(4);
-        b = ns.getFloat(8);
-        c = ns.getFloat(12);
-        float d,e,f,g;
-        d = ns.getFloat(16);
-        e = ns.getFloat(20);
-        f = ns.getFloat(24);
-        g = ns.getFloat(28);
-        pthread_mutex_trylock(&m_positions_updates_mutex);
-        m_next_positions.push_back(Vec3(a,b,c));
-        m_next_quaternions.push_back(btQuaternion(d,e,f,g));
-        m_karts_ids.push_back(kart_id);
-        pthread_mutex_unlock(&m_positions_updates_mutex);
-        ns.removeFront(32);
+
+    ServerSnapshot received;
+    switch (readServerSnapshot(*m_codec, ns, m_snapshots,
+                               m_last_received_sequence, &received))
+    {
+    case SNAPSHOT_OK:
+        break;
+    case SNAPSHOT_OUT_OF_ORDER:
+        return true;
+    case SNAPSHOT_NO_BASELINE:
+        // This can only happen if the baseline was overwritten in the
+        // meantime, then the server will soon send a full snapshot.
+        Log::verbose("KartUpdateProtocol", "Missing baseline %d.",
+                     ns.getUInt16(2));
+        return true;
+    default:
+        Log::warn("KartUpdateProtocol", "Invalid snapshot received.");
+        return true;
     }
+    const KartSnapshot &snapshot = received.m_snapshot;
+    const uint16_t sequence = snapshot.m_sequence;
+    const uint8_t client_kart = received.m_client_kart;
+
+    pthread_mutex_lock(&m_positions_updates_mutex);
+    m_snapshots[sequence % SNAPSHOT_HISTORY] = snapshot;
+    m_last_received_sequence = sequence;
+    const double sample_time = received.m_server_tick
+                             * NetworkWorld::getInstance()->getTickLength();
+    const double arrival_time = StkTime::getRealTime();
+    for (unsigned int i = 0; i < snapshot.m_karts.size() &&
+                             i < m_jitter_buffers.size(); i++)
+    {
+        // A kart that was not updated by the server (see KartRelevance)
+        // has the state of the baseline, which is not a new state. A kart
+        // that stands still is still a new sample.
+        if (snapshot.isSkipped(i))
+            continue;
+        Vec3 xyz;
+        btQuaternion q;
+        m_codec->dequantise(snapshot.m_karts[i], &xyz, &q);
+        m_jitter_buffers[i].add(sample_time, arrival_time, xyz, q);
+    }
+    if (client_kart == m_self_kart_index &&
+        client_kart < snapshot.m_karts.size())
+    {
+        Vec3 xyz;
+        btQuaternion q;
+        m_codec->dequantise(snapshot.m_karts[client_kart], &xyz, &q);
+        m_rewind_state.m_transform = btTransform(q, xyz);
+        m_rewind_state.m_linear_velocity  = received.m_linear_velocity;
+        m_rewind_state.m_angular_velocity = received.m_angular_velocity;
+        m_rewind_tick      = received.m_client_tick;
+        m_has_rewind_state = true;
+    }
+    pthread_mutex_unlock(&m_positions_updates_mutex);
     return true;
 }
 
@@ -67,64 +192,132 @@ void KartUpdateProtocol::setup()
 {
 }
 
+/** Sends the state of the karts to each peer. Each peer gets the snapshot
+ *  delta compressed against the last snapshot it has acknowledged. With
+ *  interest management only the karts selected by KartRelevance are
+ *  updated, the others are sent as skipped (see
+ *  KartRelevance::prepareSnapshot()).
+ */
+void KartUpdateProtocol::sendServerSnapshot()
+{
+    KartSnapshot snapshot;
+    snapshot.m_sequence = m_next_sequence;
+    snapshot.m_karts.resize(m_karts.size());
+    for (unsigned int i = 0; i < m_karts.size(); i++)
+    {
+        AbstractKart* kart = m_karts[i];
+        m_codec->quantise(kart->getXYZ(), kart->getRotation(),
+                          &snapshot.m_karts[kart->getWorldKartId()]);
+    }
+
+    m_relevance.update();
+
+    const uint32_t server_tick = NetworkWorld::getInstance()->getTick();
+    ControllerEventsProtocol *controller_events =
+        static_cast<ControllerEventsProtocol*>(ProtocolManager::getInstance()
+                              ->getProtocol(PROTOCOL_CONTROLLER_EVENTS));
+
+    std::vector<STKPeer*> peers = NetworkManager::getInstance()->getPeers();
+    pthread_mutex_lock(&m_positions_updates_mutex);
+    for (unsigned int i = 0; i < peers.size(); i++)
+    {
+        std::map<STKPeer*, uint16_t>::const_iterator it =
+            m_acked_sequence.find(peers[i]);
+        const uint16_t acked = it != m_acked_sequence.end()
+                             ? it->second : KartSnapshot::NO_SEQUENCE;
+        int kart = controller_events ? controller_events->findKart(peers[i])
+                                     : -1;
+        if (kart >= (int)m_karts.size())
+            kart = -1;
+
+        const KartSnapshot *baseline;
+        unsigned int num_sent;
+        const KartSnapshot &view =
+            m_relevance.prepareSnapshot(snapshot, acked, kart,
+                                        &m_peer_states[peers[i]], &baseline,
+                                        &num_sent);
+        m_kart_states_sent  += num_sent;
+        m_kart_states_total += (unsigned int)m_karts.size();
+
+        // The tick of the client this snapshot corresponds to, and the
+        // velocities of its kart, which the client needs to rewind.
+        uint32_t client_tick = RewindManager::NO_TICK;
+        if (kart >= 0)
+            client_tick = controller_events->getClientTick(kart, server_tick);
+        NetworkString ns;
+        writeServerSnapshot(*m_codec, view, baseline, server_tick,
+                            client_tick, kart,
+                            kart >= 0 ? m_karts[kart]->getBody() : NULL, &ns);
+        m_listener->sendMessage(this, peers[i], ns, false);
+        m_bytes_sent += ns.size();
+        m_bytes_uncompressed += 4 + 32 * (unsigned int)m_karts.size();
+    }
+    pthread_mutex_unlock(&m_positions_updates_mutex);
+
+    m_next_sequence++;
+    if (m_next_sequence == KartSnapshot::NO_SEQUENCE)
+        m_next_sequence = 0;
+}
+
+/** Sends the state of the local kart to the server, together with the
+ *  sequence number of the last snapshot received.
+ */
+void KartUpdateProtocol::sendClientState()
+{
+    AbstractKart* kart = m_karts[m_self_kart_index];
+    KartSnapshot::KartState state;
+    m_codec->quantise(kart->getXYZ(), kart->getRotation(), &state);
+
+    pthread_mutex_lock(&m_positions_updates_mutex);
+    const uint16_t ack = m_last_received_sequence;
+    pthread_mutex_unlock(&m_positions_updates_mutex);
+    NetworkString ns;
+    writeClientState(*m_codec, ack, World::getWorld()->getTime(),
+                     kart->getWorldKartId(), state, &ns);
+    Log::verbose("KartUpdateProtocol", "Sending %d's positions %f %f %f", kart->getWorldKartId(), kart->getXYZ()[0], kart->getXYZ()[1], kart->getXYZ()[2]);
+    m_listener->sendMessage(this, ns, false);
+    m_bytes_sent += ns.size();
+    m_bytes_uncompressed += 4 + 32;
+}
+
 void KartUpdateProtocol::update()
 {
     if (!World::getWorld())
         return;
-    static double time = 0;
     double current_time = StkTime::getRealTime();
-    if (current_time > time + 0.1) // 10 updates per second
+    int frequency = UserConfigParams::m_kart_update_frequency;
+    if (frequency < 1)
+        frequency = 1;
+    if (current_time > m_last_update_time + 1.0 / frequency)
     {
-        time = current_time;
+        m_last_update_time = current_time;
         if (m_listener->isServer())
-        {
-            NetworkString ns;
-            ns.af( World::getWorld()->getTime());
-            for (unsigned int i = 0; i < m_karts.size(); i++)
-            {
-                AbstractKart* kart = m_karts[i];
-                Vec3 v = kart->getXYZ();
-                btQuaternion quat = kart->getRotation();
-                ns.ai32( kart->getWorldKartId());
-                ns.af(v[0]).af(v[1]).af(v[2]); // add position
-                ns.af(quat.x()).af(quat.y()).af(quat.z()).af(quat.w()); // add rotation
-                Log::verbose("KartUpdateProtocol", "Sending %d's positions %f %f %f", kart->getWorldKartId(), v[0], v[1], v[2]);
-            }
-            m_listener->sendMessage(this, ns, false);
-        }
+            sendServerSnapshot();
         else
-        {
-            AbstractKart* kart = m_karts[m_self_kart_index];
-            Vec3 v = kart->getXYZ();
-            btQuaternion quat = kart->getRotation();
-            NetworkString ns;
-            ns.af( World::getWorld()->getTime());
-            ns.ai32( kart->getWorldKartId());
-            ns.af(v[0]).af(v[1]).af(v[2]); // add position
-            ns.af(quat.x()).af(quat.y()).af(quat.z()).af(quat.w()); // add rotation
-            Log::verbose("KartUpdateProtocol", "Sending %d's positions %f %f %f", kart->getWorldKartId(), v[0], v[1], v[2]);
-            m_listener->sendMessage(this, ns, false);
-        }
+            sendClientState();
+        m_ticks_sent++;
+    }
+    if (!m_listener->isServer())
+    {
+        updateRemoteKarts(current_time);
+        return;
     }
     switch(pthread_mutex_trylock(&m_positions_updates_mutex))
     {
         case 0: /* if we got the lock */
+            // Apply the states in the order they were received
             while (!m_next_positions.empty())
             {
-                uint32_t id = m_karts_ids.back();
-                if (id != m_self_kart_index || m_listener->isServer()) // server takes all updates
-                {
-                    Vec3 pos = m_next_positions.back();
-                    btTransform transform = m_karts[id]->getBody()->getInterpolationWorldTransform();
-                    transform.setOrigin(pos);
-                    transform.setRotation(m_next_quaternions.back());
-                    m_karts[id]->getBody()->setCenterOfMassTransform(transform);
-                    //m_karts[id]->getBody()->setLinearVelocity(Vec3(0,0,0));
-                    Log::verbose("KartUpdateProtocol", "Update kart %i pos to %f %f %f", id, pos[0], pos[1], pos[2]);
-                }
-                m_next_positions.pop_back();
-                m_next_quaternions.pop_back();
-                m_karts_ids.pop_back();
+                uint32_t id = m_karts_ids.front();
+                Vec3 pos = m_next_positions.front();
+                btTransform transform = m_karts[id]->getBody()->getInterpolationWorldTransform();
+                transform.setOrigin(pos);
+                transform.setRotation(m_next_quaternions.front());
+                m_karts[id]->getBody()->setCenterOfMassTransform(transform);
+                Log::verbose("KartUpdateProtocol", "Update kart %i pos to %f %f %f", id, pos[0], pos[1], pos[2]);
+                m_next_positions.pop_front();
+                m_next_quaternions.pop_front();
+                m_karts_ids.pop_front();
             }
             pthread_mutex_unlock(&m_positions_updates_mutex);
             break;
@@ -133,6 +326,154 @@ void KartUpdateProtocol::update()
     }
 }
 
+/** Writes a snapshot of the server for one client: sequence number,
+ *  baseline sequence number, server tick, the (possibly delta compressed)
+ *  karts, the client tick the snapshot corresponds to, and the kart of the
+ *  client with its velocities.
+ *  \param view The snapshot for this client (see
+ *         KartRelevance::prepareSnapshot()).
+ *  \param baseline The baseline, or NULL.
+ *  \param kart The kart of the client, or -1.
+ *  \param body The body of this kart, NULL if kart is -1.
+ */
+void KartUpdateProtocol::writeServerSnapshot(const KartSnapshotCodec &codec,
+                                             const KartSnapshot &view,
+                                             const KartSnapshot *baseline,
+                                             uint32_t server_tick,
+                                             uint32_t client_tick, int kart,
+                                             const btRigidBody *body,
+                                             NetworkString *ns)
+{
+    ns->ai16(view.m_sequence);
+    ns->ai16(baseline ? baseline->m_sequence : KartSnapshot::NO_SEQUENCE);
+    ns->ai32(server_tick);
+    codec.encode(view, baseline, ns);
+    ns->ai32(client_tick);
+    if (kart >= 0 && body)
+    {
+        ns->ai8((uint8_t)kart);
+        KartSnapshotCodec::encodeVelocities(body->getLinearVelocity(),
+                                            body->getAngularVelocity(), ns);
+    }
+    else
+        ns->ai8(0xff);
+}
 
+/** Reads a snapshot written by writeServerSnapshot().
+ *  \param history The snapshots received before, indexed by sequence
+ *         number modulo SNAPSHOT_HISTORY, which contain the baseline.
+ *  \param last_received The sequence number of the last snapshot
+ *         received, or KartSnapshot::NO_SEQUENCE.
+ *  \param result On return the snapshot, if SNAPSHOT_OK is returned.
+ */
+KartUpdateProtocol::SnapshotStatus
+    KartUpdateProtocol::readServerSnapshot(const KartSnapshotCodec &codec,
+                                           const NetworkString &ns,
+                                           const KartSnapshot *history,
+                                           uint16_t last_received,
+                                           ServerSnapshot *result)
+{
+    if (ns.size() < 9)
+        return SNAPSHOT_INVALID;
+    const uint16_t sequence          = ns.getUInt16(0);
+    const uint16_t baseline_sequence = ns.getUInt16(2);
+    // Ignore snapshots that arrive out of order
+    if (last_received != KartSnapshot::NO_SEQUENCE &&
+        !KartSnapshot::isNewer(sequence, last_received))
+        return SNAPSHOT_OUT_OF_ORDER;
 
+    const KartSnapshot *baseline = NULL;
+    if (baseline_sequence != KartSnapshot::NO_SEQUENCE)
+    {
+        baseline = &history[baseline_sequence % SNAPSHOT_HISTORY];
+        if (baseline->m_sequence != baseline_sequence)
+            return SNAPSHOT_NO_BASELINE;
+    }
+
+    result->m_server_tick = ns.getUInt32(4);
+    int pos = 8;
+    if (!codec.decode(ns, &pos, baseline, &result->m_snapshot))
+        return SNAPSHOT_INVALID;
+    result->m_snapshot.m_sequence = sequence;
+
+    result->m_client_tick = RewindManager::NO_TICK;
+    result->m_client_kart = 0xff;
+    if (pos + 5 <= ns.size())
+    {
+        result->m_client_tick = ns.getUInt32(pos);
+        result->m_client_kart = ns.getUInt8(pos + 4);
+        pos += 5;
+        if (result->m_client_kart == 0xff ||
+            !KartSnapshotCodec::decodeVelocities(ns, &pos,
+                                                 &result->m_linear_velocity,
+                                                 &result->m_angular_velocity))
+            result->m_client_kart = 0xff;
+    }
+    return SNAPSHOT_OK;
+}
 
+/** Writes the message of a client: the last snapshot received, the world
+ *  time, and the state of the client's kart.
+ */
+void KartUpdateProtocol::writeClientState(const KartSnapshotCodec &codec,
+                                          uint16_t ack, float time,
+                                          uint8_t kart,
+                                          const KartSnapshot::KartState &state,
+                                          NetworkString *ns)
+{
+    ns->ai16(ack);
+    ns->af(time);
+    ns->ai8(kart);
+    codec.encodeSingleKart(state, ns);
+}
+
+/** Reads a message written by writeClientState().
+ *  \return False if the message is invalid.
+ */
+bool KartUpdateProtocol::readClientState(const KartSnapshotCodec &codec,
+                                         const NetworkString &ns,
+                                         uint16_t *ack, uint32_t *kart,
+                                         KartSnapshot::KartState *state)
+{
+    if (ns.size() < 8)
+        return false;
+    *ack  = ns.getUInt16(0);
+    *kart = ns.getUInt8(6);
+    int pos = 7;
+    return codec.decodeSingleKart(ns, &pos, state);
+}
+
+/** Client: shows the remote karts at the position interpolated from the
+ *  states received from the server (see JitterBuffer), and corrects the
+ *  local kart if the last snapshot differs from its predicted state.
+ *  \param current_time The current real time.
+ */
+void KartUpdateProtocol::updateRemoteKarts(double current_time)
+{
+    bool rewind = false;
+    uint32_t rewind_tick = RewindManager::NO_TICK;
+    RewindManager::BodyState rewind_state;
+
+    pthread_mutex_lock(&m_positions_updates_mutex);
+    if (m_has_rewind_state)
+    {
+        rewind = true;
+        rewind_tick = m_rewind_tick;
+        rewind_state = m_rewind_state;
+        m_has_rewind_state = false;
+    }
+    for (unsigned int i = 0; i < m_karts.size(); i++)
+    {
+        Vec3 xyz;
+        btQuaternion q;
+        if (i == m_self_kart_index ||
+            !m_jitter_buffers[i].get(current_time, &xyz, &q))
+            continue;
+        m_karts[i]->getBody()->setCenterOfMassTransform(btTransform(q, xyz));
+        m_karts[i]->updatePosition();
+    }
+    pthread_mutex_unlock(&m_positions_updates_mutex);
+
+    if (rewind && RewindManager::get())
+        RewindManager::get()->reconcile(rewind_tick, rewind_state);
+}
@@ -2,15 +2,40 @@
 #define KART_UPDATE_PROTOCOL_HPP
 
 #include "network/protocol.hpp"
+#include "network/jitter_buffer.hpp"
+#include "network/kart_relevance.hpp"
+#include "network/kart_snapshot.hpp"
+#include "network/rewind_manager.hpp"
 #include "utils/vec3.hpp"
 #include "LinearMath/btQuaternion.h"
 #include <list>
+#include <map>
 
 class AbstractKart;
+class btRigidBody;
+class STKPeer;
 
 class KartUpdateProtocol : public Protocol
 {
     public:
+        /** A snapshot read from a message of the server. */
+        struct ServerSnapshot
+        {
+            uint32_t     m_server_tick;
+            KartSnapshot m_snapshot;
+            /** The tick of the client this snapshot corresponds to, and
+             *  the kart of the client with its velocities (0xff if the
+             *  client has no kart). */
+            uint32_t     m_client_tick;
+            uint8_t      m_client_kart;
+            Vec3         m_linear_velocity;
+            Vec3         m_angular_velocity;
+        };
+
+        /** Result of readServerSnapshot(). */
+        enum SnapshotStatus { SNAPSHOT_OK, SNAPSHOT_OUT_OF_ORDER,
+                              SNAPSHOT_NO_BASELINE, SNAPSHOT_INVALID };
+
         KartUpdateProtocol();
         virtual ~KartUpdateProtocol();
 
@@ -19,7 +44,39 @@ class KartUpdateProtocol : public Protocol
         virtual void update();
         virtual void asynchronousUpdate() {};
 
+        static void writeServerSnapshot(const KartSnapshotCodec &codec,
+                                        const KartSnapshot &view,
+                                        const KartSnapshot *baseline,
+                                        uint32_t server_tick,
+                                        uint32_t client_tick, int kart,
+                                        const btRigidBody *body,
+                                        NetworkString *ns);
+        static SnapshotStatus readServerSnapshot(const KartSnapshotCodec &codec,
+                                                 const NetworkString &ns,
+                                                 const KartSnapshot *history,
+                                                 uint16_t last_received,
+                                                 ServerSnapshot *result);
+        static void writeClientState(const KartSnapshotCodec &codec,
+                                     uint16_t ack, float time, uint8_t kart,
+                                     const KartSnapshot::KartState &state,
+                                     NetworkString *ns);
+        static bool readClientState(const KartSnapshotCodec &codec,
+                                    const NetworkString &ns, uint16_t *ack,
+                                    uint32_t *kart,
+                                    KartSnapshot::KartState *state);
+
     protected:
+        /** Number of snapshots kept as possible baselines for delta
+         *  compression. */
+        static const unsigned int SNAPSHOT_HISTORY =
+            KartRelevance::SNAPSHOT_HISTORY;
+
+        void sendServerSnapshot();
+        void sendClientState();
+        void updateRemoteKarts(double current_time);
+        void addNextPosition(uint32_t kart_id,
+                             const KartSnapshot::KartState &state);
+
         std::vector<AbstractKart*> m_karts;
         uint32_t m_self_kart_index;
 
@@ -28,6 +85,56 @@ class KartUpdateProtocol : public Protocol
         std::list<uint32_t> m_karts_ids;
 
         pthread_mutex_t m_positions_updates_mutex;
+
+        /** Quantises kart states relative to the track bounds. */
+        KartSnapshotCodec* m_codec;
+
+        /** Client: snapshots received, indexed by sequence number modulo
+         *  SNAPSHOT_HISTORY. */
+        KartSnapshot m_snapshots[SNAPSHOT_HISTORY];
+
+        /** Server: the snapshots and kart priorities of each peer. */
+        std::map<STKPeer*, KartRelevance::ClientView> m_peer_states;
+
+        /** Server: ranks the karts for each peer. */
+        KartRelevance m_relevance;
+
+        /** Server: sequence number of the next snapshot to send. */
+        uint16_t m_next_sequence;
+
+        /** Client: most recent snapshot received from the server, which is
+         *  acknowledged in each message sent to the server. */
+        uint16_t m_last_received_sequence;
+
+        /** Server: the most recent snapshot acknowledged by each peer. */
+        std::map<STKPeer*, uint16_t> m_acked_sequence;
+
+        /** Client: the states received for each kart, which are played
+         *  back with a delay to show the remote karts smoothly. */
+        std::vector<JitterBuffer> m_jitter_buffers;
+
+        /** Client: the state of the local kart in the last snapshot, and
+         *  the tick of the client it corresponds to, which are given to the
+         *  RewindManager in the next synchronous update. */
+        bool m_has_rewind_state;
+        uint32_t m_rewind_tick;
+        RewindManager::BodyState m_rewind_state;
+
+        /** Time at which the last update was sent. */
+        double m_last_update_time;
+
+        /** Statistics: number of ticks in which data was sent, the number
+         *  of bytes sent, and the number of bytes the uncompressed format
+         *  (seven floats per kart) would have needed. */
+        unsigned int m_ticks_sent;
+        unsigned int m_bytes_sent;
+        unsigned int m_bytes_uncompressed;
+
+        /** Server statistics: number of kart states sent to all peers, and
+         *  the number that would have been sent without interest
+         *  management. */
+        unsigned int m_kart_states_sent;
+        unsigned int m_kart_states_total;
 };
 
 #endif // KART_UPDATE_PROTOCOL_HPP
@@ -20,6 +20,8 @@
 
 #include "config/player_manager.hpp"
 #include "config/user_config.hpp"
+#include "karts/kart_properties.hpp"
+#include "karts/kart_properties_manager.hpp"
 #include "modes/world.hpp"
 #include "network/network_world.hpp"
 #include "network/protocols/get_public_address.hpp"
@@ -57,6 +59,7 @@ void ServerLobbyRoomProtocol::setup()
     m_public_address.port = 0;
     m_selection_enabled = false;
     m_in_race = false;
+    m_selection_start_time = 0;
     Log::info("ServerLobbyRoomProtocol", "Starting the protocol.");
 }
 
@@ -131,6 +134,8 @@ void ServerLobbyRoomProtocol::update()
         checkIncomingConnectionRequests();
         if (m_in_race && World::getWorld() && NetworkWorld::getInstance<NetworkWorld>()->isRunning())
             checkRaceFinished();
+        else if (!m_in_race)
+            checkAutoStart();
 
         break;
     }
@@ -174,6 +179,103 @@ void ServerLobbyRoomProtocol::startSelection()
 
 //-----------------------------------------------------------------------------
 
+/** Starts the kart selection once server_auto_start players have joined,
+ *  and the race once all players have selected a kart, or when the
+ *  selection time is over (then the players without a kart get the first
+ *  kart that is still available). A player for whom no kart is available
+ *  is disconnected, and the race only starts once the disconnection was
+ *  handled (see kartDisconnected), so that every player in the race has a
+ *  kart. This replaces the console commands on servers without a console
+ *  (e.g. with several lobbies).
+ */
+void ServerLobbyRoomProtocol::checkAutoStart()
+{
+    const int auto_start = UserConfigParams::m_server_auto_start;
+    if (auto_start <= 0 || m_setup->getPlayerCount() == 0)
+        return;
+    if (!m_selection_enabled)
+    {
+        if (m_setup->getPlayerCount() < auto_start)
+            return;
+        // Forget the karts of the last race
+        std::vector<NetworkPlayerProfile*> players = m_setup->getPlayers();
+        for (unsigned int i = 0; i < players.size(); i++)
+            players[i]->kart_name = "";
+        Log::info("ServerLobbyRoomProtocol", "%d players, starting the kart "
+                  "selection.", m_setup->getPlayerCount());
+        startSelection();
+        m_selection_start_time = StkTime::getRealTime();
+        return;
+    }
+
+    const bool timeout = StkTime::getRealTime() > m_selection_start_time
+                       + UserConfigParams::m_server_selection_time;
+    std::vector<NetworkPlayerProfile*> players = m_setup->getPlayers();
+    bool all_have_karts = true;
+    for (unsigned int i = 0; i < players.size(); i++)
+    {
+        if (players[i]->kart_name != "")
+            continue;
+        if (!timeout)
+            return;
+        for (unsigned int k = 0;
+             k < kart_properties_manager->getNumberOfKarts(); k++)
+        {
+            const std::string &kart =
+                kart_properties_manager->getKartById(k)->getIdent();
+            if (!m_setup->isKartAvailable(kart) ||
+                !m_setup->isKartAllowed(kart))
+                continue;
+            NetworkString answer;
+            answer.ai8(0x03).ai8(1).ai8(players[i]->race_id);
+            answer.ai8(kart.size()).as(kart);
+            m_listener->sendMessage(this, answer);
+            m_setup->setPlayerKart(players[i]->race_id, kart);
+            break;
+        }
+        if (players[i]->kart_name != "")
+            continue;
+        // No kart is left for this player
+        Log::warn("ServerLobbyRoomProtocol", "No kart available for "
+                  "player %d, disconnecting it.", players[i]->race_id);
+        std::vector<STKPeer*> peers =
+            NetworkManager::getInstance()->getPeers();
+        bool found = false;
+        for (unsigned int j = 0; j < peers.size(); j++)
+        {
+            if (peers[j]->getPlayerProfile() != players[i])
+                continue;
+            peers[j]->disconnect();
+            found = true;
+        }
+        if (found)
+        {
+            all_have_karts = false;
+        }
+        else
+        {
+            // A player without a peer would never be removed
+            NetworkString msg;
+            msg.ai8(0x02).ai8(1).ai8(players[i]->race_id);
+            m_listener->sendMessage(this, msg);
+            m_setup->removePlayer(players[i]->race_id);
+        }
+    }
+    if (!all_have_karts)
+        return;
+    if (m_setup->getPlayerCount() == 0)
+    {
+        m_selection_enabled = false;
+        return;
+    }
+    Log::info("ServerLobbyRoomProtocol", "Starting the race.");
+    startGame();
+    // The next race starts with a new selection
+    m_selection_enabled = false;
+}
+
+//-----------------------------------------------------------------------------
+
 void ServerLobbyRoomProtocol::checkIncomingConnectionRequests()
 {
     // first poll every 5 seconds
@@ -18,6 +18,7 @@ class ServerLobbyRoomProtocol : public LobbyRoomProtocol
         void startSelection();
         void checkIncomingConnectionRequests();
         void checkRaceFinished();
+        void checkAutoStart();
 
     protected:
         // connection management
@@ -40,6 +41,8 @@ class ServerLobbyRoomProtocol : public LobbyRoomProtocol
         TransportAddress m_public_address;
         bool m_selection_enabled;
         bool m_in_race;
+        /** Time at which the kart selection was started by checkAutoStart. */
+        double m_selection_start_time;
 
         enum STATE
         {
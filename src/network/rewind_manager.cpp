@@ -0,0 +1,294 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/rewind_manager.hpp"
+
+#include "karts/abstract_kart.hpp"
+#include "modes/world.hpp"
+#include "network/network_world.hpp"
+#include "physics/btKart.hpp"
+#include "physics/physics.hpp"
+#include "physics/user_pointer.hpp"
+#include "utils/log.hpp"
+#include "utils/time.hpp"
+
+#include <algorithm>
+#include <assert.h>
+
+RewindManager *RewindManager::m_rewind_manager = NULL;
+const float    RewindManager::POSITION_TOLERANCE = 0.1f;
+
+// ----------------------------------------------------------------------------
+/** Creates the rewind manager for the kart of this client.
+ *  \param kart The kart controlled by this client.
+ */
+void RewindManager::create(AbstractKart *kart)
+{
+    assert(!m_rewind_manager);
+    m_rewind_manager = new RewindManager(kart);
+}   // create
+
+// ----------------------------------------------------------------------------
+void RewindManager::destroy()
+{
+    delete m_rewind_manager;
+    m_rewind_manager = NULL;
+}   // destroy
+
+// ----------------------------------------------------------------------------
+RewindManager::RewindManager(AbstractKart *kart)
+{
+    m_kart               = kart;
+    m_last_tick          = NO_TICK;
+    m_num_snapshots      = 0;
+    m_num_too_old        = 0;
+    m_num_rewinds        = 0;
+    m_ticks_replayed     = 0;
+    m_max_ticks_replayed = 0;
+    m_rewind_time        = 0;
+    m_max_rewind_time    = 0;
+    for(unsigned int i=0; i<HISTORY_TICKS; i++)
+        m_history[i].m_tick = NO_TICK;
+}   // RewindManager
+
+// ----------------------------------------------------------------------------
+/** Prints the statistics of the rewinds.
+ */
+RewindManager::~RewindManager()
+{
+    if(m_num_snapshots==0)
+        return;
+    Log::info("RewindManager", "%u snapshots, %u too old, %u rewinds.",
+              m_num_snapshots, m_num_too_old, m_num_rewinds);
+    if(m_num_rewinds>0)
+    {
+        Log::info("RewindManager", "Replayed %u ticks: %.1f per rewind, "
+                  "%u max; %.3f ms per rewind, %.3f ms max.",
+                  m_ticks_replayed, m_ticks_replayed/(float)m_num_rewinds,
+                  m_max_ticks_replayed,
+                  m_rewind_time*1000.0/m_num_rewinds,
+                  m_max_rewind_time*1000.0);
+    }
+}   // ~RewindManager
+
+// ----------------------------------------------------------------------------
+void RewindManager::saveBody(const AbstractKart *kart, BodyState *state)
+{
+    const btRigidBody *body   = kart->getBody();
+    state->m_transform        = body->getCenterOfMassTransform();
+    state->m_linear_velocity  = body->getLinearVelocity();
+    state->m_angular_velocity = body->getAngularVelocity();
+}   // saveBody
+
+// ----------------------------------------------------------------------------
+void RewindManager::restoreBody(AbstractKart *kart, const BodyState &state)
+{
+    btRigidBody *body = kart->getBody();
+    body->setCenterOfMassTransform(state.m_transform);
+    body->setLinearVelocity(state.m_linear_velocity);
+    body->setAngularVelocity(state.m_angular_velocity);
+    body->clearForces();
+}   // restoreBody
+
+// ----------------------------------------------------------------------------
+/** Saves the state of all moving bodies in the physics world that are not
+ *  karts (e.g. flyables and physical objects).
+ *  \param objects On return the states, sorted by body.
+ */
+void RewindManager::saveObjects(std::vector<ObjectState> *objects)
+{
+    objects->clear();
+    const btCollisionObjectArray &all =
+        World::getWorld()->getPhysics()->getPhysicsWorld()
+                                       ->getCollisionObjectArray();
+    for(int i=0; i<all.size(); i++)
+    {
+        const btRigidBody *body = btRigidBody::upcast(all[i]);
+        if(!body || body->isStaticOrKinematicObject())
+            continue;
+        const UserPointer *up = (UserPointer*)body->getUserPointer();
+        if(up && up->is(UserPointer::UP_KART))
+            continue;
+        ObjectState object;
+        object.m_body                     = body;
+        object.m_state.m_transform        = body->getCenterOfMassTransform();
+        object.m_state.m_linear_velocity  = body->getLinearVelocity();
+        object.m_state.m_angular_velocity = body->getAngularVelocity();
+        objects->push_back(object);
+    }
+    std::sort(objects->begin(), objects->end());
+}   // saveObjects
+
+// ----------------------------------------------------------------------------
+/** Sets the moving bodies that are not karts to a saved state. Only bodies
+ *  that are still in the physics world are changed, so the saved pointers
+ *  of removed bodies are never used. A body that is not in the saved state
+ *  (because it was created later) is set to its state in fallback instead.
+ *  \param objects The saved states, sorted by body.
+ *  \param fallback The states used for bodies not in objects.
+ */
+void RewindManager::restoreObjects(const std::vector<ObjectState> &objects,
+                                   const std::vector<ObjectState> &fallback)
+{
+    btCollisionObjectArray &all =
+        World::getWorld()->getPhysics()->getPhysicsWorld()
+                                       ->getCollisionObjectArray();
+    for(int i=0; i<all.size(); i++)
+    {
+        btRigidBody *body = btRigidBody::upcast(all[i]);
+        if(!body || body->isStaticOrKinematicObject())
+            continue;
+        ObjectState key;
+        key.m_body = body;
+        std::vector<ObjectState>::const_iterator it =
+            std::lower_bound(objects.begin(), objects.end(), key);
+        if(it==objects.end() || it->m_body!=body)
+        {
+            it = std::lower_bound(fallback.begin(), fallback.end(), key);
+            if(it==fallback.end() || it->m_body!=body)
+                continue;
+        }
+        body->setCenterOfMassTransform(it->m_state.m_transform);
+        body->setLinearVelocity(it->m_state.m_linear_velocity);
+        body->setAngularVelocity(it->m_state.m_angular_velocity);
+        body->clearForces();
+    }
+}   // restoreObjects
+
+// ----------------------------------------------------------------------------
+/** Sets the wheel commands of the local kart to the saved values.
+ */
+void RewindManager::restoreWheels(const TickState &state)
+{
+    btKart *vehicle = m_kart->getVehicle();
+    const int num_wheels = std::min(vehicle->getNumWheels(), (int)MAX_WHEELS);
+    for(int i=0; i<num_wheels; i++)
+    {
+        btWheelInfo &wheel  = vehicle->getWheelInfo(i);
+        wheel.m_steering    = state.m_steering[i];
+        wheel.m_engineForce = state.m_engine_force[i];
+        wheel.m_brake       = state.m_brake[i];
+    }
+}   // restoreWheels
+
+// ----------------------------------------------------------------------------
+/** Saves the state after a tick. Must be called after each world update.
+ *  \param tick The number of the tick that was just computed.
+ */
+void RewindManager::saveState(uint32_t tick)
+{
+    TickState &state = m_history[tick % HISTORY_TICKS];
+    state.m_tick = tick;
+    const World::KartList &karts = World::getWorld()->getKarts();
+    state.m_karts.resize(karts.size());
+    for(unsigned int i=0; i<karts.size(); i++)
+        saveBody(karts[i], &state.m_karts[i]);
+    saveObjects(&state.m_objects);
+    World::getWorld()->getPhysics()->getCollisions(&state.m_collisions);
+
+    const btKart *vehicle = m_kart->getVehicle();
+    const int num_wheels = std::min(vehicle->getNumWheels(), (int)MAX_WHEELS);
+    for(int i=0; i<num_wheels; i++)
+    {
+        const btWheelInfo &wheel = vehicle->getWheelInfo(i);
+        state.m_steering[i]      = wheel.m_steering;
+        state.m_engine_force[i]  = wheel.m_engineForce;
+        state.m_brake[i]         = wheel.m_brake;
+    }
+    m_last_tick = tick;
+}   // saveState
+
+// ----------------------------------------------------------------------------
+/** Compares the state of the local kart sent by the server with the state
+ *  predicted for the same tick. If they differ, the kart is rewound to the
+ *  state of the server and all ticks since then are simulated again.
+ *  \param tick The client tick the server state corresponds to.
+ *  \param server_state The state of the local kart on the server.
+ */
+void RewindManager::reconcile(uint32_t tick, const BodyState &server_state)
+{
+    m_num_snapshots++;
+    // If the state is for the last saved tick there is nothing to replay
+    if(tick==NO_TICK || m_last_tick==NO_TICK || tick>=m_last_tick)
+        return;
+    TickState &past = m_history[tick % HISTORY_TICKS];
+    if(past.m_tick!=tick)
+    {
+        m_num_too_old++;
+        return;
+    }
+
+    const unsigned int kart_id = m_kart->getWorldKartId();
+    const BodyState &predicted = past.m_karts[kart_id];
+    const float error = (predicted.m_transform.getOrigin()
+                         - server_state.m_transform.getOrigin()).length();
+    if(error < POSITION_TOLERANCE)
+        return;
+
+    const double start = StkTime::getRealTime();
+    const World::KartList &karts = World::getWorld()->getKarts();
+    Physics *physics = World::getWorld()->getPhysics();
+    const float dt = NetworkWorld::getInstance()->getTickLength();
+
+    // The current state of the other moving bodies, which is restored
+    // after the re-simulation. This includes bodies created since the last
+    // saved tick.
+    std::vector<ObjectState> objects;
+    saveObjects(&objects);
+
+    past.m_karts[kart_id] = server_state;
+    restoreBody(m_kart, server_state);
+    for(uint32_t t=tick+1; t<=m_last_tick; t++)
+    {
+        const TickState &previous = m_history[(t-1) % HISTORY_TICKS];
+        TickState &current        = m_history[t % HISTORY_TICKS];
+        // Put the other karts and objects where they were at the start of
+        // this tick. Objects that did not exist then stay where they are.
+        for(unsigned int i=0; i<karts.size(); i++)
+        {
+            if(i!=kart_id && i<previous.m_karts.size())
+                restoreBody(karts[i], previous.m_karts[i]);
+        }
+        restoreObjects(previous.m_objects, objects);
+        restoreWheels(previous);
+        physics->stepOnly(dt, current.m_collisions);
+        saveBody(m_kart, &current.m_karts[kart_id]);
+    }
+
+    // Restore the current state of the other karts and objects
+    const TickState &last = m_history[m_last_tick % HISTORY_TICKS];
+    for(unsigned int i=0; i<karts.size(); i++)
+    {
+        if(i!=kart_id && i<last.m_karts.size())
+            restoreBody(karts[i], last.m_karts[i]);
+    }
+    restoreObjects(objects, objects);
+    restoreWheels(last);
+    m_kart->updatePosition();
+
+    const unsigned int ticks = m_last_tick - tick;
+    const double time = StkTime::getRealTime() - start;
+    m_num_rewinds++;
+    m_ticks_replayed    += ticks;
+    m_max_ticks_replayed = std::max(m_max_ticks_replayed, ticks);
+    m_rewind_time       += time;
+    m_max_rewind_time    = std::max(m_max_rewind_time, time);
+    Log::verbose("RewindManager", "Rewind to tick %u (error %.3f m): "
+                 "replayed %u ticks in %.3f ms.", tick, error, ticks,
+                 time*1000.0);
+}   // reconcile
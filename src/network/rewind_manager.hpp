@@ -0,0 +1,152 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+/*! \file rewind_manager.hpp
+ *  \brief Client side prediction and server reconciliation of the local kart.
+ */
+
+#ifndef HEADER_REWIND_MANAGER_HPP
+#define HEADER_REWIND_MANAGER_HPP
+
+#include "physics/physics.hpp"
+#include "utils/no_copy.hpp"
+#include "utils/types.hpp"
+#include "utils/vec3.hpp"
+
+#include "LinearMath/btTransform.h"
+
+#include <vector>
+
+class AbstractKart;
+class btRigidBody;
+
+/** \brief Rewinds and re-simulates the local kart when a server snapshot
+ *  differs from the predicted state.
+ *  A client simulates its own kart immediately from its inputs (i.e. it
+ *  predicts the state the server will compute once it receives the inputs).
+ *  After each tick the physical state of all karts and the wheel commands
+ *  (steering, engine force and brake) of the local kart are saved. The
+ *  server stamps each snapshot with the client tick it corresponds to.
+ *  If the state of the local kart in the snapshot differs from the state
+ *  saved for this tick, the kart is set to the state of the server, and all
+ *  following ticks are re-simulated with the saved wheel commands. During
+ *  this the other karts and all other moving bodies (flyables, physical
+ *  objects) are put at the positions they had in each tick, and they are
+ *  set back to their current state afterwards, so only the local kart is
+ *  moved by the re-simulation. Only the physics is re-simulated: items,
+ *  skidding and the other gameplay state of the kart are not rewound.
+ *  Collisions that were already handled in a tick are ignored when it is
+ *  re-simulated, new ones are handled in the next physics update.
+ *  \ingroup network
+ */
+class RewindManager : public NoCopy
+{
+public:
+    /** Tick number that indicates 'no tick'. */
+    static const uint32_t NO_TICK = 0xffffffff;
+
+    /** The physical state of a kart. */
+    struct BodyState
+    {
+        btTransform m_transform;
+        Vec3        m_linear_velocity;
+        Vec3        m_angular_velocity;
+    };   // BodyState
+
+private:
+    static RewindManager *m_rewind_manager;
+
+    /** Number of ticks that are saved (about 2 seconds at 60 ticks per
+     *  second). Older snapshots are ignored. */
+    static const unsigned int HISTORY_TICKS = 128;
+
+    /** Maximum number of wheels whose commands are saved. */
+    static const unsigned int MAX_WHEELS = 4;
+
+    /** Position difference (in m) up to which a snapshot is considered
+     *  to confirm the prediction. */
+    static const float POSITION_TOLERANCE;
+
+    /** The state of a moving body that is not a kart. */
+    struct ObjectState
+    {
+        const btRigidBody *m_body;
+        BodyState          m_state;
+        bool operator<(const ObjectState &other) const
+        {
+            return m_body < other.m_body;
+        }
+    };   // ObjectState
+
+    /** The state saved after a tick. */
+    struct TickState
+    {
+        /** The tick, or NO_TICK if this entry is unused. */
+        uint32_t               m_tick;
+        /** The state of all karts, indexed by world kart id. */
+        std::vector<BodyState> m_karts;
+        /** The state of all other moving bodies, sorted by body. */
+        std::vector<ObjectState> m_objects;
+        /** The collisions handled in this tick. */
+        Physics::CollisionIds  m_collisions;
+        /** The wheel commands of the local kart, which are used in the
+         *  physics step of the next tick. */
+        float                  m_steering[MAX_WHEELS];
+        float                  m_engine_force[MAX_WHEELS];
+        float                  m_brake[MAX_WHEELS];
+    };   // TickState
+
+    TickState     m_history[HISTORY_TICKS];
+
+    /** The kart of this client. */
+    AbstractKart *m_kart;
+
+    /** The last saved tick. */
+    uint32_t      m_last_tick;
+
+    /** Statistics: snapshots received, snapshots that were too old, number
+     *  of rewinds, ticks re-simulated, and the time used for it. */
+    unsigned int  m_num_snapshots;
+    unsigned int  m_num_too_old;
+    unsigned int  m_num_rewinds;
+    unsigned int  m_ticks_replayed;
+    unsigned int  m_max_ticks_replayed;
+    double        m_rewind_time;
+    double        m_max_rewind_time;
+
+          RewindManager(AbstractKart *kart);
+         ~RewindManager();
+    static void saveBody(const AbstractKart *kart, BodyState *state);
+    static void restoreBody(AbstractKart *kart, const BodyState &state);
+    void  restoreWheels(const TickState &state);
+    static void saveObjects(std::vector<ObjectState> *objects);
+    static void restoreObjects(const std::vector<ObjectState> &objects,
+                               const std::vector<ObjectState> &fallback);
+
+public:
+    static void create(AbstractKart *kart);
+    static void destroy();
+    // ------------------------------------------------------------------------
+    /** Returns the rewind manager, or NULL if it was not created. */
+    static RewindManager *get() { return m_rewind_manager; }
+    // ------------------------------------------------------------------------
+    void saveState(uint32_t tick);
+    void reconcile(uint32_t tick, const BodyState &server_state);
+};   // RewindManager
+
+#endif
@@ -18,6 +18,7 @@
 
 #include "network/server_network_manager.hpp"
 
+#include "config/user_config.hpp"
 #include "main_loop.hpp"
 #include "network/protocols/connect_to_server.hpp"
 #include "network/protocols/get_peer_address.hpp"
@@ -105,14 +106,19 @@ void ServerNetworkManager::run()
         return;
     }
     m_localhost = new STKHost();
-    m_localhost->setupServer(STKHost::HOST_ANY, 7321, 16, 2, 0, 0);
+    m_localhost->setupServer(STKHost::HOST_ANY,
+                             (uint16_t)UserConfigParams::m_server_port,
+                             16, 2, 0, 0);
     m_localhost->startListening();
 
     Log::info("ServerNetworkManager", "Host initialized.");
 
-    // listen keyboard console input
-    m_thread_keyboard = (pthread_t*)(malloc(sizeof(pthread_t)));
-    pthread_create(m_thread_keyboard, NULL, waitInput2, NULL);
+    // listen keyboard console input (unless several lobbies share stdin)
+    if (UserConfigParams::m_server_lobbies <= 1)
+    {
+        m_thread_keyboard = (pthread_t*)(malloc(sizeof(pthread_t)));
+        pthread_create(m_thread_keyboard, NULL, waitInput2, NULL);
+    }
 
     NetworkManager::run();
     Log::info("ServerNetworkManager", "Ready.");
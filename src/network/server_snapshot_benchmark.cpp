@@ -0,0 +1,573 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "network/server_snapshot_benchmark.hpp"
+
+#include "config/user_config.hpp"
+#include "input/input.hpp"
+#include "karts/abstract_kart.hpp"
+#include "modes/world.hpp"
+#include "network/loopback_transport.hpp"
+#include "network/network_string.hpp"
+#include "network/protocols/controller_events_protocol.hpp"
+#include "network/protocols/kart_update_protocol.hpp"
+#include "network/stk_peer.hpp"
+#include "tracks/track.hpp"
+#include "utils/log.hpp"
+#include "utils/time.hpp"
+
+#include <algorithm>
+#include <assert.h>
+
+ServerSnapshotBenchmark *
+        ServerSnapshotBenchmark::m_server_snapshot_benchmark = NULL;
+unsigned int      ServerSnapshotBenchmark::m_num_clients     = 0;
+NetworkConditions ServerSnapshotBenchmark::m_conditions;
+
+// ----------------------------------------------------------------------------
+/** Creates the server and the clients for the current world.
+ */
+void ServerSnapshotBenchmark::create()
+{
+    assert(!m_server_snapshot_benchmark);
+    assert(World::getWorld());
+    m_server_snapshot_benchmark = new ServerSnapshotBenchmark();
+}   // create
+
+// ----------------------------------------------------------------------------
+void ServerSnapshotBenchmark::destroy()
+{
+    delete m_server_snapshot_benchmark;
+    m_server_snapshot_benchmark = NULL;
+}   // destroy
+
+// ----------------------------------------------------------------------------
+ServerSnapshotBenchmark::ServerSnapshotBenchmark()
+{
+    World *world = World::getWorld();
+    const Vec3 *min, *max;
+    world->getTrack()->getAABB(&min, &max);
+    m_codec = new KartSnapshotCodec(*min, *max);
+
+    m_transport           = new LoopbackTransport(m_conditions);
+    m_server_endpoint     = m_transport->addEndpoint();
+    m_server_peer         = new STKPeer();
+    m_server_sender       = new TransportSender(this, m_server_endpoint);
+    m_server_queue        = new MessageQueue(m_server_sender);
+    m_endpoints[m_server_peer] = m_server_endpoint;
+    m_next_sequence       = 0;
+    m_time                = 0;
+    m_tick                = 0;
+    m_last_send_time      = 0;
+    m_world_time          = 0;
+    m_server_network_time = 0;
+    m_client_time         = 0;
+    m_snapshots_sent      = 0;
+    m_events_sent         = 0;
+    m_events_relayed      = 0;
+    m_events_received     = 0;
+    m_kart_states_sent    = 0;
+    m_snapshot_bytes      = 0;
+    m_snapshot_bytes_uncompressed = 0;
+    m_kart_states_total   = 0;
+    m_invalid_messages    = 0;
+    m_messages_sent       = 0;
+    m_packets_sent        = 0;
+
+    m_clients.resize(m_num_clients);
+    for(unsigned int i=0; i<m_clients.size(); i++)
+    {
+        Client &client              = m_clients[i];
+        client.m_endpoint           = m_transport->addEndpoint();
+        client.m_kart               = i % world->getNumKarts();
+        client.m_peer               = new STKPeer();
+        client.m_peer->setClientServerToken(0x10000 + i);
+        client.m_sender             = new TransportSender(this,
+                                                          client.m_endpoint);
+        client.m_queue              = new MessageQueue(client.m_sender);
+        client.m_last_received      = KartSnapshot::NO_SEQUENCE;
+        client.m_acked              = KartSnapshot::NO_SEQUENCE;
+        client.m_snapshots_received = 0;
+        client.m_snapshots_discarded= 0;
+        m_peers.push_back(client.m_peer);
+        m_endpoints[client.m_peer]  = client.m_endpoint;
+    }
+    Log::info("ServerSnapshotBenchmark", "%u clients, %u karts, latency "
+              "%.0f ms, jitter %.0f ms, loss %.1f%%, reordering %.1f%%, "
+              "bandwidth %.0f bytes/s.", m_num_clients, world->getNumKarts(),
+              m_conditions.m_latency*1000.0f, m_conditions.m_jitter*1000.0f,
+              m_conditions.m_loss*100.0f, m_conditions.m_reorder*100.0f,
+              m_conditions.m_bandwidth);
+}   // ServerSnapshotBenchmark
+
+// ----------------------------------------------------------------------------
+ServerSnapshotBenchmark::~ServerSnapshotBenchmark()
+{
+    for(unsigned int i=0; i<m_clients.size(); i++)
+    {
+        delete m_clients[i].m_queue;
+        delete m_clients[i].m_sender;
+        delete m_clients[i].m_peer;
+    }
+    delete m_server_queue;
+    delete m_server_sender;
+    delete m_server_peer;
+    delete m_transport;
+    delete m_codec;
+}   // ~ServerSnapshotBenchmark
+
+// ----------------------------------------------------------------------------
+/** Sends a packet of a MessageQueue to the endpoint of the peer.
+ */
+void ServerSnapshotBenchmark::TransportSender::sendPacket(
+                                                   STKPeer *peer,
+                                                   const NetworkString &packet,
+                                                   bool reliable)
+{
+    std::map<const STKPeer*, int>::const_iterator it =
+        m_test->m_endpoints.find(peer);
+    assert(it!=m_test->m_endpoints.end());
+    m_test->m_transport->send(m_from, it->second, packet, m_test->m_time);
+}   // TransportSender::sendPacket
+
+// ----------------------------------------------------------------------------
+/** Reads all packets that have arrived at an endpoint, and splits batches
+ *  into their messages (like ProtocolManager::notifyEvent()).
+ *  \param endpoint The receiving endpoint.
+ *  \param senders The endpoint that sent each message is appended to this
+ *         vector.
+ *  \param messages The messages (starting with their protocol type) are
+ *         appended to this vector.
+ */
+void ServerSnapshotBenchmark::receiveMessages(
+                                          int endpoint,
+                                          std::vector<int> *senders,
+                                          std::vector<NetworkString> *messages)
+{
+    int from;
+    NetworkString packet;
+    while(m_transport->receive(endpoint, m_time, &from, &packet))
+    {
+        if(packet.size()<1)
+            m_invalid_messages++;
+        else if(packet.getUInt8(0)!=PROTOCOL_BATCH)
+            messages->push_back(packet);
+        else if(!MessageBatch::split(packet, messages))
+            m_invalid_messages++;
+        senders->resize(messages->size(), from);
+    }
+}   // receiveMessages
+
+// ----------------------------------------------------------------------------
+/** Adds the protocol type to a message and queues it (like
+ *  ProtocolManager::sendMessage()). All messages are unreliable.
+ */
+void ServerSnapshotBenchmark::queueMessage(MessageQueue *queue, STKPeer *peer,
+                                           PROTOCOL_TYPE type,
+                                           const NetworkString &message)
+{
+    NetworkString ns(message);
+    ns.prependUInt8(type);
+    queue->queue(peer, ns, false);
+}   // queueMessage
+
+// ----------------------------------------------------------------------------
+/** Sends the messages of a queue, and counts them. */
+void ServerSnapshotBenchmark::flush(MessageQueue *queue,
+                                    const std::vector<STKPeer*> &peers)
+{
+    queue->flush(peers);
+    unsigned int messages, packets, dropped;
+    double bytes_saved;
+    queue->getAndResetStatistics(&messages, &packets, &bytes_saved,
+                                 &dropped);
+    m_messages_sent += messages;
+    m_packets_sent  += packets;
+}   // flush
+
+// ----------------------------------------------------------------------------
+/** Updates the world of the server, then lets the server and all clients
+ *  exchange their messages.
+ *  \param dt Time step size.
+ */
+void ServerSnapshotBenchmark::update(float dt)
+{
+    const double start = StkTime::getRealTime();
+    World::getWorld()->updateWorld(dt);
+    // At the end of a profile race the world, and with it this object,
+    // is deleted.
+    if(!m_server_snapshot_benchmark)
+        return;
+    const double world_end = StkTime::getRealTime();
+    m_world_time += world_end - start;
+
+    m_time += dt;
+    m_tick++;
+    int frequency = UserConfigParams::m_kart_update_frequency;
+    if(frequency < 1)
+        frequency = 1;
+    const bool send = m_time >= m_last_send_time + 1.0/frequency;
+    if(send)
+        m_last_send_time = m_time;
+
+    receiveServerMessages();
+    if(send)
+        sendSnapshots();
+    flush(m_server_queue, m_peers);
+    const double server_end = StkTime::getRealTime();
+    m_server_network_time += server_end - world_end;
+    m_tick_times.push_back((float)(server_end - start));
+
+    for(unsigned int i=0; i<m_clients.size(); i++)
+        updateClient(&m_clients[i], send);
+    m_client_time += StkTime::getRealTime() - server_end;
+}   // update
+
+// ----------------------------------------------------------------------------
+/** Server: handles the controller events and kart states sent by the
+ *  clients. The karts are driven by the AI of the server, so the events
+ *  are only relayed to the other clients, and of the kart states only the
+ *  acknowledgements are used.
+ */
+void ServerSnapshotBenchmark::receiveServerMessages()
+{
+    std::vector<int> senders;
+    std::vector<NetworkString> messages;
+    receiveMessages(m_server_endpoint, &senders, &messages);
+    for(unsigned int i=0; i<messages.size(); i++)
+    {
+        // The clients were created after the server, in order
+        const unsigned int index = senders[i] - m_server_endpoint - 1;
+        if(index>=m_clients.size())
+        {
+            m_invalid_messages++;
+            continue;
+        }
+        Client &client = m_clients[index];
+        NetworkString ns = messages[i];
+        const uint8_t type = ns.getUInt8(0);
+        ns.removeFront(1);
+        if(type==PROTOCOL_CONTROLLER_EVENTS)
+        {
+            uint32_t token, client_tick;
+            std::vector<ControllerEventsProtocol::Action> actions;
+            if(!ControllerEventsProtocol::readActions(ns, &token,
+                                                      &client_tick, &actions)
+               || token!=client.m_peer->getClientServerToken())
+                m_invalid_messages++;
+            else
+                relayControllerEvents(index, ns);
+            continue;
+        }
+        uint16_t ack;
+        uint32_t kart;
+        KartSnapshot::KartState state;
+        if(type!=PROTOCOL_KART_UPDATE ||
+           !KartUpdateProtocol::readClientState(*m_codec, ns, &ack, &kart,
+                                                &state))
+        {
+            m_invalid_messages++;
+            continue;
+        }
+        if(ack!=KartSnapshot::NO_SEQUENCE &&
+           (client.m_acked==KartSnapshot::NO_SEQUENCE ||
+            KartSnapshot::isNewer(ack, client.m_acked)))
+            client.m_acked = ack;
+    }
+}   // receiveServerMessages
+
+// ----------------------------------------------------------------------------
+/** Server: sends the state of the karts to each client, delta compressed
+ *  against the last snapshot the client acknowledged, and with interest
+ *  management if it is enabled (see KartRelevance::prepareSnapshot()).
+ */
+void ServerSnapshotBenchmark::sendSnapshots()
+{
+    World *world = World::getWorld();
+    KartSnapshot snapshot;
+    snapshot.m_sequence = m_next_sequence;
+    snapshot.m_karts.resize(world->getNumKarts());
+    for(unsigned int i=0; i<world->getNumKarts(); i++)
+    {
+        const AbstractKart *kart = world->getKart(i);
+        m_codec->quantise(kart->getXYZ(), kart->getRotation(),
+                          &snapshot.m_karts[i]);
+    }
+
+    m_relevance.update();
+
+    for(unsigned int i=0; i<m_clients.size(); i++)
+    {
+        Client &client = m_clients[i];
+        const KartSnapshot *baseline;
+        unsigned int num_sent;
+        const KartSnapshot &view =
+            m_relevance.prepareSnapshot(snapshot, client.m_acked,
+                                        client.m_kart, &client.m_sent,
+                                        &baseline, &num_sent);
+        m_kart_states_sent  += num_sent;
+        m_kart_states_total += (unsigned int)snapshot.m_karts.size();
+
+        // The clients do not simulate, so their tick is the server tick
+        const btRigidBody *body = world->getKart(client.m_kart)->getBody();
+        NetworkString ns;
+        KartUpdateProtocol::writeServerSnapshot(*m_codec, view, baseline,
+                                                m_tick, m_tick, client.m_kart,
+                                                body, &ns);
+        queueMessage(m_server_queue, client.m_peer, PROTOCOL_KART_UPDATE, ns);
+        m_snapshot_bytes              += ns.size();
+        m_snapshot_bytes_uncompressed += 4 + 32*snapshot.m_karts.size();
+    }
+    m_snapshots_sent++;
+
+    m_next_sequence++;
+    if(m_next_sequence==KartSnapshot::NO_SEQUENCE)
+        m_next_sequence = 0;
+}   // sendSnapshots
+
+// ----------------------------------------------------------------------------
+/** Client: reads the snapshots that have arrived, sends the controller
+ *  events for all controls of its kart that changed, and sends its kart
+ *  state with the acknowledgement.
+ *  \param client The client.
+ *  \param send_state True if the kart state should be sent.
+ */
+void ServerSnapshotBenchmark::updateClient(Client *client, bool send_state)
+{
+    std::vector<int> senders;
+    std::vector<NetworkString> messages;
+    receiveMessages(client->m_endpoint, &senders, &messages);
+    for(unsigned int i=0; i<messages.size(); i++)
+    {
+        NetworkString ns = messages[i];
+        const uint8_t type = ns.getUInt8(0);
+        ns.removeFront(1);
+        if(type==PROTOCOL_KART_UPDATE)
+            receiveSnapshot(client, ns);
+        else if(type==PROTOCOL_CONTROLLER_EVENTS)
+            receiveControllerEvents(client, ns);
+        else
+            m_invalid_messages++;
+    }
+
+    const AbstractKart *kart = World::getWorld()->getKart(client->m_kart);
+    const KartControl &controls = kart->getControls();
+    KartControl &sent = client->m_controls;
+    // Steering and acceleration are sent as analog values in [0, 32767]
+    const int left      = (int)(std::max(0.0f, -controls.m_steer)*32767);
+    const int sent_left = (int)(std::max(0.0f, -sent.m_steer)*32767);
+    if(left!=sent_left)
+        sendControllerEvent(client, PA_STEER_LEFT, left);
+    const int right      = (int)(std::max(0.0f, controls.m_steer)*32767);
+    const int sent_right = (int)(std::max(0.0f, sent.m_steer)*32767);
+    if(right!=sent_right)
+        sendControllerEvent(client, PA_STEER_RIGHT, right);
+    if((int)(controls.m_accel*32767)!=(int)(sent.m_accel*32767))
+        sendControllerEvent(client, PA_ACCEL, (int)(controls.m_accel*32767));
+    if(controls.m_brake!=sent.m_brake)
+        sendControllerEvent(client, PA_BRAKE, controls.m_brake ? 32767 : 0);
+    if(controls.m_nitro!=sent.m_nitro)
+        sendControllerEvent(client, PA_NITRO, controls.m_nitro ? 32767 : 0);
+    if((controls.m_skid!=KartControl::SC_NONE) !=
+       (sent.m_skid!=KartControl::SC_NONE))
+        sendControllerEvent(client, PA_DRIFT,
+                            controls.m_skid!=KartControl::SC_NONE ? 32767 : 0);
+    if(controls.m_rescue!=sent.m_rescue)
+        sendControllerEvent(client, PA_RESCUE, controls.m_rescue ? 32767 : 0);
+    if(controls.m_fire!=sent.m_fire)
+        sendControllerEvent(client, PA_FIRE, controls.m_fire ? 32767 : 0);
+    if(controls.m_look_back!=sent.m_look_back)
+        sendControllerEvent(client, PA_LOOK_BACK,
+                            controls.m_look_back ? 32767 : 0);
+    sent = controls;
+
+    if(send_state)
+    {
+        KartSnapshot::KartState state;
+        m_codec->quantise(kart->getXYZ(), kart->getRotation(), &state);
+        NetworkString message;
+        KartUpdateProtocol::writeClientState(*m_codec,
+                                             client->m_last_received,
+                                             (float)m_time,
+                                             (uint8_t)client->m_kart, state,
+                                             &message);
+        queueMessage(client->m_queue, m_server_peer, PROTOCOL_KART_UPDATE,
+                     message);
+    }
+    flush(client->m_queue, std::vector<STKPeer*>(1, m_server_peer));
+}   // updateClient
+
+// ----------------------------------------------------------------------------
+/** Client: decodes a snapshot (see KartUpdateProtocol) and keeps it as
+ *  baseline for the following snapshots.
+ */
+void ServerSnapshotBenchmark::receiveSnapshot(Client *client,
+                                              const NetworkString &ns)
+{
+    client->m_snapshots_received++;
+    KartUpdateProtocol::ServerSnapshot received;
+    if(KartUpdateProtocol::readServerSnapshot(*m_codec, ns,
+                                              client->m_snapshots,
+                                              client->m_last_received,
+                                              &received)
+        != KartUpdateProtocol::SNAPSHOT_OK)
+    {
+        client->m_snapshots_discarded++;
+        return;
+    }
+    const uint16_t sequence = received.m_snapshot.m_sequence;
+    client->m_snapshots[sequence % SNAPSHOT_HISTORY] = received.m_snapshot;
+    client->m_last_received = sequence;
+}   // receiveSnapshot
+
+// ----------------------------------------------------------------------------
+/** Server: sends the controller events of a client to all other clients,
+ *  with the token of the receiver in front of the actions (like
+ *  ControllerEventsProtocol::notifyEventAsynchronous()).
+ *  \param sender Index of the client that sent the events.
+ *  \param ns The message (without the protocol type).
+ */
+void ServerSnapshotBenchmark::relayControllerEvents(unsigned int sender,
+                                                    const NetworkString &ns)
+{
+    NetworkString actions = ns;
+    actions.removeFront(4);
+    for(unsigned int i=0; i<m_clients.size(); i++)
+    {
+        if(i==sender)
+            continue;
+        NetworkString relayed;
+        relayed.ai32(m_clients[i].m_peer->getClientServerToken());
+        relayed += actions;
+        queueMessage(m_server_queue, m_clients[i].m_peer,
+                     PROTOCOL_CONTROLLER_EVENTS, relayed);
+        m_events_relayed++;
+    }
+}   // relayControllerEvents
+
+// ----------------------------------------------------------------------------
+/** Client: checks the controller events of another client relayed by the
+ *  server. The karts are driven by the AI, so the events are not applied.
+ */
+void ServerSnapshotBenchmark::receiveControllerEvents(Client *client,
+                                                      const NetworkString &ns)
+{
+    uint32_t token, client_tick;
+    std::vector<ControllerEventsProtocol::Action> actions;
+    if(!ControllerEventsProtocol::readActions(ns, &token, &client_tick,
+                                              &actions)
+       || token!=client->m_peer->getClientServerToken())
+    {
+        m_invalid_messages++;
+        return;
+    }
+    m_events_received++;
+}   // receiveControllerEvents
+
+// ----------------------------------------------------------------------------
+/** Client: sends a controller event (see ControllerEventsProtocol). */
+void ServerSnapshotBenchmark::sendControllerEvent(Client *client,
+                                                  PlayerAction action,
+                                                  int value)
+{
+    const AbstractKart *kart = World::getWorld()->getKart(client->m_kart);
+    NetworkString ns;
+    ControllerEventsProtocol::writeAction(
+        client->m_peer->getClientServerToken(), m_tick,
+        (uint8_t)client->m_kart, kart->getControls(), action, value, &ns);
+    queueMessage(client->m_queue, m_server_peer, PROTOCOL_CONTROLLER_EVENTS,
+                 ns);
+    m_events_sent++;
+}   // sendControllerEvent
+
+// ----------------------------------------------------------------------------
+/** Prints the time used per server tick, and the bandwidth used per client
+ *  (payload only, without the headers of ENet, UDP and IP). Only the kart
+ *  updates and controller events are measured, not the path through
+ *  STKHost and the ProtocolManager.
+ */
+void ServerSnapshotBenchmark::printReport() const
+{
+    if(m_tick_times.empty() || m_clients.empty() || m_time<=0)
+        return;
+    std::vector<float> times = m_tick_times;
+    std::sort(times.begin(), times.end());
+    const unsigned int n = (unsigned int)times.size();
+    Log::verbose("profile", "Server snapshot benchmark (kart updates and "
+                 "controller events only, simulated clients, without "
+                 "STKHost and the ProtocolManager): "
+                 "%u clients, %u ticks.", m_num_clients, n);
+    Log::verbose("profile", "%u snapshots, %u controller events, %u "
+                 "relayed, %u received.", m_snapshots_sent, m_events_sent,
+                 m_events_relayed, m_events_received);
+    Log::verbose("profile", "Server tick: %f ms average (world %f ms, "
+                 "network %f ms), median %f ms, 99%% %f ms, max %f ms",
+                 1000.0*(m_world_time+m_server_network_time)/n,
+                 1000.0*m_world_time/n, 1000.0*m_server_network_time/n,
+                 1000.0f*times[n/2], 1000.0f*times[(n*99)/100],
+                 1000.0f*times[n-1]);
+    Log::verbose("profile", "Clients: %f ms per tick for all clients.",
+                 1000.0*m_client_time/n);
+
+    uint64_t down = 0, up = 0;
+    unsigned int sent = 0, dropped = 0, received = 0, discarded = 0;
+    for(unsigned int i=0; i<m_clients.size(); i++)
+    {
+        const Client &client = m_clients[i];
+        const Transport::Statistics s =
+            m_transport->getStatistics(client.m_endpoint);
+        down      += s.m_bytes_received;
+        up        += s.m_bytes_sent;
+        sent      += s.m_packets_sent;
+        dropped   += s.m_packets_dropped;
+        received  += client.m_snapshots_received;
+        discarded += client.m_snapshots_discarded;
+    }
+    const Transport::Statistics server =
+        m_transport->getStatistics(m_server_endpoint);
+    const double per_client = 1.0/(m_clients.size()*m_time);
+    Log::verbose("profile", "Bandwidth per client: down %f bytes/s, "
+                 "up %f bytes/s; server upload %f bytes/s",
+                 down*per_client, up*per_client,
+                 server.m_bytes_sent/m_time);
+    Log::verbose("profile", "%u messages sent in %u packets.",
+                 m_messages_sent, m_packets_sent);
+    Log::verbose("profile", "Packets dropped: server %u of %u, clients %u "
+                 "of %u; snapshots received %u, discarded %u; %u invalid "
+                 "messages.", server.m_packets_dropped,
+                 server.m_packets_sent, dropped, sent, received, discarded,
+                 m_invalid_messages);
+    if(m_snapshots_sent>0)
+    {
+        const float per_snapshot = 1.0f/(m_snapshots_sent*m_clients.size());
+        Log::verbose("profile", "Snapshots: %f bytes per client and update, "
+                     "%f without quantisation and delta compression.",
+                     m_snapshot_bytes*per_snapshot,
+                     m_snapshot_bytes_uncompressed*per_snapshot);
+    }
+    if(m_kart_states_total>0)
+    {
+        Log::verbose("profile", "Kart states: %u of %u sent (%f%%), "
+                     "interest management %s, budget %d bytes/s.",
+                     m_kart_states_sent, m_kart_states_total,
+                     100.0f*m_kart_states_sent/m_kart_states_total,
+                     UserConfigParams::m_network_interest_management
+                         ? "on" : "off",
+                     (int)UserConfigParams::m_network_client_bandwidth);
+    }
+}   // printReport
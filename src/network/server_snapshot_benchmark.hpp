@@ -0,0 +1,240 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+/*! \file server_snapshot_benchmark.hpp
+ *  \brief Measures the server side cost of the kart snapshots for many
+ *         simulated clients.
+ */
+
+#ifndef HEADER_SERVER_SNAPSHOT_BENCHMARK_HPP
+#define HEADER_SERVER_SNAPSHOT_BENCHMARK_HPP
+
+#include "input/input.hpp"
+#include "karts/controller/kart_control.hpp"
+#include "network/kart_relevance.hpp"
+#include "network/kart_snapshot.hpp"
+#include "network/message_batch.hpp"
+#include "network/protocol.hpp"
+#include "network/transport.hpp"
+#include "utils/no_copy.hpp"
+#include "utils/types.hpp"
+
+#include <map>
+#include <vector>
+
+class NetworkString;
+class STKPeer;
+
+/** \brief Runs a race as a server that sends kart snapshots to N simulated
+ *  clients, and reports the time used per server tick and the bandwidth
+ *  used per client.
+ *  This is not an end-to-end load test of the network code: the clients
+ *  are message emitters that are driven by the AI of the server's world,
+ *  not instances of the game. They do not run STKHost, a ProtocolManager,
+ *  a world or rewinding of their own, so the client side cost and the
+ *  effect of network conditions on the game play are not measured.
+ *  The race is a profile race (with AI karts only and without graphics).
+ *  The world is the world of the server: after each world update the
+ *  server reads the messages of the clients and sends the snapshots. Each
+ *  client owns one kart (if there are more clients than karts, a kart is
+ *  shared), and sends the controller events of the AI that drives this
+ *  kart, and its kart state and acknowledgement. The server relays the
+ *  controller events to all other clients, like ControllerEventsProtocol.
+ *  The clients decode the snapshots and check the relayed events, but do
+ *  not simulate a world of their own.
+ *  The messages are written and read with the functions of
+ *  KartUpdateProtocol and ControllerEventsProtocol, the snapshot for each
+ *  client is prepared by KartRelevance, and the messages are batched by a
+ *  MessageQueue (like in the ProtocolManager) whose packets are sent
+ *  through a LoopbackTransport. The transport is driven by the simulated
+ *  time of the race, so a run with the same seed and the same network
+ *  conditions is repeatable.
+ *  The messages do not go through STKHost and the ProtocolManager (their
+ *  threads, event queues and the other protocols), so the report only
+ *  covers the kart updates and controller events, and the server tick
+ *  time does not include the work of the network threads.
+ *  \ingroup network
+ */
+class ServerSnapshotBenchmark : public NoCopy
+{
+private:
+    static ServerSnapshotBenchmark *m_server_snapshot_benchmark;
+
+    /** Number of clients, 0 if the benchmark is disabled. */
+    static unsigned int     m_num_clients;
+
+    /** The conditions of all links between server and clients. */
+    static NetworkConditions m_conditions;
+
+    /** Number of snapshots kept as possible baselines. */
+    static const unsigned int SNAPSHOT_HISTORY =
+        KartRelevance::SNAPSHOT_HISTORY;
+
+    /** Sends the packets of a MessageQueue through the transport. */
+    class TransportSender : public MessageQueue::PacketSender
+    {
+    private:
+        ServerSnapshotBenchmark *m_test;
+        /** The endpoint that sends. */
+        int              m_from;
+    public:
+        TransportSender(ServerSnapshotBenchmark *test, int from)
+            : m_test(test), m_from(from) {}
+        virtual void sendPacket(STKPeer *peer, const NetworkString &packet,
+                                bool reliable);
+    };   // TransportSender
+
+    /** A simulated client. */
+    struct Client
+    {
+        /** The endpoint of the client in the transport. */
+        int          m_endpoint;
+        /** The kart of this client. */
+        unsigned int m_kart;
+        /** The peer of this client on the server, which has the token that
+         *  identifies the client in its controller events. */
+        STKPeer     *m_peer;
+        /** The messages of this client to the server. */
+        TransportSender *m_sender;
+        MessageQueue    *m_queue;
+        /** The snapshots received, indexed by sequence number modulo
+         *  SNAPSHOT_HISTORY. */
+        KartSnapshot m_snapshots[SNAPSHOT_HISTORY];
+        /** The last snapshot received. */
+        uint16_t     m_last_received;
+        /** Server: the last snapshot this client acknowledged. */
+        uint16_t     m_acked;
+        /** Server: the snapshots sent to this client, and the priorities
+         *  of the karts for it. */
+        KartRelevance::ClientView m_sent;
+        /** The controls of the kart when they were last sent. */
+        KartControl  m_controls;
+        /** Number of snapshots received, and of those that could not be
+         *  used (out of order, or the baseline was missing). */
+        unsigned int m_snapshots_received;
+        unsigned int m_snapshots_discarded;
+    };   // Client
+
+    std::vector<Client>  m_clients;
+
+    /** The simulated network. */
+    Transport           *m_transport;
+
+    /** The endpoint of the server, the peer that represents the server
+     *  on the clients, and the messages of the server to the clients. */
+    int                  m_server_endpoint;
+    STKPeer             *m_server_peer;
+    TransportSender     *m_server_sender;
+    MessageQueue        *m_server_queue;
+
+    /** The peers of the clients on the server, and the endpoint of each
+     *  peer (including the server peer). */
+    std::vector<STKPeer*>         m_peers;
+    std::map<const STKPeer*, int> m_endpoints;
+
+    /** Quantises kart states relative to the track bounds. */
+    KartSnapshotCodec   *m_codec;
+
+    /** Ranks the karts for each client (with interest management). */
+    KartRelevance        m_relevance;
+
+    /** Sequence number of the next snapshot. */
+    uint16_t             m_next_sequence;
+
+    /** The simulated time, and the number of ticks. */
+    double               m_time;
+    uint32_t             m_tick;
+
+    /** Simulated time at which the last messages were sent. */
+    double               m_last_send_time;
+
+    /** Real time used per server tick (world update and networking). */
+    std::vector<float>   m_tick_times;
+
+    /** Total real time used by the server for the world updates and for
+     *  the networking, and by all clients. */
+    double               m_world_time;
+    double               m_server_network_time;
+    double               m_client_time;
+
+    /** Number of snapshots and controller events sent, and the number of
+     *  controller events relayed by the server and received by clients. */
+    unsigned int         m_snapshots_sent;
+    unsigned int         m_events_sent;
+    unsigned int         m_events_relayed;
+    unsigned int         m_events_received;
+
+    /** Bytes of all snapshots sent, and the bytes they would have used
+     *  without quantisation and delta compression (4 bytes for the time,
+     *  and a 4 byte kart id and seven floats per kart). */
+    uint64_t             m_snapshot_bytes;
+    uint64_t             m_snapshot_bytes_uncompressed;
+
+    /** Number of kart states sent to all clients, and the number that
+     *  would have been sent without interest management. */
+    unsigned int         m_kart_states_sent;
+    unsigned int         m_kart_states_total;
+
+    /** Number of messages received by the server or the clients that
+     *  could not be parsed. */
+    unsigned int         m_invalid_messages;
+
+    /** Number of messages sent by all queues, and of packets they were
+     *  sent in. */
+    unsigned int         m_messages_sent;
+    unsigned int         m_packets_sent;
+
+         ServerSnapshotBenchmark();
+        ~ServerSnapshotBenchmark();
+    void receiveMessages(int endpoint, std::vector<int> *senders,
+                         std::vector<NetworkString> *messages);
+    void queueMessage(MessageQueue *queue, STKPeer *peer, PROTOCOL_TYPE type,
+                      const NetworkString &message);
+    void flush(MessageQueue *queue, const std::vector<STKPeer*> &peers);
+    void receiveServerMessages();
+    void sendSnapshots();
+    void updateClient(Client *client, bool send_state);
+    void receiveSnapshot(Client *client, const NetworkString &ns);
+    void relayControllerEvents(unsigned int sender, const NetworkString &ns);
+    void receiveControllerEvents(Client *client, const NetworkString &ns);
+    void sendControllerEvent(Client *client, PlayerAction action, int value);
+
+public:
+    static void create();
+    static void destroy();
+    void        update(float dt);
+    void        printReport() const;
+    // ------------------------------------------------------------------------
+    /** Returns the benchmark, or NULL if it is not running. */
+    static ServerSnapshotBenchmark *get()
+    {
+        return m_server_snapshot_benchmark;
+    }   // get
+    // ------------------------------------------------------------------------
+    /** Sets the number of clients, 0 disables the benchmark. */
+    static void setNumClients(unsigned int n) { m_num_clients = n; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of clients, 0 if the benchmark is disabled. */
+    static unsigned int getNumClients() { return m_num_clients; }
+    // ------------------------------------------------------------------------
+    /** Returns the network conditions, so that they can be changed before
+     *  the benchmark is created. */
+    static NetworkConditions &getConditions() { return m_conditions; }
+};   // ServerSnapshotBenchmark
+
+#endif
@@ -327,7 +327,7 @@ uint8_t* STKHost::receiveRawPacket(TransportAddress sender, int max_tries)
 
 void STKHost::broadcastPacket(const NetworkString& data, bool reliable)
 {
-    ENetPacket* packet = enet_packet_create(data.getBytes(), data.size() + 1,
+    ENetPacket* packet = data.createPacket(
                (reliable ? ENET_PACKET_FLAG_RELIABLE : ENET_PACKET_FLAG_UNSEQUENCED));
     enet_host_broadcast(m_host, 0, packet);
     STKHost::logPacket(data, false);
@@ -0,0 +1,94 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+/*! \file transport.hpp
+ *  \brief Interface for sending packets between network endpoints.
+ */
+
+#ifndef HEADER_TRANSPORT_HPP
+#define HEADER_TRANSPORT_HPP
+
+#include "utils/no_copy.hpp"
+#include "utils/types.hpp"
+
+class NetworkString;
+
+/** \brief The conditions of a simulated network link.
+ *  \ingroup network
+ */
+struct NetworkConditions
+{
+    /** One way latency in seconds. */
+    float m_latency;
+    /** Maximum random delay (in s) added to the latency of each packet. */
+    float m_jitter;
+    /** Probability (0 to 1) that a packet is lost. */
+    float m_loss;
+    /** Probability (0 to 1) that a packet is held back by a random delay
+     *  (up to the jitter, but at least 50 ms), so that later packets can
+     *  overtake it. */
+    float m_reorder;
+    /** Bandwidth of the link in bytes per second, 0 for unlimited. */
+    float m_bandwidth;
+
+    NetworkConditions() : m_latency(0), m_jitter(0), m_loss(0),
+                          m_reorder(0), m_bandwidth(0) {}
+};   // NetworkConditions
+
+// ============================================================================
+/** \brief Abstract interface to send unreliable packets between endpoints.
+ *  The time is passed in explicitly, so that a transport can be driven by
+ *  a simulated clock, which makes tests repeatable.
+ *  It is used by the ServerSnapshotBenchmark only: STKHost sends and
+ *  receives its packets directly with ENet.
+ *  \ingroup network
+ */
+class Transport : public NoCopy
+{
+public:
+    /** Traffic counters of one endpoint. */
+    struct Statistics
+    {
+        uint64_t     m_bytes_sent;
+        uint64_t     m_bytes_received;
+        unsigned int m_packets_sent;
+        unsigned int m_packets_received;
+        /** Packets sent by this endpoint that were dropped (lost, or
+         *  because the bandwidth of the link was exceeded). */
+        unsigned int m_packets_dropped;
+
+        Statistics() : m_bytes_sent(0), m_bytes_received(0),
+                       m_packets_sent(0), m_packets_received(0),
+                       m_packets_dropped(0) {}
+    };   // Statistics
+
+    virtual ~Transport() {}
+    /** Creates a new endpoint and returns its id. */
+    virtual int  addEndpoint() = 0;
+    /** Sends a packet from one endpoint to another at the given time. */
+    virtual void send(int from, int to, const NetworkString &data,
+                      double now) = 0;
+    /** Returns the next packet that has arrived at an endpoint by the
+     *  given time. Returns false if there is none. */
+    virtual bool receive(int to, double now, int *from,
+                         NetworkString *data) = 0;
+    /** Returns the traffic counters of an endpoint. */
+    virtual Statistics getStatistics(int endpoint) const = 0;
+};   // Transport
+
+#endif
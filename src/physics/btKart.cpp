@@ -29,14 +29,15 @@
 
 btRigidBody& btKart::getFixedBody()
 {
+    // A mass of 0 makes this a static body. Note that the mass properties
+    // are not set again on each call, since this is called from several
+    // threads when the wheel raycasts are done in parallel.
     static btRigidBody s_fixed(0, 0,0);
-    s_fixed.setMassProps(btScalar(0.),btVector3(btScalar(0.),
-                         btScalar(0.),btScalar(0.)));
     return s_fixed;
 }
 
 // ============================================================================
-btKart::btKart(btRigidBody* chassis, btVehicleRaycaster* raycaster,
+btKart::btKart(btRigidBody* chassis, btKartRaycaster* raycaster,
                Kart *kart)
       : m_vehicleRaycaster(raycaster)
 {
@@ -113,6 +114,7 @@ void btKart::reset()
         updateWheelTransform(i, true);
     }
     m_visual_wheels_touch_ground = false;
+    m_wheel_raycasts_done        = false;
     m_zipper_active              = false;
     m_zipper_velocity            = btScalar(0);
     m_skid_angular_velocity      = 0;
@@ -220,16 +222,9 @@ btScalar btKart::rayCast(unsigned int index)
 
     // Work around a bullet problem: when using a convex hull the raycast
     // would sometimes hit the chassis (which does not happen when using a
-    // box shape). Therefore set the collision mask in the chassis body so
-    // that it is not hit anymore.
-    short int old_group=0;
-    if(m_chassisBody->getBroadphaseHandle())
-    {
-        old_group = m_chassisBody->getBroadphaseHandle()
-                                 ->m_collisionFilterGroup;
-        m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup = 0;
-    }
-
+    // box shape). Therefore the chassis is ignored by the raycasts (which,
+    // unlike changing the collision group of the chassis, does not affect
+    // the raycasts of other karts done at the same time).
     updateWheelTransformsWS( wheel,false);
 
     btScalar max_susp_len = wheel.getSuspensionRestLength()+wheel.m_wheelsRadius
@@ -249,7 +244,8 @@ btScalar btKart::rayCast(unsigned int index)
 
     btAssert(m_vehicleRaycaster);
 
-    void* object = m_vehicleRaycaster->castRay(source,target,rayResults);
+    void* object = m_vehicleRaycaster->castRay(source, target, rayResults,
+                                               m_chassisBody);
 
     wheel.m_raycastInfo.m_groundObject = 0;
 
@@ -336,20 +332,14 @@ btScalar btKart::rayCast(unsigned int index)
         btVector3 target = source + rayvector;
         btVehicleRaycaster::btVehicleRaycasterResult rayResults;
 
-        void* object = m_vehicleRaycaster->castRay(source,target,rayResults);
+        void* object = m_vehicleRaycaster->castRay(source, target, rayResults,
+                                                   m_chassisBody);
         m_visual_contact_point[index] = rayResults.m_hitPointInWorld;
         m_visual_contact_point[index-2] = source;
         m_visual_wheels_touch_ground &= (object!=NULL);
     }
 #endif
 
-    if(m_chassisBody->getBroadphaseHandle())
-    {
-        m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup
-            = old_group;
-    }
-
-
     return depth;
 
 }   // rayCast
@@ -361,22 +351,18 @@ const btTransform& btKart::getChassisWorldTransform() const
 }   // getChassisWorldTransform
 
 // ----------------------------------------------------------------------------
-void btKart::updateVehicle( btScalar step )
+/** Updates the wheel transforms and does the raycast for each wheel. This
+ *  only reads the physics world (and only modifies this kart), so it can be
+ *  called for all karts in parallel before updateVehicle is called for
+ *  each kart.
+ */
+void btKart::updateWheelRaycasts()
 {
     for (int i=0;i<getNumWheels();i++)
     {
         updateWheelTransform(i,false);
     }
 
-    const btTransform& chassisTrans = getChassisWorldTransform();
-
-    btVector3 forwardW(chassisTrans.getBasis()[0][m_indexForwardAxis],
-                       chassisTrans.getBasis()[1][m_indexForwardAxis],
-                       chassisTrans.getBasis()[2][m_indexForwardAxis]);
-
-    // Simulate suspension
-    // -------------------
-
     m_num_wheels_on_ground       = 0;
     m_visual_wheels_touch_ground = true;
     for (int i=0;i<m_wheelInfo.size();i++)
@@ -385,6 +371,23 @@ void btKart::updateVehicle( btScalar step )
         if(m_wheelInfo[i].m_raycastInfo.m_isInContact)
             m_num_wheels_on_ground++;
     }
+    m_wheel_raycasts_done = true;
+}   // updateWheelRaycasts
+
+// ----------------------------------------------------------------------------
+void btKart::updateVehicle( btScalar step )
+{
+    // Simulate suspension
+    // -------------------
+    if(!m_wheel_raycasts_done)
+        updateWheelRaycasts();
+    m_wheel_raycasts_done = false;
+
+    const btTransform& chassisTrans = getChassisWorldTransform();
+
+    btVector3 forwardW(chassisTrans.getBasis()[0][m_indexForwardAxis],
+                       chassisTrans.getBasis()[1][m_indexForwardAxis],
+                       chassisTrans.getBasis()[2][m_indexForwardAxis]);
 
     // Test if the kart is falling so fast 
     // that the chassis might hit the track
@@ -67,7 +67,11 @@ private:
     btScalar calcRollingFriction(btWheelContactPoint& contactPoint);
 
     btScalar            m_damping;
-    btVehicleRaycaster *m_vehicleRaycaster;
+    btKartRaycaster    *m_vehicleRaycaster;
+
+    /** True if the wheel raycasts for the next call of updateVehicle were
+     *  already done by updateWheelRaycasts. */
+    bool                m_wheel_raycasts_done;
 
     /** True if a zipper is active for that kart. */
     bool                m_zipper_active;
@@ -147,13 +151,14 @@ public:
      *         (this is used to get access to the kart properties).
      */
                        btKart(btRigidBody* chassis,
-                              btVehicleRaycaster* raycaster,
+                              btKartRaycaster* raycaster,
                               Kart *kart);
      virtual          ~btKart();
     void               reset();
     void               debugDraw(btIDebugDraw* debugDrawer);
     const btTransform& getChassisWorldTransform() const;
     btScalar           rayCast(unsigned int index);
+    void               updateWheelRaycasts();
     virtual void       updateVehicle(btScalar step);
     void               resetSuspension();
     btScalar           getSteeringValue(int wheel) const;
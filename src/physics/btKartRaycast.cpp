@@ -19,23 +19,41 @@
 #include "physics/triangle_mesh.hpp"
 #include "tracks/track.hpp"
 
+/** Casts a ray and returns the object hit (or NULL if nothing was hit).
+ *  \param ignore An object that is not hit by the ray (e.g. the chassis of
+ *         the kart itself), or NULL.
+ */
 void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
-                               btVehicleRaycasterResult& result)
+                               btVehicleRaycasterResult& result,
+                               const btCollisionObject *ignore)
 {
     // ========================================================================
     class ClosestWithNormal : public btCollisionWorld::ClosestRayResultCallback
     {
     private:
         int m_triangle_index;
+
+        /** An object that is not hit by the ray. */
+        const btCollisionObject *m_ignore;
     public:
         /** Constructor, initialises the triangle index. */
         ClosestWithNormal(const btVector3 &from,
-                          const btVector3 &to)
+                          const btVector3 &to,
+                          const btCollisionObject *ignore)
                           : btCollisionWorld::ClosestRayResultCallback(from,to)
         {
             m_triangle_index = -1;
+            m_ignore         = ignore;
         }   // CloestWithNormal
         // --------------------------------------------------------------------
+        /** Skips the ignored object. */
+        virtual bool needsCollision(btBroadphaseProxy* proxy) const
+        {
+            if(proxy->m_clientObject==m_ignore) return false;
+            return btCollisionWorld::ClosestRayResultCallback
+                                   ::needsCollision(proxy);
+        }   // needsCollision
+        // --------------------------------------------------------------------
         /** Stores the index of the triangle hit. */
         virtual    btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
                                          bool normalInWorldSpace)
@@ -57,7 +75,7 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
     };   // CloestWithNormal
     // ========================================================================
 
-    ClosestWithNormal rayCallback(from,to);
+    ClosestWithNormal rayCallback(from, to, ignore);
 
     m_dynamicsWorld->rayTest(from, to, rayCallback);
 
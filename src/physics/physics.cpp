@@ -22,6 +22,7 @@
 #include "animations/three_d_animation.hpp"
 #include "config/player_manager.hpp"
 #include "config/player_profile.hpp"
+#include "config/user_config.hpp"
 #include "karts/abstract_kart.hpp"
 #include "graphics/irr_driver.hpp"
 #include "graphics/stars.hpp"
@@ -41,6 +42,9 @@
 #include "scriptengine/script_engine.hpp"
 #include "tracks/track.hpp"
 #include "utils/profiler.hpp"
+#include "utils/time.hpp"
+
+#include <algorithm>
 
 // ----------------------------------------------------------------------------
 /** Initialise physics.
@@ -49,7 +53,7 @@
 Physics::Physics() : btSequentialImpulseConstraintSolver()
 {
     m_collision_conf      = new btDefaultCollisionConfiguration();
-    m_dispatcher          = new btCollisionDispatcher(m_collision_conf);
+    m_dispatcher          = new STKCollisionDispatcher(m_collision_conf);
 }   // Physics
 
 //-----------------------------------------------------------------------------
@@ -66,6 +70,15 @@ void Physics::init(const Vec3 &world_min, const Vec3 &world_max)
                                                  this,
                                                  m_collision_conf);
     m_karts_to_delete.clear();
+    m_step_time           = 0;
+    m_num_updates         = 0;
+
+    // The number of threads can only be changed between races: the
+    // parallel dispatcher keeps the contact manifolds in a different order.
+    const int num_threads =
+        std::max(0, (int)UserConfigParams::m_physics_threads);
+    m_dispatcher->setNumThreads(num_threads);
+    m_dynamics_world->setNumThreads(num_threads);
     m_dynamics_world->setGravity(
         btVector3(0.0f,
                   -World::getWorld()->getTrack()->getGravity(),
@@ -151,7 +164,16 @@ void Physics::update(float dt)
 
     // Maximum of three substeps. This will work for framerate down to
     // 20 FPS (bullet default frequency is 60 HZ).
+    const double start = StkTime::getRealTime();
     m_dynamics_world->stepSimulation(dt, 3);
+    m_step_time += StkTime::getRealTime() - start;
+    m_num_updates++;
+
+    // Add the collisions that were found when ticks were re-simulated
+    // since the last update.
+    for(unsigned int i=0; i<m_rewind_collisions.size(); i++)
+        m_all_collisions.add(m_rewind_collisions[i]);
+    m_rewind_collisions.clear();
 
     // Now handle the actual collision. Note: flyables can not be removed
     // inside of this loop, since the same flyables might hit more than one
@@ -332,6 +354,49 @@ void Physics::update(float dt)
     PROFILER_POP_CPU_MARKER();
 }   // update
 
+//-----------------------------------------------------------------------------
+/** Updates the physics simulation by exactly one step of size dt, without
+ *  handling collisions. This is used to re-simulate a tick after a rewind
+ *  of the network game (see RewindManager). The collisions of the tick
+ *  that were already handled when it was first simulated are ignored, new
+ *  collisions are handled in the next update().
+ *  \param dt Time step (the tick length, which does not need to be the
+ *         internal step size of bullet).
+ *  \param known The collisions handled when the tick was first simulated
+ *         (see getCollisions()).
+ */
+void Physics::stepOnly(float dt, const CollisionIds &known)
+{
+    m_physics_loop_active = true;
+    m_all_collisions.clear();
+    m_dynamics_world->stepSimulation(dt, 1, dt);
+    for(unsigned int i=0; i<m_all_collisions.size(); i++)
+    {
+        const CollisionPair &p = m_all_collisions[i];
+        const std::pair<const UserPointer*, const UserPointer*>
+            id(p.getUserPointer(0), p.getUserPointer(1));
+        if(std::find(known.begin(), known.end(), id)==known.end())
+            m_rewind_collisions.add(p);
+    }
+    m_all_collisions.clear();
+    m_physics_loop_active = false;
+}   // stepOnly
+
+//-----------------------------------------------------------------------------
+/** Returns the objects of all collisions that were handled in the last
+ *  update (which are still stored till the next update).
+ *  \param ids On return the pairs of objects.
+ */
+void Physics::getCollisions(CollisionIds *ids) const
+{
+    ids->clear();
+    for(unsigned int i=0; i<m_all_collisions.size(); i++)
+    {
+        ids->push_back(std::make_pair(m_all_collisions[i].getUserPointer(0),
+                                      m_all_collisions[i].getUserPointer(1)));
+    }
+}   // getCollisions
+
 //-----------------------------------------------------------------------------
 /** Handles the special case of two karts colliding with each other, which
  *  means that bombs must be passed on. If both karts have a bomb, they'll
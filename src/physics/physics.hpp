@@ -30,6 +30,7 @@
 #include "btBulletDynamicsCommon.h"
 
 #include "physics/irr_debug_drawer.hpp"
+#include "physics/stk_collision_dispatcher.hpp"
 #include "physics/stk_dynamics_world.hpp"
 #include "physics/user_pointer.hpp"
 
@@ -120,6 +121,8 @@ private:
         {
             push_back(CollisionPair(a, contact_point_a, b, contact_point_b));
         }
+        /** Adds a collision pair (if it is not already in the list). */
+        void add(const CollisionPair &p) { push_back(p); }
     };  // CollisionList
     // ========================================================================
 
@@ -140,12 +143,27 @@ private:
 
     /** Used in physics debugging to draw the physics world. */
     IrrDebugDrawer                  *m_debug_drawer;
-    btCollisionDispatcher           *m_dispatcher;
+    STKCollisionDispatcher          *m_dispatcher;
     btBroadphaseInterface           *m_axis_sweep;
     btDefaultCollisionConfiguration *m_collision_conf;
     CollisionList                    m_all_collisions;
 
+    /** Collisions found while ticks were re-simulated after a rewind (see
+     *  stepOnly()), which are handled in the next update. */
+    CollisionList                    m_rewind_collisions;
+
+    /** Total time spent in stepSimulation (in seconds), used to compare the
+     *  serial and parallel physics in profile mode. */
+    double                           m_step_time;
+
+    /** Number of calls to update since init. */
+    int                              m_num_updates;
+
 public:
+    /** The objects of the collisions in one update (see getCollisions()). */
+    typedef std::vector<std::pair<const UserPointer*, const UserPointer*> >
+            CollisionIds;
+
           Physics          ();
          ~Physics          ();
     void  init             (const Vec3 &min_world, const Vec3 &max_world);
@@ -156,6 +174,8 @@ public:
     void  KartKartCollision(AbstractKart *ka, const Vec3 &contact_point_a,
                             AbstractKart *kb, const Vec3 &contact_point_b);
     void  update           (float dt);
+    void  stepOnly         (float dt, const CollisionIds &known);
+    void  getCollisions    (CollisionIds *ids) const;
     void  draw             ();
     STKDynamicsWorld*
           getPhysicsWorld  () const {return m_dynamics_world;}
@@ -166,6 +186,13 @@ public:
     /** Returns true if the debug drawer is enabled. */
     bool  isDebug() const     {return m_debug_drawer->debugEnabled(); }
     IrrDebugDrawer* getDebugDrawer() { return m_debug_drawer; }
+    /** Returns the total time spent in stepSimulation in seconds. */
+    double getStepTime() const { return m_step_time; }
+    /** Returns the number of physics updates since the race started. */
+    int   getNumUpdates() const { return m_num_updates; }
+    /** Returns the number of threads used for collision detection and
+     *  the wheel raycasts (0 if everything is done in the main thread). */
+    int   getNumThreads() const { return m_dispatcher->getNumThreads(); }
     virtual btScalar solveGroup(btCollisionObject** bodies, int numBodies,
                                 btPersistentManifold** manifold,int numManifolds,
                                 btTypedConstraint** constraints,int numConstraints,
@@ -0,0 +1,308 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "physics/stk_collision_dispatcher.hpp"
+
+#include "utils/job_system.hpp"
+
+#include "LinearMath/btPoolAllocator.h"
+
+#include <algorithm>
+
+extern int gNumManifold;
+
+// ----------------------------------------------------------------------------
+STKCollisionDispatcher::STKCollisionDispatcher(btCollisionConfiguration *config)
+                      : btCollisionDispatcher(config)
+{
+    m_num_threads = 0;
+    m_in_parallel = false;
+    m_pairs       = NULL;
+    m_info        = NULL;
+    pthread_mutex_init(&m_mutex, NULL);
+}   // STKCollisionDispatcher
+
+// ----------------------------------------------------------------------------
+STKCollisionDispatcher::~STKCollisionDispatcher()
+{
+    pthread_mutex_destroy(&m_mutex);
+}   // ~STKCollisionDispatcher
+
+// ----------------------------------------------------------------------------
+/** Returns true if all pairs with this object must be processed by the same
+ *  thread. This is the case for all dynamic objects (which are modified
+ *  while being tested) and for compound shapes (whose shape is temporarily
+ *  replaced by the child shape that is being tested).
+ */
+bool STKCollisionDispatcher::connectsPairs(const btCollisionObject *object)
+                                                                         const
+{
+    return !object->isStaticOrKinematicObject() ||
+           object->getCollisionShape()->isCompound();
+}   // connectsPairs
+
+// ----------------------------------------------------------------------------
+/** Returns the representative of the union-find set of n. */
+int STKCollisionDispatcher::findGroup(int n)
+{
+    while(m_parent[n]!=n)
+    {
+        m_parent[n] = m_parent[m_parent[n]];
+        n = m_parent[n];
+    }
+    return n;
+}   // findGroup
+
+// ----------------------------------------------------------------------------
+/** Sorts all pairs into groups, so that pairs that share an object that
+ *  connects pairs are in the same group. The groups are numbered in the
+ *  order in which they appear in the pair array, so the result only
+ *  depends on the pair array.
+ */
+void STKCollisionDispatcher::groupPairs(btBroadphasePairArray &pairs)
+{
+    const int num_pairs = pairs.size();
+    int max_id = 0;
+    for(int i=0; i<num_pairs; i++)
+    {
+        max_id = std::max(max_id, pairs[i].m_pProxy0->getUid());
+        max_id = std::max(max_id, pairs[i].m_pProxy1->getUid());
+    }
+    m_parent.resize(max_id+1);
+    for(int i=0; i<=max_id; i++)
+        m_parent[i] = i;
+
+    // Each pair is first assigned the id of an object that connects pairs
+    // (whose set is then the group of the pair). Pairs without such an
+    // object can be processed on their own and get a group of their own.
+    m_pair_group.resize(num_pairs);
+    for(int i=0; i<num_pairs; i++)
+    {
+        const btCollisionObject *obj0 =
+            (btCollisionObject*)pairs[i].m_pProxy0->m_clientObject;
+        const btCollisionObject *obj1 =
+            (btCollisionObject*)pairs[i].m_pProxy1->m_clientObject;
+        const bool c0 = connectsPairs(obj0);
+        const bool c1 = connectsPairs(obj1);
+        const int  id0 = pairs[i].m_pProxy0->getUid();
+        const int  id1 = pairs[i].m_pProxy1->getUid();
+        if(c0 && c1)
+        {
+            const int g0 = findGroup(id0);
+            const int g1 = findGroup(id1);
+            // Link to the smaller index to make the result independent
+            // of the order of the two objects in the pair.
+            if(g0<g1)
+                m_parent[g1] = g0;
+            else
+                m_parent[g0] = g1;
+        }
+        m_pair_group[i] = c0 ? id0 : (c1 ? id1 : -1);
+    }   // for i < num_pairs
+
+    // Number the groups in order of their first pair
+    std::vector<int> group_index(max_id+1, -1);
+    int num_groups = 0;
+    for(int i=0; i<num_pairs; i++)
+    {
+        if(m_pair_group[i]<0)
+        {
+            m_pair_group[i] = num_groups++;
+            continue;
+        }
+        const int root = findGroup(m_pair_group[i]);
+        if(group_index[root]<0)
+            group_index[root] = num_groups++;
+        m_pair_group[i] = group_index[root];
+    }
+
+    // Counting sort of the pairs by group, which keeps the original order
+    // of the pairs within each group.
+    m_group_start.assign(num_groups+1, 0);
+    for(int i=0; i<num_pairs; i++)
+        m_group_start[m_pair_group[i]+1]++;
+    for(int g=0; g<num_groups; g++)
+        m_group_start[g+1] += m_group_start[g];
+    m_group_pairs.resize(num_pairs);
+    std::vector<int> next(m_group_start.begin(), m_group_start.end()-1);
+    for(int i=0; i<num_pairs; i++)
+        m_group_pairs[next[m_pair_group[i]]++] = i;
+}   // groupPairs
+
+// ----------------------------------------------------------------------------
+/** Processes the pairs of the groups in [begin, end), called by the jobs
+ *  of dispatchAllCollisionPairs().
+ */
+void STKCollisionDispatcher::dispatchGroups(int begin, int end)
+{
+    btNearCallback near_callback = getNearCallback();
+    for(int g=begin; g<end; g++)
+    {
+        for(int i=m_group_start[g]; i<m_group_start[g+1]; i++)
+            (*near_callback)((*m_pairs)[m_group_pairs[i]], *this, *m_info);
+    }
+}   // dispatchGroups
+
+// ----------------------------------------------------------------------------
+/** Processes all overlapping pairs. With at least one thread, the pairs are
+ *  grouped and the groups processed in parallel by the job system.
+ */
+void STKCollisionDispatcher::dispatchAllCollisionPairs(
+                                          btOverlappingPairCache *pair_cache,
+                                          const btDispatcherInfo &info,
+                                          btDispatcher *dispatcher)
+{
+    if(m_num_threads<1)
+    {
+        btCollisionDispatcher::dispatchAllCollisionPairs(pair_cache, info,
+                                                         dispatcher);
+        return;
+    }
+
+    btBroadphasePairArray &pairs = pair_cache->getOverlappingPairArray();
+    groupPairs(pairs);
+
+    const int num_groups = (int)m_group_start.size()-1;
+    m_pairs       = &pairs;
+    m_info        = &info;
+    m_in_parallel = true;
+    JobSystem::parallelFor(0, num_groups, this,
+                           &STKCollisionDispatcher::dispatchGroups,
+                           m_num_threads);
+    m_in_parallel = false;
+    m_pairs       = NULL;
+    m_info        = NULL;
+
+    sortManifolds();
+}   // dispatchAllCollisionPairs
+
+// ----------------------------------------------------------------------------
+/** Returns the unique broadphase id of a body of a manifold. */
+static int getManifoldBodyId(const void *body)
+{
+    const btBroadphaseProxy *proxy =
+        ((btCollisionObject*)body)->getBroadphaseHandle();
+    return proxy ? proxy->getUid() : -1;
+}   // getManifoldBodyId
+
+// ----------------------------------------------------------------------------
+/** Used to sort the manifolds by the objects they belong to. */
+static bool compareManifolds(const btPersistentManifold *a,
+                             const btPersistentManifold *b)
+{
+    const int a0 = getManifoldBodyId(a->getBody0());
+    const int b0 = getManifoldBodyId(b->getBody0());
+    if(a0!=b0) return a0<b0;
+    return getManifoldBodyId(a->getBody1()) < getManifoldBodyId(b->getBody1());
+}   // compareManifolds
+
+// ----------------------------------------------------------------------------
+/** Sorts the manifolds by the objects they belong to. Manifolds that were
+ *  already there keep their relative order, and new manifolds of the same
+ *  objects are created by one thread in a well defined order, so the stable
+ *  sort gives the same order independent of the thread scheduling.
+ */
+void STKCollisionDispatcher::sortManifolds()
+{
+    const int n = m_manifoldsPtr.size();
+    m_sorted_manifolds.resize(n);
+    for(int i=0; i<n; i++)
+        m_sorted_manifolds[i] = m_manifoldsPtr[i];
+    std::stable_sort(m_sorted_manifolds.begin(), m_sorted_manifolds.end(),
+                     compareManifolds);
+    for(int i=0; i<n; i++)
+    {
+        m_manifoldsPtr[i] = m_sorted_manifolds[i];
+        m_manifoldsPtr[i]->m_index1a = i;
+    }
+}   // sortManifolds
+
+// ----------------------------------------------------------------------------
+btPersistentManifold *STKCollisionDispatcher::getNewManifold(void *b0,
+                                                             void *b1)
+{
+    if(!m_in_parallel)
+        return btCollisionDispatcher::getNewManifold(b0, b1);
+    pthread_mutex_lock(&m_mutex);
+    btPersistentManifold *manifold =
+        btCollisionDispatcher::getNewManifold(b0, b1);
+    pthread_mutex_unlock(&m_mutex);
+    return manifold;
+}   // getNewManifold
+
+// ----------------------------------------------------------------------------
+/** Removes a manifold. When using threads the order of the remaining
+ *  manifolds is kept (bullet swaps the last manifold into the free slot),
+ *  so that it does not depend on the order in which threads remove
+ *  manifolds.
+ */
+void STKCollisionDispatcher::releaseManifold(btPersistentManifold *manifold)
+{
+    if(m_num_threads<1)
+    {
+        btCollisionDispatcher::releaseManifold(manifold);
+        return;
+    }
+
+    if(m_in_parallel) pthread_mutex_lock(&m_mutex);
+    gNumManifold--;
+    clearManifold(manifold);
+
+    const int n = m_manifoldsPtr.size();
+    for(int i=manifold->m_index1a; i<n-1; i++)
+    {
+        m_manifoldsPtr[i] = m_manifoldsPtr[i+1];
+        m_manifoldsPtr[i]->m_index1a = i;
+    }
+    m_manifoldsPtr.pop_back();
+
+    manifold->~btPersistentManifold();
+    if(m_persistentManifoldPoolAllocator->validPtr(manifold))
+        m_persistentManifoldPoolAllocator->freeMemory(manifold);
+    else
+        btAlignedFree(manifold);
+    if(m_in_parallel) pthread_mutex_unlock(&m_mutex);
+}   // releaseManifold
+
+// ----------------------------------------------------------------------------
+/** Allocates memory for a collision algorithm. While processing pairs in
+ *  parallel, the memory is not taken from the (not thread-safe) pool.
+ *  Collision algorithms are frequently created and freed (one for each
+ *  triangle of the track that a kart touches), so locking the pool would
+ *  serialise the threads.
+ */
+void *STKCollisionDispatcher::allocateCollisionAlgorithm(int size)
+{
+    if(!m_in_parallel)
+        return btCollisionDispatcher::allocateCollisionAlgorithm(size);
+    return btAlignedAlloc(static_cast<size_t>(size), 16);
+}   // allocateCollisionAlgorithm
+
+// ----------------------------------------------------------------------------
+void STKCollisionDispatcher::freeCollisionAlgorithm(void *ptr)
+{
+    // Memory that was not taken from the pool can be freed without locking
+    if(!m_in_parallel || !m_collisionAlgorithmPoolAllocator->validPtr(ptr))
+    {
+        btCollisionDispatcher::freeCollisionAlgorithm(ptr);
+        return;
+    }
+    pthread_mutex_lock(&m_mutex);
+    btCollisionDispatcher::freeCollisionAlgorithm(ptr);
+    pthread_mutex_unlock(&m_mutex);
+}   // freeCollisionAlgorithm
@@ -0,0 +1,103 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_STK_COLLISION_DISPATCHER_HPP
+#define HEADER_STK_COLLISION_DISPATCHER_HPP
+
+#include "btBulletCollisionCommon.h"
+
+#include <pthread.h>
+#include <vector>
+
+/** A collision dispatcher that can run the narrowphase (i.e. the collision
+ *  algorithms of all overlapping pairs found by the broadphase) on several
+ *  threads of the job system.
+ *  Bullet's collision algorithms temporarily modify the collision objects
+ *  they handle (e.g. a compound object like a kart gets the shape of the
+ *  child that is tested), so two pairs that share an object can not be
+ *  processed at the same time. Therefore the pairs are first sorted into
+ *  groups, where all pairs that are connected through a dynamic object
+ *  are in the same group. Static objects (the track) do not connect pairs,
+ *  since they are only read. Each group is then processed by one thread.
+ *  To keep the simulation deterministic independent of the number of
+ *  threads, the persistent manifolds (which are created in the order in
+ *  which the threads find new contacts) are sorted after each dispatch,
+ *  and removed without changing the order of the other manifolds.
+ *  With 0 threads the standard, serial bullet dispatcher is used.
+ *  \ingroup physics
+ */
+class STKCollisionDispatcher : public btCollisionDispatcher
+{
+private:
+    /** Maximum number of threads to use, 0 for the original serial
+     *  dispatcher. */
+    int m_num_threads;
+
+    /** True while pairs are processed in parallel, in which case access
+     *  to the manifolds and the pool allocators must be locked. */
+    bool m_in_parallel;
+
+    /** Protects the manifold array and the pool allocators. */
+    pthread_mutex_t m_mutex;
+
+    /** Union-find parent of each broadphase proxy (indexed by the unique
+     *  id of the proxy), used to group the pairs. */
+    std::vector<int> m_parent;
+
+    /** Index of the group each pair belongs to. */
+    std::vector<int> m_pair_group;
+
+    /** Index of the first entry in m_group_pairs for each group, the last
+     *  entry is the total number of pairs. */
+    std::vector<int> m_group_start;
+
+    /** The indices of all pairs, sorted by group. */
+    std::vector<int> m_group_pairs;
+
+    /** Used to sort the manifolds. */
+    std::vector<btPersistentManifold*> m_sorted_manifolds;
+
+    /** The pairs and dispatch info while the groups are processed. */
+    btBroadphasePairArray  *m_pairs;
+    const btDispatcherInfo *m_info;
+
+    int  findGroup(int n);
+    bool connectsPairs(const btCollisionObject *object) const;
+    void groupPairs(btBroadphasePairArray &pairs);
+    void sortManifolds();
+    void dispatchGroups(int begin, int end);
+
+public:
+             STKCollisionDispatcher(btCollisionConfiguration *config);
+    virtual ~STKCollisionDispatcher();
+    virtual void dispatchAllCollisionPairs(btOverlappingPairCache *pair_cache,
+                                           const btDispatcherInfo &info,
+                                           btDispatcher *dispatcher);
+    virtual btPersistentManifold *getNewManifold(void *b0, void *b1);
+    virtual void  releaseManifold(btPersistentManifold *manifold);
+    virtual void *allocateCollisionAlgorithm(int size);
+    virtual void  freeCollisionAlgorithm(void *ptr);
+    // ------------------------------------------------------------------------
+    /** Sets the number of threads to use, 0 to use the serial dispatcher. */
+    void setNumThreads(int n) { m_num_threads = n; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of threads used. */
+    int getNumThreads() const { return m_num_threads; }
+};   // STKCollisionDispatcher
+
+#endif
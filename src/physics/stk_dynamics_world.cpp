@@ -0,0 +1,53 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "physics/stk_dynamics_world.hpp"
+
+#include "physics/btKart.hpp"
+#include "utils/job_system.hpp"
+
+// ----------------------------------------------------------------------------
+/** Does the wheel raycasts of the karts among the actions in [begin, end).
+ */
+void STKDynamicsWorld::updateWheelRaycasts(int begin, int end)
+{
+    for(int i=begin; i<end; i++)
+    {
+        btKart *kart = dynamic_cast<btKart*>(m_actions[i]);
+        if(kart)
+            kart->updateWheelRaycasts();
+    }
+}   // updateWheelRaycasts
+
+// ----------------------------------------------------------------------------
+/** Moves all bodies. Bullet updates the vehicles (i.e. the karts) directly
+ *  afterwards. If threads are used, the wheel raycasts of all karts are done
+ *  here in parallel by the job system (they only read the physics world),
+ *  and updateAction then only uses the results. Since all raycasts are done
+ *  before any kart is updated, the result does not depend on the number of
+ *  threads.
+ */
+void STKDynamicsWorld::integrateTransforms(btScalar time_step)
+{
+    btDiscreteDynamicsWorld::integrateTransforms(time_step);
+    if(m_num_threads<1) return;
+
+    JobSystem::parallelFor(0, m_actions.size(), this,
+                           &STKDynamicsWorld::updateWheelRaycasts,
+                           m_num_threads);
+}   // integrateTransforms
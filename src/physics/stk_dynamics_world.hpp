@@ -23,8 +23,19 @@
 
 class STKDynamicsWorld : public btDiscreteDynamicsWorld
 {
+private:
+    /** Maximum number of threads used for the wheel raycasts of the karts,
+     *  0 if each kart does its raycasts in updateAction. */
+    int m_num_threads;
+
+    void updateWheelRaycasts(int begin, int end);
+
+protected:
+    virtual void integrateTransforms(btScalar time_step);
+
 public:
-    /** The standard constructor which just created a btDiscreteDynamicsWorld. */
+    /** The standard constructor which just creates a
+     *  btDiscreteDynamicsWorld. */
     STKDynamicsWorld(btDispatcher*             dispatcher,
                      btBroadphaseInterface*    pairCache,
                      btConstraintSolver*       constraintSolver,
@@ -34,12 +45,16 @@ public:
                                              constraintSolver,
                                              collisionConfiguration)
     {
+        m_num_threads = 0;
     }
 
     /** Resets m_localTime to 0. This allows more precise replay of
      *  physics, which is important for replaying histories. */
     virtual void resetLocalTime() { m_localTime = 0; }
 
+    /** Sets the number of threads used for the wheel raycasts. */
+    void setNumThreads(int n) { m_num_threads = n; }
+
 };   // STKDynamicsWorld
 #endif
 /* EOF */
@@ -20,12 +20,14 @@
 
 #include "btBulletDynamicsCommon.h"
 
+#include "graphics/material.hpp"
+#include "graphics/material_manager.hpp"
 #include "modes/world.hpp"
 #include "physics/physics.hpp"
 #include "utils/constants.hpp"
 #include "utils/time.hpp"
 
-#include <fstream>
+#include <algorithm>
 
 // -----------------------------------------------------------------------------
 /** Constructor: Initialises all data structures with zero.
@@ -42,6 +44,8 @@ TriangleMesh::TriangleMesh() : m_mesh()
     // (and m_mesh->m_weldingThreshold at m_normals
     m_collision_shape  = NULL;
     m_collision_object = NULL;
+    m_cached_data      = NULL;
+    m_owns_cached_data = false;
     m_user_pointer.set(this);
 }   // TriangleMesh
 
@@ -51,6 +55,9 @@ TriangleMesh::TriangleMesh() : m_mesh()
 TriangleMesh::~TriangleMesh()
 {
     removeAll();
+    // The cached data can only be freed after the shape that uses its bvh
+    if(m_owns_cached_data)
+        delete m_cached_data;
 }   // ~TriangleMesh
 
 // -----------------------------------------------------------------------------
@@ -66,6 +73,8 @@ void TriangleMesh::addTriangle(const btVector3 &t1, const btVector3 &t2,
                                const btVector3 &n3,
                                const Material* m)
 {
+    // The points of a mesh using cached data are not stored in m_mesh
+    assert(!m_cached_data);
     m_triangleIndex2Material.push_back(m);
 
     btVector3 normal = (t2-t1).cross(t3-t1);
@@ -81,11 +90,10 @@ void TriangleMesh::addTriangle(const btVector3 &t1, const btVector3 &t2,
 
 // -----------------------------------------------------------------------------
 /** Creates a collision body only, which can be used for raycasting, but
- *  has no physical properties.
- *  @param serialized_bhv if non-null, load the serialized bhv from file instead
- *                        of builing it on the fly
+ *  has no physical properties. If the mesh uses data from the physics cache
+ *  which contains a bvh, this bvh is used instead of building one.
  */
-void TriangleMesh::createCollisionShape(bool create_collision_object, const char* serialized_bhv)
+void TriangleMesh::createCollisionShape(bool create_collision_object)
 {
     if(m_triangleIndex2Material.size()==0)
     {
@@ -96,56 +104,19 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
         return;
     }
     // Now convert the triangle mesh into a static rigid body
-    btBvhTriangleMeshShape* bhv_triangle_mesh;
+    btBvhTriangleMeshShape* bhv_triangle_mesh = NULL;
 
-    if (serialized_bhv != NULL)
+    if (m_cached_data && m_cached_data->m_bvh)
     {
-        FILE *f = fopen(serialized_bhv, "rb");
-        fseek(f, 0, SEEK_END);
-        long pos = ftell(f);
-        assert(pos != -1L);
-        fseek(f, 0, SEEK_SET);
-
-        void* bytes = btAlignedAlloc(pos, 16);
-        fread(bytes, pos, 1, f);
-        fclose(f);
-
-        btOptimizedBvh* bhv = btOptimizedBvh::deSerializeInPlace(bytes, pos, !IS_LITTLE_ENDIAN);
-        if (bhv == NULL)
-        {
-            Log::warn("TriangleMesh", "Failed to load serialized BHV");
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-        }
-        else
-        {
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
-                                                           false /* buildBvh */);
-            bhv_triangle_mesh->setOptimizedBvh( bhv );
-        }
-        // Do *NOT* free the bytes, 'deSerializeInPlace' makes the btOptimizedBvh object
-        // directly at this memory location
-        //free(bytes);
-
+        // The bvh is only read, so it can be shared with other meshes using
+        // the same data. The shape does not free it.
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
+                                                       false /* buildBvh */);
+        bhv_triangle_mesh->setOptimizedBvh(m_cached_data->m_bvh);
     }
-    else
-    {
-        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-
-        /*
-         // code to serialize triangle mesh
-        btOptimizedBvh* bvh = bhv_triangle_mesh->getOptimizedBvh();
-        unsigned int ssize = bvh->calculateSerializeBufferSize();
-        char* buffer = (char*)btAlignedAlloc(ssize, 16);
-        bool success = bvh->serialize(buffer, ssize, !IS_LITTLE_ENDIAN);
-        printf("serialization success = %i\n", success);
 
-        std::ofstream fileout("/tmp/btOptimizedBvh");
-        fileout.write(buffer, ssize);
-        fileout.close();
-
-        btAlignedFree(buffer);
-         */
-    }
+    if (!bhv_triangle_mesh)
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
 
     m_collision_shape = bhv_triangle_mesh;
     m_collision_shape->setUserPointer(&m_user_pointer);
@@ -169,15 +140,12 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
  *  removed and all objects together with the track is converted again into
  *  a single rigid body. This avoids using irrlicht (or the graphics engine)
  *  for height of terrain detection).
- *  @param serializedBhv if non-NULL, the bhv is deserialized instead of
- *                       being calculated on the fly
  */
-void TriangleMesh::createPhysicalBody(btCollisionObject::CollisionFlags flags,
-                                      const char* serializedBhv)
+void TriangleMesh::createPhysicalBody(btCollisionObject::CollisionFlags flags)
 {
     // We need the collision shape, but not the collision object (since
     // this will be created when the dynamics body is anyway).
-    createCollisionShape(/*create_collision_object*/false, serializedBhv);
+    createCollisionShape(/*create_collision_object*/false);
     btTransform startTransform;
     startTransform.setIdentity();
     m_motion_state = new btDefaultMotionState(startTransform);
@@ -219,6 +187,238 @@ void TriangleMesh::removeAll()
     m_collision_shape = NULL;
 }   // removeAll
 
+// ----------------------------------------------------------------------------
+/** Writes all triangles, their normals and materials, and the bvh of the
+ *  collision shape to a file, so that the mesh can be loaded with
+ *  loadCache() without converting the scene and building the bvh again.
+ *  Materials are stored by name. The data is written in the native byte
+ *  order, the caller must make sure that the file is not used on a
+ *  different platform.
+ *  \param fout The file to write to.
+ *  \return True if the data was written successfully.
+ */
+bool TriangleMesh::saveCache(FILE *fout) const
+{
+    const unsigned int num_triangles = getNumTriangles();
+    bool ok = fwrite(&num_triangles, sizeof(num_triangles), 1, fout)==1;
+
+    // Points and normals, 3 floats each
+    std::vector<float> data(num_triangles*18);
+    for(unsigned int i=0; i<num_triangles; i++)
+    {
+        btVector3 p[6];
+        getTriangle(i, &p[0], &p[1], &p[2]);
+        getNormals (i, &p[3], &p[4], &p[5]);
+        for(unsigned int j=0; j<6; j++)
+        {
+            data[i*18+3*j  ] = p[j].getX();
+            data[i*18+3*j+1] = p[j].getY();
+            data[i*18+3*j+2] = p[j].getZ();
+        }
+    }
+    if(num_triangles>0)
+        ok &= fwrite(&data[0], sizeof(float), data.size(), fout)==data.size();
+
+    // Materials: a list of all (different) material names, followed by the
+    // index of the material of each triangle. A NULL material is stored
+    // as an empty name.
+    std::vector<const Material*> materials;
+    std::vector<unsigned int>    material_index(num_triangles);
+    for(unsigned int i=0; i<num_triangles; i++)
+    {
+        const Material *m = m_triangleIndex2Material[i];
+        std::vector<const Material*>::iterator it =
+            std::find(materials.begin(), materials.end(), m);
+        material_index[i] = (unsigned int)(it-materials.begin());
+        if(it==materials.end())
+            materials.push_back(m);
+    }
+    const unsigned int num_materials = (unsigned int)materials.size();
+    ok &= fwrite(&num_materials, sizeof(num_materials), 1, fout)==1;
+    for(unsigned int i=0; i<num_materials; i++)
+    {
+        const std::string name = materials[i] ? materials[i]->getTexFname()
+                                              : "";
+        const unsigned int len = (unsigned int)name.size();
+        ok &= fwrite(&len, sizeof(len), 1, fout)==1;
+        if(len>0)
+            ok &= fwrite(name.c_str(), 1, len, fout)==len;
+    }
+    if(num_triangles>0)
+        ok &= fwrite(&material_index[0], sizeof(unsigned int), num_triangles,
+                     fout) == num_triangles;
+
+    // The bvh of the collision shape (if it was created)
+    btOptimizedBvh *bvh = m_collision_shape
+        ? ((btBvhTriangleMeshShape*)m_collision_shape)->getOptimizedBvh()
+        : NULL;
+    unsigned int bvh_size = bvh ? bvh->calculateSerializeBufferSize() : 0;
+    char *buffer = NULL;
+    if(bvh)
+    {
+        buffer = (char*)btAlignedAlloc(bvh_size, 16);
+        if(!bvh->serializeInPlace(buffer, bvh_size, /*swap endian*/false))
+            bvh_size = 0;
+    }
+    ok &= fwrite(&bvh_size, sizeof(bvh_size), 1, fout)==1;
+    if(bvh_size>0)
+        ok &= fwrite(buffer, 1, bvh_size, fout)==bvh_size;
+    if(buffer)
+        btAlignedFree(buffer);
+    return ok;
+}   // saveCache
+
+// ----------------------------------------------------------------------------
+/** Loads the data written by saveCache() and uses it for this mesh, see
+ *  useCachedData().
+ *  \param fin The file to read from.
+ *  \return False if the data could not be read, in which case no triangles
+ *          were added.
+ */
+bool TriangleMesh::loadCache(FILE *fin)
+{
+    TriangleMeshData *data = new TriangleMeshData();
+    if(!data->load(fin))
+    {
+        delete data;
+        return false;
+    }
+    useCachedData(data, /*take_ownership*/true);
+    return true;
+}   // loadCache
+
+// ----------------------------------------------------------------------------
+/** Uses the triangles, normals and the bvh of data loaded from the physics
+ *  cache for this mesh, which must be empty. The points and normals are
+ *  not copied, only the materials of the triangles are looked up (since
+ *  the materials of a track are loaded again for each race). So several
+ *  meshes can use the same data, which then must exist as long as any of
+ *  these meshes.
+ *  \param data The data to use.
+ *  \param take_ownership If true, the data is freed with this mesh.
+ */
+void TriangleMesh::useCachedData(const TriangleMeshData *data,
+                                 bool take_ownership)
+{
+    assert(!m_cached_data && m_triangleIndex2Material.size()==0);
+
+    std::vector<const Material*> materials(data->m_material_names.size());
+    for(unsigned int i=0; i<materials.size(); i++)
+    {
+        const std::string &name = data->m_material_names[i];
+        materials[i] = name.size()>0
+                     ? material_manager->getMaterial(name,
+                                                  /*is_full_path*/false,
+                                                  /*make_permanent*/false,
+                                                  /*complain_if_not_found*/false)
+                     : NULL;
+    }
+    const unsigned int num_triangles = data->getNumTriangles();
+    m_triangleIndex2Material.resize(num_triangles);
+    for(unsigned int i=0; i<num_triangles; i++)
+        m_triangleIndex2Material[i] = materials[data->m_material_index[i]];
+
+    m_cached_data      = data;
+    m_owns_cached_data = take_ownership;
+    if(num_triangles==0)
+        return;
+
+    // Let bullet read the points of the cached data instead of the
+    // (empty) arrays of m_mesh. m_mesh uses 32 bit indices and btVector3
+    // as points, so only the base pointers and counts are changed.
+    btIndexedMesh &mesh = m_mesh.getIndexedMeshArray()[0];
+    mesh.m_numTriangles      = num_triangles;
+    mesh.m_triangleIndexBase = (const unsigned char*)&data->m_indices[0];
+    mesh.m_numVertices       = 3*num_triangles;
+    mesh.m_vertexBase        = (const unsigned char*)&data->m_points[0];
+}   // useCachedData
+
+// ============================================================================
+TriangleMeshData::TriangleMeshData()
+{
+    m_bvh        = NULL;
+    m_bvh_buffer = NULL;
+}   // TriangleMeshData
+
+// ----------------------------------------------------------------------------
+TriangleMeshData::~TriangleMeshData()
+{
+    // The bvh was created in place, so only the buffer is freed
+    if(m_bvh_buffer)
+        btAlignedFree(m_bvh_buffer);
+}   // ~TriangleMeshData
+
+// ----------------------------------------------------------------------------
+/** Loads the data written by TriangleMesh::saveCache(). The bvh is created
+ *  in its buffer right away, so it is never changed afterwards.
+ *  \param fin The file to read from.
+ *  \return False if the data could not be read.
+ */
+bool TriangleMeshData::load(FILE *fin)
+{
+    unsigned int num_triangles;
+    if(fread(&num_triangles, sizeof(num_triangles), 1, fin)!=1)
+        return false;
+
+    std::vector<float> data(num_triangles*18);
+    if(num_triangles>0 &&
+        fread(&data[0], sizeof(float), data.size(), fin)!=data.size())
+        return false;
+
+    unsigned int num_materials;
+    if(fread(&num_materials, sizeof(num_materials), 1, fin)!=1)
+        return false;
+    m_material_names.resize(num_materials);
+    for(unsigned int i=0; i<num_materials; i++)
+    {
+        unsigned int len;
+        if(fread(&len, sizeof(len), 1, fin)!=1 || len>1024)
+            return false;
+        m_material_names[i].resize(len);
+        if(len>0 && fread(&m_material_names[i][0], 1, len, fin)!=len)
+            return false;
+    }
+    m_material_index.resize(num_triangles);
+    if(num_triangles>0 &&
+        fread(&m_material_index[0], sizeof(unsigned int), num_triangles,
+              fin) != num_triangles)
+        return false;
+    for(unsigned int i=0; i<num_triangles; i++)
+    {
+        if(m_material_index[i]>=num_materials)
+            return false;
+    }
+
+    unsigned int bvh_size;
+    if(fread(&bvh_size, sizeof(bvh_size), 1, fin)!=1)
+        return false;
+    if(bvh_size>0)
+    {
+        m_bvh_buffer = (char*)btAlignedAlloc(bvh_size, 16);
+        if(fread(m_bvh_buffer, 1, bvh_size, fin)!=bvh_size)
+            return false;
+        m_bvh = btOptimizedBvh::deSerializeInPlace(m_bvh_buffer, bvh_size,
+                                                   /*swap endian*/false);
+        if(!m_bvh)
+        {
+            Log::warn("TriangleMesh", "Failed to load serialized BHV");
+            return false;
+        }
+    }
+
+    m_points.resize(3*num_triangles);
+    m_normals.resize(3*num_triangles);
+    m_indices.resize(3*num_triangles);
+    for(unsigned int i=0; i<3*num_triangles; i++)
+    {
+        const float *d = &data[(i/3)*18 + (i%3)*3];
+        m_points [i] = btVector3(d[0], d[1], d[2]);
+        m_normals[i] = btVector3(d[9], d[10], d[11]);
+        m_indices[i] = i;
+    }
+    return true;
+}   // load
+
 // -----------------------------------------------------------------------------
 /** Interpolates the normal at the given position for the triangle with
  *  a given index. The position must be inside of the given triangle.
@@ -19,14 +19,56 @@
 #ifndef HEADER_TRIANGLE_MESH_HPP
 #define HEADER_TRIANGLE_MESH_HPP
 
+#include <stdio.h>
+#include <string>
 #include <vector>
 #include "btBulletDynamicsCommon.h"
 
 #include "physics/user_pointer.hpp"
 #include "utils/aligned_array.hpp"
+#include "utils/no_copy.hpp"
 
 class Material;
 
+/**
+ * \brief The triangles, normals, materials and bvh of a triangle mesh as
+ *  stored in the physics cache. The data is not changed after it is loaded,
+ *  so several TriangleMesh objects can use it at the same time (see
+ *  TriangleMesh::useCachedData). Materials are stored by name, since the
+ *  material objects of a track only exist while the track is loaded.
+ * \ingroup physics
+ */
+class TriangleMeshData : public NoCopy
+{
+public:
+    /** The three points of each triangle. */
+    AlignedArray<btVector3>   m_points;
+    /** The three normals of each triangle. */
+    AlignedArray<btVector3>   m_normals;
+    /** The indices of the points of each triangle (0, 1, 2, 3, ...),
+     *  needed since bullet only supports indexed meshes. */
+    std::vector<int>          m_indices;
+    /** The names of all materials used, an empty name for no material. */
+    std::vector<std::string>  m_material_names;
+    /** The index in m_material_names of the material of each triangle. */
+    std::vector<unsigned int> m_material_index;
+    /** The bvh, created in place in m_bvh_buffer (or NULL if no bvh was
+     *  cached). */
+    btOptimizedBvh           *m_bvh;
+    /** The serialized bvh, which must be kept as long as m_bvh is used. */
+    char                     *m_bvh_buffer;
+
+         TriangleMeshData();
+        ~TriangleMeshData();
+    bool load(FILE *fin);
+    // ------------------------------------------------------------------------
+    /** Returns the number of triangles. */
+    unsigned int getNumTriangles() const
+    {
+        return (unsigned int)m_material_index.size();
+    }   // getNumTriangles
+};   // TriangleMeshData
+
 /**
  * \brief A special class to store a triangle mesh with a separate material per triangle.
  * \ingroup physics
@@ -45,8 +87,17 @@ private:
     btVector3 dummy1, dummy2;
     btDefaultMotionState        *m_motion_state;
     btCollisionShape            *m_collision_shape;
-    /** The three normals for each triangle. */
+    /** The three normals for each triangle (unless m_cached_data is
+     *  used). */
     AlignedArray<btVector3>      m_normals;
+
+    /** The points, normals and bvh of this mesh if it was loaded from the
+     *  physics cache, otherwise NULL. */
+    const TriangleMeshData      *m_cached_data;
+
+    /** True if m_cached_data was loaded by this mesh and must be freed. */
+    bool                         m_owns_cached_data;
+
 public:
          TriangleMesh();
         ~TriangleMesh();
@@ -54,11 +105,13 @@ public:
                      const btVector3 &t3, const btVector3 &n1,
                      const btVector3 &n2, const btVector3 &n3,
                      const Material* m);
-    void createCollisionShape(bool create_collision_object=true, const char* serialized_bhv=NULL);
+    void createCollisionShape(bool create_collision_object=true);
     void createPhysicalBody(btCollisionObject::CollisionFlags flags=
-                               (btCollisionObject::CollisionFlags)0,
-                            const char* serializedBhv = NULL);
+                               (btCollisionObject::CollisionFlags)0);
     void removeAll();
+    bool saveCache(FILE *fout) const;
+    bool loadCache(FILE *fin);
+    void useCachedData(const TriangleMeshData *data, bool take_ownership);
     void removeCollisionObject();
     btVector3 getInterpolatedNormal(unsigned int index,
                                     const btVector3 &position) const;
@@ -102,6 +155,12 @@ public:
         *p3 = p[2];
     }   // getTriangle
     // ------------------------------------------------------------------------
+    /** Returns the number of triangles in this mesh. */
+    unsigned int getNumTriangles() const
+    {
+        return (unsigned int)m_triangleIndex2Material.size();
+    }   // getNumTriangles
+    // ------------------------------------------------------------------------
     /** Returns the normals of the triangle with the given index.
      *  \param indx Index of the triangle to get the three normals of.
      *  \result n1,n2,n3 The three normals. */
@@ -109,10 +168,12 @@ public:
                     btVector3 *n3) const
     {
         assert(indx < m_triangleIndex2Material.size());
+        const AlignedArray<btVector3> &normals =
+            m_cached_data ? m_cached_data->m_normals : m_normals;
         unsigned int n = indx*3;
-        *n1 = m_normals[n  ];
-        *n2 = m_normals[n+1];
-        *n3 = m_normals[n+2];
+        *n1 = normals[n  ];
+        *n2 = normals[n+1];
+        *n3 = normals[n+2];
     }   // getNormals
 };
 #endif
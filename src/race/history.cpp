@@ -18,8 +18,12 @@
 
 #include "race/history.hpp"
 
+#include <algorithm>
 #include <stdio.h>
+#include <string.h>
 
+#include "config/stk_config.hpp"
+#include "config/user_config.hpp"
 #include "io/file_manager.hpp"
 #include "modes/world.hpp"
 #include "karts/abstract_kart.hpp"
@@ -27,15 +31,86 @@
 #include "race/race_manager.hpp"
 #include "tracks/track.hpp"
 #include "utils/constants.hpp"
+#include "utils/types.hpp"
 
 History* history = 0;
 
+/** Identifies a binary history file. */
+static const char HISTORY_MAGIC[4] = { 'S', 'T', 'K', 'H' };
+
+/** Version of the binary history format. Since the version is stored as a
+ *  native integer, a file written on a machine with a different byte order
+ *  is detected as a different version. */
+static const uint32_t HISTORY_VERSION = 1;
+
+/** The data stored for each kart in each frame. A frame consists of the
+ *  time step (a float) followed by one of these records for each kart.
+ *  All fields are 4 bytes, so the layout is the same on all platforms. */
+struct HistoryKartRecord
+{
+    float    m_steer;
+    float    m_accel;
+    float    m_xyz[3];
+    float    m_rotation[4];
+    uint32_t m_buttons;
+};   // HistoryKartRecord
+
+// ----------------------------------------------------------------------------
+/** Appends a 32 bit integer to a buffer. */
+static void writeUInt32(std::vector<char> *buffer, uint32_t value)
+{
+    const char *p = (const char*)&value;
+    buffer->insert(buffer->end(), p, p+sizeof(value));
+}   // writeUInt32
+
+// ----------------------------------------------------------------------------
+/** Appends a string (length followed by the characters) to a buffer. */
+static void writeString(std::vector<char> *buffer, const std::string &s)
+{
+    writeUInt32(buffer, (uint32_t)s.size());
+    buffer->insert(buffer->end(), s.begin(), s.end());
+}   // writeString
+
+// ----------------------------------------------------------------------------
+/** Reads a 32 bit integer from a header.
+ *  \return False if the data is too short.
+ */
+static bool readUInt32(const char *data, size_t size, size_t *offset,
+                       uint32_t *value)
+{
+    if(*offset+sizeof(*value) > size) return false;
+    memcpy(value, data+*offset, sizeof(*value));
+    *offset += sizeof(*value);
+    return true;
+}   // readUInt32
+
+// ----------------------------------------------------------------------------
+/** Reads a string from a header.
+ *  \return False if the data is too short.
+ */
+static bool readString(const char *data, size_t size, size_t *offset,
+                       std::string *s)
+{
+    uint32_t len;
+    if(!readUInt32(data, size, offset, &len) || *offset+len > size)
+        return false;
+    s->assign(data+*offset, len);
+    *offset += len;
+    return true;
+}   // readString
+
 //-----------------------------------------------------------------------------
 /** Initialises the history object and sets the mode to none.
  */
 History::History()
 {
-    m_replay_mode = HISTORY_NONE;
+    m_replay_mode   = HISTORY_NONE;
+    m_current       = -1;
+    m_wrapped       = false;
+    m_size          = 0;
+    m_num_karts     = 0;
+    m_frame_size    = 0;
+    m_replay_frames = NULL;
 }   // History
 
 //-----------------------------------------------------------------------------
@@ -47,31 +122,107 @@ void History::startReplay()
 }   // startReplay
 
 //-----------------------------------------------------------------------------
-/** Initialise the history for a new recording. It especially allocates memory
- *  to store the history.
+/** Returns the size of a frame in bytes.
+ *  \param num_karts Number of karts in the race.
+ */
+unsigned int History::getFrameSize(unsigned int num_karts)
+{
+    return sizeof(float) + num_karts*sizeof(HistoryKartRecord);
+}   // getFrameSize
+
+//-----------------------------------------------------------------------------
+/** Creates the header of a binary history file: the magic, version, size
+ *  of the header, STK version, number of karts and players, difficulty,
+ *  track and the identifiers of all karts. The header is padded so that
+ *  the frames start at a 4 byte boundary.
+ */
+void History::createHeader(std::vector<char> *header, int num_players,
+                           int difficulty, const std::string &track,
+                           const std::vector<std::string> &karts)
+{
+    header->clear();
+    header->insert(header->end(), HISTORY_MAGIC, HISTORY_MAGIC+4);
+    writeUInt32(header, HISTORY_VERSION);
+    // Size of the header, set below
+    writeUInt32(header, 0);
+    writeString(header, STK_VERSION);
+    writeUInt32(header, (uint32_t)karts.size());
+    writeUInt32(header, num_players);
+    writeUInt32(header, difficulty);
+    writeString(header, track);
+    for(unsigned int i=0; i<karts.size(); i++)
+        writeString(header, karts[i]);
+    while(header->size() % 4 != 0)
+        header->push_back(0);
+    uint32_t size = (uint32_t)header->size();
+    memcpy(&(*header)[8], &size, sizeof(size));
+}   // createHeader
+
+//-----------------------------------------------------------------------------
+/** Initialise the history for a new recording. If the history is streamed
+ *  (--record-history), every frame is written to the history file in the
+ *  background. Otherwise memory is allocated to keep the last
+ *  m_replay_max_time seconds, which are written by Save().
  */
 void History::initRecording()
 {
-    unsigned int max_frames = (unsigned int)(  stk_config->m_replay_max_time
-                                             / stk_config->m_replay_dt      );
-    allocateMemory(max_frames);
+    World *world = World::getWorld();
+    m_num_karts  = world->getNumKarts();
+    m_frame_size = getFrameSize(m_num_karts);
+    m_frame.resize(m_frame_size);
+
+    std::vector<std::string> karts;
+    for(unsigned int i=0; i<m_num_karts; i++)
+        karts.push_back(world->getKart(i)->getIdent());
+    createHeader(&m_header, race_manager->getNumPlayers(),
+                 race_manager->getDifficulty(),
+                 world->getTrack()->getIdent(), karts);
+
     m_current = -1;
     m_wrapped = false;
     m_size    = 0;
+
+    if(UserConfigParams::m_record_history && openStream())
+    {
+        // No need to keep the frames in memory
+        std::vector<char>().swap(m_frames);
+        return;
+    }
+
+    unsigned int max_frames = (unsigned int)(  stk_config->m_replay_max_time
+                                             / stk_config->m_replay_dt      );
+    allocateMemory(max_frames);
 }   // initRecording
 
 //-----------------------------------------------------------------------------
-/** Allocates memory for the history. This is used when recording as well
- *  as when replaying (since in replay the data is read into memory first).
+/** Opens the history file for streaming and writes the header.
+ *  \return False if the file can't be written.
+ */
+bool History::openStream()
+{
+    if(!m_stream.open("history.bin"))
+    {
+        std::string fn = file_manager->getUserConfigFile("history.bin");
+        if(!m_stream.open(fn))
+        {
+            Log::warn("History", "Can't open history.bin for writing - "
+                      "only the end of the race will be kept in memory.");
+            return false;
+        }
+    }
+    Log::info("History", "Recording history in '%s'.",
+              m_stream.getFilename().c_str());
+    m_stream.append(&m_header[0], m_header.size());
+    return true;
+}   // openStream
+
+//-----------------------------------------------------------------------------
+/** Allocates memory for the history when recording without streaming.
  *  \param number_of_frames Maximum number of frames to store.
  */
 void History::allocateMemory(int number_of_frames)
 {
-    m_all_deltas.resize   (number_of_frames);
-    unsigned int num_karts = race_manager->getNumberOfKarts();
-    m_all_controls.resize (number_of_frames*num_karts);
-    m_all_xyz.resize      (number_of_frames*num_karts);
-    m_all_rotations.resize(number_of_frames*num_karts);
+    m_frames.resize(number_of_frames*m_frame_size);
 }   // allocateMemory
 
 //-----------------------------------------------------------------------------
@@ -93,32 +244,73 @@ void History::update(float dt)
  */
 void History::updateSaving(float dt)
 {
-    m_current++;
-    if(m_current>=(int)m_all_deltas.size())
+    char *frame;
+    if(m_stream.isOpen())
     {
-        m_wrapped = true;
-        m_current = 0;
+        frame = &m_frame[0];
+        m_size++;
     }
     else
     {
-        // m_size must be m_all_deltas.size() or smaller
-        if(m_size<(int)m_all_deltas.size())
-            m_size ++;
+        const int max_frames = (int)(m_frames.size() / m_frame_size);
+        if(max_frames==0) return;
+        m_current++;
+        if(m_current>=max_frames)
+        {
+            m_wrapped = true;
+            m_current = 0;
+        }
+        else
+        {
+            // m_size must be max_frames or smaller
+            if(m_size<max_frames)
+                m_size ++;
+        }
+        frame = &m_frames[m_current*m_frame_size];
     }
-    m_all_deltas[m_current] = dt;
 
+    memcpy(frame, &dt, sizeof(float));
     World *world = World::getWorld();
-    unsigned int num_karts = world->getNumKarts();
-    unsigned int index     = m_current*num_karts;
-    for(unsigned int i=0; i<num_karts; i++)
+    HistoryKartRecord record;
+    for(unsigned int i=0; i<m_num_karts; i++)
     {
-        const AbstractKart *kart         = world->getKart(i);
-        m_all_controls[index+i]  = kart->getControls();
-        m_all_xyz[index+i]       = kart->getXYZ();
-        m_all_rotations[index+i] = kart->getVisualRotation();
+        const AbstractKart *kart = world->getKart(i);
+        const KartControl &control = kart->getControls();
+        const Vec3 &xyz = kart->getXYZ();
+        const btQuaternion &q = kart->getVisualRotation();
+        record.m_steer       = control.m_steer;
+        record.m_accel       = control.m_accel;
+        record.m_buttons     = (unsigned char)control.getButtonsCompressed();
+        record.m_xyz[0]      = xyz.getX();
+        record.m_xyz[1]      = xyz.getY();
+        record.m_xyz[2]      = xyz.getZ();
+        record.m_rotation[0] = q.getX();
+        record.m_rotation[1] = q.getY();
+        record.m_rotation[2] = q.getZ();
+        record.m_rotation[3] = q.getW();
+        memcpy(frame+sizeof(float)+i*sizeof(record), &record, sizeof(record));
     }   // for i
+
+    if(m_stream.isOpen())
+        m_stream.append(frame, m_frame_size);
 }   // updateSaving
 
+//-----------------------------------------------------------------------------
+/** Returns a pointer to frame n of the replayed history. */
+const char *History::getFrame(int n) const
+{
+    return m_replay_frames + (size_t)n*m_frame_size;
+}   // getFrame
+
+//-----------------------------------------------------------------------------
+/** Returns the size of the next timestep. */
+float History::getNextDelta() const
+{
+    float dt;
+    memcpy(&dt, getFrame(m_current), sizeof(dt));
+    return dt;
+}   // getNextDelta
+
 //-----------------------------------------------------------------------------
 /** Sets the kart position and controls to the recorded history value.
  *  \param dt Time step size.
@@ -127,7 +319,7 @@ void History::updateReplay(float dt)
 {
     m_current++;
     World *world = World::getWorld();
-    if(m_current>=(int)m_all_deltas.size())
+    if(m_current>=m_size)
     {
         Log::info("History", "Replay finished");
         m_current = 0;
@@ -135,194 +327,269 @@ void History::updateReplay(float dt)
         // need to be reset, e.g. velocity, ...
         world->reset();
     }
-    unsigned int num_karts = world->getNumKarts();
+    const char *frame = getFrame(m_current) + sizeof(float);
+    unsigned int num_karts = std::min(world->getNumKarts(), m_num_karts);
+    HistoryKartRecord record;
     for(unsigned k=0; k<num_karts; k++)
     {
         AbstractKart *kart = world->getKart(k);
-        unsigned int index=m_current*num_karts+k;
+        memcpy(&record, frame+k*sizeof(record), sizeof(record));
         if(m_replay_mode==HISTORY_POSITION)
         {
-            kart->setXYZ(m_all_xyz[index]);
-            kart->setRotation(m_all_rotations[index]);
+            kart->setXYZ(Vec3(record.m_xyz[0], record.m_xyz[1],
+                              record.m_xyz[2]));
+            kart->setRotation(btQuaternion(record.m_rotation[0],
+                                           record.m_rotation[1],
+                                           record.m_rotation[2],
+                                           record.m_rotation[3]));
         }
         else
         {
-            kart->setControls(m_all_controls[index]);
+            KartControl control;
+            control.m_steer = record.m_steer;
+            control.m_accel = record.m_accel;
+            control.setButtonsCompressed(char(record.m_buttons));
+            kart->setControls(control);
         }
     }
 }   // updateReplay
 
 //-----------------------------------------------------------------------------
-/** Saves the history stored in the internal data structures into a file called
- *  history.dat.
+/** Saves the history into a file called history.bin. If the history is
+ *  streamed, this only makes sure that all frames are written, otherwise
+ *  the frames kept in memory are saved.
  */
 void History::Save()
 {
-    FILE *fd = fopen("history.dat","w");
+    if(m_stream.isOpen())
+    {
+        m_stream.flush();
+        Log::info("History", "Saved in '%s'.",
+                  m_stream.getFilename().c_str());
+        return;
+    }
+    if(m_header.empty()) return;
+
+    FILE *fd = fopen("history.bin","wb");
     if(fd)
-        Log::info("History", "Saved in ./history.dat.");
+        Log::info("History", "Saved in ./history.bin.");
     else
     {
-        std::string fn = file_manager->getUserConfigFile("history.dat");
-        fd = fopen(fn.c_str(), "w");
+        std::string fn = file_manager->getUserConfigFile("history.bin");
+        fd = fopen(fn.c_str(), "wb");
         if(fd)
             Log::info("History", "Saved in '%s'.", fn.c_str());
     }
     if(!fd)
     {
-        Log::info("History", "Can't open history.dat file for writing - can't save history.");
-        Log::info("History", "Make sure history.dat in the current directory "
+        Log::info("History", "Can't open history.bin file for writing - can't save history.");
+        Log::info("History", "Make sure history.bin in the current directory "
                              "or the config directory is writable.");
         return;
     }
 
-    World *world   = World::getWorld();
-    const int num_karts = world->getNumKarts();
-    fprintf(fd, "Version:  %s\n",   STK_VERSION);
-    fprintf(fd, "numkarts: %d\n",   num_karts);
-    fprintf(fd, "numplayers: %d\n", race_manager->getNumPlayers());
-    fprintf(fd, "difficulty: %d\n", race_manager->getDifficulty());
-    fprintf(fd, "track: %s\n",      world->getTrack()->getIdent().c_str());
-
-    assert(num_karts > 0);
-
-    int k;
-    for(k=0; k<num_karts; k++)
+    fwrite(&m_header[0], 1, m_header.size(), fd);
+    if(m_size>0)
     {
-        fprintf(fd, "model %d: %s\n",k, world->getKart(k)->getIdent().c_str());
+        // If the buffer has wrapped around, the oldest frame is the one
+        // after the current one.
+        const int first = m_wrapped ? (m_current+1) % m_size : 0;
+        fwrite(&m_frames[first*m_frame_size], m_frame_size, m_size-first,
+               fd);
+        if(first>0)
+            fwrite(&m_frames[0], m_frame_size, first, fd);
     }
-    fprintf(fd, "size:     %d\n", m_size);
-
-    int index = m_wrapped ? m_current : 0;
-    for(int i=0; i<m_size; i++)
-    {
-        fprintf(fd, "delta: %f\n",m_all_deltas[index]);
-        index=(index+1)%m_size;
-    }
-
-    index = num_karts * (m_wrapped ? m_current : 0);
-    for(int i=0; i<m_size; i++)
-    {
-        for(int k=0; k<num_karts; k++)
-        {
-            fprintf(fd, "%f %f %d  %f %f %f  %f %f %f %f\n",
-                    m_all_controls[index+k].m_steer,
-                    m_all_controls[index+k].m_accel,
-                    m_all_controls[index+k].getButtonsCompressed(),
-                    m_all_xyz[index+k].getX(), m_all_xyz[index+k].getY(),
-                    m_all_xyz[index+k].getZ(),
-                    m_all_rotations[index+k].getX(),
-                    m_all_rotations[index+k].getY(),
-                    m_all_rotations[index+k].getZ(),
-                    m_all_rotations[index+k].getW()  );
-        }   // for i
-        index=(index+num_karts)%(num_karts*m_size);
-    }   // for k
-    fprintf(fd, "History file end.\n");
     fclose(fd);
 }   // Save
 
 //-----------------------------------------------------------------------------
-/** Loads a history from history.dat in the current directory.
+/** Loads a history from history.bin in the current directory or the config
+ *  directory. The file is memory mapped, the frames are accessed directly
+ *  during the replay. If only a text history file (history.dat) exists, it
+ *  is converted first.
  */
 void History::Load()
 {
-    char s[1024], s1[1024];
-    int  n;
-
-    FILE *fd = fopen("history.dat","r");
-    if(fd)
-        Log::info("History", "Reading ./history.dat");
-    else
+    const std::string names[2] = { "history",
+                                   file_manager->getUserConfigFile("history") };
+    std::string filename;
+    for(unsigned int i=0; i<2 && filename.empty(); i++)
     {
-        std::string fn = file_manager->getUserConfigFile("history.dat");
-        fd = fopen(fn.c_str(), "r");
-        if(fd)
-            Log::info("History", "Reading '%s'.", fn.c_str());
+        if(m_replay_file.open(names[i]+".bin"))
+            filename = names[i]+".bin";
+        else if(file_manager->fileExists(names[i]+".dat") &&
+                convertTextHistory(names[i]+".dat", names[i]+".bin") &&
+                m_replay_file.open(names[i]+".bin")                      )
+            filename = names[i]+".bin";
     }
-    if(!fd)
-        Log::fatal("History", "Could not open history.dat");
-
-    if (fgets(s, 1023, fd) == NULL)
-        Log::fatal("History", "Could not read history.dat.");
-
-    if (sscanf(s,"Version: %1023s",s1)!=1)
-        Log::fatal("History", "No Version information found in history file (bogus history file).");
-    else if (strcmp(s1,STK_VERSION))
-        Log::warn("History", "History is version '%s', STK version is '%s'.", s1, STK_VERSION);
-
-    if (fgets(s, 1023, fd) == NULL)
-        Log::fatal("History", "Could not read history.dat.");
-
-    unsigned int num_karts;
-    if(sscanf(s, "numkarts: %u", &num_karts)!=1)
-        Log::fatal("History", "No number of karts found in history file.");
+    if(filename.empty())
+        Log::fatal("History", "Could not open history.bin");
+    Log::info("History", "Reading '%s'.", filename.c_str());
+
+    const char *data = m_replay_file.getData();
+    const size_t size = m_replay_file.getSize();
+    size_t offset = 4;
+    uint32_t version, header_size;
+    if(size<4 || memcmp(data, HISTORY_MAGIC, 4)!=0)
+        Log::fatal("History", "'%s' is not a history file.", filename.c_str());
+    if(!readUInt32(data, size, &offset, &version) ||
+        version!=HISTORY_VERSION)
+        Log::fatal("History", "Unsupported history version in '%s'.",
+                   filename.c_str());
+
+    std::string s;
+    uint32_t num_karts, num_players, difficulty;
+    if(!readUInt32(data, size, &offset, &header_size) ||
+       !readString(data, size, &offset, &s)           ||
+       !readUInt32(data, size, &offset, &num_karts)   ||
+       !readUInt32(data, size, &offset, &num_players) ||
+       !readUInt32(data, size, &offset, &difficulty)    )
+        Log::fatal("History", "Truncated history file.");
+
+    if(s!=STK_VERSION)
+        Log::warn("History", "History is version '%s', STK version is '%s'.",
+                  s.c_str(), STK_VERSION);
     race_manager->setNumKarts(num_karts);
+    race_manager->setNumLocalPlayers(num_players);
+    race_manager->setDifficulty((RaceManager::Difficulty)difficulty);
 
-    fgets(s, 1023, fd);
-    if(sscanf(s, "numplayers: %d",&n)!=1)
-        Log::fatal("History", "No number of players found in history file.");
-    race_manager->setNumLocalPlayers(n);
-
-    fgets(s, 1023, fd);
-    if(sscanf(s, "difficulty: %d",&n)!=1)
-        Log::fatal("History", "No difficulty found in history file.");
-    race_manager->setDifficulty((RaceManager::Difficulty)n);
-
-    fgets(s, 1023, fd);
-    if(sscanf(s, "track: %1023s",s1)!=1)
-        Log::warn("History", "Track not found in history file.");
-    race_manager->setTrack(s1);
+    if(!readString(data, size, &offset, &s))
+        Log::fatal("History", "Truncated history file.");
+    race_manager->setTrack(s);
     // This value doesn't really matter, but should be defined, otherwise
     // the racing phase can switch to 'ending'
     race_manager->setNumLaps(10);
 
+    m_kart_ident.clear();
     for(unsigned int i=0; i<num_karts; i++)
     {
-        fgets(s, 1023, fd);
-        if(sscanf(s, "model %d: %1023s",&n, s1) != 2)
-            Log::fatal("History", "No model information for kart %d found.", i);
-        m_kart_ident.push_back(s1);
+        if(!readString(data, size, &offset, &s))
+            Log::fatal("History", "No model information for kart %d found.",
+                       i);
+        m_kart_ident.push_back(s);
         if(i<race_manager->getNumPlayers())
         {
-            race_manager->setLocalKartInfo(i, s1);
+            race_manager->setLocalKartInfo(i, s);
         }
     }   // for i<nKarts
     // FIXME: The model information is currently ignored
-    fgets(s, 1023, fd);
-    if(sscanf(s,"size: %d",&m_size)!=1)
-        Log::fatal("History", "Number of records not found in history file.");
 
-    allocateMemory(m_size);
-    m_current = -1;
+    if(header_size<offset || header_size>size)
+        Log::fatal("History", "Invalid header size in history file.");
+    m_num_karts     = num_karts;
+    m_frame_size    = getFrameSize(num_karts);
+    m_replay_frames = data + header_size;
+    // An incomplete last frame (e.g. STK crashed while streaming) is ignored
+    m_size          = (int)((size-header_size) / m_frame_size);
+    m_current       = -1;
+    if(m_size==0)
+        Log::fatal("History", "No frames found in history file.");
+    Log::info("History", "%d frames found.", m_size);
+}   // Load
+
+//-----------------------------------------------------------------------------
+/** Converts a history file in the old text format into the binary format.
+ *  \param text_file Name of the text history file.
+ *  \param binary_file Name of the binary file to create.
+ *  \return True if the file was converted.
+ */
+bool History::convertTextHistory(const std::string &text_file,
+                                 const std::string &binary_file)
+{
+    char s[1024], s1[1024];
+    int  n;
+
+    FILE *fd = fopen(text_file.c_str(), "r");
+    if(!fd)
+    {
+        Log::error("History", "Could not open '%s'.", text_file.c_str());
+        return false;
+    }
+    Log::info("History", "Converting '%s' to '%s'.", text_file.c_str(),
+              binary_file.c_str());
+
+    // Each line must be read (and checked) in the right order
+    bool ok = fgets(s, 1023, fd)!=NULL && sscanf(s,"Version: %1023s",s1)==1;
+    if(!ok)
+        Log::error("History", "No Version information found in history file (bogus history file).");
+
+    unsigned int num_karts = 0;
+    int num_players = 0, difficulty = 0, size = 0;
+    ok = ok && fgets(s, 1023, fd) && sscanf(s, "numkarts: %u", &num_karts)==1
+            && fgets(s, 1023, fd) && sscanf(s, "numplayers: %d",&num_players)==1
+            && fgets(s, 1023, fd) && sscanf(s, "difficulty: %d",&difficulty)==1
+            && fgets(s, 1023, fd);
+    std::string track;
+    if(ok)
+    {
+        if(sscanf(s, "track: %1023s",s1)==1)
+            track = s1;
+        else
+            Log::warn("History", "Track not found in history file.");
+    }
 
-    for(int i=0; i<m_size; i++)
+    std::vector<std::string> karts;
+    for(unsigned int i=0; ok && i<num_karts; i++)
     {
-        fgets(s, 1023, fd);
-        sscanf(s, "delta: %f\n",&m_all_deltas[i]);
+        ok = fgets(s, 1023, fd) && sscanf(s, "model %d: %1023s",&n, s1)==2;
+        if(ok)
+            karts.push_back(s1);
+        else
+            Log::error("History", "No model information for kart %d found.",
+                       i);
+    }   // for i<nKarts
+
+    ok = ok && fgets(s, 1023, fd) && sscanf(s,"size: %d",&size)==1;
+    std::vector<float> deltas(ok ? size : 0);
+    for(int i=0; ok && i<size; i++)
+        ok = fgets(s, 1023, fd) && sscanf(s, "delta: %f\n",&deltas[i])==1;
+
+    FILE *out = ok ? fopen(binary_file.c_str(), "wb") : NULL;
+    if(!out)
+    {
+        if(ok)
+            Log::error("History", "Can't open '%s' for writing.",
+                       binary_file.c_str());
+        else
+            Log::error("History", "'%s' is not a valid history file.",
+                       text_file.c_str());
+        fclose(fd);
+        return false;
     }
 
-    for(int i=0; i<m_size; i++)
+    std::vector<char> buffer;
+    createHeader(&buffer, num_players, difficulty, track, karts);
+    fwrite(&buffer[0], 1, buffer.size(), out);
+
+    buffer.resize(getFrameSize(num_karts));
+    HistoryKartRecord record;
+    for(int i=0; i<size; i++)
     {
+        memcpy(&buffer[0], &deltas[i], sizeof(float));
         for(unsigned int k=0; k<num_karts; k++)
         {
-            unsigned int index = num_karts * i+k;
-            fgets(s, 1023, fd);
-            int buttonsCompressed;
-            float x,y,z,rx,ry,rz,rw;
-            sscanf(s, "%f %f %d  %f %f %f  %f %f %f %f\n",
-                    &m_all_controls[index].m_steer,
-                    &m_all_controls[index].m_accel,
-                    &buttonsCompressed,
-                    &x, &y, &z,
-                    &rx, &ry, &rz, &rw
-                    );
-            m_all_xyz[index]       = Vec3(x,y,z);
-            m_all_rotations[index] = btQuaternion(rx,ry,rz,rw);
-            m_all_controls[index].setButtonsCompressed(char(buttonsCompressed));
-        }   // for i
-    }   // for k
-    fprintf(fd, "History file end.\n");
+            int buttons_compressed = 0;
+            if(!fgets(s, 1023, fd) ||
+               sscanf(s, "%f %f %d  %f %f %f  %f %f %f %f\n",
+                      &record.m_steer, &record.m_accel,
+                      &buttons_compressed,
+                      &record.m_xyz[0], &record.m_xyz[1], &record.m_xyz[2],
+                      &record.m_rotation[0], &record.m_rotation[1],
+                      &record.m_rotation[2], &record.m_rotation[3]) != 10)
+            {
+                Log::warn("History", "History file ends after %d frames.",
+                          i);
+                fclose(out);
+                fclose(fd);
+                return true;
+            }
+            record.m_buttons = (unsigned char)buttons_compressed;
+            memcpy(&buffer[sizeof(float)+k*sizeof(record)], &record,
+                   sizeof(record));
+        }   // for k
+        fwrite(&buffer[0], 1, buffer.size(), out);
+    }   // for i
+    fclose(out);
     fclose(fd);
-}   // Load
-
+    return true;
+}   // convertTextHistory
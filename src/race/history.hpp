@@ -22,15 +22,22 @@
 #include <vector>
 #include <string>
 
-#include "LinearMath/btQuaternion.h"
-
-#include "karts/controller/kart_control.hpp"
-#include "utils/aligned_array.hpp"
-#include "utils/vec3.hpp"
+#include "io/stream_writer.hpp"
+#include "utils/mapped_file.hpp"
 
 class Kart;
 
 /**
+  * \brief Records the controls and positions of all karts for each frame,
+  *  and replays them (for debugging and profiling).
+  *  History files use a binary format: a header (see createHeader) followed
+  *  by one record per frame, each containing the time step and a fixed size
+  *  entry for each kart. Since all frames have the same size, frame n can be
+  *  accessed directly, so a history is replayed from a memory mapped file
+  *  without reading or parsing it first. The number of frames is not stored
+  *  in the header, it follows from the file size, which allows the file to
+  *  be written while the race is running (see --record-history). Old text
+  *  history files (history.dat) are converted when they are loaded.
   * \ingroup race
   */
 class History
@@ -61,17 +68,30 @@ private:
      *  how many entries to save. */
     int                        m_size;
 
-    /** Stores all time step sizes. */
-    std::vector<float>         m_all_deltas;
+    /** Number of karts stored in each frame. */
+    unsigned int               m_num_karts;
+
+    /** Size of one frame in bytes. */
+    unsigned int               m_frame_size;
+
+    /** When recording without streaming: the last frames in binary format,
+     *  used as a ring buffer. */
+    std::vector<char>          m_frames;
+
+    /** A frame in binary format, used while recording. */
+    std::vector<char>          m_frame;
+
+    /** The header of the current recording. */
+    std::vector<char>          m_header;
 
-    /** Stores the kart controls being used (for physics replay). */
-    std::vector<KartControl>   m_all_controls;
+    /** When streaming, writes each frame to the history file. */
+    StreamWriter               m_stream;
 
-    /** Stores the coordinates (for simple replay). */
-    AlignedArray<Vec3>         m_all_xyz;
+    /** The history file that is replayed. */
+    MappedFile                 m_replay_file;
 
-    /** Stores the rotations of the karts. */
-    AlignedArray<btQuaternion> m_all_rotations;
+    /** Points to the first frame in m_replay_file. */
+    const char                *m_replay_frames;
 
     /** The identities of the karts to use. */
     std::vector<std::string>  m_kart_ident;
@@ -79,6 +99,13 @@ private:
     void  allocateMemory(int number_of_frames);
     void  updateSaving(float dt);
     void  updateReplay(float dt);
+    bool  openStream();
+    const char *getFrame(int n) const;
+
+    static void createHeader(std::vector<char> *header, int num_players,
+                             int difficulty, const std::string &track,
+                             const std::vector<std::string> &karts);
+    static unsigned int getFrameSize(unsigned int num_karts);
 public:
           History        ();
     void  startReplay    ();
@@ -86,6 +113,10 @@ public:
     void  update         (float dt);
     void  Save           ();
     void  Load           ();
+    float getNextDelta   () const;
+
+    static bool convertTextHistory(const std::string &text_file,
+                                   const std::string &binary_file);
 
     // -------------------I-----------------------------------------------------
     /** Returns the identifier of the n-th kart. */
@@ -93,10 +124,6 @@ public:
     {
         return m_kart_ident[n];
     }
-    // ------------------------------------------------------------------------
-    /** Returns the size of the next timestep. */
-    float getNextDelta   () const { return m_all_deltas[m_current];         }
-
     // ------------------------------------------------------------------------
     /** Returns if a history is replayed, i.e. the history mode is not none. */
     bool  replayHistory  () const { return m_replay_mode != HISTORY_NONE;    }
@@ -19,6 +19,11 @@
 
 #include "io/file_manager.hpp"
 #include "race/race_manager.hpp"
+#include "utils/mapped_file.hpp"
+
+#include <string.h>
+
+const char ReplayBase::REPLAY_MAGIC[4] = { 'S', 'T', 'K', 'R' };
 
 // -----------------------------------------------------------------------------
 ReplayBase::ReplayBase()
@@ -35,12 +40,88 @@ FILE* ReplayBase::openReplayFile(bool writeable)
 {
     m_filename = file_manager->getUserConfigFile(
                                        race_manager->getTrackName()+".replay");
-    FILE *fd = fopen(m_filename.c_str(), writeable ? "w" : "r");
+    FILE *fd = fopen(m_filename.c_str(), writeable ? "wb" : "rb");
     if(!fd)
     {
         m_filename = race_manager->getTrackName()+".replay";
-        fd = fopen(m_filename.c_str(), writeable ? "w" : "r");
+        fd = fopen(m_filename.c_str(), writeable ? "wb" : "rb");
     }
     return fd;
 
 }   // openReplayFile
+
+// -----------------------------------------------------------------------------
+/** Maps the replay file for the current track into memory (looking in the
+ *  same places as openReplayFile).
+ *  \param file The mapped file object to use.
+ *  \return True if the file was found.
+ */
+bool ReplayBase::mapReplayFile(MappedFile *file)
+{
+    m_filename = file_manager->getUserConfigFile(
+                                       race_manager->getTrackName()+".replay");
+    if(file->open(m_filename))
+        return true;
+    m_filename = race_manager->getTrackName()+".replay";
+    return file->open(m_filename);
+}   // mapReplayFile
+
+// -----------------------------------------------------------------------------
+/** Appends data to a buffer that is written to a replay file. */
+void ReplayBase::writeData(std::vector<uint8_t> *buffer, const void *data,
+                           size_t size)
+{
+    buffer->insert(buffer->end(), (const uint8_t*)data,
+                   (const uint8_t*)data+size);
+}   // writeData
+
+// -----------------------------------------------------------------------------
+/** Appends a 32 bit integer to a buffer. */
+void ReplayBase::writeUInt32(std::vector<uint8_t> *buffer, uint32_t value)
+{
+    writeData(buffer, &value, sizeof(value));
+}   // writeUInt32
+
+// -----------------------------------------------------------------------------
+/** Appends a string (length followed by the characters) to a buffer. */
+void ReplayBase::writeString(std::vector<uint8_t> *buffer,
+                             const std::string &s)
+{
+    writeUInt32(buffer, (uint32_t)s.size());
+    writeData(buffer, s.data(), s.size());
+}   // writeString
+
+// -----------------------------------------------------------------------------
+/** Copies data from a replay file.
+ *  \param offset Offset in the file, will be increased by size.
+ *  \return False if the file is too short.
+ */
+bool ReplayBase::readData(const MappedFile &file, size_t *offset, void *data,
+                          size_t size)
+{
+    if(*offset+size > file.getSize()) return false;
+    memcpy(data, file.getData()+*offset, size);
+    *offset += size;
+    return true;
+}   // readData
+
+// -----------------------------------------------------------------------------
+/** Reads a 32 bit integer from a replay file. */
+bool ReplayBase::readUInt32(const MappedFile &file, size_t *offset,
+                            uint32_t *value)
+{
+    return readData(file, offset, value, sizeof(*value));
+}   // readUInt32
+
+// -----------------------------------------------------------------------------
+/** Reads a string from a replay file. */
+bool ReplayBase::readString(const MappedFile &file, size_t *offset,
+                            std::string *s)
+{
+    uint32_t len;
+    if(!readUInt32(file, offset, &len) || *offset+len > file.getSize())
+        return false;
+    s->assign(file.getData()+*offset, len);
+    *offset += len;
+    return true;
+}   // readString
@@ -21,9 +21,13 @@
 
 #include "LinearMath/btTransform.h"
 #include "utils/no_copy.hpp"
+#include "utils/types.hpp"
 
 #include <stdio.h>
 #include <string>
+#include <vector>
+
+class MappedFile;
 
 /**
   * \ingroup race
@@ -32,6 +36,8 @@ class ReplayBase : public NoCopy
 {
     // Needs access to KartReplayEvent
     friend class GhostKart;
+    // Needs access to TransformEvent
+    friend class ReplayStream;
 private:
     /** The filename of the replay file. Only defined after calling
      *  openReplayFile. */
@@ -62,8 +68,24 @@ protected:
     };   // KartReplayEvent
 
     // ------------------------------------------------------------------------
+    /** Identifies a binary replay file. */
+    static const char REPLAY_MAGIC[4];
+
           ReplayBase();
     FILE *openReplayFile(bool writeable);
+    bool  mapReplayFile(MappedFile *file);
+
+    static void writeData(std::vector<uint8_t> *buffer, const void *data,
+                          size_t size);
+    static void writeUInt32(std::vector<uint8_t> *buffer, uint32_t value);
+    static void writeString(std::vector<uint8_t> *buffer,
+                            const std::string &s);
+    static bool readData(const MappedFile &file, size_t *offset, void *data,
+                         size_t size);
+    static bool readUInt32(const MappedFile &file, size_t *offset,
+                           uint32_t *value);
+    static bool readString(const MappedFile &file, size_t *offset,
+                           std::string *s);
     // ----------------------------------------------------------------------
     /** Returns the filename that was opened. */
     const std::string &getReplayFilename() const { return m_filename;}
@@ -71,7 +93,7 @@ protected:
     /** Returns the version number of the replay file. This is used to check
      *  that a loaded replay file can still be understood by this
      *  executable. */
-    unsigned int getReplayVersion() const { return 1; }
+    unsigned int getReplayVersion() const { return 2; }
 };   // ReplayBase
 
 #endif
@@ -23,9 +23,11 @@
 #include "karts/ghost_kart.hpp"
 #include "modes/world.hpp"
 #include "race/race_manager.hpp"
+#include "replay/replay_stream.hpp"
 #include "tracks/track.hpp"
 
 #include <stdio.h>
+#include <string.h>
 #include <string>
 
 ReplayPlay *ReplayPlay::m_replay_play = NULL;
@@ -78,15 +80,15 @@ void ReplayPlay::update(float dt)
 }   // update
 
 //-----------------------------------------------------------------------------
-/** Loads a replay data from  file called 'trackname'.replay.
+/** Loads a replay data from  file called 'trackname'.replay. The file is
+ *  memory mapped, and only the header of each kart is read: the transforms
+ *  are decoded by the ghost karts while racing.
  */
 void ReplayPlay::Load()
 {
     m_ghost_karts.clearAndDeleteAll();
-    char s[1024], s1[1024];
 
-    FILE *fd = openReplayFile(/*writeable*/false);
-    if(!fd)
+    if(!mapReplayFile(&m_file))
     {
         Log::error("Replay", "Can't read '%s', ghost replay disabled.",
                getReplayFilename().c_str());
@@ -96,11 +98,20 @@ void ReplayPlay::Load()
 
     Log::info("Replay", "Reading replay file '%s'.", getReplayFilename().c_str());
 
-    if (fgets(s, 1023, fd) == NULL)
-        Log::fatal("Replay", "Could not read '%s'.", getReplayFilename().c_str());
+    size_t offset = 0;
+    char magic[4];
+    if(!readData(m_file, &offset, magic, sizeof(magic)) ||
+       memcmp(magic, REPLAY_MAGIC, sizeof(magic))!=0)
+    {
+        Log::error("Replay", "'%s' is not a binary replay file (replays "
+                   "saved by older versions must be recorded again), "
+                   "ghost replay disabled.", getReplayFilename().c_str());
+        destroy();
+        return;
+    }
 
     unsigned int version;
-    if (sscanf(s,"Version: %u", &version) != 1)
+    if (!readUInt32(m_file, &offset, &version))
         Log::fatal("Replay", "No Version information found in replay file (bogus replay file).");
 
     if (version != getReplayVersion())
@@ -110,11 +121,8 @@ void ReplayPlay::Load()
         Log::warn("Replay", "We try to proceed, but it may fail.");
     }
 
-    if (fgets(s, 1023, fd) == NULL)
-        Log::fatal("Replay", "Could not read '%s'.", getReplayFilename().c_str());
-
-    int  n;
-    if(sscanf(s, "difficulty: %d", &n) != 1)
+    uint32_t n;
+    if(!readUInt32(m_file, &offset, &n))
         Log::fatal("Replay", " No difficulty found in replay file.");
 
     if(race_manager->getDifficulty()!=(RaceManager::Difficulty)n)
@@ -122,105 +130,76 @@ void ReplayPlay::Load()
                   "while '%d' is selected.",
                   race_manager->getDifficulty(), n);
 
-    fgets(s, 1023, fd);
-    if(sscanf(s, "track: %s", s1) != 1)
+    std::string track;
+    if(!readString(m_file, &offset, &track))
         Log::warn("Replay", "Track not found in replay file.");
-    assert(std::string(s1)==race_manager->getTrackName());
-    race_manager->setTrack(s1);
+    assert(track==race_manager->getTrackName());
+    race_manager->setTrack(track);
 
     unsigned int num_laps;
-    fgets(s, 1023, fd);
-    if(sscanf(s, "Laps: %u", &num_laps) != 1)
+    if(!readUInt32(m_file, &offset, &num_laps))
         Log::fatal("Replay", "No number of laps found in replay file.");
 
     race_manager->setNumLaps(num_laps);
 
-    // eof actually doesn't trigger here, since it requires first to try
-    // reading behind eof, but still it's clearer this way.
-    while(!feof(fd))
-    {
-        if(fgets(s, 1023, fd)==NULL)  // eof reached
-            break;
-        readKartData(fd, s);
-    }   // for k<num_ghost_karts
+    unsigned int num_karts;
+    if(!readUInt32(m_file, &offset, &num_karts))
+        Log::fatal("Replay", "No number of karts found in replay file.");
 
-    fprintf(fd, "Replay file end.\n");
-    fclose(fd);
+    for(unsigned int k=0; k<num_karts; k++)
+        readKartData(&offset);
 }   // Load
 
 //-----------------------------------------------------------------------------
-/** Reads all data from a replay file for a specific kart.
- *  \param fd The file descriptor from which to read.
+/** Reads the data from a replay file for a specific kart, and creates the
+ *  ghost kart. The transforms are not decoded, the ghost kart only gets a
+ *  pointer to them (and the keyframe index).
+ *  \param offset Offset of the kart data in the file, on return the offset
+ *         of the data of the next kart.
  */
-void ReplayPlay::readKartData(FILE *fd, char *next_line)
+void ReplayPlay::readKartData(size_t *offset)
 {
-    char s[1024];
-    if(sscanf(next_line, "model: %s", s)!=1)
+    std::string ident;
+    if(!readString(m_file, offset, &ident))
         Log::fatal("Replay", "No model information for kart %d found.",
             m_ghost_karts.size());
 
-    m_ghost_karts.push_back(new GhostKart(std::string(s)));
-    m_ghost_karts[m_ghost_karts.size()-1].init(RaceManager::KT_GHOST);
-
-    fgets(s, 1023, fd);
-    unsigned int size;
-    if(sscanf(s,"size: %u",&size)!=1)
-        Log::fatal("Replay", "Number of records not found in replay file "
-            "for kart %d.",
-            m_ghost_karts.size()-1);
+    GhostKart *ghost_kart = new GhostKart(ident);
+    m_ghost_karts.push_back(ghost_kart);
+    ghost_kart->init(RaceManager::KT_GHOST);
 
-    for(unsigned int i=0; i<size; i++)
-    {
-        fgets(s, 1023, fd);
-        float x, y, z, rx, ry, rz, rw, time;
-
-        // Check for EV_TRANSFORM event:
-        // -----------------------------
-        if(sscanf(s, "%f  %f %f %f  %f %f %f %f\n",
-            &time,
-            &x, &y, &z,
-            &rx, &ry, &rz, &rw
-            )==8)
-        {
-            btQuaternion q(rx, ry, rz, rw);
-            btVector3 xyz(x, y, z);
-            m_ghost_karts[m_ghost_karts.size()-1].addTransform(time,
-                                                          btTransform(q, xyz));
-        }
-        else
-        {
-            // Invalid record found
-            // ---------------------
-            Log::warn("Replay", "Can't read replay data line %d:", i);
-            Log::warn("Replay", "%s", s);
-            Log::warn("Replay", "Ignored.");
-        }
-    }   // for i
-    fgets(s, 1023, fd);
-    unsigned int num_events;
-    if(sscanf(s,"events: %u",&num_events)!=1)
-        Log::warn("Replay", "Number of events not found in replay file "
+    uint32_t num_events;
+    if(!readUInt32(m_file, offset, &num_events))
+        Log::fatal("Replay", "Number of events not found in replay file "
                 "for kart %d.", m_ghost_karts.size()-1);
 
     for(unsigned int i=0; i<num_events; i++)
     {
-        fgets(s, 1023, fd);
         KartReplayEvent kre;
-        int type;
-        if(sscanf(s, "%f %d\n", &kre.m_time, &type)==2)
-        {
-            kre.m_type = (KartReplayEvent::KartReplayEventType)type;
-            m_ghost_karts[m_ghost_karts.size()-1].addReplayEvent(kre);
-        }
-        else
-        {
-            // Invalid record found
-            // ---------------------
-            Log::warn("Replay", "Can't read replay event line %d:", i);
-            Log::warn("Replay", "%s", s);
-            Log::warn("Replay", "Ignored.");
-        }
-
+        uint32_t type;
+        if(!readData(m_file, offset, &kre.m_time, sizeof(kre.m_time)) ||
+           !readUInt32(m_file, offset, &type))
+            Log::fatal("Replay", "Can't read replay event %d.", i);
+        kre.m_type = (KartReplayEvent::KartReplayEventType)type;
+        ghost_kart->addReplayEvent(kre);
     }   // for i < events
 
+    uint32_t num_keyframes;
+    if(!readUInt32(m_file, offset, &num_keyframes))
+        Log::fatal("Replay", "Number of keyframes not found in replay file "
+            "for kart %d.", m_ghost_karts.size()-1);
+    std::vector<ReplayStream::KeyFrame> keyframes(num_keyframes);
+    if(num_keyframes>0 &&
+       !readData(m_file, offset, &keyframes[0],
+                 num_keyframes*sizeof(ReplayStream::KeyFrame)))
+        Log::fatal("Replay", "Can't read keyframes for kart %d.",
+                   m_ghost_karts.size()-1);
+
+    uint32_t size;
+    if(!readUInt32(m_file, offset, &size) || *offset+size>m_file.getSize())
+        Log::fatal("Replay", "Can't read transforms for kart %d.",
+                   m_ghost_karts.size()-1);
+    ghost_kart->setTransforms((const uint8_t*)m_file.getData()+*offset, size,
+                              keyframes);
+    *offset += size;
 }   // readKartData
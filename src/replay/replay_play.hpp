@@ -20,6 +20,7 @@
 #define HEADER_REPLAY__PLAY_HPP
 
 #include "replay/replay_base.hpp"
+#include "utils/mapped_file.hpp"
 #include "utils/ptr_vector.hpp"
 
 #include <string>
@@ -38,12 +39,16 @@ private:
     /** Points to the next free entry. */
     unsigned int m_next;
 
+    /** The replay file. The ghost karts decode their transforms directly
+     *  from the mapped file, so it must be kept open. */
+    MappedFile              m_file;
+
     /** All ghost karts. */
     PtrVector<GhostKart>    m_ghost_karts;
 
           ReplayPlay();
          ~ReplayPlay();
-    void  readKartData(FILE *fd, char *next_line);
+    void  readKartData(size_t *offset);
 public:
     void  init();
     void  update(float dt);
@@ -23,6 +23,7 @@
 #include "karts/ghost_kart.hpp"
 #include "modes/world.hpp"
 #include "race/race_manager.hpp"
+#include "replay/replay_stream.hpp"
 #include "tracks/track.hpp"
 
 #include <algorithm>
@@ -164,45 +165,54 @@ void ReplayRecorder::Save()
         return;
     }
 
-    Log::info("ReplayRecorder", "Replay saved in '%s'.\n", getReplayFilename().c_str());
-
     World *world   = World::getWorld();
     unsigned int num_karts = world->getNumKarts();
-    fprintf(fd, "Version:  %d\n",   getReplayVersion());
-    fprintf(fd, "difficulty: %d\n", race_manager->getDifficulty());
-    fprintf(fd, "track: %s\n",      world->getTrack()->getIdent().c_str());
-    fprintf(fd, "Laps: %d\n",       race_manager->getNumLaps());
+    std::vector<uint8_t> buffer;
+    writeData  (&buffer, REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+    writeUInt32(&buffer, getReplayVersion());
+    writeUInt32(&buffer, race_manager->getDifficulty());
+    writeString(&buffer, world->getTrack()->getIdent());
+    writeUInt32(&buffer, race_manager->getNumLaps());
+    writeUInt32(&buffer, num_karts);
 
     unsigned int max_frames = (unsigned int)(  stk_config->m_replay_max_time 
                                              / stk_config->m_replay_dt      );
+    std::vector<uint8_t> transforms;
+    std::vector<ReplayStream::KeyFrame> keyframes;
     for(unsigned int k=0; k<num_karts; k++)
     {
-        fprintf(fd, "model: %s\n", world->getKart(k)->getIdent().c_str());
-        fprintf(fd, "size:     %d\n", m_count_transforms[k]);
+        writeString(&buffer, world->getKart(k)->getIdent());
 
-        unsigned int num_transforms = std::min(max_frames,
-                                               m_count_transforms[k]);
-        for(unsigned int i=0; i<num_transforms; i++)
-        {
-            const TransformEvent *p=&(m_transform_events[k][i]);
-            fprintf(fd, "%f  %f %f %f  %f %f %f %f\n",
-                    p->m_time,
-                    p->m_transform.getOrigin().getX(),
-                    p->m_transform.getOrigin().getY(),
-                    p->m_transform.getOrigin().getZ(),
-                    p->m_transform.getRotation().getX(),
-                    p->m_transform.getRotation().getY(),
-                    p->m_transform.getRotation().getZ(),
-                    p->m_transform.getRotation().getW()
-                );
-        }   // for i
-        fprintf(fd, "events: %d\n", (int)m_kart_replay_event[k].size());
+        writeUInt32(&buffer, (uint32_t)m_kart_replay_event[k].size());
         for(unsigned int i=0; i<m_kart_replay_event[k].size(); i++)
         {
             const KartReplayEvent *p=&(m_kart_replay_event[k][i]);
-            fprintf(fd, "%f %d\n", p->m_time, p->m_type);
+            writeData  (&buffer, &p->m_time, sizeof(p->m_time));
+            writeUInt32(&buffer, p->m_type);
         }
-    }
+
+        unsigned int num_transforms = std::min(max_frames,
+                                               m_count_transforms[k]);
+        ReplayStream::encode(num_transforms>0 ? &m_transform_events[k][0]
+                                              : NULL,
+                             num_transforms,
+                             stk_config->m_replay_keyframe_interval,
+                             &transforms, &keyframes);
+        writeUInt32(&buffer, (uint32_t)keyframes.size());
+        if(!keyframes.empty())
+            writeData(&buffer, &keyframes[0],
+                      keyframes.size()*sizeof(ReplayStream::KeyFrame));
+        writeUInt32(&buffer, (uint32_t)transforms.size());
+        if(!transforms.empty())
+            writeData(&buffer, &transforms[0], transforms.size());
+    }   // for k<num_karts
+
+    if(fwrite(&buffer[0], 1, buffer.size(), fd)!=buffer.size())
+        Log::error("ReplayRecorder", "Could not write '%s'.",
+                   getReplayFilename().c_str());
+    else
+        Log::info("ReplayRecorder", "Replay saved in '%s' (%d bytes).",
+                  getReplayFilename().c_str(), (int)buffer.size());
     fclose(fd);
 }   // Save
 
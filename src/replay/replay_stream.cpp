@@ -0,0 +1,278 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "replay/replay_stream.hpp"
+
+#include "network/kart_snapshot.hpp"
+#include "utils/log.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+/** Size of a keyframe record: type, time, position and rotation. */
+static const uint32_t KEYFRAME_SIZE = 1 + 8*sizeof(float);
+
+/** Size of a delta record: type, time, position and packed rotation. */
+static const uint32_t DELTA_SIZE    = 1 + 4*sizeof(int16_t) + sizeof(uint32_t);
+
+/** Two consecutive transforms must be at least this far apart. Besides
+ *  saving space it guarantees that the time between two decoded
+ *  transforms is never 0. */
+static const float    MIN_TIME_STEP = 0.0005f;
+
+// ----------------------------------------------------------------------------
+/** Compares a keyframe with a time, used for binary search. */
+static bool isBefore(float time, const ReplayStream::KeyFrame &kf)
+{
+    return time < kf.m_time;
+}   // isBefore
+
+// ----------------------------------------------------------------------------
+ReplayStream::ReplayStream()
+{
+    m_data     = NULL;
+    m_size     = 0;
+    m_offset   = 0;
+    m_time     = 0;
+    m_xyz      = btVector3(0, 0, 0);
+    m_rotation = btQuaternion(0, 0, 0, 1);
+}   // ReplayStream
+
+// ----------------------------------------------------------------------------
+/** Sets the data to decode. The data is not copied, so it must be kept
+ *  alive while this stream is used.
+ *  \param data The encoded transforms.
+ *  \param size Size of the data.
+ *  \param keyframes The keyframe index.
+ */
+void ReplayStream::init(const uint8_t *data, uint32_t size,
+                        const std::vector<KeyFrame> &keyframes)
+{
+    m_data      = data;
+    m_size      = size;
+    m_keyframes = keyframes;
+    seek(0);
+}   // init
+
+// ----------------------------------------------------------------------------
+/** Applies a time and position delta. This is used by the encoder as well
+ *  as the decoder, so that both compute exactly the same values, and
+ *  quantisation errors do not accumulate.
+ */
+void ReplayStream::applyDelta(int16_t dt, const int16_t *dxyz, float *time,
+                              btVector3 *xyz)
+{
+    *time += dt*0.001f;
+    *xyz  += btVector3(dxyz[0]*0.001f, dxyz[1]*0.001f, dxyz[2]*0.001f);
+}   // applyDelta
+
+// ----------------------------------------------------------------------------
+/** Encodes the transforms of one kart.
+ *  \param events The transforms, sorted by time.
+ *  \param count Number of transforms.
+ *  \param keyframe_interval Time between keyframes.
+ *  \param data On return the encoded transforms.
+ *  \param keyframes On return the keyframe index.
+ */
+void ReplayStream::encode(const ReplayBase::TransformEvent *events,
+                          unsigned int count, float keyframe_interval,
+                          std::vector<uint8_t> *data,
+                          std::vector<KeyFrame> *keyframes)
+{
+    data->clear();
+    keyframes->clear();
+    // The values the decoder will compute
+    float     time          = 0;
+    btVector3 xyz(0, 0, 0);
+    float     last_keyframe = 0;
+    for(unsigned int i=0; i<count; i++)
+    {
+        const ReplayBase::TransformEvent &e = events[i];
+        if(i>0 && e.m_time - time < MIN_TIME_STEP)
+            continue;
+        const btVector3    &p = e.m_transform.getOrigin();
+        const btQuaternion  q = e.m_transform.getRotation();
+
+        bool keyframe = keyframes->empty() ||
+                        e.m_time - last_keyframe >= keyframe_interval;
+        int16_t delta[4];
+        if(!keyframe)
+        {
+            float f = roundf((e.m_time-time)*1000.0f);
+            keyframe = f<1 || f>32767;
+            delta[0] = (int16_t)f;
+            for(unsigned int j=0; j<3 && !keyframe; j++)
+            {
+                f = roundf((p[j]-xyz[j])*1000.0f);
+                keyframe = fabsf(f) > 32767;
+                delta[j+1] = (int16_t)f;
+            }
+        }
+
+        if(keyframe)
+        {
+            KeyFrame kf;
+            kf.m_time   = e.m_time;
+            kf.m_offset = (uint32_t)data->size();
+            keyframes->push_back(kf);
+            const float values[8] = { e.m_time, p.getX(), p.getY(), p.getZ(),
+                                      q.getX(), q.getY(), q.getZ(), q.getW() };
+            data->push_back(RECORD_KEYFRAME);
+            const uint8_t *v = (const uint8_t*)values;
+            data->insert(data->end(), v, v+sizeof(values));
+            time          = e.m_time;
+            xyz           = p;
+            last_keyframe = e.m_time;
+        }
+        else
+        {
+            const uint32_t c = KartSnapshotCodec::compressQuaternion(q);
+            data->push_back(RECORD_DELTA);
+            const uint8_t *v = (const uint8_t*)delta;
+            data->insert(data->end(), v, v+sizeof(delta));
+            v = (const uint8_t*)&c;
+            data->insert(data->end(), v, v+sizeof(c));
+            applyDelta(delta[0], delta+1, &time, &xyz);
+        }
+    }   // for i<count
+}   // encode
+
+// ----------------------------------------------------------------------------
+/** Prepares decoding at the given time: the next call to next() returns
+ *  the last keyframe at or before this time (or the first transform if
+ *  time is before the first keyframe). This is a binary search in the
+ *  keyframe index.
+ *  \param time The race time.
+ */
+void ReplayStream::seek(float time)
+{
+    if(m_keyframes.empty())
+    {
+        m_offset = m_size;
+        return;
+    }
+    std::vector<KeyFrame>::const_iterator i =
+        std::upper_bound(m_keyframes.begin(), m_keyframes.end(), time,
+                         isBefore);
+    if(i!=m_keyframes.begin())
+        i--;
+    m_offset = i->m_offset;
+}   // seek
+
+// ----------------------------------------------------------------------------
+/** Decodes the next transform.
+ *  \param time On return the time of the transform.
+ *  \param transform On return the transform.
+ *  \return False if there are no more transforms.
+ */
+bool ReplayStream::next(float *time, btTransform *transform)
+{
+    if(m_offset>=m_size) return false;
+
+    const uint8_t *p = m_data + m_offset;
+    if(p[0]==RECORD_KEYFRAME && m_offset+KEYFRAME_SIZE<=m_size)
+    {
+        float values[8];
+        memcpy(values, p+1, sizeof(values));
+        m_time     = values[0];
+        m_xyz      = btVector3(values[1], values[2], values[3]);
+        m_rotation = btQuaternion(values[4], values[5], values[6], values[7]);
+        m_offset  += KEYFRAME_SIZE;
+    }
+    else if(p[0]==RECORD_DELTA && m_offset+DELTA_SIZE<=m_size)
+    {
+        int16_t  delta[4];
+        uint32_t c;
+        memcpy(delta, p+1, sizeof(delta));
+        memcpy(&c, p+1+sizeof(delta), sizeof(c));
+        applyDelta(delta[0], delta+1, &m_time, &m_xyz);
+        m_rotation = KartSnapshotCodec::decompressQuaternion(c);
+        m_offset  += DELTA_SIZE;
+    }
+    else
+    {
+        Log::warn("ReplayStream", "Invalid replay data at offset %d.",
+                  m_offset);
+        m_offset = m_size;
+        return false;
+    }
+    *time = m_time;
+    transform->setOrigin(m_xyz);
+    transform->setRotation(m_rotation);
+    return true;
+}   // next
+
+// ----------------------------------------------------------------------------
+/** Encodes a kart driving on a circle for ten minutes, and checks that the
+ *  decoded transforms (when decoding from the start or after seeking) are
+ *  close to the original ones.
+ */
+void ReplayStream::unitTesting()
+{
+    const unsigned int count = 12000;
+    std::vector<ReplayBase::TransformEvent> events(count);
+    for(unsigned int i=0; i<count; i++)
+    {
+        float t = i*0.05f;
+        events[i].m_time = t;
+        events[i].m_transform.setOrigin(btVector3(150.0f*cosf(0.1f*t), 2.0f,
+                                                  150.0f*sinf(0.1f*t)));
+        events[i].m_transform.setRotation(btQuaternion(btVector3(0, 1, 0),
+                                                       -0.1f*t));
+    }
+    std::vector<uint8_t>  data;
+    std::vector<KeyFrame> keyframes;
+    encode(&events[0], count, 2.0f, &data, &keyframes);
+
+    ReplayStream stream;
+    stream.init(&data[0], (uint32_t)data.size(), keyframes);
+    float time;
+    btTransform transform;
+    unsigned int n = 0;
+    while(stream.next(&time, &transform))
+    {
+        // Quantisation error is at most 0.5 ms and 0.5 mm, plus rounding
+        const btVector3 d = transform.getOrigin()
+                          - events[n].m_transform.getOrigin();
+        const btQuaternion q = events[n].m_transform.getRotation();
+        if(fabsf(time-events[n].m_time) > 0.001f ||
+           fabsf(d.getX())>0.001f || fabsf(d.getY())>0.001f ||
+           fabsf(d.getZ())>0.001f ||
+           fabsf(fabsf(q.dot(transform.getRotation()))-1.0f) > 0.001f)
+        {
+            Log::error("ReplayStream", "Transform %d decoded incorrectly.",
+                       n);
+            assert(false);
+        }
+        n++;
+    }
+    assert(n==count);
+
+    // After seeking, decoding must continue at the keyframe before the time
+    stream.seek(317.3f);
+    stream.next(&time, &transform);
+    assert(time<=317.3f && time>317.3f-2.0f);
+    while(time<317.3f && stream.next(&time, &transform)) {}
+    assert(fabsf(time-317.3f) < 0.05f);
+
+    Log::info("ReplayStream", "%d transforms: %d bytes, %d keyframes "
+              "(%d bytes uncompressed).", count, (int)data.size(),
+              (int)keyframes.size(), count*8*(int)sizeof(float));
+}   // unitTesting
@@ -0,0 +1,100 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_REPLAY_STREAM_HPP
+#define HEADER_REPLAY_STREAM_HPP
+
+#include "replay/replay_base.hpp"
+#include "utils/types.hpp"
+
+#include "LinearMath/btTransform.h"
+
+#include <vector>
+
+/**
+  * \brief Compact encoding of the transforms of one kart in a replay file.
+  *  Transforms are stored as a sequence of records. A keyframe contains
+  *  the full transform, all other records only contain the time and
+  *  position relative to the previous record (in ms and mm) and the
+  *  rotation packed into 32 bits (see KartSnapshotCodec). A keyframe is
+  *  stored every keyframe interval (and whenever a delta does not fit), and
+  *  each keyframe has an entry in an index, so decoding can start at any
+  *  race time without decoding the transforms before it.
+  *  The decoder only keeps a pointer to the encoded data, transforms are
+  *  decoded one by one when they are needed.
+  * \ingroup replay
+  */
+class ReplayStream
+{
+public:
+    /** An entry in the keyframe index. */
+    struct KeyFrame
+    {
+        /** Time of the transform in the keyframe. */
+        float    m_time;
+        /** Offset of the keyframe record in the data. */
+        uint32_t m_offset;
+    };   // KeyFrame
+
+private:
+    /** The types of records. */
+    enum { RECORD_KEYFRAME = 0, RECORD_DELTA = 1 };
+
+    /** The encoded transforms. */
+    const uint8_t        *m_data;
+
+    /** Size of m_data in bytes. */
+    uint32_t              m_size;
+
+    /** The keyframe index. */
+    std::vector<KeyFrame> m_keyframes;
+
+    /** Offset of the next record to decode. */
+    uint32_t              m_offset;
+
+    /** The last decoded time, position and rotation. Deltas are relative
+     *  to these values. */
+    float                 m_time;
+    btVector3             m_xyz;
+    btQuaternion          m_rotation;
+
+    static void applyDelta(int16_t dt, const int16_t *dxyz, float *time,
+                           btVector3 *xyz);
+
+public:
+         ReplayStream();
+    void init(const uint8_t *data, uint32_t size,
+              const std::vector<KeyFrame> &keyframes);
+    void seek(float time);
+    bool next(float *time, btTransform *transform);
+
+    static void encode(const ReplayBase::TransformEvent *events,
+                       unsigned int count, float keyframe_interval,
+                       std::vector<uint8_t> *data,
+                       std::vector<KeyFrame> *keyframes);
+    static void unitTesting();
+
+    // ------------------------------------------------------------------------
+    /** Returns the time of the first transform. */
+    float getStartTime() const
+    {
+        return m_keyframes.empty() ? 0.0f : m_keyframes[0].m_time;
+    }   // getStartTime
+};   // ReplayStream
+
+#endif
@@ -22,6 +22,8 @@
 
 #include <IMesh.h>
 #include <ICameraSceneNode.h>
+#include <algorithm>
+#include <math.h>
 #include "graphics/central_settings.hpp"
 #include "config/user_config.hpp"
 #include "graphics/callbacks.hpp"
@@ -56,11 +58,14 @@ QuadGraph::QuadGraph(const std::string &quad_file_name,
     m_mesh_buffer          = NULL;
     m_lap_length           = 0;
     m_new_rtt              = NULL;
+    m_grid_width           = 0;
+    m_grid_height          = 0;
     QuadSet::create();
     QuadSet::get()->init(quad_file_name);
     m_quad_filename        = quad_file_name;
     m_quad_graph           = this;
     load(graph_file_name);
+    buildGrid();
 }   // QuadGraph
 
 // -----------------------------------------------------------------------------
@@ -848,6 +853,17 @@ void QuadGraph::findRoadSector(const Vec3& xyz, int *sector,
     unsigned int max_count  = (*sector!=UNKNOWN_SECTOR && all_sectors!=NULL)
                             ? (unsigned int)all_sectors->size()
                             : (unsigned int)m_all_nodes.size();
+
+    // Without a list of sectors only the nodes in the grid cell of xyz
+    // need to be tested.
+    if(!all_sectors && m_grid_width>0)
+    {
+        *sector = findRoadSectorInGrid(xyz,
+                                       indx<(int)m_all_nodes.size()-1 ? indx+1
+                                                                      : 0);
+        return;
+    }
+
     *sector = UNKNOWN_SECTOR;
     for(unsigned int i=0; i<max_count; i++)
     {
@@ -925,6 +941,16 @@ int QuadGraph::findOutOfRoadSector(const Vec3& xyz,
         if(current_sector<0) current_sector += getNumNodes();
     }
 
+    if(!all_sectors && m_grid_width>0)
+    {
+        const int first = current_sector+1==(int)getNumNodes()
+                        ? 0 : current_sector+1;
+        int sector = findNearestSectorInGrid(xyz, first);
+        if(sector==UNKNOWN_SECTOR)
+            Log::info("Quad Grap", "unknown sector found.");
+        return sector;
+    }
+
     int   min_sector = UNKNOWN_SECTOR;
     float min_dist_2 = 999999.0f*999999.0f;
 
@@ -975,6 +1001,245 @@ int QuadGraph::findOutOfRoadSector(const Vec3& xyz,
     return min_sector;
 }   // findOutOfRoadSector
 
+//-----------------------------------------------------------------------------
+/** Builds the grid used by findRoadSector and findOutOfRoadSector. Each node
+ *  is added to all cells that its quad's bounding box overlaps. Since the
+ *  line of a node (see GraphNode::getDistance2FromPoint) connects the
+ *  centers of two quad sides, it is inside this bounding box as well. The
+ *  cell size is chosen so that on average a few quads are in each cell.
+ */
+void QuadGraph::buildGrid()
+{
+    m_grid_width  = 0;
+    m_grid_height = 0;
+    m_grid_start.clear();
+    m_grid_nodes.clear();
+    if(m_all_nodes.empty()) return;
+
+    std::vector<float> min_x(m_all_nodes.size()), max_x(m_all_nodes.size());
+    std::vector<float> min_z(m_all_nodes.size()), max_z(m_all_nodes.size());
+    float size_sum = 0;
+    for(unsigned int i=0; i<m_all_nodes.size(); i++)
+    {
+        const Quad &q = getQuadOfNode(i);
+        min_x[i] = max_x[i] = q[0].getX();
+        min_z[i] = max_z[i] = q[0].getZ();
+        for(unsigned int j=1; j<4; j++)
+        {
+            min_x[i] = std::min(min_x[i], q[j].getX());
+            max_x[i] = std::max(max_x[i], q[j].getX());
+            min_z[i] = std::min(min_z[i], q[j].getZ());
+            max_z[i] = std::max(max_z[i], q[j].getZ());
+        }
+        size_sum += std::max(max_x[i]-min_x[i], max_z[i]-min_z[i]);
+        if(i==0 || q.getMinHeight()<m_grid_min_height)
+            m_grid_min_height = q.getMinHeight();
+        if(i==0 || q.getMinHeight()>m_grid_max_height)
+            m_grid_max_height = q.getMinHeight();
+    }
+    m_grid_min_x = *std::min_element(min_x.begin(), min_x.end());
+    m_grid_min_z = *std::min_element(min_z.begin(), min_z.end());
+    const float extent_x = *std::max_element(max_x.begin(), max_x.end())
+                         - m_grid_min_x;
+    const float extent_z = *std::max_element(max_z.begin(), max_z.end())
+                         - m_grid_min_z;
+
+    // Use twice the average quad size, but limit the number of cells.
+    const int MAX_CELLS_PER_AXIS = 512;
+    m_grid_cell_size = std::max(2.0f*size_sum/m_all_nodes.size(), 1.0f);
+    m_grid_cell_size = std::max(m_grid_cell_size,
+                                std::max(extent_x, extent_z)
+                                / (MAX_CELLS_PER_AXIS-1)            );
+    m_grid_width     = (int)(extent_x/m_grid_cell_size) + 1;
+    m_grid_height    = (int)(extent_z/m_grid_cell_size) + 1;
+
+    // First count the nodes in each cell, then fill in the nodes.
+    const unsigned int num_cells = m_grid_width*m_grid_height;
+    m_grid_start.resize(num_cells+1, 0);
+    for(int pass=0; pass<2; pass++)
+    {
+        if(pass==1)
+        {
+            for(unsigned int c=0; c<num_cells; c++)
+                m_grid_start[c+1] += m_grid_start[c];
+            m_grid_nodes.resize(m_grid_start[num_cells]);
+        }
+        std::vector<unsigned int> next(m_grid_start.begin(),
+                                       m_grid_start.end()-1);
+        // Add the nodes in increasing order, so each cell is sorted.
+        for(unsigned int i=0; i<m_all_nodes.size(); i++)
+        {
+            int x0, z0, x1, z1;
+            getGridCell(min_x[i], min_z[i], &x0, &z0);
+            getGridCell(max_x[i], max_z[i], &x1, &z1);
+            for(int z=z0; z<=z1; z++)
+            {
+                for(int x=x0; x<=x1; x++)
+                {
+                    const unsigned int c = z*m_grid_width+x;
+                    if(pass==0)
+                        m_grid_start[c+1]++;
+                    else
+                        m_grid_nodes[next[c]++] = i;
+                }
+            }
+        }   // for i<m_all_nodes.size()
+    }   // for pass
+
+    Log::debug("Quad Graph", "%d nodes in a %dx%d grid (%.1fm cells), "
+               "%d entries.", (int)m_all_nodes.size(), m_grid_width,
+               m_grid_height, m_grid_cell_size, (int)m_grid_nodes.size());
+}   // buildGrid
+
+//-----------------------------------------------------------------------------
+/** Returns the grid cell of a point. The result is not clamped to the grid,
+ *  i.e. the cell might not exist.
+ */
+void QuadGraph::getGridCell(float x, float z, int *cx, int *cz) const
+{
+    // Avoid integer overflow for points (very) far away from the track
+    const float MAX_CELL = 1000000.0f;
+    float fx = floorf((x-m_grid_min_x)/m_grid_cell_size);
+    float fz = floorf((z-m_grid_min_z)/m_grid_cell_size);
+    *cx = (int)std::max(-MAX_CELL, std::min(fx, MAX_CELL));
+    *cz = (int)std::max(-MAX_CELL, std::min(fz, MAX_CELL));
+}   // getGridCell
+
+//-----------------------------------------------------------------------------
+/** Finds the sector that contains xyz using the grid. This gives the same
+ *  result as the linear search in findRoadSector.
+ *  \param xyz The point to test.
+ *  \param first The node a linear search would start with.
+ */
+int QuadGraph::findRoadSectorInGrid(const Vec3 &xyz, int first) const
+{
+    int cx, cz;
+    getGridCell(xyz.getX(), xyz.getZ(), &cx, &cz);
+    if(cx<0 || cz<0 || cx>=m_grid_width || cz>=m_grid_height)
+        return UNKNOWN_SECTOR;
+
+    const unsigned int c = cz*m_grid_width+cx;
+    int   sector    = UNKNOWN_SECTOR;
+    int   min_order = 0;
+    float min_dist  = 999999.9f;
+    for(unsigned int i=m_grid_start[c]; i<m_grid_start[c+1]; i++)
+    {
+        const int indx = m_grid_nodes[i];
+        const Quad &q  = getQuadOfNode(indx);
+        float dist     = xyz.getY() - q.getMinHeight();
+        // While negative distances are unlikely, we allow some small negative
+        // numbers in case that the kart is partly in the track.
+        if(dist<=-1.0f || dist>min_dist) continue;
+        // If several quads have the same distance, use the one
+        // a linear search would have found first.
+        const int order = getSearchOrder(indx, first);
+        if(dist==min_dist && (sector==UNKNOWN_SECTOR || order>=min_order))
+            continue;
+        if(!q.pointInQuad(xyz)) continue;
+        min_dist  = dist;
+        min_order = order;
+        sector    = indx;
+    }   // for i
+    return sector;
+}   // findRoadSectorInGrid
+
+//-----------------------------------------------------------------------------
+/** Finds the node whose line is closest to xyz (in 2d), searching the grid
+ *  cells in rings of increasing distance around xyz. The search stops when
+ *  all remaining cells are further away than the closest line found. Like
+ *  findOutOfRoadSector, nodes whose quad is a little bit below xyz are
+ *  preferred, and only if there is no such node the closest node is
+ *  returned. Both are searched in one pass, which gives the same result
+ *  as the two linear searches in findOutOfRoadSector.
+ *  \param xyz The point to test.
+ *  \param first The node a linear search would start with.
+ */
+int QuadGraph::findNearestSectorInGrid(const Vec3 &xyz, int first) const
+{
+    int cx, cz;
+    getGridCell(xyz.getX(), xyz.getZ(), &cx, &cz);
+
+    // Rings closer than r_min are outside of the grid, ring r_max
+    // contains the furthest grid cell.
+    const int r_min = std::max(std::max(-cx, cx-m_grid_width +1),
+                               std::max(-cz, cz-m_grid_height+1));
+    const int r_max = std::max(std::max(cx, m_grid_width -1-cx),
+                               std::max(cz, m_grid_height-1-cz));
+
+    // If no quad is at a suitable height, don't search for one (which
+    // would mean testing all nodes).
+    bool check_height = xyz.getY() > m_grid_min_height - 1.0f &&
+                        xyz.getY() < m_grid_max_height + 5.0f;
+
+    // Index 0: closest node with height test, index 1: closest node
+    int   min_sector[2] = { UNKNOWN_SECTOR, UNKNOWN_SECTOR };
+    int   min_order[2]  = { 0, 0 };
+    float min_dist_2[2] = { 999999.0f*999999.0f, 999999.0f*999999.0f };
+    for(int r=std::max(r_min, 0); r<=r_max; r++)
+    {
+        // Stop if the result can't change anymore: all nodes not found so
+        // far are outside of the square formed by the rings 0 to r-1, so
+        // they can't be closer than the border of this square. If they
+        // have the same distance, they might still be found first in a
+        // linear search, so continue in this case.
+        const int result = check_height ? 0 : 1;
+        if(min_sector[result]!=UNKNOWN_SECTOR && r>0)
+        {
+            const float left   = m_grid_min_x + (cx-r+1)*m_grid_cell_size;
+            const float right  = m_grid_min_x + (cx+r  )*m_grid_cell_size;
+            const float bottom = m_grid_min_z + (cz-r+1)*m_grid_cell_size;
+            const float top    = m_grid_min_z + (cz+r  )*m_grid_cell_size;
+            const float d = std::min(std::min(xyz.getX()-left,
+                                              right-xyz.getX()),
+                                     std::min(xyz.getZ()-bottom,
+                                              top-xyz.getZ())   );
+            if(d>0 && d*d>min_dist_2[result])
+                break;
+        }
+
+        const int z0 = std::max(cz-r, 0), z1 = std::min(cz+r, m_grid_height-1);
+        for(int z=z0; z<=z1; z++)
+        {
+            // Only the cells on the border of the ring: all cells in the
+            // top and bottom row, otherwise only the left and right cell.
+            const bool full_row = z==cz-r || z==cz+r;
+            const int  step     = full_row || r==0 ? 1 : 2*r;
+            for(int x=cx-r; x<=cx+r; x+=step)
+            {
+                if(x<0 || x>=m_grid_width) continue;
+                const unsigned int c = z*m_grid_width+x;
+                for(unsigned int i=m_grid_start[c]; i<m_grid_start[c+1]; i++)
+                {
+                    const int indx = m_grid_nodes[i];
+                    float dist_2 = m_all_nodes[indx]->getDistance2FromPoint(xyz);
+                    if(dist_2>min_dist_2[1] && dist_2>min_dist_2[0])
+                        continue;
+                    const int order = getSearchOrder(indx, first);
+                    for(int k=check_height ? 0 : 1; k<2; k++)
+                    {
+                        if(dist_2>min_dist_2[k] ||
+                           (dist_2==min_dist_2[k] &&
+                            (min_sector[k]==UNKNOWN_SECTOR ||
+                             order>=min_order[k])              ))
+                            continue;
+                        if(k==0)
+                        {
+                            float dist = xyz.getY()
+                                       - getQuadOfNode(indx).getMinHeight();
+                            if(dist >= 5.0f || dist<=-1.0f) continue;
+                        }
+                        min_dist_2[k] = dist_2;
+                        min_order[k]  = order;
+                        min_sector[k] = indx;
+                    }   // for k
+                }   // for i in cell
+            }   // for x
+        }   // for z
+    }   // for r
+
+    return min_sector[0]!=UNKNOWN_SECTOR ? min_sector[0] : min_sector[1];
+}   // findNearestSectorInGrid
+
 //-----------------------------------------------------------------------------
 /** Takes a snapshot of the driveline quads so they can be used as minimap.
  */
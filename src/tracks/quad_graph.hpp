@@ -82,6 +82,25 @@ private:
     /** Wether the graph should be reverted or not */
     bool                     m_reverse;
 
+    /** A 2d grid (x/z) over the bounding boxes of all quads, used to avoid
+     *  testing all nodes in findRoadSector and findOutOfRoadSector. The
+     *  nodes whose quad overlaps cell c are stored in
+     *  m_grid_nodes[m_grid_start[c]] to m_grid_nodes[m_grid_start[c+1]-1]. */
+    std::vector<unsigned int> m_grid_start;
+    std::vector<int>         m_grid_nodes;
+
+    /** Minimum x and z coordinate of the grid. */
+    float                    m_grid_min_x, m_grid_min_z;
+
+    /** Size of a grid cell. */
+    float                    m_grid_cell_size;
+
+    /** Lowest and highest minimum height of all quads. */
+    float                    m_grid_min_height, m_grid_max_height;
+
+    /** Number of cells in x and z direction. */
+    int                      m_grid_width, m_grid_height;
+
     void setDefaultSuccessors();
     void computeChecklineRequirements(GraphNode* node, int latest_checkline);
     void computeDirectionData();
@@ -91,6 +110,19 @@ private:
     void addSuccessor(unsigned int from, unsigned int to);
     void load         (const std::string &filename);
     void computeDistanceFromStart(unsigned int start_node, float distance);
+    void buildGrid();
+    void getGridCell(float x, float z, int *cx, int *cz) const;
+    int  findRoadSectorInGrid(const Vec3 &xyz, int first) const;
+    int  findNearestSectorInGrid(const Vec3 &xyz, int first) const;
+    // ------------------------------------------------------------------------
+    /** Returns the position of node n in a linear search that starts with
+     *  node first. Used to give the same results as a linear search if two
+     *  nodes are equally good. */
+    int  getSearchOrder(int n, int first) const
+    {
+        return n>=first ? n-first : n-first+(int)m_all_nodes.size();
+    }   // getSearchOrder
+    // ------------------------------------------------------------------------
     void createMesh(bool show_invisible=true,
                     bool enable_transparency=false,
                     const video::SColor *track_color=NULL,
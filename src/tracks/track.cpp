@@ -40,6 +40,7 @@
 #include "graphics/particle_kind_manager.hpp"
 #include "graphics/stk_text_billboard.hpp"
 #include "guiengine/scalable_font.hpp"
+#include "io/asset_loader.hpp"
 #include "io/file_manager.hpp"
 #include "io/xml_node.hpp"
 #include "items/item.hpp"
@@ -61,8 +62,11 @@
 #include "tracks/quad_set.hpp"
 #include "tracks/track_object_manager.hpp"
 #include "utils/constants.hpp"
+#include "utils/job_system.hpp"
 #include "utils/log.hpp"
+#include "utils/profiler.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/time.hpp"
 #include "utils/translation.hpp"
 
 #include <IBillboardTextSceneNode.h>
@@ -75,7 +79,14 @@
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
+#include <sys/stat.h>
 #include <wchar.h>
+#ifdef WIN32
+#  include <process.h>
+#  define getpid _getpid
+#else
+#  include <unistd.h>
+#endif
 
 using namespace irr;
 
@@ -83,7 +94,12 @@ using namespace irr;
 const float Track::NOHIT           = -99999.9f;
 
 // ----------------------------------------------------------------------------
-Track::Track(const std::string &filename)
+/** Creates a track and reads its track.xml file.
+ *  \param filename Name of the track.xml file.
+ *  \param root The already parsed track.xml file, or NULL if the file
+ *         should be read now. The track takes ownership of this tree.
+ */
+Track::Track(const std::string &filename, XMLNode *root)
 {
 #ifdef DEBUG
     m_magic_number          = 0x17AC3802;
@@ -108,6 +124,9 @@ Track::Track(const std::string &filename)
     m_version               = 0;
     m_track_mesh            = NULL;
     m_gfx_effect_mesh       = NULL;
+    m_preloaded_physics[0]  = NULL;
+    m_preloaded_physics[1]  = NULL;
+    m_preloaded_physics_key = 0;
     m_internal              = false;
     m_enable_auto_rescue    = true;  // Below set to false in arenas
     m_enable_push_back      = true;
@@ -143,8 +162,9 @@ Track::Track(const std::string &filename)
     m_default_number_of_laps= 3;
     m_all_nodes.clear();
     m_static_physics_only_nodes.clear();
+    m_library_dirs.clear();
     m_all_cached_meshes.clear();
-    loadTrackInfo();
+    loadTrackInfo(root);
 }   // Track
 
 //-----------------------------------------------------------------------------
@@ -154,6 +174,8 @@ Track::~Track()
     // Note that the music information in m_music is globally managed
     // by the music_manager, and is freed there. So no need to free it
     // here (esp. since various track might share the same music).
+    delete m_preloaded_physics[0];
+    delete m_preloaded_physics[1];
 #ifdef DEBUG
     assert(m_magic_number == 0x17AC3802);
     m_magic_number = 0xDEADBEEF;
@@ -294,6 +316,7 @@ void Track::cleanup()
     }
     m_all_nodes.clear();
     m_static_physics_only_nodes.clear();
+    m_library_dirs.clear();
 
     m_all_emitters.clearAndDeleteAll();
 
@@ -451,7 +474,11 @@ void Track::cleanup()
 }   // cleanup
 
 //-----------------------------------------------------------------------------
-void Track::loadTrackInfo()
+/** Reads the information from track.xml.
+ *  \param root The parsed track.xml file (which will be deleted), or NULL
+ *         in which case the file is read here.
+ */
+void Track::loadTrackInfo(XMLNode *root)
 {
     // Default values
     m_use_fog               = false;
@@ -474,10 +501,12 @@ void Track::loadTrackInfo()
     irr_driver->setSSAORadius(1.);
     irr_driver->setSSAOK(1.5);
     irr_driver->setSSAOSigma(1.);
-    XMLNode *root           = file_manager->createXMLTree(m_filename);
+    if(!root)
+        root = file_manager->createXMLTree(m_filename);
 
     if(!root || root->getName()!="track")
     {
+        delete root;
         std::ostringstream o;
         o<<"Can't load track '"<<m_filename<<"', no track element.";
         throw std::runtime_error(o.str());
@@ -704,21 +733,16 @@ void Track::mapPoint2MiniMap(const Vec3 &xyz, Vec3 *draw_at) const
     draw_at->setY(draw_at->getY() * m_minimap_y_scale);
 }
 // -----------------------------------------------------------------------------
-/** Convert the track tree into its physics equivalents.
- *  \param main_track_count The number of meshes that are already converted
- *         when the main track was converted. Only the additional meshes
- *         added later still need to be converted.
+/** Convert the track tree into its physics equivalents. If a valid physics
+ *  cache exists for this track, the triangle meshes and their bvh are
+ *  loaded from the cache instead of converting all scene nodes. Otherwise
+ *  the nodes are converted and the cache is written.
+ *  \param main_track_count The number of meshes that belong to the main
+ *         track model. They are converted first, followed by physics-only
+ *         nodes and all additional objects.
  */
 void Track::createPhysicsModel(unsigned int main_track_count)
 {
-    // Remove the temporary track rigid body, and then convert all objects
-    // (i.e. the track and all additional objects) into a new rigid body
-    // and convert this again. So this way we have an optimised track
-    // rigid body which includes all track objects.
-    // Note that removing the rigid body does not remove the already collected
-    // triangle information, so there is no need to convert the actual track
-    // (first element in m_track_mesh) again!
-
     if (m_track_mesh == NULL)
     {
         Log::error("track",
@@ -726,33 +750,301 @@ void Track::createPhysicsModel(unsigned int main_track_count)
         return;
     }
 
+    const double start_time = StkTime::getRealTime();
 
-    // Now convert all objects that are only used for the physics
-    // (like invisible walls).
-    for (unsigned int i = 0; i<m_static_physics_only_nodes.size(); i++)
+    // All nodes that are converted, in the order in which they are
+    // converted: the main track, then all objects that are only used for
+    // the physics (like invisible walls), then all other objects.
+    std::vector<scene::ISceneNode*> nodes(m_all_nodes.begin(),
+                                          m_all_nodes.begin()+main_track_count);
+    nodes.insert(nodes.end(), m_static_physics_only_nodes.begin(),
+                 m_static_physics_only_nodes.end());
+    nodes.insert(nodes.end(), m_object_physics_only_nodes.begin(),
+                 m_object_physics_only_nodes.end());
+    nodes.insert(nodes.end(), m_all_nodes.begin()+main_track_count,
+                 m_all_nodes.end());
+
+    const std::string cache_file = getPhysicsCacheFile();
+    const unsigned int key = getPhysicsCacheKey(nodes);
+    bool from_cache = UserConfigParams::m_cache_physics &&
+                      loadPhysicsCache(cache_file, key);
+    if(!from_cache)
     {
-        convertTrackToBullet(m_static_physics_only_nodes[i]);
-        irr_driver->removeNode(m_static_physics_only_nodes[i]);
+        for (unsigned int i = 0; i < nodes.size(); i++)
+            convertTrackToBullet(nodes[i]);
     }
+
+    for (unsigned int i = 0; i<m_static_physics_only_nodes.size(); i++)
+        irr_driver->removeNode(m_static_physics_only_nodes[i]);
     m_static_physics_only_nodes.clear();
 
     for (unsigned int i = 0; i<m_object_physics_only_nodes.size(); i++)
     {
-        convertTrackToBullet(m_object_physics_only_nodes[i]);
         m_object_physics_only_nodes[i]->setVisible(false);
         m_object_physics_only_nodes[i]->grab();
         irr_driver->removeNode(m_object_physics_only_nodes[i]);
     }
 
-    m_track_mesh->removeAll();
-    m_gfx_effect_mesh->removeAll();
-    for(unsigned int i=main_track_count; i<m_all_nodes.size(); i++)
+    // Building the bvh of the track mesh is the slowest part if the cache
+    // is not used, so the gfx effect mesh is built at the same time.
+    JobSystem::parallelFor(0, 2, this, &Track::createCollisionShapes);
+
+    if(!from_cache && UserConfigParams::m_cache_physics)
+        savePhysicsCache(cache_file, key);
+
+    Log::info("track", "%s physics model of '%s' (%d triangles) in %f ms.",
+              from_cache ? "Loaded" : "Created", m_ident.c_str(),
+              m_track_mesh->getNumTriangles()
+                                    + m_gfx_effect_mesh->getNumTriangles(),
+              1000.0*(StkTime::getRealTime()-start_time));
+}   // createPhysicsModel
+
+// -----------------------------------------------------------------------------
+/** Creates the physical body of the track mesh (index 0) and the collision
+ *  shape of the gfx effect mesh (index 1), which are independent of each
+ *  other. Called by JobSystem::parallelFor, the main thread waits till both
+ *  are done (so it can't access the physics world meanwhile).
+ */
+void Track::createCollisionShapes(int begin, int end)
+{
+    for(int i=begin; i<end; i++)
     {
-        convertTrackToBullet(m_all_nodes[i]);
+        if(i==0)
+            m_track_mesh->createPhysicalBody();
+        else
+            m_gfx_effect_mesh->createCollisionShape();
     }
-    m_track_mesh->createPhysicalBody();
-    m_gfx_effect_mesh->createCollisionShape();
-}   // createPhysicsModel
+}   // createCollisionShapes
+
+// -----------------------------------------------------------------------------
+/** Returns the name of the physics cache file of this track, which is
+ *  stored next to the cached textures.
+ */
+std::string Track::getPhysicsCacheFile() const
+{
+    std::string dir = file_manager->getCachedTexturesDir() + "physics/";
+    file_manager->checkAndCreateDirectoryP(dir);
+    return dir + m_ident + ".bin";
+}   // getPhysicsCacheFile
+
+// -----------------------------------------------------------------------------
+/** Adds the bytes of some data to a FNV-1a hash. */
+static void addToHash(unsigned int *hash, const void *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char*)data;
+    for(size_t i=0; i<size; i++)
+        *hash = (*hash ^ p[i]) * 16777619u;
+}   // addToHash
+
+// -----------------------------------------------------------------------------
+/** Computes a key that identifies the scene nodes which are converted to the
+ *  physics model. It does not look at the actual vertices (which would be as
+ *  slow as converting them), but at the position and the mesh buffers of
+ *  each node, and at the names and modification times of all files the
+ *  nodes are loaded from: the files of the track, of all library objects
+ *  used by the track, and the global materials. So a cache is not used
+ *  anymore if any of these files is changed or replaced (even by an older
+ *  file).
+ *  \param nodes The nodes that are converted.
+ */
+unsigned int Track::getPhysicsCacheKey(
+                           const std::vector<scene::ISceneNode*> &nodes) const
+{
+    unsigned int hash = 2166136261u;
+    addToHash(&hash, &stk_config->m_smooth_angle_limit,
+              sizeof(stk_config->m_smooth_angle_limit));
+
+    std::set<std::string> files;
+    file_manager->listFiles(files, m_root, /*make_full_path*/true);
+    for(std::set<std::string>::const_iterator i=m_library_dirs.begin();
+        i!=m_library_dirs.end(); i++)
+    {
+        file_manager->listFiles(files, *i, /*make_full_path*/true);
+    }
+    files.insert(file_manager->getAsset(FileManager::TEXTURE,
+                                        "materials.xml"));
+    files.insert(file_manager->getAsset(FileManager::MODEL, "materials.xml"));
+    for(std::set<std::string>::iterator i=files.begin(); i!=files.end(); i++)
+    {
+        struct stat file_stat;
+        if(stat(i->c_str(), &file_stat)!=0)
+            continue;
+        const long long mtime = (long long)file_stat.st_mtime;
+        addToHash(&hash, i->c_str(), i->size());
+        addToHash(&hash, &mtime, sizeof(mtime));
+    }
+    for(unsigned int i=0; i<nodes.size(); i++)
+    {
+        scene::ISceneNode *node = nodes[i];
+        if (node->getType() == scene::ESNT_LOD_NODE)
+            node = ((LODNode*)node)->getFirstNode();
+        if(!node) continue;
+
+        const scene::ESCENE_NODE_TYPE type = node->getType();
+        addToHash(&hash, &type, sizeof(type));
+        node->updateAbsolutePosition();
+        addToHash(&hash, node->getAbsoluteTransformation().pointer(),
+                  16*sizeof(f32));
+
+        scene::IMesh *mesh = NULL;
+        if(type==scene::ESNT_MESH || type==scene::ESNT_WATER_SURFACE ||
+           type==scene::ESNT_OCTREE)
+            mesh = ((scene::IMeshSceneNode*)node)->getMesh();
+        else if(type==scene::ESNT_ANIMATED_MESH)
+            mesh = ((scene::IAnimatedMeshSceneNode*)node)->getMesh();
+        if(!mesh) continue;
+
+        for(unsigned int j=0; j<mesh->getMeshBufferCount(); j++)
+        {
+            scene::IMeshBuffer *mb = mesh->getMeshBuffer(j);
+            const u32 data[3] = { (u32)mb->getVertexType(),
+                                  mb->getVertexCount(), mb->getIndexCount() };
+            addToHash(&hash, data, sizeof(data));
+        }
+    }   // for i<nodes.size()
+    return hash;
+}   // getPhysicsCacheKey
+
+// -----------------------------------------------------------------------------
+/** Version of the physics cache file, must be increased whenever the format
+ *  or the way the track is converted changes. */
+static const unsigned int PHYSICS_CACHE_VERSION = 1;
+
+/** Loads the track mesh and the gfx effect mesh from the physics cache. The
+ *  cache is only used if it has the current version and was created for the
+ *  same scene nodes and files (see getPhysicsCacheKey).
+ *  \param cache_file Name of the cache file.
+ *  \param key Key of the scene nodes that are converted.
+ *  \return True if the meshes were loaded.
+ */
+bool Track::loadPhysicsCache(const std::string &cache_file, unsigned int key)
+{
+    if(m_preloaded_physics[0] && m_preloaded_physics_key==key)
+    {
+        m_track_mesh->useCachedData(m_preloaded_physics[0],
+                                    /*take_ownership*/false);
+        m_gfx_effect_mesh->useCachedData(m_preloaded_physics[1],
+                                         /*take_ownership*/false);
+        return true;
+    }
+
+    if(!file_manager->fileExists(cache_file))
+        return false;
+
+    FILE *fin = fopen(cache_file.c_str(), "rb");
+    if(!fin)
+        return false;
+    unsigned int header[3];
+    bool ok = fread(header, sizeof(header), 1, fin)==1 &&
+              header[0] == PHYSICS_CACHE_VERSION &&
+              header[1] == sizeof(btScalar) &&
+              header[2] == key;
+    if(!ok)
+        Log::info("track", "Physics cache '%s' is outdated.",
+                  cache_file.c_str());
+    ok = ok && m_track_mesh->loadCache(fin) &&
+         m_gfx_effect_mesh->loadCache(fin);
+    fclose(fin);
+    if(!ok)
+    {
+        // Discard any triangles that might have been loaded
+        delete m_track_mesh;
+        delete m_gfx_effect_mesh;
+        m_track_mesh      = new TriangleMesh();
+        m_gfx_effect_mesh = new TriangleMesh();
+    }
+    return ok;
+}   // loadPhysicsCache
+
+// -----------------------------------------------------------------------------
+/** Loads the physics cache of this track (if it exists) and keeps it for
+ *  all following races on this track. The cache key can only be checked
+ *  once the track is loaded, so if the cache is outdated by then, it is
+ *  not used (see loadPhysicsCache). This is used by a dedicated server
+ *  before it forks its lobbies, so that all lobbies share the memory of the
+ *  collision meshes of the track.
+ *  \return True if the cache was loaded.
+ */
+bool Track::preloadPhysicsCache()
+{
+    if(m_preloaded_physics[0])
+        return true;
+    const std::string cache_file = getPhysicsCacheFile();
+    if(!file_manager->fileExists(cache_file))
+        return false;
+
+    FILE *fin = fopen(cache_file.c_str(), "rb");
+    if(!fin)
+        return false;
+    unsigned int header[3];
+    TriangleMeshData *track_data = new TriangleMeshData();
+    TriangleMeshData *gfx_data   = new TriangleMeshData();
+    bool ok = fread(header, sizeof(header), 1, fin)==1 &&
+              header[0] == PHYSICS_CACHE_VERSION &&
+              header[1] == sizeof(btScalar) &&
+              track_data->load(fin) && gfx_data->load(fin);
+    fclose(fin);
+    if(!ok)
+    {
+        delete track_data;
+        delete gfx_data;
+        return false;
+    }
+    m_preloaded_physics[0]  = track_data;
+    m_preloaded_physics[1]  = gfx_data;
+    m_preloaded_physics_key = header[2];
+    return true;
+}   // preloadPhysicsCache
+
+// -----------------------------------------------------------------------------
+/** Writes the track mesh and the gfx effect mesh (including their bvh) to
+ *  the physics cache. The data is written to a temporary file (whose name
+ *  contains the process id, since several server lobbies can load the same
+ *  track at the same time), which then replaces the cache file. So a
+ *  crash or a full disk never leaves a partially written cache behind.
+ *  \param cache_file Name of the cache file.
+ *  \param key Key of the scene nodes that were converted.
+ */
+void Track::savePhysicsCache(const std::string &cache_file,
+                             unsigned int key) const
+{
+    std::ostringstream tmp_name;
+    tmp_name << cache_file << "." << getpid() << ".tmp";
+    const std::string tmp_file = tmp_name.str();
+
+    FILE *fout = fopen(tmp_file.c_str(), "wb");
+    if(!fout)
+    {
+        Log::warn("track", "Can't write physics cache '%s'.",
+                  tmp_file.c_str());
+        return;
+    }
+    const unsigned int header[3] = { PHYSICS_CACHE_VERSION,
+                                     (unsigned int)sizeof(btScalar), key };
+    bool ok = fwrite(header, sizeof(header), 1, fout)==1 &&
+              m_track_mesh->saveCache(fout) &&
+              m_gfx_effect_mesh->saveCache(fout);
+    ok = fclose(fout)==0 && ok;
+    if(!ok)
+    {
+        Log::warn("track", "Error writing physics cache '%s'.",
+                  tmp_file.c_str());
+        file_manager->removeFile(tmp_file);
+        return;
+    }
+
+#ifdef WIN32
+    // The behaviour of rename is unspecified if the target file already
+    // exists on windows - so remove it.
+    file_manager->removeFile(cache_file);
+#endif
+    if(rename(tmp_file.c_str(), cache_file.c_str())!=0)
+    {
+        Log::warn("track", "Can't rename '%s' to '%s'.",
+                  tmp_file.c_str(), cache_file.c_str());
+        file_manager->removeFile(tmp_file);
+    }
+}   // savePhysicsCache
 
 // -----------------------------------------------------------------------------
 
@@ -1409,18 +1701,9 @@ bool Track::loadMainTrack(const XMLNode &root)
 
     }   // for i
 
-    // This will (at this stage) only convert the main track model.
-    for(unsigned int i=0; i<m_all_nodes.size(); i++)
-    {
-        convertTrackToBullet(m_all_nodes[i]);
-    }
-
-    if (m_track_mesh == NULL)
-    {
-        Log::fatal("track", "m_track_mesh == NULL, cannot loadMainTrack\n");
-    }
-
-    m_gfx_effect_mesh->createCollisionShape();
+    // The main track model is converted to the physics model together
+    // with all other objects in createPhysicsModel (or loaded from the
+    // physics cache).
     scene_node->setMaterialFlag(video::EMF_LIGHTING, true);
     scene_node->setMaterialFlag(video::EMF_GOURAUD_SHADING, true);
 
@@ -1651,6 +1934,12 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
     m_sky_type             = SKY_NONE;
     m_track_object_manager = new TrackObjectManager();
 
+    // Start parsing the scene file on a worker thread, while the
+    // materials and the quad graph are loaded.
+    AssetLoader loader("Track '"+m_ident+"'");
+    std::string path = m_root + m_all_modes[mode_id].m_scene;
+    loader.loadXML(path);
+
     // Add the track directory to the texture search path
     file_manager->pushTextureSearchPath(m_root);
     file_manager->pushModelSearchPath  (m_root);
@@ -1704,8 +1993,7 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
 
 
     // Start building the scene graph
-    std::string path = m_root + m_all_modes[mode_id].m_scene;
-    XMLNode *root    = file_manager->createXMLTree(path);
+    XMLNode *root    = loader.getXML(path);
 
     // Make sure that we have a track (which is used for raycasts to
     // place other objects).
@@ -1717,6 +2005,11 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         throw std::runtime_error(msg.str());
     }
 
+    // The textures that the scene uses are decoded by the workers while
+    // the models are loaded, so that the model loaders (which must run in
+    // the main thread) only parse the meshes and upload the textures.
+    loader.decodeTextures(*root, m_root);
+
     const XMLNode *default_start = root->getNode("default-start");
     if (default_start)
     {
@@ -1760,6 +2053,7 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         node->get("xyz", &m_godrays_position);
     }
 
+    double start = getTimeMilliseconds();
     loadMainTrack(*root);
     unsigned int main_track_count = (unsigned int)m_all_nodes.size();
 
@@ -1785,6 +2079,8 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
 
     // Init all track objects
     m_track_object_manager->init();
+    loader.addStageTime(AssetLoader::STAGE_MODELS,
+                        getTimeMilliseconds()-start);
 
 
     // ---- Fog
@@ -1888,7 +2184,10 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         irr_driver->createSunInterposer();
 
 
+    start = getTimeMilliseconds();
     createPhysicsModel(main_track_count);
+    loader.addStageTime(AssetLoader::STAGE_PHYSICS,
+                        getTimeMilliseconds()-start);
 
 
     for (unsigned int i=0; i<root->getNumNodes(); i++)
@@ -1944,6 +2243,7 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         easter_world->readData(dir+"/easter_eggs.xml");
     }
 
+    loader.printStatistics();
     irr_driver->unsetTextureErrorMessage();
 }   // loadTrackModel
 
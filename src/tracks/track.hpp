@@ -26,6 +26,7 @@
   * objects.
   */
 
+#include <set>
 #include <string>
 #include <vector>
 
@@ -58,6 +59,7 @@ class ParticleKind;
 class PhysicalObject;
 class TrackObjectManager;
 class TriangleMesh;
+class TriangleMeshData;
 class World;
 class XMLNode;
 namespace Scripting
@@ -191,6 +193,10 @@ private:
       */
     std::vector<scene::ISceneNode*> m_object_physics_only_nodes;
 
+    /** The directories of all library objects used by this track. Their
+     *  files are part of the key of the physics cache. */
+    std::set<std::string> m_library_dirs;
+
     /** The list of all meshes that are loaded from disk, which means
      *  that those meshes are being cached by irrlicht, and need to be freed. */
     std::vector<scene::IMesh*>      m_all_cached_meshes;
@@ -238,6 +244,12 @@ private:
      *  allowing the kart to drive in/partly under water), but the
      *  actual surface position is needed for the water splash effect. */
     TriangleMesh*            m_gfx_effect_mesh;
+    /** The data of the track mesh and the gfx effect mesh from the physics
+     *  cache, if it was loaded by preloadPhysicsCache (otherwise NULL). It
+     *  is used by all races on this track (if the cache key matches). */
+    TriangleMeshData*        m_preloaded_physics[2];
+    /** The cache key of m_preloaded_physics. */
+    unsigned int             m_preloaded_physics_key;
     /** Minimum coordinates of this track. */
     Vec3                     m_aabb_min;
     /** Maximum coordinates of this track. */
@@ -415,9 +427,16 @@ private:
     /** The number of laps that is predefined in a track info dialog. */
     int m_actual_number_of_laps;
 
-    void loadTrackInfo();
+    void loadTrackInfo(XMLNode *root);
     void loadQuadGraph(unsigned int mode_id, const bool reverse);
     void convertTrackToBullet(scene::ISceneNode *node);
+    void createCollisionShapes(int begin, int end);
+    std::string  getPhysicsCacheFile() const;
+    unsigned int getPhysicsCacheKey(
+                          const std::vector<scene::ISceneNode*> &nodes) const;
+    bool loadPhysicsCache(const std::string &cache_file, unsigned int key);
+    void savePhysicsCache(const std::string &cache_file,
+                          unsigned int key) const;
     bool loadMainTrack(const XMLNode &node);
     void createWater(const XMLNode &node);
     void getMusicInformation(std::vector<std::string>&  filenames,
@@ -432,10 +451,12 @@ public:
 
     static const float NOHIT;
 
-                       Track             (const std::string &filename);
+                       Track             (const std::string &filename,
+                                          XMLNode *root=NULL);
                       ~Track             ();
     void               cleanup           ();
     void               removeCachedData  ();
+    bool               preloadPhysicsCache();
     void               startMusic        () const;
 
     bool               setTerrainHeight(Vec3 *pos) const;
@@ -552,6 +573,10 @@ public:
     std::string        getTrackFile(const std::string &s) const
                                 { return m_root+"/"+s; }
     // ------------------------------------------------------------------------
+    /** Adds the directory of a library object that is used by this track. */
+    void               addLibraryDir(const std::string &dir)
+                                { m_library_dirs.insert(dir); }
+    // ------------------------------------------------------------------------
     /** Returns the number of modes available for this track. */
     unsigned int       getNumberOfModes() const { return (unsigned int) m_all_modes.size();  }
     // ------------------------------------------------------------------------
@@ -20,6 +20,7 @@
 
 #include "config/stk_config.hpp"
 #include "graphics/irr_driver.hpp"
+#include "io/asset_loader.hpp"
 #include "io/file_manager.hpp"
 #include "tracks/track.hpp"
 
@@ -146,33 +147,72 @@ void TrackManager::loadTrackList()
     m_track_avail.clear();
     m_tracks.clear();
 
+    AssetLoader loader("Track list");
+
+    // First collect all directories that contain a track, so that all
+    // track.xml files can be read and parsed in parallel. A directory in
+    // the search path can either be a track itself, or contain tracks.
+    std::vector<std::string> track_dirs;
+    std::vector<bool> is_search_path;
     for(unsigned int i=0; i<m_track_search_path.size(); i++)
     {
         const std::string &dir = m_track_search_path[i];
-
-        // First test if the directory itself contains a track:
-        // ----------------------------------------------------
-        if(loadTrack(dir)) continue;  // track found, no more tests
-
-        // Then see if a subdir of this dir contains tracks
-        // ------------------------------------------------
+        if(file_manager->fileExists(dir+"track.xml"))
+        {
+            track_dirs.push_back(dir);
+            is_search_path.push_back(true);
+            continue;
+        }
         std::set<std::string> dirs;
         file_manager->listFiles(dirs, dir);
         for(std::set<std::string>::iterator subdir = dirs.begin();
             subdir != dirs.end(); subdir++)
         {
             if(*subdir=="." || *subdir=="..") continue;
-            loadTrack(dir+*subdir+"/");
+            if(!file_manager->fileExists(dir+*subdir+"/track.xml")) continue;
+            track_dirs.push_back(dir+*subdir+"/");
+            is_search_path.push_back(false);
         }   // for dir in dirs
     }   // for i <m_track_search_path.size()
+
+    for(unsigned int i=0; i<track_dirs.size(); i++)
+        loader.loadXML(track_dirs[i]+"track.xml");
+
+    for(unsigned int i=0; i<track_dirs.size(); i++)
+    {
+        if(loadTrack(track_dirs[i], &loader) || !is_search_path[i])
+            continue;
+        // If a directory in the search path contains an invalid track,
+        // see if its subdirectories contain tracks
+        std::set<std::string> dirs;
+        file_manager->listFiles(dirs, track_dirs[i]);
+        for(std::set<std::string>::iterator subdir = dirs.begin();
+            subdir != dirs.end(); subdir++)
+        {
+            if(*subdir=="." || *subdir=="..") continue;
+            loadTrack(track_dirs[i]+*subdir+"/", &loader);
+        }   // for dir in dirs
+    }   // for i < track_dirs.size()
+
+    // Now create the textures of the screenshots, which were decoded
+    // by the loader while the tracks were loaded.
+    for(unsigned int i=0; i<m_tracks.size(); i++)
+    {
+        if(!m_tracks[i]->isInternal())
+            loader.getTexture(m_tracks[i]->getScreenshotFile());
+    }
+    loader.printStatistics();
 }  // loadTrackList
 
 // ----------------------------------------------------------------------------
 /** Tries to load a track from a single directory. Returns true if a track was
  *  successfully loaded.
  *  \param dirname Name of the directory to load the track from.
+ *  \param loader If not NULL, track.xml is taken from this loader, and the
+ *         screenshot is only queued in the loader (the caller must get the
+ *         texture from the loader later).
  */
-bool TrackManager::loadTrack(const std::string& dirname)
+bool TrackManager::loadTrack(const std::string& dirname, AssetLoader *loader)
 {
     std::string config_file = dirname+"track.xml";
     if(!file_manager->fileExists(config_file))
@@ -182,7 +222,8 @@ bool TrackManager::loadTrack(const std::string& dirname)
 
     try
     {
-        track = new Track(config_file);
+        track = new Track(config_file,
+                          loader ? loader->getXML(config_file) : NULL);
     }
     catch (std::exception& e)
     {
@@ -211,7 +252,12 @@ bool TrackManager::loadTrack(const std::string& dirname)
     // Populate the texture cache with track screenshots
     // (internal tracks like end cutscene don't have screenshots)
     if (!track->isInternal())
-        irr_driver->getTexture(track->getScreenshotFile());
+    {
+        if(loader)
+            loader->loadImage(track->getScreenshotFile());
+        else
+            irr_driver->getTexture(track->getScreenshotFile());
+    }
 
     return true;
 }   // loadTrack
@@ -23,6 +23,7 @@
 #include <vector>
 #include <map>
 
+class AssetLoader;
 class Track;
 
 /**
@@ -80,7 +81,8 @@ public:
     /** Load all .track files from all directories */
     void  loadTrackList();
     void  removeTrack(const std::string &ident);
-    bool  loadTrack(const std::string& dirname);
+    bool  loadTrack(const std::string& dirname,
+                    AssetLoader *loader=NULL);
     void  removeAllCachedData();
     int   getNumberOfRaceTracks() const;
     Track* getTrack(const std::string& ident) const;
@@ -211,6 +211,7 @@ TrackObjectPresentationLibraryNode::TrackObjectPresentationLibraryNode(
         file_manager->pushModelSearchPath(lib_path);
         material_manager->pushTempMaterial(lib_path + "/materials.xml");
         model_def_loader.addToLibrary(name, libroot);
+        World::getWorld()->getTrack()->addLibraryDir(lib_path);
 
         // Load LOD groups
         const XMLNode *lod_xml_node = libroot->getNode("lod");
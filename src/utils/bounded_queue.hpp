@@ -0,0 +1,277 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_BOUNDED_QUEUE_HPP
+#define HEADER_BOUNDED_QUEUE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <pthread.h>
+#include <vector>
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <sys/time.h>
+#endif
+
+/** A ring buffer that can be filled by several threads and is emptied by
+ *  one consumer thread, which can sleep until data arrives.
+ *  The mutex is only held for the duration of a single push or pop (the
+ *  elements are not processed while the lock is held), so producers are
+ *  never blocked by the work the consumer does. push() never waits: if the
+ *  queue is full, the ring buffer grows up to a maximum capacity, and
+ *  beyond that the element is dropped (and counted). Some of the maximum
+ *  capacity can be reserved for high priority elements, which are then
+ *  still added when normal elements are already dropped. A producer like
+ *  the network thread must not wait, since it would then not handle
+ *  keep-alives and acknowledgements either.
+ */
+template<typename TYPE>
+class BoundedQueue : public NoCopy
+{
+private:
+    /** The ring buffer. */
+    std::vector<TYPE> m_data;
+
+    /** Index of the oldest element. */
+    unsigned int      m_head;
+
+    /** Number of elements in the queue. */
+    unsigned int      m_size;
+
+    /** Highest number of elements that were in the queue at the same time
+     *  since the last call to resetMaxSize(). */
+    unsigned int      m_max_size;
+
+    /** Maximum number of elements the ring buffer can grow to. */
+    unsigned int      m_max_capacity;
+
+    /** Number of elements of the maximum capacity that can only be used
+     *  by high priority elements. */
+    unsigned int      m_reserved;
+
+    /** Number of times the ring buffer was grown, and the number of
+     *  elements dropped because it had the maximum capacity. */
+    unsigned int      m_grow_count;
+    unsigned int      m_drop_count;
+
+    /** Set when the queue is closed, which wakes up all waiting threads. */
+    bool              m_closed;
+
+    mutable pthread_mutex_t m_mutex;
+    pthread_cond_t    m_cond_not_empty;
+
+    // ------------------------------------------------------------------------
+    /** Computes the absolute time timeout_ms milliseconds from now, which
+     *  is needed by pthread_cond_timedwait. */
+    static void getAbsoluteTime(int timeout_ms, struct timespec *ts)
+    {
+#ifdef WIN32
+        FILETIME ft;
+        GetSystemTimeAsFileTime(&ft);
+        unsigned __int64 t = ft.dwHighDateTime;
+        t = (t << 32) | ft.dwLowDateTime;
+        // Convert from 100ns intervals since 1601 to microseconds since 1970
+        t = t/10 - 11644473600000000ULL;
+        long sec  = (long)(t / 1000000);
+        long usec = (long)(t % 1000000);
+#else
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        long sec  = (long)tv.tv_sec;
+        long usec = (long)tv.tv_usec;
+#endif
+        long nsec  = usec*1000 + (long)(timeout_ms % 1000)*1000000;
+        ts->tv_sec  = sec + timeout_ms/1000 + nsec/1000000000;
+        ts->tv_nsec = nsec % 1000000000;
+    }   // getAbsoluteTime
+
+public:
+    // ------------------------------------------------------------------------
+    /** Creates a queue.
+     *  \param capacity Initial number of elements the queue can hold.
+     *  \param max_capacity Number of elements the queue can grow to.
+     *  \param reserved Number of elements of the maximum capacity that are
+     *         reserved for high priority elements. */
+    BoundedQueue(unsigned int capacity, unsigned int max_capacity,
+                 unsigned int reserved=0)
+        : m_data(capacity)
+    {
+        m_head         = 0;
+        m_size         = 0;
+        m_max_size     = 0;
+        m_max_capacity = max_capacity;
+        m_reserved     = reserved<max_capacity ? reserved : max_capacity-1;
+        m_grow_count   = 0;
+        m_drop_count   = 0;
+        m_closed       = false;
+        pthread_mutex_init(&m_mutex, NULL);
+        pthread_cond_init(&m_cond_not_empty, NULL);
+    }   // BoundedQueue
+
+    // ------------------------------------------------------------------------
+    ~BoundedQueue()
+    {
+        pthread_cond_destroy(&m_cond_not_empty);
+        pthread_mutex_destroy(&m_mutex);
+    }   // ~BoundedQueue
+
+    // ------------------------------------------------------------------------
+    /** Adds an element and wakes up the consumer. If the queue is full,
+     *  it grows (up to the maximum capacity), this never waits.
+     *  \param high_priority If true, the element can use the reserved part
+     *         of the maximum capacity. This is meant for the few elements
+     *         that must not be lost.
+     *  \return False if the queue was closed or is full, in which case the
+     *          element was not added.
+     */
+    bool push(const TYPE &value, bool high_priority=false)
+    {
+        pthread_mutex_lock(&m_mutex);
+        if(m_closed)
+        {
+            pthread_mutex_unlock(&m_mutex);
+            return false;
+        }
+        const unsigned int limit = high_priority ? m_max_capacity
+                                                 : m_max_capacity-m_reserved;
+        if(m_size>=limit)
+        {
+            m_drop_count++;
+            pthread_mutex_unlock(&m_mutex);
+            return false;
+        }
+        if(m_size==m_data.size())
+        {
+            // Copy the elements in order into a larger buffer
+            unsigned int capacity = 2*(unsigned int)m_data.size();
+            if(capacity>m_max_capacity)
+                capacity = m_max_capacity;
+            if(capacity==0)
+                capacity = 1;
+            std::vector<TYPE> data(capacity);
+            for(unsigned int i=0; i<m_size; i++)
+                data[i] = m_data[(m_head+i) % m_data.size()];
+            m_data.swap(data);
+            m_head = 0;
+            m_grow_count++;
+        }
+        m_data[(m_head+m_size) % m_data.size()] = value;
+        m_size++;
+        if(m_size>m_max_size)
+            m_max_size = m_size;
+        pthread_cond_signal(&m_cond_not_empty);
+        pthread_mutex_unlock(&m_mutex);
+        return true;
+    }   // push
+
+    // ------------------------------------------------------------------------
+    /** Removes the oldest element if there is one.
+     *  \return False if the queue was empty.
+     */
+    bool tryPop(TYPE *value)
+    {
+        pthread_mutex_lock(&m_mutex);
+        if(m_size==0)
+        {
+            pthread_mutex_unlock(&m_mutex);
+            return false;
+        }
+        *value = m_data[m_head];
+        m_data[m_head] = TYPE();
+        m_head = (m_head+1) % m_data.size();
+        m_size--;
+        pthread_mutex_unlock(&m_mutex);
+        return true;
+    }   // tryPop
+
+    // ------------------------------------------------------------------------
+    /** Waits till the queue is not empty, the queue is closed, or the
+     *  timeout has expired.
+     *  \param timeout_ms Maximum time to wait in milliseconds.
+     *  \return True if there is data in the queue.
+     */
+    bool waitForData(int timeout_ms)
+    {
+        struct timespec ts;
+        getAbsoluteTime(timeout_ms, &ts);
+        pthread_mutex_lock(&m_mutex);
+        // The loop is necessary because of spurious wakeups.
+        while(m_size==0 && !m_closed)
+        {
+            if(pthread_cond_timedwait(&m_cond_not_empty, &m_mutex, &ts)!=0)
+                break;
+        }
+        const bool has_data = m_size>0;
+        pthread_mutex_unlock(&m_mutex);
+        return has_data;
+    }   // waitForData
+
+    // ------------------------------------------------------------------------
+    /** Closes the queue: all waiting threads are woken up, and no more
+     *  elements can be added. The elements in the queue can still be
+     *  removed. */
+    void close()
+    {
+        pthread_mutex_lock(&m_mutex);
+        m_closed = true;
+        pthread_cond_broadcast(&m_cond_not_empty);
+        pthread_mutex_unlock(&m_mutex);
+    }   // close
+
+    // ------------------------------------------------------------------------
+    /** Returns true if the queue was closed. */
+    bool isClosed() const
+    {
+        pthread_mutex_lock(&m_mutex);
+        const bool closed = m_closed;
+        pthread_mutex_unlock(&m_mutex);
+        return closed;
+    }   // isClosed
+
+    // ------------------------------------------------------------------------
+    /** Returns the number of elements in the queue. */
+    unsigned int getSize() const
+    {
+        pthread_mutex_lock(&m_mutex);
+        const unsigned int size = m_size;
+        pthread_mutex_unlock(&m_mutex);
+        return size;
+    }   // getSize
+
+    // ------------------------------------------------------------------------
+    /** Returns the highest number of elements in the queue since the last
+     *  call, the number of times the queue grew, and the number of elements
+     *  that were dropped, and resets them.
+     */
+    void getAndResetStatistics(unsigned int *max_size,
+                               unsigned int *grow_count,
+                               unsigned int *drop_count)
+    {
+        pthread_mutex_lock(&m_mutex);
+        *max_size    = m_max_size;
+        *grow_count  = m_grow_count;
+        *drop_count  = m_drop_count;
+        m_max_size   = m_size;
+        m_grow_count = 0;
+        m_drop_count = 0;
+        pthread_mutex_unlock(&m_mutex);
+    }   // getAndResetStatistics
+};   // BoundedQueue
+
+#endif
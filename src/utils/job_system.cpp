@@ -0,0 +1,432 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/job_system.hpp"
+
+#include "config/hardware_stats.hpp"
+#include "config/user_config.hpp"
+#include "utils/log.hpp"
+#include "utils/profiler.hpp"
+
+#include <assert.h>
+#include <stddef.h>
+
+JobSystem *JobSystem::m_job_system = NULL;
+
+// ----------------------------------------------------------------------------
+/** Creates the job system, if it does not exist yet. The number of workers
+ *  is taken from the user config, see getNumWorkersToUse().
+ */
+void JobSystem::create()
+{
+    if (!m_job_system)
+        m_job_system = new JobSystem(getNumWorkersToUse());
+}   // create
+
+// ----------------------------------------------------------------------------
+/** Stops all workers and destroys the job system. All submitted jobs must
+ *  be finished. Afterwards parallelFor() runs in the calling thread.
+ */
+void JobSystem::destroy()
+{
+    delete m_job_system;
+    m_job_system = NULL;
+}   // destroy
+
+// ----------------------------------------------------------------------------
+/** Returns the number of worker threads to use. If the job_threads config
+ *  option is negative, one thread less than the number of processors is
+ *  used, since the main thread takes part in the work, too.
+ */
+int JobSystem::getNumWorkersToUse()
+{
+    int n = UserConfigParams::m_job_threads;
+    if (n < 0)
+        n = HardwareStats::getNumProcessors() - 1;
+    return n < 0 ? 0 : n;
+}   // getNumWorkersToUse
+
+// ----------------------------------------------------------------------------
+/** Starts the worker threads.
+ *  \param num_workers Number of worker threads.
+ */
+JobSystem::JobSystem(int num_workers)
+{
+    m_num_queued = 0;
+    m_stop       = false;
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
+    pthread_key_create(&m_queue_key, NULL);
+
+    // The queues must exist before any worker starts
+    for (int i = 0; i <= num_workers; i++)
+    {
+        Queue *queue = new Queue();
+        pthread_mutex_init(&queue->m_mutex, NULL);
+        m_queues.push_back(queue);
+    }
+    for (int i = 0; i < num_workers; i++)
+    {
+        WorkerData *wd    = new WorkerData();
+        wd->m_job_system  = this;
+        wd->m_index       = i + 1;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, &JobSystem::mainLoop, wd) != 0)
+        {
+            Log::warn("JobSystem", "Could not create thread, only %d "
+                      "workers will be used.", i);
+            delete wd;
+            break;
+        }
+        m_threads.push_back(thread);
+    }
+    Log::info("JobSystem", "Using %d worker threads.", (int)m_threads.size());
+}   // JobSystem
+
+// ----------------------------------------------------------------------------
+/** Stops and joins the worker threads. */
+JobSystem::~JobSystem()
+{
+    pthread_mutex_lock(&m_mutex);
+    assert(m_num_queued <= 0);
+    m_stop = true;
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+    for (unsigned int i = 0; i < m_threads.size(); i++)
+        pthread_join(m_threads[i], NULL);
+
+    for (unsigned int i = 0; i < m_queues.size(); i++)
+    {
+        pthread_mutex_destroy(&m_queues[i]->m_mutex);
+        delete m_queues[i];
+    }
+    pthread_key_delete(m_queue_key);
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_mutex);
+}   // ~JobSystem
+
+// ----------------------------------------------------------------------------
+/** Returns the index of the queue of the calling thread: 0 for threads
+ *  that are not workers of this job system.
+ */
+int JobSystem::getQueueIndex() const
+{
+    return (int)(ptrdiff_t)pthread_getspecific(m_queue_key);
+}   // getQueueIndex
+
+// ----------------------------------------------------------------------------
+/** The main loop of a worker: runs jobs from its own queue or stolen from
+ *  other queues, and sleeps while there is nothing to do.
+ */
+void *JobSystem::mainLoop(void *data)
+{
+    WorkerData *wd = (WorkerData*)data;
+    JobSystem  *me = wd->m_job_system;
+    pthread_setspecific(me->m_queue_key, (void*)(ptrdiff_t)wd->m_index);
+    delete wd;
+
+    while (true)
+    {
+        Job *job = me->findJob();
+        if (job)
+        {
+            me->runJob(job);
+            continue;
+        }
+        pthread_mutex_lock(&me->m_mutex);
+        while (!me->m_stop && me->m_num_queued <= 0)
+            pthread_cond_wait(&me->m_cond, &me->m_mutex);
+        const bool stop = me->m_stop;
+        pthread_mutex_unlock(&me->m_mutex);
+        if (stop)
+            break;
+    }
+    return NULL;
+}   // mainLoop
+
+// ----------------------------------------------------------------------------
+/** Adds a job whose dependencies are all finished to the queue of the
+ *  calling thread and wakes up the workers. Must be called with m_mutex
+ *  locked.
+ */
+void JobSystem::enqueueLocked(Job *job)
+{
+    Queue *queue = m_queues[getQueueIndex()];
+    pthread_mutex_lock(&queue->m_mutex);
+    queue->m_jobs.push_back(job);
+    pthread_mutex_unlock(&queue->m_mutex);
+    m_num_queued++;
+    pthread_cond_broadcast(&m_cond);
+}   // enqueueLocked
+
+// ----------------------------------------------------------------------------
+/** Takes a job: the newest job from the queue of the calling thread, or
+ *  else the oldest job of another queue.
+ *  \return The job, or NULL if all queues are empty.
+ */
+Job *JobSystem::findJob()
+{
+    const int own   = getQueueIndex();
+    const int count = (int)m_queues.size();
+    Job *job = NULL;
+    for (int i = 0; i < count && !job; i++)
+    {
+        Queue *queue = m_queues[(own + i) % count];
+        pthread_mutex_lock(&queue->m_mutex);
+        if (!queue->m_jobs.empty())
+        {
+            if (i == 0)
+            {
+                job = queue->m_jobs.back();
+                queue->m_jobs.pop_back();
+            }
+            else
+            {
+                job = queue->m_jobs.front();
+                queue->m_jobs.pop_front();
+            }
+        }
+        pthread_mutex_unlock(&queue->m_mutex);
+    }
+    if (job)
+    {
+        pthread_mutex_lock(&m_mutex);
+        m_num_queued--;
+        pthread_mutex_unlock(&m_mutex);
+    }
+    return job;
+}   // findJob
+
+// ----------------------------------------------------------------------------
+/** Runs a job, marks it as finished and queues all jobs that only waited
+ *  for this job.
+ */
+void JobSystem::runJob(Job *job)
+{
+    job->run();
+    pthread_mutex_lock(&m_mutex);
+    // The job might be deleted as soon as m_done is set and the lock is
+    // released, so the dependents are handled first.
+    for (unsigned int i = 0; i < job->m_dependents.size(); i++)
+    {
+        Job *dependent = job->m_dependents[i];
+        if (--dependent->m_unfinished == 0)
+            enqueueLocked(dependent);
+    }
+    job->m_dependents.clear();
+    job->m_done = true;
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+}   // runJob
+
+// ----------------------------------------------------------------------------
+/** Submits a job. It is run by a worker (or a thread waiting for a job)
+ *  once all its dependencies are finished.
+ */
+void JobSystem::submit(Job *job)
+{
+    pthread_mutex_lock(&m_mutex);
+    assert(job->m_unfinished > 0 && !job->m_done);
+    if (--job->m_unfinished == 0)
+        enqueueLocked(job);
+    pthread_mutex_unlock(&m_mutex);
+}   // submit
+
+// ----------------------------------------------------------------------------
+/** Makes a job wait for another job. This must be called before the job is
+ *  submitted, the dependency can be submitted before or after.
+ *  \param job The job that must wait.
+ *  \param dependency The job that must be finished first.
+ */
+void JobSystem::addDependency(Job *job, Job *dependency)
+{
+    pthread_mutex_lock(&m_mutex);
+    assert(job->m_unfinished > 0 && !job->m_done);
+    if (!dependency->m_done)
+    {
+        job->m_unfinished++;
+        dependency->m_dependents.push_back(job);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}   // addDependency
+
+// ----------------------------------------------------------------------------
+/** Returns if a job is finished. */
+bool JobSystem::isDone(const Job *job) const
+{
+    pthread_mutex_lock(const_cast<pthread_mutex_t*>(&m_mutex));
+    const bool done = job->m_done;
+    pthread_mutex_unlock(const_cast<pthread_mutex_t*>(&m_mutex));
+    return done;
+}   // isDone
+
+// ----------------------------------------------------------------------------
+/** Waits till a submitted job is finished. Meanwhile the calling thread
+ *  runs other queued jobs (which might include the job itself), so this
+ *  can be called by jobs, and works without any worker threads.
+ */
+void JobSystem::wait(Job *job)
+{
+    while (true)
+    {
+        pthread_mutex_lock(&m_mutex);
+        const bool done = job->m_done;
+        pthread_mutex_unlock(&m_mutex);
+        if (done)
+            return;
+
+        Job *other = findJob();
+        if (other)
+        {
+            runJob(other);
+            continue;
+        }
+        // Nothing to do, the job is being run by another thread (or waits
+        // for a dependency that is being run)
+        pthread_mutex_lock(&m_mutex);
+        while (!job->m_done && m_num_queued <= 0)
+            pthread_cond_wait(&m_cond, &m_mutex);
+        pthread_mutex_unlock(&m_mutex);
+    }
+}   // wait
+
+// ============================================================================
+namespace JobSystemTest
+{
+    /** A job that records the order in which jobs are run. */
+    class OrderJob : public Job
+    {
+    public:
+        static pthread_mutex_t m_mutex;
+        static int             m_counter;
+        int                    m_order;
+        virtual void run()
+        {
+            pthread_mutex_lock(&m_mutex);
+            m_order = m_counter++;
+            pthread_mutex_unlock(&m_mutex);
+        }
+    };   // OrderJob
+    pthread_mutex_t OrderJob::m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    int             OrderJob::m_counter = 0;
+
+    /** Counts how often each index is visited. */
+    struct CountRange
+    {
+        std::vector<int> *m_count;
+        void operator()(int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+                (*m_count)[i]++;
+        }
+    };   // CountRange
+
+    /** Does some floating point work for each index. */
+    struct WorkRange
+    {
+        std::vector<float> *m_result;
+        void operator()(int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                float x = (float)i;
+                for (int j = 0; j < 200; j++)
+                    x = x * 0.999f + 1.0f / (1.0f + j);
+                (*m_result)[i] = x;
+            }
+        }
+    };   // WorkRange
+
+    /** A job that runs a parallel for itself. */
+    class NestedJob : public Job
+    {
+    public:
+        std::vector<int> m_count;
+        virtual void run()
+        {
+            m_count.resize(1000, 0);
+            CountRange range;
+            range.m_count = &m_count;
+            JobSystem::parallelFor(0, (int)m_count.size(), &range);
+        }
+    };   // NestedJob
+}   // namespace JobSystemTest
+
+// ----------------------------------------------------------------------------
+/** Tests dependencies, parallelFor (also from within jobs) and prints the
+ *  speed up of parallelFor compared to a simple loop.
+ */
+void JobSystem::unitTesting()
+{
+    using namespace JobSystemTest;
+    const bool created = m_job_system == NULL;
+    if (created)
+        create();
+    JobSystem *js = get();
+
+    // a and b before c, c before d
+    OrderJob a, b, c, d;
+    js->addDependency(&d, &c);
+    js->addDependency(&c, &a);
+    js->addDependency(&c, &b);
+    js->submit(&d);
+    js->submit(&c);
+    js->submit(&b);
+    js->submit(&a);
+    js->wait(&d);
+    assert(js->isDone(&a) && js->isDone(&b) && js->isDone(&c));
+    assert(a.m_order < c.m_order && b.m_order < c.m_order);
+    assert(c.m_order < d.m_order);
+
+    // Each index must be visited exactly once
+    std::vector<int> count(100003, 0);
+    CountRange range;
+    range.m_count = &count;
+    parallelFor(0, (int)count.size(), &range);
+    parallelFor(5, 5, &range);
+    for (unsigned int i = 0; i < count.size(); i++)
+        assert(count[i] == 1);
+
+    const int num_nested = 8;
+    NestedJob nested[num_nested];
+    for (int i = 0; i < num_nested; i++)
+        js->submit(&nested[i]);
+    for (int i = 0; i < num_nested; i++)
+    {
+        js->wait(&nested[i]);
+        for (unsigned int j = 0; j < nested[i].m_count.size(); j++)
+            assert(nested[i].m_count[j] == 1);
+    }
+
+    std::vector<float> serial(200000), parallel(200000);
+    WorkRange work;
+    work.m_result = &serial;
+    double start = getTimeMilliseconds();
+    work(0, (int)serial.size());
+    const double serial_time = getTimeMilliseconds() - start;
+    work.m_result = &parallel;
+    start = getTimeMilliseconds();
+    parallelFor(0, (int)parallel.size(), &work);
+    const double parallel_time = getTimeMilliseconds() - start;
+    assert(serial == parallel);
+    Log::info("JobSystem", "parallelFor with %d workers: %.2f ms, serial "
+              "loop %.2f ms.", js->getNumWorkers(), parallel_time, serial_time);
+
+    if (created)
+        destroy();
+}   // unitTesting
@@ -0,0 +1,221 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_JOB_SYSTEM_HPP
+#define HEADER_JOB_SYSTEM_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <deque>
+#include <pthread.h>
+#include <vector>
+
+/**
+ * \brief A piece of work that is run by the JobSystem.
+ * A job can depend on other jobs, it is only started once all of them are
+ * finished (see JobSystem::addDependency()). Jobs are owned by the code
+ * that submits them, and must not be deleted before they are finished
+ * (see JobSystem::wait()). A job can only be submitted once.
+ * \ingroup utils
+ */
+class Job : public NoCopy
+{
+private:
+    friend class JobSystem;
+
+    /** Number of unfinished dependencies, plus one till it is submitted. */
+    int               m_unfinished;
+
+    /** The jobs that depend on this job. */
+    std::vector<Job*> m_dependents;
+
+    /** Set once the job is finished. */
+    bool              m_done;
+
+public:
+                 Job() : m_unfinished(1), m_done(false) {}
+    virtual     ~Job() {}
+    /** Does the work of this job. */
+    virtual void run() = 0;
+};   // Job
+
+// ============================================================================
+/**
+ * \brief A pool of worker threads that run jobs.
+ * Each worker has its own queue: jobs submitted by a worker (e.g. by a job
+ * that splits its work) are added to its own queue and taken from the back,
+ * while idle workers steal the oldest jobs from the front of the other
+ * queues. Jobs submitted by other threads (e.g. the main thread) go into
+ * a shared queue. A thread waiting for a job runs other jobs meanwhile, so
+ * jobs can wait for jobs, and everything also works without workers.
+ * parallelFor() splits a loop into jobs and is the usual way to use the
+ * job system. It can be used before the job system is created (or after it
+ * was destroyed), in which case the loop runs in the calling thread.
+ * \ingroup utils
+ */
+class JobSystem : public NoCopy
+{
+private:
+    /** The queue of a thread. Index 0 is used by all non-worker threads. */
+    struct Queue
+    {
+        std::deque<Job*> m_jobs;
+        pthread_mutex_t  m_mutex;
+    };   // Queue
+
+    static JobSystem *m_job_system;
+
+    /** One queue per worker, plus the shared queue at index 0. */
+    std::vector<Queue*>    m_queues;
+
+    /** The worker threads. */
+    std::vector<pthread_t> m_threads;
+
+    /** Protects the dependencies and the state of all jobs, m_num_queued
+     *  and m_stop. */
+    pthread_mutex_t        m_mutex;
+
+    /** Broadcast when jobs are queued or finished. */
+    pthread_cond_t         m_cond;
+
+    /** Number of jobs in all queues (might be briefly negative, since a
+     *  job is counted after it was added to a queue). */
+    int                    m_num_queued;
+
+    /** Set to stop the workers. */
+    bool                   m_stop;
+
+    /** Thread specific data: index of the queue of the thread (the worker
+     *  number plus one, 0 for other threads). */
+    pthread_key_t          m_queue_key;
+
+    /** Parameters of a worker thread. */
+    struct WorkerData
+    {
+        JobSystem *m_job_system;
+        int        m_index;
+    };   // WorkerData
+
+    // ------------------------------------------------------------------------
+    /** A job that calls a functor for a range of indices. */
+    template<typename F>
+    class RangeJob : public Job
+    {
+    public:
+        F  *m_functor;
+        int m_begin, m_end;
+        virtual void run() { (*m_functor)(m_begin, m_end); }
+    };   // RangeJob
+
+    // ------------------------------------------------------------------------
+    /** A functor that calls a member function for a range of indices. */
+    template<typename T>
+    struct MethodCall
+    {
+        T *m_object;
+        void (T::*m_method)(int, int);
+        void operator()(int begin, int end) { (m_object->*m_method)(begin, end); }
+    };   // MethodCall
+
+             JobSystem(int num_workers);
+            ~JobSystem();
+    static void *mainLoop(void *data);
+    int   getQueueIndex() const;
+    void  enqueueLocked(Job *job);
+    Job  *findJob();
+    void  runJob(Job *job);
+
+public:
+    static void create();
+    static void destroy();
+    static int  getNumWorkersToUse();
+    // ------------------------------------------------------------------------
+    /** Returns the job system, or NULL if it was not created. */
+    static JobSystem *get() { return m_job_system; }
+    // ------------------------------------------------------------------------
+    /** Returns the number of worker threads. */
+    int getNumWorkers() const { return (int)m_threads.size(); }
+    // ------------------------------------------------------------------------
+    void submit(Job *job);
+    void wait(Job *job);
+    void addDependency(Job *job, Job *dependency);
+    bool isDone(const Job *job) const;
+
+    // ------------------------------------------------------------------------
+    /** Calls functor(b, e) for consecutive ranges [b, e) that cover
+     *  [begin, end), using the workers and the calling thread, and returns
+     *  once all ranges are done. The ranges are split so that idle threads
+     *  can help, the functor must not depend on how the range is split.
+     *  \param begin, end The range of indices.
+     *  \param functor Object with an operator()(int begin, int end).
+     *  \param max_jobs Maximum number of ranges (e.g. to limit the number
+     *         of threads used), 0 for no limit. With 1 (or without
+     *         workers) the functor is only called once for the whole range.
+     */
+    template<typename F>
+    static void parallelFor(int begin, int end, F *functor, int max_jobs = 0)
+    {
+        const int count = end - begin;
+        if (count <= 0)
+            return;
+        JobSystem *js = m_job_system;
+        // A few ranges per thread, so that idle threads can help
+        int num_jobs = js ? 4 * (js->getNumWorkers() + 1) : 1;
+        if (max_jobs > 0 && num_jobs > max_jobs)
+            num_jobs = max_jobs;
+        if (num_jobs > count)
+            num_jobs = count;
+        if (!js || js->getNumWorkers() == 0 || num_jobs <= 1)
+        {
+            (*functor)(begin, end);
+            return;
+        }
+
+        RangeJob<F> *jobs = new RangeJob<F>[num_jobs];
+        for (int i = 0; i < num_jobs; i++)
+        {
+            jobs[i].m_functor = functor;
+            jobs[i].m_begin   = begin + (int)((long long)count *  i    / num_jobs);
+            jobs[i].m_end     = begin + (int)((long long)count * (i+1) / num_jobs);
+        }
+        // The calling thread starts with the first range
+        for (int i = 1; i < num_jobs; i++)
+            js->submit(&jobs[i]);
+        js->submit(&jobs[0]);
+        for (int i = 0; i < num_jobs; i++)
+            js->wait(&jobs[i]);
+        delete [] jobs;
+    }   // parallelFor
+
+    // ------------------------------------------------------------------------
+    /** Same as parallelFor() above, but calls a member function
+     *  (object->*method)(b, e) for the ranges. */
+    template<typename T>
+    static void parallelFor(int begin, int end, T *object,
+                            void (T::*method)(int, int), int max_jobs = 0)
+    {
+        MethodCall<T> call;
+        call.m_object = object;
+        call.m_method = method;
+        parallelFor(begin, end, &call, max_jobs);
+    }   // parallelFor
+
+    static void unitTesting();
+};   // JobSystem
+
+#endif
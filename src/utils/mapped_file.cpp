@@ -0,0 +1,155 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/mapped_file.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+// ----------------------------------------------------------------------------
+MappedFile::MappedFile()
+{
+    m_data      = NULL;
+    m_size      = 0;
+    m_allocated = false;
+#ifdef WIN32
+    m_file_handle    = INVALID_HANDLE_VALUE;
+    m_mapping_handle = NULL;
+#endif
+}   // MappedFile
+
+// ----------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+    close();
+}   // ~MappedFile
+
+// ----------------------------------------------------------------------------
+/** Opens and maps the given file. A previously opened file is closed.
+ *  \param filename Name of the file.
+ *  \return True if the file could be opened.
+ */
+bool MappedFile::open(const std::string &filename)
+{
+    close();
+#ifdef WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                              NULL);
+    if(file!=INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER size;
+        HANDLE mapping = NULL;
+        if(GetFileSizeEx(file, &size) && size.QuadPart>0)
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0,
+                                         NULL);
+        if(mapping)
+        {
+            m_data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ,
+                                                0, 0, 0);
+            if(m_data)
+            {
+                m_size           = (size_t)size.QuadPart;
+                m_file_handle    = file;
+                m_mapping_handle = mapping;
+                return true;
+            }
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+    }
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd>=0)
+    {
+        struct stat st;
+        if(fstat(fd, &st)==0 && st.st_size>0)
+        {
+            void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                           fd, 0);
+            if(p!=MAP_FAILED)
+            {
+                // The mapping stays valid after the file is closed.
+                ::close(fd);
+                m_data = (const char*)p;
+                m_size = (size_t)st.st_size;
+                return true;
+            }
+        }
+        ::close(fd);
+    }
+#endif
+
+    // Mapping is not possible (or the file is empty): read the file
+    FILE *f = fopen(filename.c_str(), "rb");
+    if(!f) return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if(size<=0)
+    {
+        fclose(f);
+        return false;
+    }
+    char *data = (char*)malloc(size);
+    if(!data || fread(data, 1, size, f)!=(size_t)size)
+    {
+        free(data);
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+    m_data      = data;
+    m_size      = (size_t)size;
+    m_allocated = true;
+    return true;
+}   // open
+
+// ----------------------------------------------------------------------------
+/** Unmaps the file (if any).
+ */
+void MappedFile::close()
+{
+    if(!m_data) return;
+    if(m_allocated)
+        free((void*)m_data);
+    else
+    {
+#ifdef WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping_handle);
+        CloseHandle(m_file_handle);
+        m_file_handle    = INVALID_HANDLE_VALUE;
+        m_mapping_handle = NULL;
+#else
+        munmap((void*)m_data, m_size);
+#endif
+    }
+    m_data      = NULL;
+    m_size      = 0;
+    m_allocated = false;
+}   // close
@@ -0,0 +1,68 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2015 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_MAPPED_FILE_HPP
+#define HEADER_MAPPED_FILE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <string>
+
+/** A read-only view of a whole file. The file is memory mapped where the
+ *  operating system supports it, so that large files can be accessed
+ *  without reading (or parsing) them first: only the pages that are
+ *  actually used are loaded. If mapping fails, the file is read into
+ *  memory instead, so callers do not need a fallback.
+ *  \ingroup utils
+ */
+class MappedFile : public NoCopy
+{
+private:
+    /** The file content, or NULL if no file is open. */
+    const char *m_data;
+
+    /** Size of the file in bytes. */
+    size_t      m_size;
+
+    /** True if m_data was allocated (instead of mapped). */
+    bool        m_allocated;
+
+#ifdef WIN32
+    /** The windows file and file mapping handles. */
+    void       *m_file_handle;
+    void       *m_mapping_handle;
+#endif
+
+public:
+         MappedFile();
+        ~MappedFile();
+    bool open(const std::string &filename);
+    void close();
+
+    // ------------------------------------------------------------------------
+    /** Returns the content of the file. */
+    const char *getData() const { return m_data; }
+    // ------------------------------------------------------------------------
+    /** Returns the size of the file. */
+    size_t getSize() const { return m_size; }
+    // ------------------------------------------------------------------------
+    /** Returns true if a file is open. */
+    bool isOpen() const { return m_data!=NULL; }
+};   // MappedFile
+
+#endif
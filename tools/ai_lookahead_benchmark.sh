@@ -0,0 +1,28 @@
+#!/bin/bash
+#
+# Compares the AI with and without its look-ahead table on a fixed profile
+# race. Both runs use the same track, karts and random seed without
+# graphics. For each run the time spent in the AI (and kart) updates and
+# the minimum, maximum and average finish times of all karts are printed:
+# the finish times should be close, while the AI time should be smaller
+# with the table. The run with the table also compares the aim points
+# found with and without the table on the track (--ai-lookahead-check),
+# outside of the timed race.
+#
+# Usage: tools/ai_lookahead_benchmark.sh [path-to-supertuxkart]
+
+stk=${1:-./cmake_build/bin/supertuxkart}
+track=${TRACK:-hacienda}
+karts=${KARTS:-20}
+laps=${LAPS:-3}
+seed=${SEED:-1234}
+
+for table in 0 1; do
+    check=""
+    [ $table = 1 ] && check="--ai-lookahead-check"
+    result=$($stk --no-start-screen --track=$track --numkarts=$karts \
+                  --profile-laps=$laps --no-graphics --seed=$seed \
+                  --ai-lookahead-table=$table $check --log=0 2>&1 \
+             | grep -E "AI lookahead table|Check \(|min .* max .* av")
+    echo "$result"
+done
@@ -0,0 +1,31 @@
+#!/bin/bash
+#
+# Compares the bandwidth used for kart states with and without interest
+# management (see KartRelevance), using the server snapshot benchmark
+# (see tools/server_snapshot_benchmark.sh) with one kart per client. For
+# each number of clients the bandwidth per client and the number of kart
+# states sent are printed for both runs, which use the same track and
+# random seed.
+# The bandwidth includes the relayed controller events, but as in
+# tools/server_snapshot_benchmark.sh not the traffic of the other protocols.
+#
+# Usage: tools/interest_management_benchmark.sh [path-to-supertuxkart]
+# The bandwidth budget per client (in bytes/s, 0 is unlimited) can be set
+# with BUDGET.
+
+stk=${1:-./cmake_build/bin/supertuxkart}
+track=${TRACK:-hacienda}
+laps=${LAPS:-1}
+seed=${SEED:-1234}
+clients=${CLIENTS:-"8 16 32 64"}
+
+for n in $clients; do
+    for interest in 0 1; do
+        echo "== $n clients, interest management $interest"
+        $stk --no-start-screen --track=$track --profile-laps=$laps \
+             --no-graphics --seed=$seed --snapshot-bench=$n \
+             --interest-management=$interest \
+             --client-bandwidth=${BUDGET:-0} --log=0 2>&1 \
+            | grep -E "Server snapshot benchmark|Server tick|Bandwidth per|Kart states"
+    done
+done
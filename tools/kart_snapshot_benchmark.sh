@@ -0,0 +1,28 @@
+#!/bin/bash
+#
+# Compares the bytes per tick of the kart snapshots (see KartSnapshotCodec)
+# with the old format, which sent the time and, for each kart, its id and
+# seven floats. First the unit test of the codec is run, which encodes a
+# simulated race of 8 karts. Then a profile race with the server snapshot
+# benchmark (see tools/server_snapshot_benchmark.sh) is run for each number
+# of karts, which reports the bytes per snapshot sent to each client in a
+# real race.
+#
+# Usage: tools/kart_snapshot_benchmark.sh [path-to-supertuxkart]
+
+stk=${1:-./cmake_build/bin/supertuxkart}
+track=${TRACK:-hacienda}
+laps=${LAPS:-1}
+seed=${SEED:-1234}
+karts=${KARTS:-"4 8 16"}
+
+echo "== Simulated race"
+$stk --unit-testing --log=0 2>&1 | grep -E "KartSnapshotCodec.*bytes/tick"
+
+for n in $karts; do
+    echo "== $n karts on $track"
+    $stk --no-start-screen --track=$track --numkarts=$n \
+         --profile-laps=$laps --no-graphics --seed=$seed --snapshot-bench=$n \
+         --interest-management=0 --log=0 2>&1 \
+        | grep -E "Snapshots:"
+done
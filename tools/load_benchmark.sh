@@ -0,0 +1,24 @@
+#!/bin/bash
+#
+# Measures how long it takes to load tracks. Each track is loaded in a
+# separate supertuxkart process (without graphics, followed by a very
+# short profile race), and the loading statistics of the track are
+# printed: the time spent loading the models (which includes finding the
+# materials for all mesh buffers) and creating the physics model. Run it
+# with two different executables to compare their loading times.
+#
+# Usage: tools/load_benchmark.sh [path-to-supertuxkart] [tracks...]
+
+stk=${1:-./cmake_build/bin/supertuxkart}
+shift
+tracks=${@:-hacienda lighthouse mines snowmountain}
+runs=${RUNS:-3}
+
+for track in $tracks; do
+    for run in $(seq 1 $runs); do
+        result=$($stk --no-start-screen --track=$track --numkarts=1 \
+                      --profile-time=1 --no-graphics --log=0 2>&1 \
+                 | grep "AssetLoader.*Track '")
+        echo "$result"
+    done
+done
@@ -0,0 +1,26 @@
+#!/bin/bash
+#
+# Compares the serial and the parallel physics on a fixed profile race.
+# Each configuration runs the same race (same track, karts and random
+# seed) without graphics, and the physics time and the checksum of the
+# final kart positions are printed. All runs with at least one thread
+# must have the same checksum (the result does not depend on the number
+# of threads); the serial run (0 threads) sorts contacts differently and
+# can therefore end with a different checksum.
+#
+# Usage: tools/physics_benchmark.sh [path-to-supertuxkart] [threads...]
+
+stk=${1:-./cmake_build/bin/supertuxkart}
+shift
+threads=${@:-0 1 2 4}
+track=${TRACK:-hacienda}
+karts=${KARTS:-20}
+laps=${LAPS:-2}
+seed=${SEED:-1234}
+
+for t in $threads; do
+    result=$($stk --no-start-screen --track=$track --numkarts=$karts \
+                  --profile-laps=$laps --no-graphics --seed=$seed \
+                  --physics-threads=$t --log=0 2>&1 | grep "Physics threads")
+    echo "$result"
+done
@@ -0,0 +1,64 @@
+#!/bin/bash
+#
+# Runs a matrix of headless profile races (tracks x difficulties x number
+# of karts x seeds) with several races running in parallel, and collects
+# the statistics of all karts in a single CSV file. Each race is a separate
+# supertuxkart process which appends its results to its own file (using
+# --profile-stats), the files are merged once all races are finished.
+#
+# Usage: tools/profile_farm.sh [path-to-supertuxkart] [output.csv]
+#
+# The matrix and the number of parallel races can be set with environment
+# variables, e.g.:
+#   TRACKS="hacienda lighthouse" SEEDS="$(seq 1 100)" tools/profile_farm.sh
+# Any additional arguments for supertuxkart (e.g. "--ai=tux,gnu,sara")
+# can be specified in STK_ARGS.
+
+stk=${1:-./cmake_build/bin/supertuxkart}
+output=${2:-profile_farm.csv}
+tracks=${TRACKS:-hacienda}
+difficulties=${DIFFICULTIES:-0 1 2 3}   # 0=novice ... 3=supertux
+num_karts=${NUM_KARTS:-8}
+seeds=${SEEDS:-1 2 3 4}
+laps=${LAPS:-2}
+jobs=${JOBS:-$(nproc 2>/dev/null || echo 2)}
+
+tmpdir=$(mktemp -d)
+trap "rm -rf $tmpdir" EXIT
+
+# Create the list of all races, one line per race with its arguments
+n=0
+for track in $tracks; do
+    for difficulty in $difficulties; do
+        for karts in $num_karts; do
+            for seed in $seeds; do
+                echo "$n --track=$track --mode=$difficulty --numkarts=$karts" \
+                     "--seed=$seed" >> $tmpdir/races
+                n=$((n+1))
+            done
+        done
+    done
+done
+echo "Running $n races, $jobs at a time."
+
+export stk laps tmpdir STK_ARGS
+start=$(date +%s)
+xargs -P $jobs -L 1 sh -c \
+    '$stk --no-start-screen --no-graphics --profile-laps=$laps --log=0 \
+          --profile-stats=$tmpdir/race-$0.csv $STK_ARGS "$@" >/dev/null 2>&1 \
+     || echo "Race $0 ($*) failed."' < $tmpdir/races
+
+# Merge the results, keeping only the header line of the first file
+rm -f $output
+for i in $(seq 0 $((n-1))); do
+    f=$tmpdir/race-$i.csv
+    [ -f $f ] || continue
+    if [ -f $output ]; then
+        tail -n +2 $f >> $output
+    else
+        cat $f > $output
+    fi
+done
+done_races=$(ls $tmpdir/race-*.csv 2>/dev/null | wc -l)
+echo "$done_races of $n races finished in $(( $(date +%s)-start )) s," \
+     "results written to $output."
@@ -0,0 +1,36 @@
+#!/bin/bash
+#
+# Runs a profile race as server that sends kart snapshots to an increasing
+# number of simulated clients (see ServerSnapshotBenchmark), which are
+# connected through an in-memory transport with the given network
+# conditions. For each number of clients the server tick time and the
+# bandwidth per client are printed. All runs use the same track and random
+# seed, so they are repeatable.
+# This is not an end-to-end load test: the clients only send the messages
+# of the karts they own and decode the snapshots, they do not run a game.
+# Only the kart updates and the controller events (including their relay
+# to all other clients) are measured: the messages do not go through
+# STKHost and the ProtocolManager, so their threads and the other
+# protocols are not included in the numbers.
+#
+# Usage: tools/server_snapshot_benchmark.sh [path-to-supertuxkart]
+# The network conditions can be set with LATENCY, JITTER (in ms), LOSS,
+# REORDER (in percent) and BANDWIDTH (in bytes/s, 0 is unlimited).
+
+stk=${1:-./cmake_build/bin/supertuxkart}
+track=${TRACK:-hacienda}
+laps=${LAPS:-1}
+seed=${SEED:-1234}
+clients=${CLIENTS:-"8 16 32 64"}
+
+for n in $clients; do
+    echo "== $n clients"
+    $stk --no-start-screen --track=$track --profile-laps=$laps \
+         --no-graphics --seed=$seed --snapshot-bench=$n \
+         --snapshot-bench-latency=${LATENCY:-50} \
+         --snapshot-bench-jitter=${JITTER:-10} \
+         --snapshot-bench-loss=${LOSS:-1} \
+         --snapshot-bench-reorder=${REORDER:-1} \
+         --snapshot-bench-bandwidth=${BANDWIDTH:-0} --log=0 2>&1 \
+        | grep -E "Server snapshot benchmark|Server tick|Clients:|Bandwidth per|Packets dropped"
+done